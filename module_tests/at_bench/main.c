@@ -0,0 +1,177 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Host side benchmark of the mbedtls_net_* -> AT -> UART path. Build with
+ * DEV_BOARD=virtual and run against the modem emulator in loopback mode:
+ *
+ *   tools/modem_emu/modem_emu -m toby201 -b 115200 -L -l /tmp/modem &
+ *   TS_UART_DEV=/tmp/modem ./at_bench
+ *
+ * Reports the average command round trip latency, the echo throughput of the
+ * data path and the CPU time spent per byte moved, then checks that a second
+ * connection can be used next to the first.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include "dbg.h"
+#include "mbedtls/net.h"
+#include "at_modem.h"
+#include "sys.h"
+
+const char *host = "localhost";
+const char *port = "7";
+
+#define NUM_CMDS	50
+#define CHUNK_SZ	256
+/* Stay below the AT receive buffer size, there is no flow control */
+#define WINDOW_SZ	512
+#define TOTAL_BYTES	(64 * 1024)
+#define IDLE_LIMIT_MS	5000
+
+static uint64_t cpu_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_cmd_latency(void)
+{
+	char ss[16];
+	uint64_t start = sys_get_tick_ms();
+	for (int i = 0; i < NUM_CMDS; i++)
+		if (!at_modem_get_ss(ss)) {
+			dbg_printf("Signal strength query failed, looping forever\n");
+			ASSERT(0);
+		}
+	uint64_t elapsed = sys_get_tick_ms() - start;
+	dbg_printf("Command latency: %u.%02u ms over %d commands\n",
+			(unsigned)(elapsed / NUM_CMDS),
+			(unsigned)(elapsed * 100 / NUM_CMDS % 100), NUM_CMDS);
+}
+
+/* Send TOTAL_BYTES in chunks and wait for every byte to be echoed back */
+static void bench_throughput(mbedtls_net_context *ctx)
+{
+	static uint8_t tx_buf[CHUNK_SZ];
+	static uint8_t rx_buf[CHUNK_SZ];
+	for (size_t i = 0; i < sizeof(tx_buf); i++)
+		tx_buf[i] = (uint8_t)i;
+
+	size_t sent = 0;
+	size_t rcvd = 0;
+	uint64_t cpu_start = cpu_time_ns();
+	uint64_t start = sys_get_tick_ms();
+	uint64_t last_progress = start;
+	while (rcvd < TOTAL_BYTES) {
+		if (sent < TOTAL_BYTES && sent - rcvd + CHUNK_SZ <= WINDOW_SZ) {
+			int res = mbedtls_net_send(ctx, tx_buf, CHUNK_SZ);
+			if (res > 0)
+				sent += res;
+		}
+		int res = mbedtls_net_recv(ctx, rx_buf, sizeof(rx_buf));
+		if (res > 0) {
+			for (int i = 0; i < res; i++)
+				if (rx_buf[i] != (uint8_t)(rcvd + i)) {
+					dbg_printf("Echoed data mismatch, "
+						"looping forever\n");
+					ASSERT(0);
+				}
+			rcvd += res;
+			last_progress = sys_get_tick_ms();
+		} else if (res != MBEDTLS_ERR_SSL_WANT_READ) {
+			dbg_printf("Receive failed with error: %d\n", res);
+			break;
+		} else if (sys_get_tick_ms() - last_progress > IDLE_LIMIT_MS) {
+			dbg_printf("Timed out waiting for echoed data\n");
+			break;
+		}
+	}
+	uint64_t elapsed = sys_get_tick_ms() - start;
+	uint64_t cpu = cpu_time_ns() - cpu_start;
+	if (elapsed == 0)
+		elapsed = 1;
+	dbg_printf("Sent %u bytes, received %u bytes in %u ms\n",
+			(unsigned)sent, (unsigned)rcvd, (unsigned)elapsed);
+	dbg_printf("Throughput: %u bytes/s\n",
+			(unsigned)((sent + rcvd) * 1000 / elapsed));
+	if (sent + rcvd > 0)
+		dbg_printf("CPU time: %u ns/byte\n",
+				(unsigned)(cpu / (sent + rcvd)));
+}
+
+/*
+ * Open a second connection next to 'ctx' and check that data sent on each
+ * comes back on the same one.
+ */
+static void bench_two_sockets(mbedtls_net_context *ctx)
+{
+	mbedtls_net_context ctx2;
+	mbedtls_net_init(&ctx2);
+	int res = mbedtls_net_connect(&ctx2, host, port, MBEDTLS_NET_PROTO_TCP);
+	if (res != 0) {
+		dbg_printf("Second connection failed with error: %d\n", res);
+		return;
+	}
+
+	static const uint8_t msg[2][8] = { "first..", "second." };
+	mbedtls_net_context *c[2] = { ctx, &ctx2 };
+	for (int i = 0; i < 2; i++)
+		if (mbedtls_net_send(c[i], msg[i], sizeof(msg[i])) !=
+				sizeof(msg[i])) {
+			dbg_printf("Send on connection %d failed\n", i);
+			goto done;
+		}
+	for (int i = 0; i < 2; i++) {
+		uint8_t rx[sizeof(msg[i])];
+		size_t got = 0;
+		uint64_t start = sys_get_tick_ms();
+		while (got < sizeof(rx) &&
+				sys_get_tick_ms() - start < IDLE_LIMIT_MS) {
+			res = mbedtls_net_recv(c[i], rx + got, sizeof(rx) - got);
+			if (res > 0)
+				got += res;
+		}
+		if (got != sizeof(rx) || memcmp(rx, msg[i], sizeof(rx)) != 0) {
+			dbg_printf("Connection %d echoed wrong data\n", i);
+			goto done;
+		}
+	}
+	dbg_printf("Two concurrent connections: OK\n");
+done:
+	mbedtls_net_free(&ctx2);
+}
+
+int main(int argc, char *argv[])
+{
+	sys_init();
+
+	dbg_module_init();
+	dbg_printf("Initializing the modem\n");
+
+	/* step 1: Initializes network stack */
+	mbedtls_net_context ctx;
+	mbedtls_net_init(&ctx);
+
+	/* step 2: command round trip latency */
+	bench_cmd_latency();
+
+	/* step 3: network connect */
+	int res = mbedtls_net_connect(&ctx, host, port, MBEDTLS_NET_PROTO_TCP);
+	if (res != 0) {
+		dbg_printf("Connect failed with error: %d, looping forever\n",
+			res);
+		ASSERT(0);
+	}
+
+	/* step 4: data path throughput */
+	bench_throughput(&ctx);
+
+	/* step 5: a second connection alongside the first */
+	bench_two_sockets(&ctx);
+
+	mbedtls_net_free(&ctx);
+	return 0;
+}
@@ -122,6 +122,18 @@ int main(int argc, char *argv[])
 			goto done;
 		}
 
+		sys_delay(2500);
+
+		/* Send the same message again, keeping the relay link open */
+		dbg_printf("Sending a multi-part message in one go (%s)\n", num);
+		at_msg_t segments[] = { outgoing_segment1, outgoing_segment2 };
+		segments[0].ref_no = 9;
+		segments[1].ref_no = 9;
+		if (!at_sms_send_multi(segments, 2, 2)) {
+			dbg_printf("Error sending the segments\n");
+			goto done;
+		}
+
 		dbg_printf("Waiting for %u seconds\n", WAIT_TIME_SEC);
 		wait_ms(WAIT_TIME_SEC * 1000);
 	}
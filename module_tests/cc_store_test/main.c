@@ -0,0 +1,248 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Checks the ring of the offline store over the RAM backend: wrapping around,
+ * the drop policies of a full store, records failing their check, a record
+ * whose header was torn by a reset and finding the records again when the
+ * store is opened anew. The RAM backend also stands in for a flash area, which
+ * can only be written sequentially and erased as a whole.
+ */
+
+#include <string.h>
+#include "sys.h"
+#include "dbg.h"
+#include "cc_store.h"
+
+/* Slots of the RAM backend, see cc_store_mem.c */
+#define SLOTS		4
+
+/* Offset of the message of a slot */
+#define MSG_AT(slot)	((slot) * CC_STORE_SLOT_SZ + CC_STORE_HDR_SZ + \
+				CC_STORE_DATA_AREA_SZ)
+
+/* When set, header writes stop half way as if the board was reset */
+static bool tear_hdr;
+
+static bool test_init(uint32_t *size)
+{
+	return cc_store_mem_backend.init(size);
+}
+
+static bool test_read(uint32_t off, void *dst, uint32_t len)
+{
+	return cc_store_mem_backend.read(off, dst, len);
+}
+
+static bool test_write(uint32_t off, const void *src, uint32_t len)
+{
+	if (tear_hdr && off % CC_STORE_SLOT_SZ == 0 && len == CC_STORE_HDR_SZ)
+		len /= 2;
+	return cc_store_mem_backend.write(off, src, len);
+}
+
+static bool test_erase(void)
+{
+	return cc_store_mem_backend.erase();
+}
+
+static const cc_store_backend ram_be = {
+	test_init, test_read, test_write, test_erase, true
+};
+
+static const cc_store_backend flash_be = {
+	test_init, test_read, test_write, test_erase, false
+};
+
+static uint8_t data[PROTO_SEND_DATA_SZ];
+static uint8_t msg[CC_MAX_SEND_BUF_SZ];
+
+/* Open the store on an erased area */
+static void open_empty(const cc_store_backend *be, cc_store_policy policy)
+{
+	ASSERT(cc_store_mem_backend.erase());
+	ASSERT(cc_store_open(be, policy));
+	ASSERT(cc_store_len() == 0);
+}
+
+/* Message 'n' has n bytes of data set to n and 10 + n bytes set to n + 1 */
+static bool push(uint8_t n)
+{
+	cc_store_rec rec = {
+		.svc_id = n,
+		.kind = 1,
+		.data_sz = n,
+		.msg_sz = 10 + n
+	};
+	memset(data, n, rec.data_sz);
+	memset(msg, n + 1, rec.msg_sz);
+	return cc_store_push(&rec, data, msg);
+}
+
+/* Check that the oldest message is 'n' and remove it */
+static void pop(uint8_t n)
+{
+	cc_store_rec rec;
+	memset(data, 0, sizeof(data));
+	memset(msg, 0, sizeof(msg));
+	ASSERT(cc_store_peek(&rec, data, msg, sizeof(msg)));
+	ASSERT(rec.svc_id == n && rec.kind == 1);
+	ASSERT(rec.data_sz == n && rec.msg_sz == 10 + n);
+	for (uint16_t i = 0; i < rec.data_sz; i++)
+		ASSERT(data[i] == n);
+	for (uint16_t i = 0; i < rec.msg_sz; i++)
+		ASSERT(msg[i] == n + 1);
+	cc_store_pop();
+}
+
+static void pop_none(void)
+{
+	cc_store_rec rec;
+	ASSERT(!cc_store_peek(&rec, data, msg, sizeof(msg)));
+	ASSERT(cc_store_len() == 0);
+}
+
+static void test_ring(void)
+{
+	open_empty(&ram_be, CC_STORE_DROP_OLDEST);
+	for (uint8_t n = 1; n <= SLOTS; n++)
+		ASSERT(push(n));
+	ASSERT(cc_store_len() == SLOTS);
+	pop(1);
+	pop(2);
+	/* These go to the first slots again */
+	ASSERT(push(5) && push(6));
+	ASSERT(cc_store_len() == SLOTS);
+	for (uint8_t n = 3; n <= 6; n++)
+		pop(n);
+	pop_none();
+
+	/* A message too large for the slot is refused */
+	cc_store_rec rec = {.svc_id = 1, .data_sz = 0,
+		.msg_sz = CC_MAX_SEND_BUF_SZ + 1};
+	ASSERT(!cc_store_push(&rec, data, msg));
+	ASSERT(cc_store_len() == 0);
+
+	dbg_printf("Ring tests passed\n");
+}
+
+static void test_policies(void)
+{
+	open_empty(&ram_be, CC_STORE_DROP_NEWEST);
+	for (uint8_t n = 1; n <= SLOTS; n++)
+		ASSERT(push(n));
+	ASSERT(!push(5));
+	ASSERT(cc_store_len() == SLOTS);
+
+	/* The policy of the store opened again applies to what it found */
+	ASSERT(cc_store_open(&ram_be, CC_STORE_DROP_OLDEST));
+	ASSERT(push(5));
+	ASSERT(cc_store_len() == SLOTS);
+	for (uint8_t n = 2; n <= 5; n++)
+		pop(n);
+	pop_none();
+
+	/* A full flash area takes nothing until it was replayed and erased,
+	 * whatever the policy
+	 */
+	open_empty(&flash_be, CC_STORE_DROP_OLDEST);
+	for (uint8_t n = 1; n <= SLOTS; n++)
+		ASSERT(push(n));
+	ASSERT(!push(5));
+	pop(1);
+	ASSERT(!push(5));
+	for (uint8_t n = 2; n <= SLOTS; n++)
+		pop(n);
+	pop_none();
+	ASSERT(push(5));
+	pop(5);
+	pop_none();
+
+	dbg_printf("Policy tests passed\n");
+}
+
+static void test_check(void)
+{
+	open_empty(&ram_be, CC_STORE_DROP_OLDEST);
+	for (uint8_t n = 1; n <= 3; n++)
+		ASSERT(push(n));
+
+	/* A byte of the second message flips */
+	uint8_t bad = 0;
+	ASSERT(cc_store_mem_backend.write(MSG_AT(1) + 5, &bad, 1));
+	/* Found damaged when the store is opened */
+	ASSERT(cc_store_open(&ram_be, CC_STORE_DROP_OLDEST));
+	pop(1);
+	pop(3);
+	pop_none();
+
+	/* Found damaged when it is about to be sent */
+	ASSERT(push(4) && push(5));
+	ASSERT(cc_store_mem_backend.write(MSG_AT(3), &bad, 1));
+	pop(5);
+	pop_none();
+
+	dbg_printf("Check tests passed\n");
+}
+
+static void test_recovery(void)
+{
+	/* The header of the third message is torn by a reset */
+	open_empty(&ram_be, CC_STORE_DROP_OLDEST);
+	ASSERT(push(1) && push(2));
+	tear_hdr = true;
+	ASSERT(push(3));
+	tear_hdr = false;
+	ASSERT(cc_store_open(&ram_be, CC_STORE_DROP_OLDEST));
+	ASSERT(cc_store_len() == 2);
+	ASSERT(push(4));
+	pop(1);
+
+	/* Opening the store again finds the remaining messages in order and
+	 * stores new ones after them
+	 */
+	ASSERT(cc_store_open(&ram_be, CC_STORE_DROP_OLDEST));
+	ASSERT(cc_store_len() == 2);
+	ASSERT(push(5));
+	ASSERT(cc_store_open(&ram_be, CC_STORE_DROP_OLDEST));
+	pop(2);
+	pop(4);
+	pop(5);
+	pop_none();
+
+	/* The same on a flash area, where the torn slot is skipped */
+	open_empty(&flash_be, CC_STORE_DROP_OLDEST);
+	ASSERT(push(1) && push(2));
+	tear_hdr = true;
+	ASSERT(push(3));
+	tear_hdr = false;
+	ASSERT(cc_store_open(&flash_be, CC_STORE_DROP_OLDEST));
+	ASSERT(push(4));
+	ASSERT(!push(5));
+	ASSERT(cc_store_open(&flash_be, CC_STORE_DROP_OLDEST));
+	pop(1);
+	pop(2);
+	pop(4);
+	pop_none();
+	/* Everything was replayed, the area was erased */
+	ASSERT(cc_store_open(&flash_be, CC_STORE_DROP_OLDEST));
+	pop_none();
+	ASSERT(push(5));
+
+	dbg_printf("Recovery tests passed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	sys_init();
+
+	dbg_module_init();
+
+	test_ring();
+	test_policies();
+	test_check();
+	test_recovery();
+
+	while (1)
+		sys_delay(1000);
+	return 0;
+}
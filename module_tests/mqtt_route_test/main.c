@@ -0,0 +1,149 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Checks how the MQTT topic router resolves topics against filters with and
+ * without wildcards, that it rejects invalid filters, that a route or node
+ * shortage leaves the routes in place, and measures how fast it matches.
+ */
+
+#include <string.h>
+#include "sys.h"
+#include "dbg.h"
+#include "mqtt_route.h"
+
+#define BENCH_ROUNDS	20000
+
+static const mqtt_route *match(const char *topic)
+{
+	return mqtt_route_match(topic, strlen(topic));
+}
+
+/* Filter of the route matching 'topic', NULL if none does */
+static const char *routed(const char *topic)
+{
+	const mqtt_route *r = match(topic);
+	return r ? r->filter : NULL;
+}
+
+static bool routed_to(const char *topic, const char *filter)
+{
+	const char *f = routed(topic);
+	return f && strcmp(f, filter) == 0;
+}
+
+static const mqtt_route *add(const char *filter)
+{
+	return mqtt_route_add(filter, NULL, 0, NULL, NULL);
+}
+
+static void test_wildcards(void)
+{
+	mqtt_route_reset();
+	ASSERT(add("dev/cmd"));
+	ASSERT(add("dev/+"));
+	ASSERT(add("dev/#"));
+	ASSERT(add("+/+/status"));
+	ASSERT(mqtt_route_count() == 4);
+
+	/* A literal level wins over "+", which wins over "#" */
+	ASSERT(routed_to("dev/cmd", "dev/cmd"));
+	ASSERT(routed_to("dev/cfg", "dev/+"));
+	ASSERT(routed_to("dev/cmd/1", "dev/#"));
+	ASSERT(routed_to("dev", "dev/#"));
+	ASSERT(routed_to("dev/", "dev/+"));
+
+	/* "+" matches exactly one level, possibly empty */
+	ASSERT(routed_to("a/b/status", "+/+/status"));
+	ASSERT(routed_to("a//status", "+/+/status"));
+	ASSERT(routed("a/status") == NULL);
+	ASSERT(routed("a/b/c/status") == NULL);
+	/* The first level matching literally is tried first and wins */
+	ASSERT(routed_to("dev/x/status", "dev/#"));
+
+	/* Topics need not be NULL terminated */
+	ASSERT(mqtt_route_match("dev/cmdXYZ", 7)->filter == routed("dev/cmd"));
+
+	/* Wildcards do not match the first level of $ topics */
+	ASSERT(routed("$SYS/a/status") == NULL);
+	mqtt_route_reset();
+	ASSERT(add("#"));
+	ASSERT(routed_to("a/b", "#"));
+	ASSERT(routed("$SYS/a") == NULL);
+	ASSERT(add("$SYS/#"));
+	ASSERT(routed_to("$SYS/a", "$SYS/#"));
+
+	dbg_printf("Wildcard tests passed\n");
+}
+
+static void test_add(void)
+{
+	mqtt_route_reset();
+	ASSERT(!add(NULL));
+	ASSERT(!add(""));
+	ASSERT(!add("dev/cm+"));
+	ASSERT(!add("dev/#/cmd"));
+	ASSERT(!add("dev#"));
+	ASSERT(mqtt_route_count() == 0 && match("dev/cmd") == NULL);
+
+	/* Adding the same filter again updates its route */
+	static uint8_t buf[4];
+	const mqtt_route *r = add("dev/cmd");
+	ASSERT(r && mqtt_route_add("dev/cmd", buf, sizeof(buf), NULL, NULL) == r);
+	ASSERT(r->rcv_buf == buf && r->rcv_sz == sizeof(buf));
+	ASSERT(mqtt_route_count() == 1 && mqtt_route_get(0) == r);
+	ASSERT(mqtt_route_get(1) == NULL);
+
+	/* Out of routes, existing ones can still be updated */
+	ASSERT(add("a") && add("b") && add("c"));
+	ASSERT(!add("d/e/f"));
+	ASSERT(mqtt_route_count() == MQTT_MAX_ROUTES);
+	ASSERT(routed("d/e/f") == NULL);
+	ASSERT(add("a") && routed_to("a", "a"));
+
+	/* Out of nodes, a filter fitting in what is left is still accepted */
+	static char long_filter[2 * (MQTT_ROUTE_NODES + 1)];
+	mqtt_route_reset();
+	for (uint8_t i = 0; i <= MQTT_ROUTE_NODES; i++)
+		strcat(long_filter, i ? "/x" : "x");
+	ASSERT(!add(long_filter));
+	long_filter[2 * (MQTT_ROUTE_NODES - 1) - 1] = '\0';
+	ASSERT(add(long_filter));
+	ASSERT(!add("y/z"));
+	ASSERT(add("y"));
+	ASSERT(routed_to(long_filter, long_filter) && routed_to("y", "y"));
+
+	dbg_printf("Route table tests passed\n");
+}
+
+static void test_throughput(void)
+{
+	mqtt_route_reset();
+	ASSERT(add("ts/dev/+/cmd"));
+	ASSERT(add("ts/dev/+/cfg"));
+	ASSERT(add("ts/dev/+/fw/#"));
+	ASSERT(add("ts/bcast/#"));
+	static const char topic[] = "ts/dev/0123456789ab/fw/chunk/17";
+
+	uint64_t start = sys_get_tick_ms();
+	for (uint16_t r = 0; r < BENCH_ROUNDS; r++)
+		ASSERT(match(topic));
+	uint64_t elapsed = sys_get_tick_ms() - start;
+	ASSERT(routed_to(topic, "ts/dev/+/fw/#"));
+	dbg_printf("Matched %u topics in %u ms\n", BENCH_ROUNDS,
+			(unsigned)elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+	sys_init();
+
+	dbg_module_init();
+
+	test_wildcards();
+	test_add();
+	test_throughput();
+
+	while (1)
+		sys_delay(1000);
+	return 0;
+}
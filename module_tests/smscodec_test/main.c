@@ -0,0 +1,155 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Checks the SMS PDU codec against known PDUs, feeds it randomly damaged PDUs
+ * and measures how fast it encodes and decodes full segments.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sys.h"
+#include "dbg.h"
+#include "smscodec.h"
+
+#define BENCH_ROUNDS	2000
+#define FUZZ_ROUNDS	20000
+
+/* Segment 1 of 2, reference 0x42, carrying 01 AB 7F for +15551234567 */
+#define SUBMIT_CONCAT	"41000B915155214365F700040905000342020101AB7F"
+#define SUBMIT_SINGLE	"0101039121F300040301AB7F"
+#define DELIVER_CONCAT	"07911326040000F0" "44" "0B915155214365F7" "0004" \
+			"71103012000000" "09050003420201" "01AB7F"
+#define DELIVER_SINGLE	"07911326040000F0" "04" "039121F3" "0004" \
+			"71103012000000" "03" "01ab7f"
+
+static const uint8_t data[] = {0x01, 0xAB, 0x7F};
+static char pdu[MAX_IN_PDU_SZ + 1];
+static uint8_t rcv_buf[MAX_DATA_SZ];
+static char rcv_addr[ADDR_SZ + 1];
+
+static bool decode(const char *in, sms_t *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->buf = rcv_buf;
+	msg->addr = rcv_addr;
+	return smscodec_decode(strlen(in), in, msg);
+}
+
+/* Places the data of segment n at (n - 1) * 3 in place_buf */
+static uint8_t place_buf[2 * sizeof(data)];
+static uint8_t *place_seg(const sms_t *msg)
+{
+	if (msg->seq_no == 0 || msg->seq_no > 2 || msg->len != sizeof(data))
+		return NULL;
+	return place_buf + (msg->seq_no - 1) * sizeof(data);
+}
+
+static void test_correctness(void)
+{
+	/* Must run first, the message reference number counts up from 0 */
+	sms_t out = {
+		.len = sizeof(data), .buf = (uint8_t *)data, .ref_no = 0x42,
+		.num_seg = 2, .seq_no = 1, .addr = "+15551234567"
+	};
+	ASSERT(smscodec_encode(&out, pdu) == strlen(SUBMIT_CONCAT));
+	ASSERT(strcmp(pdu, SUBMIT_CONCAT) == 0);
+	out.num_seg = 1;
+	out.addr = "123";
+	ASSERT(smscodec_encode(&out, pdu) == strlen(SUBMIT_SINGLE));
+	ASSERT(strcmp(pdu, SUBMIT_SINGLE) == 0);
+
+	sms_t in;
+	ASSERT(decode(DELIVER_CONCAT, &in));
+	ASSERT(in.len == sizeof(data) && memcmp(in.buf, data, in.len) == 0);
+	ASSERT(in.ref_no == 0x42 && in.num_seg == 2 && in.seq_no == 1);
+	ASSERT(strcmp(in.addr, "15551234567") == 0);
+
+	/* Lower case digits are accepted, the UDH flag does not stick */
+	ASSERT(decode(DELIVER_SINGLE, &in));
+	ASSERT(in.len == sizeof(data) && memcmp(in.buf, data, in.len) == 0);
+	ASSERT(in.num_seg == 1 && strcmp(in.addr, "123") == 0);
+
+	ASSERT(!decode(DELIVER_SINGLE "00", &in));
+	ASSERT(!decode("07911326040000F0" "04" "FF9121F3", &in));
+
+	/* The data lands where the selector wants it, once the header is known */
+	memset(&in, 0, sizeof(in));
+	in.buf = rcv_buf;
+	in.addr = rcv_addr;
+	ASSERT(smscodec_decode_to(strlen(DELIVER_CONCAT), DELIVER_CONCAT, &in,
+				place_seg));
+	ASSERT(in.buf == place_buf && memcmp(place_buf, data, in.len) == 0);
+	in.buf = rcv_buf;
+	ASSERT(smscodec_decode_to(strlen(DELIVER_SINGLE), DELIVER_SINGLE, &in,
+				place_seg));
+	ASSERT(in.buf == rcv_buf);
+
+	dbg_printf("Correctness tests passed\n");
+}
+
+/* Damaged PDUs must be rejected or decoded without overrunning the buffers */
+static void test_fuzz(void)
+{
+	uint32_t decoded = 0;
+	for (uint32_t r = 0; r < FUZZ_ROUNDS; r++) {
+		strcpy(pdu, (r & 1) ? DELIVER_CONCAT : DELIVER_SINGLE);
+		uint16_t len = strlen(pdu);
+		for (uint8_t n = rand() % 4; n > 0; n--)
+			pdu[rand() % len] = (rand() & 1) ? "0123456789ABCDEF"
+				[rand() % 16] : (char)(rand() % 255 + 1);
+		sms_t in;
+		if (decode(pdu, &in)) {
+			ASSERT(in.len <= MAX_DATA_SZ);
+			ASSERT(strlen(in.addr) <= ADDR_SZ);
+			decoded++;
+		}
+	}
+	dbg_printf("Fuzzed %u PDUs, %u decoded\n", FUZZ_ROUNDS, (unsigned)decoded);
+}
+
+static void test_throughput(void)
+{
+	static uint8_t seg[MAX_DATA_SZ];
+	static char deliver[MAX_IN_PDU_SZ + 1];
+	for (uint16_t i = 0; i < sizeof(seg); i++)
+		seg[i] = i;
+	sms_t out = {
+		.len = sizeof(seg), .buf = seg, .num_seg = 1,
+		.addr = "+15551234567"
+	};
+
+	uint64_t start = sys_get_tick_ms();
+	for (uint16_t r = 0; r < BENCH_ROUNDS; r++)
+		ASSERT(smscodec_encode(&out, pdu) > 0);
+	uint64_t elapsed = sys_get_tick_ms() - start;
+	dbg_printf("Encoded %u segments of %u bytes in %u ms\n",
+			BENCH_ROUNDS, MAX_DATA_SZ, (unsigned)elapsed);
+
+	/* Turn the SMS-SUBMIT into an SMS-DELIVER carrying the same data */
+	strcpy(deliver, "07911326040000F0" "04" "0B915155214365F7" "0004"
+			"71103012000000");
+	strcat(deliver, strstr(pdu, "0004") + 4);
+	sms_t in;
+	start = sys_get_tick_ms();
+	for (uint16_t r = 0; r < BENCH_ROUNDS; r++)
+		ASSERT(decode(deliver, &in));
+	elapsed = sys_get_tick_ms() - start;
+	ASSERT(in.len == sizeof(seg) && memcmp(in.buf, seg, in.len) == 0);
+	dbg_printf("Decoded %u segments of %u bytes in %u ms\n",
+			BENCH_ROUNDS, MAX_DATA_SZ, (unsigned)elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+	sys_init();
+
+	dbg_module_init();
+
+	test_correctness();
+	test_fuzz();
+	test_throughput();
+
+	while (1)
+		sys_delay(1000);
+	return 0;
+}
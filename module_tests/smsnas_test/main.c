@@ -0,0 +1,332 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Checks how the SMSNAS protocol reassembles received concatenated sms's:
+ * segments out of order, duplicated or short, several messages interleaved with
+ * each other and with single sms's, a message timing out half way and the
+ * user buffer being replaced while a message is being reassembled. The modem
+ * layer is replaced by the functions below, which hand the protocol segments
+ * the way the AT layer decodes them.
+ */
+
+#include <string.h>
+#include "sys.h"
+#include "dbg.h"
+#include "smsnas_protocol.h"
+#include "at_sms.h"
+
+#define MSG_SZ		PROTO_MAX_MSG_SZ
+#define SERVICE_ID	0x5
+/* Well past the time out waiting for the next segment */
+#define LONG_AFTER_MS	60000
+
+static at_sms_cb rcv_cb;
+static at_sms_buf_cb rcv_buf_cb;
+static uint16_t acks;
+static uint16_t nacks;
+/* Number of segments not decoded in place */
+static uint16_t copies;
+
+bool at_init(void)
+{
+	return true;
+}
+
+bool at_sms_ack(void)
+{
+	acks++;
+	return true;
+}
+
+bool at_sms_nack(void)
+{
+	nacks++;
+	return true;
+}
+
+void at_sms_set_rcv_cb(at_sms_cb cb)
+{
+	rcv_cb = cb;
+}
+
+void at_sms_set_rcv_buf_cb(at_sms_buf_cb cb)
+{
+	rcv_buf_cb = cb;
+}
+
+bool at_sms_send_multi(const at_msg_t *sms_segs, uint8_t num_segs,
+		uint8_t retries)
+{
+	return true;
+}
+
+/* Message contents, each starting with the protocol header */
+static uint8_t msg_a[MSG_SZ];
+static uint8_t msg_b[MSG_SZ];
+static uint8_t msg_c[MSG_SZ];
+
+static uint8_t user_buf[PROTO_MAX_MSG_SZ];
+static uint8_t other_buf[PROTO_MAX_MSG_SZ];
+
+static uint16_t events;
+static proto_event last_evt;
+static uint32_t last_sz;
+static uint8_t last_msg[PROTO_MAX_MSG_SZ];
+
+static void user_cb(const void *buf, uint32_t sz, proto_event evt,
+		proto_service_id s_id)
+{
+	events++;
+	last_evt = evt;
+	last_sz = sz;
+	if (evt == PROTO_RCVD_MSG)
+		memcpy(last_msg, buf, sz);
+}
+
+static void fill_msg(uint8_t *msg, uint8_t seed)
+{
+	for (uint16_t i = 0; i < MSG_SZ; i++)
+		msg[i] = (uint8_t)(i * seed + 1);
+	msg[0] = 0x1;
+	msg[1] = SERVICE_ID;
+}
+
+static void arm(uint8_t *buf, proto_pl_sz sz)
+{
+	ASSERT(smsnas_set_recv_buffer_cb(buf, sz, user_cb) == PROTO_OK);
+}
+
+/*
+ * Hands the protocol one segment the way the AT layer does: decoded where the
+ * protocol asks for it, into the AT layer's own buffer otherwise.
+ */
+static void rcv_seg(const uint8_t *data, uint8_t ref, uint8_t num, uint8_t seq,
+		uint8_t len)
+{
+	static uint8_t at_buf[MAX_SMS_PL_SZ];
+	at_msg_t seg;
+	memset(&seg, 0, sizeof(seg));
+	seg.ref_no = ref;
+	seg.num_seg = num;
+	seg.seq_no = seq;
+	seg.len = len;
+	seg.buf = rcv_buf_cb ? rcv_buf_cb(&seg) : NULL;
+	if (!seg.buf) {
+		seg.buf = at_buf;
+		copies++;
+	}
+	memcpy(seg.buf, data, len);
+	rcv_cb(&seg);
+	smsnas_maintenance(false, sys_get_tick_ms());
+}
+
+/* Segment 'seq' of a concatenated message whose segments are all full but
+ * the last one
+ */
+static void rcv_conct(const uint8_t *msg, uint8_t ref, uint8_t num, uint8_t seq,
+		uint8_t last_len)
+{
+	rcv_seg(msg + (seq - 1) * CONCT_SMS_SZ, ref, num, seq,
+			(seq == num) ? last_len : CONCT_SMS_SZ);
+}
+
+static void rcv_single(const uint8_t *msg, uint8_t len)
+{
+	rcv_seg(msg, 0, 1, 0, len);
+}
+
+static bool delivered(const uint8_t *msg, uint32_t sz)
+{
+	return last_evt == PROTO_RCVD_MSG && last_sz == sz &&
+		memcmp(last_msg, msg, sz) == 0;
+}
+
+static void test_out_of_order(void)
+{
+	smsnas_protocol_init();
+	arm(user_buf, sizeof(user_buf));
+	uint16_t ev = events;
+	uint16_t nk = nacks;
+	uint16_t cp = copies;
+	uint16_t ak = acks;
+
+	rcv_conct(msg_a, 9, 3, 3, 50);
+	rcv_conct(msg_a, 9, 3, 1, 50);
+	/* The server resends a segment whose ack it missed */
+	rcv_conct(msg_a, 9, 3, 1, 50);
+	ASSERT(events == ev && acks == ak + 3);
+	rcv_conct(msg_a, 9, 3, 2, 50);
+	ASSERT(events == ev + 1 && delivered(msg_a, 2 * CONCT_SMS_SZ + 50));
+	/* Only the duplicate was not decoded in place */
+	ASSERT(nacks == nk && copies == cp + 1);
+
+	/* Nothing is delivered until the receive buffer is set again */
+	rcv_single(msg_b, 40);
+	ASSERT(events == ev + 1 && nacks == nk + 1);
+
+	dbg_printf("Out of order tests passed\n");
+}
+
+/* Receives a concatenated message split at the given segment lengths, in the
+ * given order of sequence numbers
+ */
+static void rcv_split(const uint8_t *msg, uint8_t ref, uint8_t num,
+		const uint8_t *lens, const uint8_t *order)
+{
+	for (uint8_t i = 0; i < num; i++) {
+		uint8_t seq = order[i];
+		proto_pl_sz off = 0;
+		for (uint8_t s = 1; s < seq; s++)
+			off += lens[s - 1];
+		rcv_seg(msg + off, ref, num, seq, lens[seq - 1]);
+	}
+}
+
+static void test_short_segments(void)
+{
+	static const uint8_t lens[] = {100, 60, CONCT_SMS_SZ, 20};
+	static const uint8_t order[] = {3, 1, 4, 2};
+	smsnas_protocol_init();
+	arm(user_buf, sizeof(user_buf));
+	uint16_t ev = events;
+	uint16_t nk = nacks;
+	uint16_t cp = copies;
+
+	rcv_split(msg_a, 10, 4, lens, order);
+	ASSERT(events == ev + 1 && delivered(msg_a, 100 + 60 + CONCT_SMS_SZ + 20));
+	ASSERT(nacks == nk && copies == cp);
+	arm(user_buf, sizeof(user_buf));
+
+	/* The largest message fitting the user buffer */
+	static const uint8_t full[] = {CONCT_SMS_SZ, CONCT_SMS_SZ, CONCT_SMS_SZ,
+		PROTO_MAX_MSG_SZ - 3 * CONCT_SMS_SZ};
+	static const uint8_t reverse[] = {4, 3, 2, 1};
+	rcv_split(msg_b, 11, 4, full, reverse);
+	ASSERT(events == ev + 2 && delivered(msg_b, PROTO_MAX_MSG_SZ));
+	arm(user_buf, sizeof(user_buf));
+
+	/* A segment longer than a concatenated sms holds is rejected */
+	rcv_seg(msg_c, 12, 2, 1, CONCT_SMS_SZ + 1);
+	ASSERT(nacks == nk + 1 && events == ev + 2);
+	ASSERT(smsnas_get_polling_interval() == 0);
+
+	dbg_printf("Short segment tests passed\n");
+}
+
+static void test_interleaved(void)
+{
+	smsnas_protocol_init();
+	arm(user_buf, sizeof(user_buf));
+	uint16_t ev = events;
+	uint16_t nk = nacks;
+	uint16_t cp = copies;
+
+	rcv_conct(msg_a, 1, 2, 2, 10);
+	rcv_conct(msg_b, 2, 3, 1, 0);
+	/* Every receive path is busy */
+	rcv_conct(msg_c, 3, 2, 1, 0);
+	ASSERT(events == ev && nacks == nk + 1);
+
+	/* A single sms does not need a receive path */
+	rcv_single(msg_c, 40);
+	ASSERT(events == ev + 1 && delivered(msg_c, 40));
+	arm(user_buf, sizeof(user_buf));
+
+	rcv_conct(msg_b, 2, 3, 3, 30);
+	rcv_conct(msg_a, 1, 2, 1, 10);
+	ASSERT(events == ev + 2 && delivered(msg_a, CONCT_SMS_SZ + 10));
+	arm(user_buf, sizeof(user_buf));
+	rcv_conct(msg_b, 2, 3, 2, 30);
+	ASSERT(events == ev + 3 && delivered(msg_b, 2 * CONCT_SMS_SZ + 30));
+	arm(user_buf, sizeof(user_buf));
+
+	/* A reference number reused for another message replaces the one
+	 * left unfinished
+	 */
+	rcv_conct(msg_a, 4, 2, 2, 10);
+	rcv_conct(msg_c, 4, 3, 1, 20);
+	rcv_conct(msg_c, 4, 3, 3, 20);
+	rcv_conct(msg_c, 4, 3, 2, 20);
+	ASSERT(events == ev + 4 && delivered(msg_c, 2 * CONCT_SMS_SZ + 20));
+	/* Only the rejected segment and the one replacing an unfinished
+	 * message were not decoded in place
+	 */
+	ASSERT(nacks == nk + 1 && copies == cp + 2);
+	ASSERT(smsnas_get_polling_interval() == 0);
+
+	dbg_printf("Interleaved tests passed\n");
+}
+
+static void test_timeout(void)
+{
+	smsnas_protocol_init();
+	arm(user_buf, sizeof(user_buf));
+	uint16_t ev = events;
+
+	rcv_conct(msg_a, 5, 3, 1, 0);
+	rcv_conct(msg_b, 6, 2, 2, 10);
+	ASSERT(smsnas_get_polling_interval() > 0);
+	smsnas_maintenance(true, sys_get_tick_ms() + LONG_AFTER_MS);
+	ASSERT(smsnas_get_polling_interval() == 0);
+
+	/* Only what arrives after the time out is reassembled */
+	rcv_conct(msg_a, 5, 3, 2, 0);
+	rcv_conct(msg_a, 5, 3, 3, 60);
+	rcv_conct(msg_b, 6, 2, 1, 10);
+	ASSERT(events == ev);
+	rcv_conct(msg_b, 6, 2, 2, 10);
+	ASSERT(events == ev + 1 && delivered(msg_b, CONCT_SMS_SZ + 10));
+
+	dbg_printf("Time out tests passed\n");
+}
+
+static void test_rearm(void)
+{
+	smsnas_protocol_init();
+	arm(user_buf, sizeof(user_buf));
+	uint16_t ev = events;
+
+	/* The user buffer is taken by a single sms and then given up while a
+	 * message is being reassembled
+	 */
+	rcv_conct(msg_a, 7, 2, 1, 0);
+	rcv_single(msg_c, 40);
+	ASSERT(events == ev + 1 && delivered(msg_c, 40));
+	memset(user_buf, 0, sizeof(user_buf));
+	arm(other_buf, sizeof(other_buf));
+	rcv_conct(msg_a, 7, 2, 2, 10);
+	ASSERT(events == ev + 2 && delivered(msg_a, CONCT_SMS_SZ + 10));
+	ASSERT(memcmp(other_buf, msg_a, CONCT_SMS_SZ + 10) == 0);
+	for (uint16_t i = 0; i < sizeof(user_buf); i++)
+		ASSERT(user_buf[i] == 0);
+
+	/* A message not fitting the user buffer is reported and dropped */
+	arm(user_buf, CONCT_SMS_SZ);
+	rcv_conct(msg_b, 8, 2, 2, 10);
+	rcv_conct(msg_b, 8, 2, 1, 10);
+	ASSERT(events == ev + 3 && last_evt == PROTO_RCVD_MEM_OVRFL);
+	ASSERT(smsnas_get_polling_interval() == 0);
+
+	dbg_printf("Receive buffer tests passed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	sys_init();
+
+	dbg_module_init();
+
+	fill_msg(msg_a, 7);
+	fill_msg(msg_b, 3);
+	fill_msg(msg_c, 5);
+
+	test_out_of_order();
+	test_short_segments();
+	test_interleaved();
+	test_timeout();
+	test_rearm();
+
+	while (1)
+		sys_delay(1000);
+	return 0;
+}
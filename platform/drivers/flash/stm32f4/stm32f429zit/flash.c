@@ -0,0 +1,72 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include <stm32f4xx_hal.h>
+#include "flash_hal.h"
+
+/*
+ * The last sector, sector 23 in bank 2, is the data area. The DATA_FLASH region
+ * of the linker script sets its bounds and keeps the program image clear of it.
+ */
+extern const uint8_t _sflash_data[];
+extern const uint8_t _eflash_data[];
+
+#define DATA_ADDR	((uint32_t)_sflash_data)
+#define DATA_SZ		((uint32_t)(_eflash_data - _sflash_data))
+#define DATA_SECTOR	FLASH_SECTOR_23
+
+#define FLASH_ERR_FLAGS	(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | \
+			FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | \
+			FLASH_FLAG_PGSERR)
+
+static bool in_area(uint32_t off, uint32_t len)
+{
+	return len <= DATA_SZ && off <= DATA_SZ - len;
+}
+
+bool flash_data_init(uint32_t *size)
+{
+	*size = DATA_SZ;
+	return true;
+}
+
+bool flash_data_read(uint32_t off, void *dst, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+	memcpy(dst, (const void *)(DATA_ADDR + off), len);
+	return true;
+}
+
+bool flash_data_write(uint32_t off, const void *src, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+
+	const uint8_t *b = src;
+	bool ok = true;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_ERR_FLAGS);
+	for (uint32_t i = 0; i < len && ok; i++)
+		ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE,
+				DATA_ADDR + off + i, b[i]) == HAL_OK;
+	HAL_FLASH_Lock();
+	return ok;
+}
+
+bool flash_data_erase(void)
+{
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_SECTORS,
+		.Sector = DATA_SECTOR,
+		.NbSectors = 1,
+		.VoltageRange = FLASH_VOLTAGE_RANGE_3
+	};
+	uint32_t bad_sector;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_ERR_FLAGS);
+	bool ok = HAL_FLASHEx_Erase(&erase, &bad_sector) == HAL_OK;
+	HAL_FLASH_Lock();
+	return ok;
+}
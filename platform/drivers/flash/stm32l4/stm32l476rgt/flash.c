@@ -0,0 +1,85 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include <stm32l4xx_hal.h>
+#include "flash_hal.h"
+
+/*
+ * The last 32 pages of bank 2 are the data area. The DATA_FLASH region of the
+ * linker script sets its bounds and keeps the program image clear of them.
+ * Flash is programmed by double words.
+ */
+extern const uint8_t _sflash_data[];
+extern const uint8_t _eflash_data[];
+
+#define DATA_ADDR	((uint32_t)_sflash_data)
+#define DATA_SZ		((uint32_t)(_eflash_data - _sflash_data))
+#define DATA_FIRST_PAGE	((DATA_ADDR - FLASH_BASE - FLASH_BANK_SIZE) / \
+				FLASH_PAGE_SIZE)
+#define DATA_PAGES	(DATA_SZ / FLASH_PAGE_SIZE)
+
+static bool in_area(uint32_t off, uint32_t len)
+{
+	return len <= DATA_SZ && off <= DATA_SZ - len;
+}
+
+bool flash_data_init(uint32_t *size)
+{
+	*size = DATA_SZ;
+	return true;
+}
+
+bool flash_data_read(uint32_t off, void *dst, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+	memcpy(dst, (const void *)(DATA_ADDR + off), len);
+	return true;
+}
+
+bool flash_data_write(uint32_t off, const void *src, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+
+	const uint8_t *b = src;
+	bool ok = true;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	while (len > 0 && ok) {
+		/* Merge the new bytes into the double word holding them */
+		uint32_t dw_off = off & ~7UL;
+		uint32_t start = off - dw_off;
+		uint32_t n = 8 - start < len ? 8 - start : len;
+		uint64_t cur;
+		uint64_t val;
+		memcpy(&cur, (const void *)(DATA_ADDR + dw_off), sizeof(cur));
+		val = cur;
+		memcpy((uint8_t *)&val + start, b, n);
+		if (val != cur)
+			ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,
+					DATA_ADDR + dw_off, val) == HAL_OK;
+		off += n;
+		b += n;
+		len -= n;
+	}
+	HAL_FLASH_Lock();
+	return ok;
+}
+
+bool flash_data_erase(void)
+{
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_PAGES,
+		.Banks = FLASH_BANK_2,
+		.Page = DATA_FIRST_PAGE,
+		.NbPages = DATA_PAGES
+	};
+	uint32_t bad_page;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	bool ok = HAL_FLASHEx_Erase(&erase, &bad_page) == HAL_OK;
+	HAL_FLASH_Lock();
+	return ok;
+}
@@ -5,3 +5,29 @@
  * Target board : Raspberry Pi 3
  * Target SoC   : BCM2837
  */
+
+#include "gpio_hal.h"
+
+/*
+ * There are no GPIO pins to drive; accept unconnected pins so that drivers
+ * such as the modem's reset line can be used with 'NC'.
+ */
+bool gpio_init(pin_name_t pin_name, const gpio_config_t *config)
+{
+	return pin_name == NC;
+}
+
+bit_value_t gpio_read(pin_name_t pin_name)
+{
+	return PIN_LOW;
+}
+
+void gpio_write(pin_name_t pin_name, bit_value_t bit)
+{
+	/* XXX: Stub for now */
+}
+
+void gpio_pwr(pin_name_t pin_name, bool state)
+{
+	/* XXX: Stub for now */
+}
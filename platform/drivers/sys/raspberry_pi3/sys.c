@@ -1,16 +1,96 @@
 /* Copyright(C) 2017 Verizon. All rights reserved. */
 
-#define _POSIX_C_SOURCE 199309
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include "sys.h"
+#include "irq_emu.h"
 
 #define MS_NS_MULT	     1000000
 #define MS_SEC_MULT          1000
 
+/* Recursive lock standing in for the interrupt mask */
+static pthread_mutex_t irq_lock;
+static pthread_once_t irq_lock_once = PTHREAD_ONCE_INIT;
+
+static void irq_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&irq_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void irq_emu_enter(void)
+{
+	pthread_once(&irq_lock_once, irq_lock_init);
+	pthread_mutex_lock(&irq_lock);
+}
+
+void irq_emu_exit(void)
+{
+	pthread_mutex_unlock(&irq_lock);
+}
+
+/* All completions share one condition variable; there are only a few */
+static pthread_mutex_t compl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compl_cond;
+static pthread_once_t compl_once = PTHREAD_ONCE_INIT;
+
+static void compl_cond_init(void)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&compl_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+void sys_completion_init(sys_completion *c)
+{
+	pthread_once(&compl_once, compl_cond_init);
+	c->done = false;
+}
+
+void sys_completion_signal(sys_completion *c)
+{
+	pthread_once(&compl_once, compl_cond_init);
+	pthread_mutex_lock(&compl_lock);
+	c->done = true;
+	pthread_cond_broadcast(&compl_cond);
+	pthread_mutex_unlock(&compl_lock);
+}
+
+bool sys_completion_wait(sys_completion *c, uint32_t timeout_ms)
+{
+	pthread_once(&compl_once, compl_cond_init);
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / MS_SEC_MULT;
+	deadline.tv_nsec += (timeout_ms % MS_SEC_MULT) * MS_NS_MULT;
+	if (deadline.tv_nsec >= MS_SEC_MULT * MS_NS_MULT) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= MS_SEC_MULT * MS_NS_MULT;
+	}
+
+	pthread_mutex_lock(&compl_lock);
+	while (!c->done) {
+		if (pthread_cond_timedwait(&compl_cond, &compl_lock,
+					&deadline) == ETIMEDOUT)
+			break;
+	}
+	bool signalled = c->done;
+	c->done = false;
+	pthread_mutex_unlock(&compl_lock);
+	return signalled;
+}
+
 void sys_init(void)
 {
         /* nothing to do here */
@@ -2,6 +2,8 @@
 
 #include <stm32f4xx_hal.h>
 #include "dbg.h"
+#include "sys.h"
+#include "sys_stm32.h"
 #include "timer_hal.h"
 #include "gpio_hal.h"
 #include "timer_interface.h"
@@ -253,3 +255,18 @@ void dsb()
 {
 	__DSB();
 }
+
+void sys_completion_init(sys_completion *c)
+{
+	c->done = false;
+}
+
+void sys_completion_signal(sys_completion *c)
+{
+	c->done = true;
+}
+
+bool sys_completion_wait(sys_completion *c, uint32_t timeout_ms)
+{
+	return sys_stm32_completion_wait(c, timeout_ms);
+}
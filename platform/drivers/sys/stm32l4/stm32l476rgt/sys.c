@@ -2,6 +2,8 @@
 
 #include <stm32l4xx_hal.h>
 #include "dbg.h"
+#include "sys.h"
+#include "sys_stm32.h"
 #include "gpio_hal.h"
 #include "timer_hal.h"
 #include "timer_interface.h"
@@ -239,3 +241,32 @@ void dsb()
 {
 	__DSB();
 }
+
+void sys_completion_init(sys_completion *c)
+{
+	c->done = false;
+}
+
+void sys_completion_signal(sys_completion *c)
+{
+	c->done = true;
+}
+
+bool sys_completion_wait(sys_completion *c, uint32_t timeout_ms)
+{
+#if defined(FREE_RTOS)
+	uint64_t start = sys_get_tick_ms();
+	for (;;) {
+		/* Let other tasks run; the idle task puts the CPU to sleep */
+		if (c->done) {
+			c->done = false;
+			return true;
+		}
+		if ((sys_get_tick_ms() - start) > timeout_ms)
+			return false;
+		osDelay(1);
+	}
+#else
+	return sys_stm32_completion_wait(c, timeout_ms);
+#endif
+}
@@ -0,0 +1,39 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __SYS_STM32
+#define __SYS_STM32
+
+/*
+ * Parts of the sys layer shared by the STM32 boards. To be included after the
+ * HAL header of the chipset, which provides the CMSIS intrinsics.
+ */
+
+#include "sys.h"
+
+/*
+ * Sleep until the completion is signalled or timeout_ms have passed. The flag
+ * is tested and the CPU put to sleep with interrupts masked. A pending
+ * interrupt still ends WFI, so a signal raised in between can't be missed.
+ * SysTick wakes the CPU up to check the timeout.
+ */
+static inline bool sys_stm32_completion_wait(sys_completion *c,
+		uint32_t timeout_ms)
+{
+	uint64_t start = sys_get_tick_ms();
+	for (;;) {
+		__disable_irq();
+		if (c->done) {
+			c->done = false;
+			__enable_irq();
+			return true;
+		}
+		if ((sys_get_tick_ms() - start) > timeout_ms) {
+			__enable_irq();
+			return false;
+		}
+		__WFI();
+		__enable_irq();
+	}
+}
+
+#endif
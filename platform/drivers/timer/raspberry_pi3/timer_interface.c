@@ -0,0 +1,209 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Periodic timers emulated with one thread per timer. The callback runs within
+ * the emulated interrupt context (see irq_emu.h) once every period while the
+ * timer is running.
+ *
+ * Target board : Raspberry Pi 3 / Linux virtual devices
+ * Target SoC   : BCM2837
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "timer_interface.h"
+#include "timer_hal.h"
+#include "irq_emu.h"
+
+#define NS_PER_SEC		1000000000ULL
+
+typedef struct timer_private {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool initialized;
+	volatile bool running;
+	uint32_t gen;			/* Bumped on every (re)start */
+	uint64_t period_ns;
+	uint32_t base_freq;
+	struct timespec start;
+	struct timespec deadline;
+	timercallback_t cb;
+} timer_private_t;
+
+static timer_private_t timers[MAX_TIMERS];
+
+static void ts_add_ns(struct timespec *ts, uint64_t ns)
+{
+	uint64_t t = ts->tv_nsec + ns;
+	ts->tv_sec += t / NS_PER_SEC;
+	ts->tv_nsec = t % NS_PER_SEC;
+}
+
+static uint64_t ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * NS_PER_SEC + a->tv_nsec - b->tv_nsec;
+}
+
+static bool ts_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void *timer_thread_fn(void *data)
+{
+	timer_private_t *tm = data;
+	for (;;) {
+		pthread_mutex_lock(&tm->lock);
+		while (!tm->running)
+			pthread_cond_wait(&tm->cond, &tm->lock);
+		uint32_t gen = tm->gen;
+		struct timespec deadline = tm->deadline;
+		pthread_mutex_unlock(&tm->lock);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&deadline, NULL) == EINTR)
+			;
+
+		pthread_mutex_lock(&tm->lock);
+		if (!tm->running || tm->gen != gen) {
+			pthread_mutex_unlock(&tm->lock);
+			continue;
+		}
+		/* Skip the periods that were missed rather than bursting */
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ts_add_ns(&tm->deadline, tm->period_ns);
+		if (ts_before(&tm->deadline, &now)) {
+			tm->deadline = now;
+			ts_add_ns(&tm->deadline, tm->period_ns);
+		}
+		pthread_mutex_unlock(&tm->lock);
+
+		irq_emu_enter();
+		if (tm->running && tm->gen == gen && tm->cb)
+			tm->cb();
+		irq_emu_exit();
+	}
+	return NULL;
+}
+
+static bool tim_init(uint32_t period, uint32_t priority, uint32_t base_freq,
+			void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL || base_freq == 0)
+		return false;
+	if (!tm->initialized) {
+		pthread_mutex_init(&tm->lock, NULL);
+		pthread_cond_init(&tm->cond, NULL);
+		if (pthread_create(&tm->thread, NULL, timer_thread_fn, tm) != 0)
+			return false;
+		tm->initialized = true;
+	}
+	pthread_mutex_lock(&tm->lock);
+	tm->running = false;
+	tm->base_freq = base_freq;
+	/* Like the hardware timers, the period counts from zero */
+	tm->period_ns = (uint64_t)(period + 1) * NS_PER_SEC / base_freq;
+	pthread_mutex_unlock(&tm->lock);
+	return true;
+}
+
+static void tim_reg_callback(timercallback_t cb, void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL)
+		return;
+	tm->cb = cb;
+}
+
+static bool tim_is_running(void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL)
+		return false;
+	return tm->running;
+}
+
+static void tim_start(void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL || !tm->initialized)
+		return;
+	pthread_mutex_lock(&tm->lock);
+	clock_gettime(CLOCK_MONOTONIC, &tm->start);
+	tm->deadline = tm->start;
+	ts_add_ns(&tm->deadline, tm->period_ns);
+	tm->gen++;
+	tm->running = true;
+	pthread_cond_signal(&tm->cond);
+	pthread_mutex_unlock(&tm->lock);
+}
+
+static uint32_t tim_get_time(void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL || !tm->running)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ts_diff_ns(&now, &tm->start) * tm->base_freq / NS_PER_SEC;
+}
+
+static void tim_stop(void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL || !tm->initialized)
+		return;
+	pthread_mutex_lock(&tm->lock);
+	tm->running = false;
+	pthread_mutex_unlock(&tm->lock);
+}
+
+static void tim_set_time(uint32_t period, void *data)
+{
+	timer_private_t *tm = data;
+	if (tm == NULL || !tm->initialized)
+		return;
+	pthread_mutex_lock(&tm->lock);
+	tm->period_ns = (uint64_t)period * NS_PER_SEC / tm->base_freq;
+	clock_gettime(CLOCK_MONOTONIC, &tm->start);
+	tm->deadline = tm->start;
+	ts_add_ns(&tm->deadline, tm->period_ns);
+	tm->gen++;
+	pthread_mutex_unlock(&tm->lock);
+}
+
+#define TIMER_INTERFACE(id) [id] = { \
+	.init_timer = tim_init, \
+	.reg_callback = tim_reg_callback, \
+	.is_running = tim_is_running, \
+	.start = tim_start, \
+	.get_time = tim_get_time, \
+	.stop = tim_stop, \
+	.set_time = tim_set_time, \
+	.irq_handler = NULL, \
+	.data = &timers[id] \
+}
+
+static const timer_interface_t timer_interface[MAX_TIMERS] = {
+	TIMER_INTERFACE(TIMER1), TIMER_INTERFACE(TIMER2),
+	TIMER_INTERFACE(TIMER3), TIMER_INTERFACE(TIMER4),
+	TIMER_INTERFACE(TIMER5), TIMER_INTERFACE(TIMER6),
+	TIMER_INTERFACE(TIMER7), TIMER_INTERFACE(TIMER8),
+	TIMER_INTERFACE(TIMER9), TIMER_INTERFACE(TIMER10),
+	TIMER_INTERFACE(TIMER11), TIMER_INTERFACE(TIMER12),
+	TIMER_INTERFACE(TIMER13), TIMER_INTERFACE(TIMER14)
+};
+
+const timer_interface_t *timer_get_interface(timer_id_t tim)
+{
+	if (tim >= MAX_TIMERS)
+		return NULL;
+	return &timer_interface[tim];
+}
@@ -1,8 +1,246 @@
 /* Copyright(C) 2017 Verizon. All rights reserved. */
 
 /*
- * Raspberry pi 3 does not support peripherals for now
+ * UART driver backed by a Linux serial device. The device path is taken from
+ * the environment (UART_DEV_ENV) or defaults to UART_DEV_PATH, which makes it
+ * possible to run the AT stack against a pseudo-terminal. A background thread
+ * reads the device and hands every character to the receive callback from
+ * within the emulated interrupt context (see irq_emu.h).
  *
- * Target board : Raspberry Pi 3
+ * Target board : Raspberry Pi 3 / Linux virtual devices
  * Target SoC   : BCM2837
  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+/* pin_std_defs.h has its own speed_t; keep the termios one out of its way */
+#define speed_t tio_speed_t
+#include <termios.h>
+#undef speed_t
+#include "uart_hal.h"
+#include "board_config.h"
+#include "irq_emu.h"
+
+#define RX_CHUNK_SZ		256
+
+/* Only a single instance is supported; its handle is the file descriptor */
+static struct {
+	int fd;
+	uart_rx_char_cb rx_cb;
+	pthread_t rx_thread;
+	bool rx_thread_running;
+} port = {
+	.fd = -1
+};
+
+#define CHECK_HANDLE(hdl, retval)	do { \
+	if ((hdl) == NO_PERIPH || (int)(hdl) != port.fd) \
+		return retval; \
+} while (0)
+
+static tio_speed_t baud_to_speed(uint32_t baud)
+{
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return B0;
+	}
+}
+
+static bool configure_port(int fd, const uart_config *config, bool hw_fl_ctrl)
+{
+	tio_speed_t speed = baud_to_speed(config->baud);
+	if (speed == B0)
+		return false;
+	if (config->data_width != 8 ||
+			(config->stop_bits != 1 && config->stop_bits != 2))
+		return false;
+
+	struct termios tio;
+	if (tcgetattr(fd, &tio) != 0)
+		return false;
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+	if (config->parity != NONE)
+		tio.c_cflag |= PARENB | ((config->parity == ODD) ? PARODD : 0);
+	if (config->stop_bits == 2)
+		tio.c_cflag |= CSTOPB;
+	if (hw_fl_ctrl)
+		tio.c_cflag |= CRTSCTS;
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	if (tcsetattr(fd, TCSANOW, &tio) != 0)
+		return false;
+	tcflush(fd, TCIOFLUSH);
+	return true;
+}
+
+/*
+ * Stands in for the receive interrupt: every character read from the device is
+ * passed to the callback while holding the emulated interrupt lock.
+ */
+static void *rx_thread_fn(void *arg)
+{
+	uint8_t buf[RX_CHUNK_SZ];
+	for (;;) {
+		ssize_t n = read(port.fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		irq_emu_enter();
+		if (port.rx_cb)
+			for (ssize_t i = 0; i < n; i++)
+				port.rx_cb(buf[i]);
+		irq_emu_exit();
+	}
+	return NULL;
+}
+
+periph_t uart_init(const struct uart_pins *pins, const uart_config *config)
+{
+	if (pins == NULL || config == NULL)
+		return NO_PERIPH;
+	if (port.fd >= 0)
+		return (periph_t)port.fd;
+
+	const char *path = getenv(UART_DEV_ENV);
+	if (path == NULL)
+		path = UART_DEV_PATH;
+	int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0)
+		return NO_PERIPH;
+
+	bool hw_fl_ctrl = pins->rts != NC && pins->cts != NC;
+	if (!configure_port(fd, config, hw_fl_ctrl)) {
+		close(fd);
+		return NO_PERIPH;
+	}
+	port.fd = fd;
+	port.rx_cb = NULL;
+	/* Pins carry no meaning here beyond selecting flow control */
+	if (config->irq) {
+		if (pthread_create(&port.rx_thread, NULL, rx_thread_fn,
+					NULL) != 0) {
+			close(fd);
+			port.fd = -1;
+			return NO_PERIPH;
+		}
+		port.rx_thread_running = true;
+	}
+	return (periph_t)fd;
+}
+
+void uart_set_rx_char_cb(periph_t hdl, uart_rx_char_cb cb)
+{
+	CHECK_HANDLE(hdl, /* No return value */);
+	if (cb == NULL)
+		return;
+	irq_emu_enter();
+	port.rx_cb = cb;
+	irq_emu_exit();
+}
+
+bool uart_tx(periph_t hdl, uint8_t *data, uint16_t size, uint16_t timeout_ms)
+{
+	CHECK_HANDLE(hdl, false);
+	if (data == NULL)
+		return false;
+
+	uint16_t sent = 0;
+	while (sent < size) {
+		struct pollfd pfd = { .fd = port.fd, .events = POLLOUT };
+		int r = poll(&pfd, 1, timeout_ms);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		ssize_t n = write(port.fd, data + sent, size - sent);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+bool uart_tx_bulk(periph_t hdl, const uint8_t *data, uint16_t size,
+		uint16_t timeout_ms)
+{
+	/* The kernel already moves the whole buffer without our involvement */
+	return uart_tx(hdl, (uint8_t *)data, size, timeout_ms);
+}
+
+bool uart_tx_async(periph_t hdl, const uint8_t *data, uint16_t size,
+		uart_tx_done_cb cb)
+{
+	return false;
+}
+
+bool uart_tx_busy(periph_t hdl)
+{
+	return false;
+}
+
+bool uart_rx(periph_t hdl, uint8_t *data, uint16_t size, uint16_t timeout_ms)
+{
+	CHECK_HANDLE(hdl, false);
+	/* Bytes are owned by the receive thread when it is running */
+	if (data == NULL || port.rx_thread_running)
+		return false;
+
+	uint16_t rcvd = 0;
+	while (rcvd < size) {
+		struct pollfd pfd = { .fd = port.fd, .events = POLLIN };
+		int r = poll(&pfd, 1, timeout_ms);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		ssize_t n = read(port.fd, data + rcvd, size - rcvd);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		if (n == 0)
+			return false;
+		rcvd += n;
+	}
+	return true;
+}
+
+void uart_irq_handler(periph_t hdl)
+{
+	/* Reception is driven by the receive thread */
+}
+
+void uart_irq_on(periph_t hdl)
+{
+	CHECK_HANDLE(hdl, /* No return value */);
+	irq_emu_exit();
+}
+
+void uart_irq_off(periph_t hdl)
+{
+	CHECK_HANDLE(hdl, /* No return value */);
+	irq_emu_enter();
+}
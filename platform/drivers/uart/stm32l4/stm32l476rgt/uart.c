@@ -24,7 +24,20 @@
 	X(U5, UART5)
 
 /*
- * Define operations on the table above. These are used to generate repetitive
+ * Table mapping UART / USART IDs to the DMA controller, channel and request
+ * servicing their transmit requests.
+ * The format of the table is:
+ * ID, DMA controller, DMA channel, DMA request.
+ */
+#define UART_TX_DMA_TABLE(X) \
+	X(U1, DMA1, DMA1_Channel4, DMA_REQUEST_2) \
+	X(U2, DMA1, DMA1_Channel7, DMA_REQUEST_2) \
+	X(U3, DMA1, DMA1_Channel2, DMA_REQUEST_2) \
+	X(U4, DMA2, DMA2_Channel3, DMA_REQUEST_2) \
+	X(U5, DMA2, DMA2_Channel1, DMA_REQUEST_2)
+
+/*
+ * Define operations on the tables above. These are used to generate repetitive
  * blocks / boilerplate code.
  */
 #define GET_IDS(a, b)			a,
@@ -39,6 +52,18 @@
 #define ENABLE_CLOCKS(a, b) \
 	if (inst == b) { CAT(__HAL_RCC_, b##_CLK_ENABLE()); return; }
 
+#define DEF_DMA_IRQ_HANDLERS(a, b, c, d) \
+	void c##_IRQHandler(void) { HAL_DMA_IRQHandler(&tx_dma[a].hdma); }
+
+#define SELECT_TX_DMA(a, b, c, d) \
+	if (uid == a) { \
+		CAT(__HAL_RCC_, b##_CLK_ENABLE()); \
+		tx_dma[a].hdma.Instance = c; \
+		tx_dma[a].hdma.Init.Request = d; \
+		*irq = c##_IRQn; \
+		return true; \
+	}
+
 enum uart_id {
 	UART_TABLE(GET_IDS)
 	NUM_UART,
@@ -49,12 +74,26 @@ static uart_rx_char_cb rx_char_cb[NUM_UART];
 static UART_HandleTypeDef uart_stm32_handle[NUM_UART];
 static bool uart_usage[NUM_UART];
 
+/* State of the DMA transfer servicing each transmitter */
+static struct {
+	DMA_HandleTypeDef hdma;
+	uart_tx_done_cb cb;
+	volatile bool busy;
+	volatile bool ok;
+	bool ready;
+} tx_dma[NUM_UART];
+
 /*
  * Defines UART IRQ Handlers that call uart_irq_handler with the appropriate
  * peripheral as the parameter.
  */
 UART_TABLE(DEF_IRQ_HANDLERS);
 
+/*
+ * Defines DMA IRQ Handlers that service the transmit DMA of each UART.
+ */
+UART_TX_DMA_TABLE(DEF_DMA_IRQ_HANDLERS);
+
 static const IRQn_Type irq_vec[] = {
 	UART_TABLE(GET_IRQ_VECS)
 };
@@ -70,6 +109,65 @@ static void enable_clock(const USART_TypeDef *inst)
 	UART_TABLE(ENABLE_CLOCKS);
 }
 
+static bool select_tx_dma(enum uart_id uid, IRQn_Type *irq)
+{
+	UART_TX_DMA_TABLE(SELECT_TX_DMA);
+	return false;
+}
+
+static void tx_dma_done(DMA_HandleTypeDef *hdma, bool ok)
+{
+	UART_HandleTypeDef *huart = (UART_HandleTypeDef *)hdma->Parent;
+	enum uart_id uid = (enum uart_id)(huart - uart_stm32_handle);
+
+	CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+	tx_dma[uid].ok = ok;
+	tx_dma[uid].busy = false;
+	if (tx_dma[uid].cb)
+		tx_dma[uid].cb((periph_t)huart->Instance, ok);
+}
+
+static void tx_dma_cplt(DMA_HandleTypeDef *hdma)
+{
+	tx_dma_done(hdma, true);
+}
+
+static void tx_dma_error(DMA_HandleTypeDef *hdma)
+{
+	tx_dma_done(hdma, false);
+}
+
+/*
+ * Set up the DMA channel feeding the transmit data register. Failure here is
+ * not fatal; bulk transfers fall back to the blocking path.
+ */
+static void init_tx_dma(enum uart_id uid, uint32_t priority)
+{
+	IRQn_Type irq;
+	DMA_HandleTypeDef *hdma = &tx_dma[uid].hdma;
+
+	tx_dma[uid].ready = false;
+	if (!select_tx_dma(uid, &irq))
+		return;
+
+	hdma->Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma->Init.MemInc = DMA_MINC_ENABLE;
+	hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma->Init.Mode = DMA_NORMAL;
+	hdma->Init.Priority = DMA_PRIORITY_LOW;
+	if (HAL_DMA_Init(hdma) != HAL_OK)
+		return;
+
+	hdma->Parent = &uart_stm32_handle[uid];
+	hdma->XferCpltCallback = tx_dma_cplt;
+	hdma->XferErrorCallback = tx_dma_error;
+	HAL_NVIC_SetPriority(irq, priority, 0);
+	HAL_NVIC_EnableIRQ(irq);
+	tx_dma[uid].ready = true;
+}
+
 static bool validate_config(const uart_config *config)
 {
 	if (config == NULL)
@@ -166,6 +264,8 @@ static bool init_peripheral(periph_t hdl, const uart_config *config,
 			HAL_NVIC_EnableIRQ(irq_vec[uid]);
 		}
 	}
+	if (tx != NC)
+		init_tx_dma(uid, config->priority);
 	uart_usage[uid] = true;
 	return true;
 }
@@ -288,8 +388,73 @@ bool uart_tx(periph_t hdl, uint8_t *data, uint16_t size, uint16_t timeout_ms)
 	if (!data)
 		return false;
 
-	if (HAL_UART_Transmit(&uart_stm32_handle[convert_hdl_to_id(hdl)], data,
-				size, timeout_ms) != HAL_OK)
+	enum uart_id uid = convert_hdl_to_id(hdl);
+	if (tx_dma[uid].busy)
+		return false;
+
+	if (HAL_UART_Transmit(&uart_stm32_handle[uid], data, size,
+				timeout_ms) != HAL_OK)
 		return false;
 	return true;
 }
+
+bool uart_tx_async(periph_t hdl, const uint8_t *data, uint16_t size,
+		uart_tx_done_cb cb)
+{
+	CHECK_HANDLE(hdl, false);
+	if (!data || size == 0)
+		return false;
+
+	enum uart_id uid = convert_hdl_to_id(hdl);
+	if (!tx_dma[uid].ready || tx_dma[uid].busy)
+		return false;
+
+	USART_TypeDef *uart_instance = (USART_TypeDef *)hdl;
+	tx_dma[uid].cb = cb;
+	tx_dma[uid].busy = true;
+	if (HAL_DMA_Start_IT(&tx_dma[uid].hdma, (uint32_t)data,
+				(uint32_t)&uart_instance->TDR, size) != HAL_OK) {
+		tx_dma[uid].busy = false;
+		return false;
+	}
+	SET_BIT(uart_instance->CR3, USART_CR3_DMAT);
+	return true;
+}
+
+bool uart_tx_busy(periph_t hdl)
+{
+	CHECK_HANDLE(hdl, false);
+	return tx_dma[convert_hdl_to_id(hdl)].busy;
+}
+
+bool uart_tx_bulk(periph_t hdl, const uint8_t *data, uint16_t size,
+		uint16_t timeout_ms)
+{
+	CHECK_HANDLE(hdl, false);
+	if (!data)
+		return false;
+
+	enum uart_id uid = convert_hdl_to_id(hdl);
+	if (!tx_dma[uid].ready)
+		return uart_tx(hdl, (uint8_t *)data, size, timeout_ms);
+
+	uint32_t start = HAL_GetTick();
+	if (!uart_tx_async(hdl, data, size, NULL))
+		return false;
+
+	/*
+	 * Sleep until the transfer completes. Either the DMA interrupt or the
+	 * SysTick wakes the processor up, the latter bounding the wait.
+	 */
+	while (tx_dma[uid].busy) {
+		if (HAL_GetTick() - start > timeout_ms) {
+			HAL_DMA_Abort(&tx_dma[uid].hdma);
+			CLEAR_BIT(((USART_TypeDef *)hdl)->CR3, USART_CR3_DMAT);
+			tx_dma[uid].busy = false;
+			return false;
+		}
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON,
+				PWR_SLEEPENTRY_WFI);
+	}
+	return tx_dma[uid].ok;
+}
@@ -0,0 +1,56 @@
+/**
+ * \file flash_hal.h
+ * \copyright Copyright (c) 2017 Verizon. All rights reserved.
+ * \brief Hardware abstraction layer for the flash data area.
+ * \details Provide access to a region of the on-chip flash set aside for data
+ * that must survive a reset. The region lies outside of the program image and
+ * can only be erased as a whole. Erased bytes read as 0xFF. Writing can only
+ * clear bits, except that bytes already written may always be written again
+ * with zeros.
+ */
+
+#ifndef __FLASH_HAL_H
+#define __FLASH_HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \brief Prepare the flash data area for use.
+ * \param[out] size Size of the data area in bytes.
+ * \retval true Data area is ready.
+ * \retval false The device has no data area.
+ */
+bool flash_data_init(uint32_t *size);
+
+/**
+ * \brief Read from the flash data area.
+ * \param[in] off Offset from the start of the data area.
+ * \param[out] dst Buffer to receive the data.
+ * \param[in] len Number of bytes to read.
+ * \retval true Data was read.
+ * \retval false The range lies outside of the data area.
+ */
+bool flash_data_read(uint32_t off, void *dst, uint32_t len);
+
+/**
+ * \brief Program the flash data area.
+ * \details Offsets that are not a multiple of 8 may cost a read back of the
+ * surrounding bytes on devices programmed by double words; bytes left out of
+ * such a double word keep their value.
+ * \param[in] off Offset from the start of the data area.
+ * \param[in] src Data to program.
+ * \param[in] len Number of bytes to program.
+ * \retval true Data was programmed.
+ * \retval false The range lies outside of the data area or programming failed.
+ */
+bool flash_data_write(uint32_t off, const void *src, uint32_t len);
+
+/**
+ * \brief Erase the whole flash data area, blocking until done.
+ * \retval true Data area was erased.
+ * \retval false Erasing failed.
+ */
+bool flash_data_erase(void);
+
+#endif /* __FLASH_HAL_H */
@@ -11,6 +11,7 @@
 #define SYS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
  /**
   * \brief       Initializes platform, includes HAL layer init, system clock
@@ -54,4 +55,42 @@ uint32_t sys_sleep_ms(uint32_t sleep_ms);
  */
 void dsb(void);
 
+/**
+ * \brief       One-shot completion signalled from interrupt context (e.g. a
+ *              peripheral callback) and waited upon from thread context.
+ *              Waiting puts the CPU to sleep until an interrupt occurs instead
+ *              of polling.
+ */
+typedef struct {
+	volatile bool done;
+} sys_completion;
+
+/**
+ * \brief       Initializes a completion to the unsignalled state.
+ *
+ * \param[in] c    completion to initialize
+ */
+void sys_completion_init(sys_completion *c);
+
+/**
+ * \brief       Signals a completion, waking up the waiter if there is one. May be
+ *              called from interrupt context.
+ *
+ * \param[in] c    completion to signal
+ */
+void sys_completion_signal(sys_completion *c);
+
+/**
+ * \brief       Waits for a completion to be signalled and consumes the signal.
+ *
+ * \param[in] c            completion to wait on
+ * \param[in] timeout_ms   maximum time to wait in miliseconds
+ * \returns
+ * 	true if the completion was signalled, false on timeout.
+ * \note
+ * A signal raised before the call is not lost; the function returns right
+ * away in that case.
+ */
+bool sys_completion_wait(sys_completion *c, uint32_t timeout_ms);
+
 #endif
@@ -4,7 +4,7 @@
  * \brief Hardware abstraction layer for UART
  * \details This header defines a platform independent API
  * to read and write over the UART port. All sending operations
- * are blocking while data is received
+ * are blocking, except \ref uart_tx_async, while data is received
  * byte-by-byte via a receive callback.
  */
 #ifndef UART_HAL_H
@@ -100,6 +100,71 @@ void uart_set_rx_char_cb(periph_t hdl, uart_rx_char_cb cb);
  */
 bool uart_tx(periph_t hdl, uint8_t *data, uint16_t size, uint16_t timeout_ms);
 
+/**
+ * \brief UART transmit completion callback.
+ * \details Invoked from interrupt context once an asynchronous transfer started
+ * through \ref uart_tx_async has finished.
+ * \param[in] hdl Handle of the UART peripheral that completed the transfer.
+ * \param[in] ok true if every byte was handed to the peripheral, false if the
+ * transfer was aborted due to an error.
+ */
+typedef void (*uart_tx_done_cb)(periph_t hdl, bool ok);
+
+/**
+ * \brief Send a buffer over the UART in a single transfer.
+ * \details Semantically identical to \ref uart_tx but meant for large buffers.
+ * Where the platform supports it, the whole buffer is moved by DMA and the
+ * processor sleeps until the transfer completes instead of being involved
+ * in every byte. Platforms without DMA support fall back to \ref uart_tx.
+ *
+ * \param[in] hdl Handle of the UART peripheral to write.
+ * \param[in] data Pointer to the data to be sent. It must remain valid until
+ * this call returns.
+ * \param[in] size Number of bytes to send
+ * \param[in] timeout_ms Total number of milliseconds to wait for the transfer
+ * to complete before aborting it.
+ *
+ * \retval true Data was sent out successfully.
+ * \retval false Send aborted due to timeout, a transfer already in progress or
+ * null pointer was provided for the data.
+ *
+ * \pre \ref uart_init must be called to retrieve a valid handle.
+ */
+bool uart_tx_bulk(periph_t hdl, const uint8_t *data, uint16_t size,
+		uint16_t timeout_ms);
+
+/**
+ * \brief Start sending a buffer over the UART without waiting for completion.
+ * \details The transfer is carried out in the background and 'cb' is invoked
+ * from interrupt context once it finishes. Only one transfer can be in flight
+ * per peripheral; \ref uart_tx_busy can be used to poll for completion when
+ * no callback is provided.
+ *
+ * \param[in] hdl Handle of the UART peripheral to write.
+ * \param[in] data Pointer to the data to be sent. It must remain valid until
+ * the transfer completes.
+ * \param[in] size Number of bytes to send
+ * \param[in] cb Completion callback, may be NULL.
+ *
+ * \retval true Transfer was started.
+ * \retval false Asynchronous transfers are not supported on this platform, a
+ * transfer is already in progress or invalid parameters were passed.
+ *
+ * \pre \ref uart_init must be called to retrieve a valid handle.
+ */
+bool uart_tx_async(periph_t hdl, const uint8_t *data, uint16_t size,
+		uart_tx_done_cb cb);
+
+/**
+ * \brief Check whether an asynchronous transfer is still in progress.
+ *
+ * \param[in] hdl Handle of the UART peripheral.
+ *
+ * \retval true A transfer started by \ref uart_tx_async has not completed yet.
+ * \retval false The transmitter is free.
+ */
+bool uart_tx_busy(periph_t hdl);
+
 /**
  * \brief Receive data over the UART.
  * \details This is a blocking receive. In case the receiver blocks the flow via
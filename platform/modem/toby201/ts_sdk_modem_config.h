@@ -130,6 +130,28 @@
 #define MODEM_UART_IDLE_TIMER	TIMER2
 #endif	/* BOARD */
 
+#elif defined(raspberry_pi3) || defined(virtual)
+/*
+ * The modem is reached through a Linux serial device (see board_config.h); the
+ * pins are only used to decide whether to enable hardware flow control.
+ */
+#define MODEM_UART_TX_PIN	NC
+#define MODEM_UART_RX_PIN	NC
+#define MODEM_UART_RTS_PIN	NC
+#define MODEM_UART_CTS_PIN	NC
+#define MODEM_HW_RESET_PIN	NC
+#define MODEM_UART_BAUD_RATE	115200
+#define MODEM_UART_DATA_WIDTH	8
+#define MODEM_UART_PARITY	NONE
+#define MODEM_UART_STOP_BITS	1
+
+/* Unused on Linux, interrupts are emulated by threads */
+#define MODEM_UART_IRQ_PRIORITY	5
+#define IDL_TIM_IRQ_PRIORITY	6
+
+/* Timer ID */
+#define MODEM_UART_IDLE_TIMER	TIMER2
+
 #else
 #error "Must specify chipset and board"
 
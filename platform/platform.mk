@@ -3,6 +3,10 @@
 # raspberry_pi3 and linux based virtual devices use same code base
 ifeq ($(DEV_BOARD),$(filter $(DEV_BOARD),raspberry_pi3 virtual))
 DEV_BOARD_MOD = raspberry_pi3
+# The AT stack needs an idle timer; it is emulated by a thread on Linux
+ifneq ($(MODEM_TARGET),none)
+PLATFORM_TIMER_HAL_SRC = timer_hal.c timer_interface.c
+endif
 else
 DEV_BOARD_MOD = $(DEV_BOARD)
 PLATFORM_TIMER_HAL_SRC = timer_hal.c timer_interface.c
@@ -12,6 +16,8 @@ endif
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/inc
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/modem/$(MODEM_TARGET)
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/sw
+# Sys layer parts shared by the boards of different chipset families
+PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/drivers/sys
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/sw/$(CHIPSET_FAMILY)
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/sw/$(CHIPSET_FAMILY)/$(CHIPSET_MCU)
 PLATFORM_INC += -I $(PLATFORM_HAL_ROOT)/sw/$(CHIPSET_FAMILY)/$(CHIPSET_MCU)/$(DEV_BOARD_MOD)
@@ -42,6 +48,11 @@ ifneq ($(PROTOCOL),SMSNAS_PROTOCOL)
 PLATFORM_HAL_SRC += hwrng.c
 endif
 
+# Flash data area, used by the offline store of the cloud_comm API
+ifneq ($(filter stm32f4 stm32l4,$(CHIPSET_FAMILY)),)
+PLATFORM_HAL_SRC += flash.c
+endif
+
 export PLATFORM_HAL_SRC
 export PLATFORM_INC
 
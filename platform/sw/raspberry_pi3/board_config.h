@@ -9,5 +9,12 @@
 #ifndef BOARD_CONFIG_H
 #define BOARD_CONFIG_H
 
+/*
+ * Serial device backing the UART driver. The environment variable named by
+ * UART_DEV_ENV takes precedence, e.g. to point the driver at a pseudo-terminal
+ * created by a modem emulator.
+ */
+#define UART_DEV_PATH		"/dev/serial0"
+#define UART_DEV_ENV		"TS_UART_DEV"
 
 #endif
@@ -0,0 +1,27 @@
+/**
+ * \file irq_emu.h
+ * \copyright Copyright (c) 2017 Verizon. All rights reserved.
+ * \brief Emulated interrupt context for Linux based targets.
+ * \details Peripherals that deliver events through callbacks (UART receive,
+ * timer expiry) are serviced by background threads on Linux. These threads
+ * hold the emulated interrupt lock while running a callback, and code that
+ * would mask interrupts on a microcontroller takes the same lock. The lock is
+ * recursive so callbacks may mask interrupts themselves, just like an ISR
+ * calling \ref uart_irq_off on the target.
+ * Target board : Raspberry Pi 3 / Linux virtual devices
+ */
+#ifndef IRQ_EMU_H
+#define IRQ_EMU_H
+
+/**
+ * \brief Enter the emulated interrupt context.
+ * \details Blocks until no other thread is inside the context.
+ */
+void irq_emu_enter(void);
+
+/**
+ * \brief Leave the emulated interrupt context.
+ */
+void irq_emu_exit(void);
+
+#endif
@@ -0,0 +1,77 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __CC_METRICS
+#define __CC_METRICS
+
+#include <stdint.h>
+
+/**
+ * \file cc_metrics.h
+ *
+ * Runtime metrics of the cloud communication stack. Every layer updates its
+ * counters in a statically allocated registry as it goes, at the cost of an
+ * addition per update, so the numbers are available in production builds and
+ * can be read at any time with cc_get_metrics().
+ *
+ * Counters only ever increase until cc_reset_metrics() and wrap around at
+ * 2^32. Times are in milliseconds and include the time spent in the layers
+ * below, i.e. proto_ms includes net_ms which includes at_ms when the network
+ * runs over AT commands. Bytes on the wire minus message bytes is the
+ * overhead added by TLS and the protocol framing.
+ *
+ * Defining CC_NO_METRICS compiles the updates out, the metrics then read 0.
+ */
+
+/**
+ * Registry of the metrics.
+ */
+typedef struct {
+	/* Traffic */
+	uint32_t wire_bytes_sent;	/**< Written to sockets or sent as SMS PDUs */
+	uint32_t wire_bytes_rcvd;	/**< Read from sockets or received as SMS PDUs */
+	uint32_t msg_bytes_sent;	/**< Size of the messages handed to the protocol */
+	uint32_t msg_bytes_rcvd;	/**< Size of the messages delivered by the protocol */
+	uint32_t msgs_sent;		/**< Messages the protocol accepted */
+	uint32_t msgs_rcvd;		/**< Messages delivered to services and routes */
+	uint32_t send_failures;		/**< Messages the protocol failed to send */
+
+	/* TLS */
+	uint32_t tls_handshakes;	/**< Handshakes completed */
+	uint32_t tls_hs_bytes;		/**< Bytes on the wire during handshakes, both ways */
+
+	/* Modem */
+	uint32_t at_cmds;		/**< AT commands issued */
+	uint32_t at_cmd_errors;		/**< AT commands that failed or timed out */
+	uint32_t at_cmd_max_ms;		/**< Longest AT command, a gauge */
+
+	/* Connection */
+	uint32_t connects;		/**< Connections established */
+	uint32_t connect_failures;	/**< Connection attempts that failed */
+	uint32_t reconnects;		/**< Connections set up again after a failure */
+	uint32_t retries;		/**< Sends repeated: SMS segments, MQTT publishes, stored messages */
+
+	/* Time */
+	uint32_t proto_ms;		/**< Spent in the protocol layer */
+	uint32_t net_ms;		/**< Spent in the network layer */
+	uint32_t at_ms;			/**< Spent waiting on AT commands */
+} cc_metrics;
+
+/**
+ * \brief
+ * Retrieve the metrics.
+ *
+ * \param[out] m : Where to copy the registry.
+ *
+ * \details
+ * Each field is read in one access, so a field updated concurrently from an
+ * interrupt is either before or after that update.
+ */
+void cc_get_metrics(cc_metrics *m);
+
+/**
+ * \brief
+ * Set every metric back to 0, e.g. to measure a single transaction.
+ */
+void cc_reset_metrics(void);
+
+#endif
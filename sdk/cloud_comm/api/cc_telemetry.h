@@ -0,0 +1,183 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __CC_TELEMETRY
+#define __CC_TELEMETRY
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cbor.h"
+#include "cloud_comm.h"
+
+/**
+ * \file cc_telemetry.h
+ *
+ * Streaming encoder for telemetry payloads. Records are written as CBOR
+ * directly into the send buffer of a cloud communication buffer descriptor,
+ * without any heap allocation. The payload is a single map of key / value
+ * records; values may themselves be maps or arrays up to a fixed nesting
+ * depth.
+ *
+ * Usage:
+ *	cc_telemetry t;
+ *	cc_telemetry_begin(&t, &send_buffer, CC_SERVICE_BASIC);
+ *	cc_telemetry_add_str(&t, "unitMacId", dev_id);
+ *	cc_telemetry_add_double(&t, "temperature", 21.5);
+ *	cc_data_sz sz = cc_telemetry_end(&t);
+ *	if (sz > 0)
+ *		cc_send_svc_msg_to_cloud(&send_buffer, sz, CC_SERVICE_BASIC, NULL);
+ *
+ * Once an add function fails, all following calls fail as well and
+ * cc_telemetry_end() returns 0, so errors need only be checked at the end.
+ */
+
+/**
+ * Maximum nesting of maps and arrays, counting the top level map.
+ */
+#ifndef CC_TELEMETRY_MAX_DEPTH
+#define CC_TELEMETRY_MAX_DEPTH	4
+#endif
+
+/**
+ * Encoder state. Treat as opaque; it is exposed only so that it can be
+ * allocated by the caller.
+ */
+typedef struct {
+	CborEncoder enc[CC_TELEMETRY_MAX_DEPTH + 1];
+	bool is_array[CC_TELEMETRY_MAX_DEPTH + 1];
+	uint8_t depth;		/* Index of the innermost open container */
+	uint8_t *start;		/* First byte of the payload */
+	CborError err;		/* First error seen */
+} cc_telemetry;
+
+/**
+ * \brief
+ * Start a telemetry payload in the send buffer of a buffer descriptor.
+ *
+ * \param[out] t     : Encoder state to initialize.
+ * \param[in] buf    : Send buffer descriptor the payload is written to.
+ * \param[in] svc_id : Service id the message will be sent to. Space reserved
+ *                     for the service header is skipped.
+ *
+ * \returns
+ *	True  : The top level map was opened.
+ *	False : Invalid parameters or the buffer is too small.
+ */
+bool cc_telemetry_begin(cc_telemetry *t, cc_buffer_desc *buf,
+			cc_service_id svc_id);
+
+/**
+ * \brief
+ * Add a signed integer record.
+ *
+ * \param[in] t   : Encoder state.
+ * \param[in] key : Null terminated record name. Must be NULL when adding an
+ *                  element to an array and non NULL otherwise.
+ * \param[in] val : Value of the record.
+ *
+ * \returns
+ *	True  : The record was encoded.
+ *	False : The record did not fit or an earlier call failed.
+ */
+bool cc_telemetry_add_int(cc_telemetry *t, const char *key, int64_t val);
+
+/**
+ * \brief
+ * Add an unsigned integer record. See cc_telemetry_add_int().
+ */
+bool cc_telemetry_add_uint(cc_telemetry *t, const char *key, uint64_t val);
+
+/**
+ * \brief
+ * Add a single precision floating point record. See cc_telemetry_add_int().
+ */
+bool cc_telemetry_add_float(cc_telemetry *t, const char *key, float val);
+
+/**
+ * \brief
+ * Add a double precision floating point record. See cc_telemetry_add_int().
+ */
+bool cc_telemetry_add_double(cc_telemetry *t, const char *key, double val);
+
+/**
+ * \brief
+ * Add a boolean record. See cc_telemetry_add_int().
+ */
+bool cc_telemetry_add_bool(cc_telemetry *t, const char *key, bool val);
+
+/**
+ * \brief
+ * Add a null terminated text string record. See cc_telemetry_add_int().
+ */
+bool cc_telemetry_add_str(cc_telemetry *t, const char *key, const char *val);
+
+/**
+ * \brief
+ * Add a byte string record. See cc_telemetry_add_int().
+ *
+ * \param[in] len : Number of bytes in val.
+ */
+bool cc_telemetry_add_bytes(cc_telemetry *t, const char *key,
+			    const uint8_t *val, size_t len);
+
+/**
+ * \brief
+ * Open a nested map. Records added until the matching cc_telemetry_close()
+ * belong to it.
+ *
+ * \param[in] t   : Encoder state.
+ * \param[in] key : Record name, NULL when the map is an array element.
+ *
+ * \returns
+ *	True  : The map was opened.
+ *	False : Maximum nesting depth exceeded, the map did not fit or an
+ *	        earlier call failed.
+ */
+bool cc_telemetry_open_map(cc_telemetry *t, const char *key);
+
+/**
+ * \brief
+ * Open a nested array. Elements are added with a NULL key until the matching
+ * cc_telemetry_close(). See cc_telemetry_open_map().
+ */
+bool cc_telemetry_open_array(cc_telemetry *t, const char *key);
+
+/**
+ * \brief
+ * Close the innermost map or array opened by cc_telemetry_open_map() or
+ * cc_telemetry_open_array().
+ *
+ * \param[in] t : Encoder state.
+ *
+ * \returns
+ *	True  : The container was closed.
+ *	False : No nested container is open or an earlier call failed.
+ */
+bool cc_telemetry_close(cc_telemetry *t);
+
+/**
+ * \brief
+ * Finish the payload, closing any containers that are still open.
+ *
+ * \param[in] t : Encoder state.
+ *
+ * \returns
+ * 	Size of the payload in bytes, to be passed to the cc_send_*() functions,
+ * 	or 0 if encoding failed.
+ */
+cc_data_sz cc_telemetry_end(cc_telemetry *t);
+
+/**
+ * \brief
+ * Number of bytes by which the send buffer was too small.
+ *
+ * \param[in] t : Encoder state.
+ *
+ * \returns
+ * 	Additional bytes that would have been needed to encode everything added
+ * 	so far, or 0 if it fit. Useful to size CC_SEND_BUFFER() during
+ * 	development.
+ */
+size_t cc_telemetry_bytes_short(const cc_telemetry *t);
+
+#endif
@@ -25,7 +25,8 @@
 typedef enum {
 	CC_SEND_FAILED,		/**< Failed to send the message */
 	CC_SEND_BUSY,		/**< A message is currently being sent */
-	CC_SEND_SUCCESS		/**< Message was sent successfully */
+	CC_SEND_SUCCESS,	/**< Message was sent successfully */
+	CC_SEND_STORED		/**< Kept in the offline store for later */
 } cc_send_result;
 
 /**
@@ -47,6 +48,10 @@ typedef enum {
 	CC_EVT_SEND_ACKED,	/**< Received an ACK for the last message sent */
 	CC_EVT_SEND_NACKED,	/**< Received a NACK for the last message sent */
 	CC_EVT_SEND_TIMEOUT,	/**< Timed out waiting for a response */
+	CC_EVT_SEND_FAILED,	/**< A queued message could not be sent */
+	CC_EVT_SEND_STORED,	/**< Kept in the offline store for later */
+	CC_EVT_SEND_DONE,	/**< A queued message was sent, the protocol
+				  reports no acknowledgement */
 
 	/* Incoming message events: */
 	CC_EVT_RCVD_MSG,	/**< Received a message from the cloud */
@@ -276,6 +281,8 @@ cc_data_sz cc_get_receive_data_len(const cc_buffer_desc *buf,
  * 	CC_SEND_BUSY    : A send is in progress.
  * 	CC_SEND_SUCCESS : Message was sent, waiting for a response from the
  *                        cloud.
+ * 	CC_SEND_STORED  : Sending failed and the message was kept in the
+ *                        offline store, see cc_enable_offline_store().
  *
  * The data is sent using the selected protocol to the specified service.
  *
@@ -303,6 +310,8 @@ cc_send_result cc_send_svc_msg_to_cloud(cc_buffer_desc *buf,
  * 	CC_SEND_BUSY    : A send is in progress.
  * 	CC_SEND_SUCCESS : Message was sent, waiting for a response from the
  *                        cloud.
+ * 	CC_SEND_STORED  : Sending failed and the message was kept in the
+ *                        offline store, see cc_enable_offline_store().
  *
  * The data is sent using the selected protocol to the specified service.
  *
@@ -336,6 +345,174 @@ cc_send_result cc_send_status_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz);
  */
 cc_send_result cc_send_diag_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz);
 
+/**
+ * Maximum number of messages that can wait in the outbound queue.
+ */
+#ifndef CC_SEND_QUEUE_LEN
+#define CC_SEND_QUEUE_LEN	8
+#endif
+
+/**
+ * Pointer to a routine notified of the outcome of a queued message. 'event' is
+ * one of CC_EVT_SEND_ACKED, CC_EVT_SEND_NACKED, CC_EVT_SEND_TIMEOUT,
+ * CC_EVT_SEND_FAILED, CC_EVT_SEND_STORED or CC_EVT_SEND_DONE. 'ctx' is the
+ * value passed when queueing the message.
+ * The buffer may be reused once this has been called. For MQTT publishes with
+ * QoS 1 or 2 that happens once the acknowledgement came in, which may be during
+ * a later call to cc_service_send_receive().
+ */
+typedef void (*cc_send_done_cb)(cc_buffer_desc *buf, cc_event event,
+				void *ctx);
+
+/**
+ * \brief
+ * Queue a message for the specified service to be sent to the cloud.
+ *
+ * \param[in] buf    : Pointer to the cloud communication buffer descriptor
+ *                     containing the data to be sent.
+ * \param[in] sz     : Size of the data in bytes.
+ * \param[in] svc_id : Id of the service that will process this message.
+ * \param[in] proto_data : Optional protocol specific data, as for
+ *                         cc_send_svc_msg_to_cloud().
+ * \param[in] cb     : Optional routine notified once the message was sent.
+ * \param[in] ctx    : Opaque value handed back to 'cb'.
+ *
+ * \returns
+ * 	CC_SEND_FAILED  : Invalid parameters.
+ * 	CC_SEND_BUSY    : The queue is full.
+ * 	CC_SEND_SUCCESS : Message was queued.
+ *
+ * Queued messages are sent from cc_service_send_receive(), all of them over a
+ * single connection to the cloud where the protocol supports it. The buffer
+ * must not be modified until the message has been sent. Service callbacks are
+ * invoked for queued messages just like for messages sent directly.
+ */
+cc_send_result cc_queue_svc_msg_to_cloud(cc_buffer_desc *buf,
+					 cc_data_sz sz, cc_service_id svc_id,
+					 void *proto_data,
+					 cc_send_done_cb cb, void *ctx);
+
+/**
+ * \brief
+ * Queue a status message to be sent to the cloud.
+ *
+ * \param[in] buf    : Pointer to the cloud communication buffer descriptor
+ *                     containing the data to be sent.
+ * \param[in] sz     : Size of the data in bytes.
+ * \param[in] cb     : Optional routine notified once the message was sent.
+ * \param[in] ctx    : Opaque value handed back to 'cb'.
+ *
+ * \returns
+ * 	CC_SEND_FAILED  : Invalid parameters.
+ * 	CC_SEND_BUSY    : The queue is full.
+ * 	CC_SEND_SUCCESS : Message was queued.
+ *
+ * See cc_queue_svc_msg_to_cloud().
+ */
+cc_send_result cc_queue_status_msg_to_cloud(cc_buffer_desc *buf,
+					    cc_data_sz sz,
+					    cc_send_done_cb cb, void *ctx);
+
+/**
+ * \brief
+ * Number of messages waiting in the outbound queue.
+ */
+uint8_t cc_get_send_queue_len(void);
+
+/**
+ * Size of a slot of the offline store. Each stored message takes one slot,
+ * whatever its length.
+ */
+#define CC_STORE_HDR_SZ		16
+#define CC_STORE_DATA_AREA_SZ	((PROTO_SEND_DATA_SZ + 7) & ~7)
+#define CC_STORE_SLOT_SZ	((CC_STORE_HDR_SZ + CC_STORE_DATA_AREA_SZ + \
+					CC_MAX_SEND_BUF_SZ + 7) & ~7)
+
+/**
+ * Maximum number of stored messages sent per call to cc_service_send_receive().
+ */
+#ifndef CC_STORE_BATCH_LEN
+#define CC_STORE_BATCH_LEN	16
+#endif
+
+/**
+ * Time in milliseconds between attempts at sending stored messages while the
+ * link to the cloud is down.
+ */
+#ifndef CC_STORE_RETRY_MS
+#define CC_STORE_RETRY_MS	60000
+#endif
+
+/**
+ * Storage behind the offline store. Offsets count from the start of the
+ * storage area. write() must also be able to zero bytes that were already
+ * written, which flash memories allow.
+ */
+typedef struct {
+	bool (*init)(uint32_t *size);	/* Prepare the area, report its size */
+	bool (*read)(uint32_t off, void *dst, uint32_t len);
+	bool (*write)(uint32_t off, const void *src, uint32_t len);
+	bool (*erase)(void);		/* Set every byte of the area to 0xFF */
+	bool rewritable;		/* Written bytes can be written again
+					 * with any value without an erase */
+} cc_store_backend;
+
+/** Storage backend in RAM; its contents do not survive a reset. */
+extern const cc_store_backend cc_store_mem_backend;
+/** Storage backend in a file, on Linux based devices. */
+extern const cc_store_backend cc_store_file_backend;
+/** Storage backend in the flash data area, on STM32 based devices. */
+extern const cc_store_backend cc_store_flash_backend;
+
+/**
+ * What to do with a message to be stored when the offline store is full.
+ */
+typedef enum {
+	CC_STORE_DROP_OLDEST,	/**< Drop the oldest stored message */
+	CC_STORE_DROP_NEWEST	/**< Do not store the new message */
+} cc_store_policy;
+
+/**
+ * \brief
+ * Keep messages that could not be sent and send them once the link to the
+ * cloud is back.
+ *
+ * \param[in] backend    : Storage for the messages.
+ * \param[in] policy     : What to drop when the storage is full.
+ * \param[in] replay_buf : Buffer the stored messages are sent from; messages
+ *                         larger than this buffer are not stored.
+ *
+ * \returns
+ * 	true  : Offline store is in use.
+ * 	false : The storage could not be prepared.
+ *
+ * Must be called after cc_init(). Messages stored before a reset are sent as
+ * well when the backend keeps them. A message is stored instead of being
+ * dropped when the protocol fails to send it or times out waiting for a
+ * response; the send routines then return CC_SEND_STORED and the completion
+ * routines of queued messages receive CC_EVT_SEND_STORED. Messages for the
+ * Control service are never stored.
+ *
+ * Stored messages are sent from cc_service_send_receive(), oldest first and
+ * ahead of the outbound queue, up to CC_STORE_BATCH_LEN of them over the same
+ * session. While the link is down this is tried once every CC_STORE_RETRY_MS.
+ * A message leaves the store only once it went through, so it may reach the
+ * cloud twice if the device resets in between.
+ *
+ * The flash backend is written sequentially and erased once all its messages
+ * were sent. Until then a partly sent backlog cannot make room for new
+ * messages, so they are not stored whatever the policy.
+ */
+bool cc_enable_offline_store(const cc_store_backend *backend,
+			     cc_store_policy policy,
+			     cc_buffer_desc *replay_buf);
+
+/**
+ * \brief
+ * Number of messages waiting in the offline store.
+ */
+uint16_t cc_get_offline_store_len(void);
+
 /**
  * \brief
  * Make a buffer available to hold received messages.
@@ -360,7 +537,8 @@ cc_set_recv_result cc_set_recv_buffer(cc_buffer_desc *buf);
 
 /**
  * \brief
- * Call this function periodically to advance the time-based activities.
+ * Call this function periodically to advance the time-based activities and
+ * to send the queued messages.
  *
  * \param[in] cur_ts : The current timestamp representing the system tick
  *                     time in ms.
@@ -425,4 +603,40 @@ void cc_nak_msg(void);
 bool cc_register_service(const cc_service_descriptor *svc_desc,
 			 cc_svc_callback_rtn cb);
 
+/**
+ * Maximum number of topic filters that can be routed with
+ * cc_register_topic_route().
+ */
+#ifndef CC_MAX_TOPIC_ROUTES
+#define CC_MAX_TOPIC_ROUTES	4
+#endif
+
+/**
+ * \brief
+ * Deliver the messages received on the topics matching a filter to a receive
+ * buffer and callback of their own, instead of the buffer set through
+ * cc_set_recv_buffer().
+ *
+ * \param[in] topic_filter : Topic filter, which may contain the "+" and "#"
+ *                           wildcards. It is not copied and must remain valid.
+ * \param[in] buf          : Receive buffer of the messages of this route.
+ * \param[in] cb           : Invoked with CC_EVT_RCVD_MSG and the length of
+ *                           the message, or with CC_EVT_RCVD_OVERFLOW if it did
+ *                           not fit into the buffer; 'ptr' is 'buf'.
+ *
+ * \returns
+ *	True  : The route was registered, or updated if the filter was
+ *	        registered before.
+ *	False : Invalid parameters, no room left or unsupported by the protocol.
+ *
+ * \note
+ * Only supported by the MQTT protocol, which subscribes to the filter.
+ * Messages on the command topic always go to the regular receive buffer. When
+ * several filters match a topic, a literal level wins over "+", which wins
+ * over "#". The buffer is overwritten by the next message of the route as soon
+ * as the callback returns.
+ */
+bool cc_register_topic_route(const char *topic_filter, cc_buffer_desc *buf,
+			     cc_svc_callback_rtn cb);
+
 #endif /* __CLOUD_COMM */
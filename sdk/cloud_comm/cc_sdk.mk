@@ -9,6 +9,12 @@ include $(SDK_ROOT)/modem.mk
 SDK_INC += $(PROTOCOL_INC)
 SDK_INC += $(MODEM_INC)
 
+# Header files for the network driver and TLS support of mbed TLS, needed by
+# the protocols and the modem layer alike
+ifneq (,$(findstring mbedtls,$(VENDOR_LIB_DIRS)))
+SDK_INC += -I $(SDK_ROOT)/inc/network
+endif
+
 # Header files for the cloud_comm API
 SDK_INC += -I $(SDK_ROOT)/api
 
@@ -19,14 +25,35 @@ SDK_INC += -I $(SDK_ROOT)/inc/services
 # Header files for vendor libraries
 SDK_INC += $(VENDOR_INC)
 
-# Source for the main cloud API
-CLOUD_COMM_SRC ?= cloud_comm.c
+# Source for the main cloud API and the telemetry payload encoder
+CLOUD_COMM_SRC ?= cloud_comm.c cc_telemetry.c
+
+# Source for the offline store and its storage backends
+CC_STORE_SRC = cc_store.c cc_store_mem.c
+ifeq ($(DEV_BOARD),$(filter $(DEV_BOARD),raspberry_pi3 virtual))
+CC_STORE_SRC += cc_store_file.c
+else ifneq ($(filter stm32f4 stm32l4,$(CHIPSET_FAMILY)),)
+CC_STORE_SRC += cc_store_flash.c
+endif
+
+# Source for the runtime metrics registry, updated by every layer of the stack
+CC_METRICS_SRC = cc_metrics.c
 
 # Source for the standard services.
 # An application may append to this variable if it uses additional services.
 SERVICES_SRC ?= cc_basic_service.c cc_control_service.c
 
-SDK_SRC += $(MODEM_SRC) $(PROTOCOL_SRC) $(CLOUD_COMM_SRC) $(SERVICES_SRC)
+SDK_SRC += $(MODEM_SRC) $(PROTOCOL_SRC) $(CLOUD_COMM_SRC)
+# The offline store and the metrics registry serve the cloud_comm API, which
+# needs a protocol
+ifneq ($(PROTOCOL),NO_PROTOCOL)
+SDK_SRC += $(CC_STORE_SRC)
+SDK_SRC += $(CC_METRICS_SRC)
+else
+# Without the cloud_comm API nothing reads the metrics, compile the updates out
+CFLAGS_SDK += -DCC_NO_METRICS
+endif
+SDK_SRC += $(SERVICES_SRC)
 
 CFLAGS_SDK += $(MODEM_CFLAGS) $(PROTOCOL_CFLAGS)
 export CFLAGS_SDK
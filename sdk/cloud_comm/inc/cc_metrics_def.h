@@ -0,0 +1,47 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __CC_METRICS_DEF
+#define __CC_METRICS_DEF
+
+/*
+ * Updates of the metrics registry by the layers of the stack, see
+ * cc_metrics.h for the meaning of the metrics.
+ */
+
+#include "cc_metrics.h"
+#include "sys.h"
+
+#ifndef CC_NO_METRICS
+
+extern cc_metrics cc_metrics_reg;
+
+#define CC_METRIC_INC(name)		(cc_metrics_reg.name++)
+#define CC_METRIC_ADD(name, n)		(cc_metrics_reg.name += (uint32_t)(n))
+#define CC_METRIC_MAX(name, v) do { \
+	if ((uint32_t)(v) > cc_metrics_reg.name) \
+		cc_metrics_reg.name = (uint32_t)(v); \
+} while (0)
+
+/* Read a metric, e.g. to take the difference across an operation */
+#define CC_METRIC_GET(name)		(cc_metrics_reg.name)
+
+/* Time an operation: uint64_t t = CC_METRIC_TIME_BEGIN(); ...
+ * CC_METRIC_TIME_END(net_ms, t);
+ */
+#define CC_METRIC_TIME_BEGIN()		sys_get_tick_ms()
+#define CC_METRIC_ELAPSED(begin)	((uint32_t)(sys_get_tick_ms() - (begin)))
+#define CC_METRIC_TIME_END(name, begin)	CC_METRIC_ADD(name, CC_METRIC_ELAPSED(begin))
+
+#else
+
+#define CC_METRIC_INC(name)		((void)0)
+#define CC_METRIC_ADD(name, n)		((void)(n))
+#define CC_METRIC_MAX(name, v)		((void)(v))
+#define CC_METRIC_GET(name)		0
+#define CC_METRIC_TIME_BEGIN()		0
+#define CC_METRIC_ELAPSED(begin)	((void)(begin), 0)
+#define CC_METRIC_TIME_END(name, begin)	((void)(begin))
+
+#endif	/* CC_NO_METRICS */
+
+#endif
@@ -30,6 +30,14 @@ typedef sms_t at_msg_t;
 /* Callback that will be invoked when a URC is received */
 typedef void (*at_sms_cb)(const at_msg_t *sms_seg);
 
+/*
+ * Callback that picks where the data of a segment being received is decoded.
+ * Every field of the segment but the data is valid when it is invoked. It
+ * returns a buffer of at least sms_seg->len bytes, or NULL to decode into the
+ * buffer of the AT layer.
+ */
+typedef uint8_t *(*at_sms_buf_cb)(const at_msg_t *sms_seg);
+
 /*
  * Initialize the AT interface for sending and receiving SMS
  *
@@ -54,6 +62,23 @@ bool at_init(void);
  */
 bool at_sms_send(const at_msg_t *sms_seg);
 
+/*
+ * Send the segments of a concatenated message in order. The relay link to the
+ * SMSC is kept open from one segment to the next (AT+CMMS) and a segment that
+ * fails is retried on its own, without sending the others again.
+ *
+ * Parameters:
+ * 	sms_segs - Array of the segments to send
+ * 	num_segs - Number of segments in the array
+ * 	retries  - Number of times a failed segment is sent again
+ *
+ * Returns:
+ * 	True  - If every segment was sent successfully
+ * 	False - A segment could not be sent, the ones after it were not sent
+ */
+bool at_sms_send_multi(const at_msg_t *sms_segs, uint8_t num_segs,
+		uint8_t retries);
+
 /*
  * Set the receive callback that will be invoked when a SMS segment is received
  * in a URC.
@@ -66,6 +91,20 @@ bool at_sms_send(const at_msg_t *sms_seg);
  */
 void at_sms_set_rcv_cb(at_sms_cb cb);
 
+/*
+ * Set the callback that picks the buffer the data of a received SMS segment is
+ * decoded into, ahead of the receive callback being invoked with it. This
+ * avoids copying the data once it is received.
+ *
+ * Parameters:
+ * 	cb - Pointer to callback function, NULL to always use the buffer of the
+ * 	     AT layer
+ *
+ * Returns:
+ * 	None
+ */
+void at_sms_set_rcv_buf_cb(at_sms_buf_cb cb);
+
 /*
  * Send a RP-ACK acknowledging the message segment most recently received.
  *
@@ -47,12 +47,17 @@ bool at_init();
 
 /**
  * \brief       Initiate a tcp connection with host:port
+ * \details     Several connections may be open at the same time, up to a
+ *              limit set by the modem back-end. Each is addressed by the
+ *              socket id returned here in the calls below, and opening or
+ *              closing one does not disturb the others.
  *
  * \param[in] host    Host to connect to
  * \param[in] port    Port to connect to
  *
  * \return      socket or session id number if successful or
- *              AT_CONNECT_FAILED/AT_SOCKET_FAILED for failure
+ *              AT_CONNECT_FAILED/AT_SOCKET_FAILED for failure,
+ *              AT_SOCKET_FAILED also when all sockets are in use
  *
  */
 int at_tcp_connect(const char *host, const char *port);
@@ -81,6 +86,16 @@ int at_tcp_send(int s_id, const uint8_t *buf, size_t len);
  */
 int at_read_available(int s_id);
 
+/**
+ * \brief               Sleep until the modem reports received data or a
+ *                      connection closed by the remote side, on any socket
+ * \details             Returns early for events that happened since the last
+ *                      wait, so callers check at_read_available() again.
+ *
+ * \param[in] timeout_ms Maximum time to wait in milliseconds
+ */
+void at_tcp_wait_rx(uint32_t timeout_ms);
+
 /**
  * \brief          Read at most 'len' characters.
  *                 If no error occurs, the actual amount read is returned.
@@ -101,27 +116,6 @@ int at_tcp_recv(int s_id, uint8_t *buf, size_t len);
  * \param[in] s_id      socket or tcp session id to close to
  */
 void at_tcp_close(int s_id);
-
-/**
- * \brief Enter the modem's command mode
- * \details If the TCP connection is active in "online mode" / "direct link mode",
- * suspend the link (keeping the TCP connection alive) and enter the modem's
- * command mode
- *
- * \retval true Entered command mode successfully
- * \retval false Failed to enter command mode
- */
-bool at_tcp_enter_cmd_mode(void);
-
-/**
- * \brief Leave the modem's command mode
- * \details If a TCP connection is active and "online mode" / "direct link mode"
- * is suspended, resume it, leaving the modem's command mode.
- *
- * \retval true Left command mode successfully
- * \retval false Failed to leave command mode
- */
-bool at_tcp_leave_cmd_mode(void);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,36 @@
+/**
+ * \file net_poll.h
+ * \copyright Copyright (c) 2017 Verizon. All rights reserved.
+ * \brief Readiness hook for the network layer used by mbed TLS.
+ * \details Complements the mbedtls_net_* functions implemented by the
+ * net_mbedtls_*.c modules. Callers that drive a non-blocking connection can
+ * wait on it instead of retrying reads and writes in a tight loop.
+ */
+#ifndef NET_POLL_H
+#define NET_POLL_H
+
+#include <stdint.h>
+#include "mbedtls/net.h"
+
+/** Wait until data can be read from the connection */
+#define NET_POLL_READ		1
+/** Wait until data can be written to the connection */
+#define NET_POLL_WRITE		2
+
+/**
+ * \brief Wait until the connection is ready for reading and / or writing.
+ * \details May return early with the requested events set if the wait was
+ * interrupted, so callers must be prepared to see MBEDTLS_ERR_SSL_WANT_READ or
+ * MBEDTLS_ERR_SSL_WANT_WRITE again.
+ *
+ * \param[in] ctx Connection to wait on.
+ * \param[in] rw Bitwise OR of \ref NET_POLL_READ and \ref NET_POLL_WRITE.
+ * \param[in] timeout_ms Maximum time to wait in milliseconds.
+ *
+ * \returns Bitwise OR of the events that are ready, 0 on timeout or a negative
+ * mbed TLS error code (MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ * MBEDTLS_ERR_NET_RECV_FAILED) on failure.
+ */
+int net_poll(mbedtls_net_context *ctx, uint32_t rw, uint32_t timeout_ms);
+
+#endif
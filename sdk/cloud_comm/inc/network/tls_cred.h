@@ -0,0 +1,65 @@
+/**
+ * \file tls_cred.h
+ * \copyright Copyright (c) 2017 Verizon. All rights reserved.
+ * \brief Cache of the parsed credentials used by mbed TLS.
+ * \details Parsing a certificate or a private key costs several milliseconds
+ * of ASN.1 decoding on an MCU. The functions below keep the parsed objects and
+ * only parse again when they are handed credentials that differ from the ones
+ * they were parsed from, so setting the same credentials before every
+ * connection is cheap. Parsed objects are always allocated as persistent
+ * memory (see tls_mem.h).
+ */
+#ifndef TLS_CRED_H
+#define TLS_CRED_H
+
+#include <stdint.h>
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/** Outcome of loading a credential */
+typedef enum {
+	TLS_CRED_ERROR = -1,	/**< Parsing failed, nothing is loaded */
+	TLS_CRED_PARSED,	/**< New credential, it was parsed */
+	TLS_CRED_CACHED		/**< Same credential as before, nothing done */
+} tls_cred_result;
+
+/** Private key along with a digest of the buffer it was parsed from */
+typedef struct {
+	mbedtls_pk_context pk;
+	unsigned char digest[32];
+} tls_cred_key;
+
+/**
+ * \brief Load a DER encoded certificate.
+ * \details Unlike mbedtls_x509_crt_parse_der(), the certificate replaces the
+ * contents of 'crt' instead of being appended to it.
+ *
+ * \param[in,out] crt Initialized certificate chain.
+ * \param[in] der     DER encoded certificate.
+ * \param[in] len     Length of the certificate in bytes.
+ *
+ * \returns See \ref tls_cred_result.
+ */
+tls_cred_result tls_cred_load_crt(mbedtls_x509_crt *crt, const uint8_t *der,
+		uint32_t len);
+
+/** \brief Initialize a key before its first use. */
+void tls_cred_key_init(tls_cred_key *key);
+
+/**
+ * \brief Load a private key.
+ *
+ * \param[in,out] key Initialized key.
+ * \param[in] buf     PEM or DER encoded key, unencrypted.
+ * \param[in] len     Length of the key in bytes, including the terminating
+ *                    NUL for PEM.
+ *
+ * \returns See \ref tls_cred_result.
+ */
+tls_cred_result tls_cred_load_key(tls_cred_key *key, const uint8_t *buf,
+		uint32_t len);
+
+/** \brief Release a key, it must be initialized again before reuse. */
+void tls_cred_key_free(tls_cred_key *key);
+
+#endif
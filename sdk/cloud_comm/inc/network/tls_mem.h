@@ -0,0 +1,115 @@
+/**
+ * \file tls_mem.h
+ * \copyright Copyright (c) 2017 Verizon. All rights reserved.
+ * \brief Static arena backing the allocations made by mbed TLS.
+ * \details When the SDK is built with TLS_MEM_ARENA_SZ defined (the default on
+ * MCU targets, see protocol.mk), mbed TLS allocates from a statically sized
+ * arena instead of the C heap. Memory is handed out in size classes, so the
+ * cost of an allocation or a release is constant and does not depend on how
+ * fragmented the arena is.
+ *
+ * Allocations made while no connection is in progress (\ref TLS_MEM_IDLE),
+ * such as the RNG, the configuration and the parsed certificates, are
+ * persistent. Allocations made during a connection come from a separate region
+ * that \ref tls_mem_conn_reset releases in one step once the TLS context has
+ * been freed. Peak usage is recorded for every phase of the connection.
+ *
+ * Without TLS_MEM_ARENA_SZ mbed TLS uses the C heap, the functions below do
+ * nothing and no usage is recorded.
+ */
+#ifndef TLS_MEM_H
+#define TLS_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Phases of a TLS connection, as far as memory is concerned */
+typedef enum {
+	TLS_MEM_IDLE,		/**< No connection, allocations are persistent */
+	TLS_MEM_HANDSHAKE,	/**< TCP connect, TLS setup and handshake */
+	TLS_MEM_STEADY,		/**< Application data exchange */
+	TLS_MEM_CLOSE,		/**< Close notification and teardown */
+	TLS_MEM_NUM_PHASES
+} tls_mem_phase;
+
+/** Arena usage, all sizes in bytes */
+typedef struct {
+	size_t arena_sz;	/**< Size of the arena */
+	size_t in_use;		/**< Currently allocated, including headers */
+	size_t footprint;	/**< Carved out of the arena so far */
+	size_t peak_footprint;	/**< Highest footprint since the last reset */
+	/** Highest in_use seen during each phase since the last reset */
+	size_t peak[TLS_MEM_NUM_PHASES];
+	uint32_t failed;	/**< Allocations that could not be served */
+} tls_mem_stats;
+
+#ifdef TLS_MEM_ARENA_SZ
+
+/**
+ * \brief Route the allocations of mbed TLS to the arena.
+ * \details Must be called before any other mbed TLS function. Calling it
+ * again is harmless.
+ *
+ * \returns true on success, false otherwise.
+ */
+bool tls_mem_init(void);
+
+/**
+ * \brief Enter a new phase.
+ *
+ * \param[in] phase Phase that the following allocations belong to.
+ *
+ * \returns The phase that was current before the call, so that a caller can
+ * temporarily switch to \ref TLS_MEM_IDLE to keep data across connections.
+ */
+tls_mem_phase tls_mem_set_phase(tls_mem_phase phase);
+
+/**
+ * \brief Release every allocation made during the connection and return to
+ * \ref TLS_MEM_IDLE.
+ * \details Takes constant time. Must only be called after the TLS context
+ * of the connection has been freed, since nothing allocated during the
+ * connection may be used afterwards.
+ */
+void tls_mem_conn_reset(void);
+
+/**
+ * \brief Retrieve arena usage.
+ *
+ * \param[out] stats Where to store the usage.
+ */
+void tls_mem_get_stats(tls_mem_stats *stats);
+
+/** \brief Restart the peak figures from the current usage. */
+void tls_mem_reset_peaks(void);
+
+#else
+
+static inline bool tls_mem_init(void)
+{
+	return true;
+}
+
+static inline tls_mem_phase tls_mem_set_phase(tls_mem_phase phase)
+{
+	(void)phase;
+	return TLS_MEM_IDLE;
+}
+
+static inline void tls_mem_conn_reset(void)
+{
+}
+
+static inline void tls_mem_get_stats(tls_mem_stats *stats)
+{
+	*stats = (tls_mem_stats){ 0 };
+}
+
+static inline void tls_mem_reset_peaks(void)
+{
+}
+
+#endif	/* TLS_MEM_ARENA_SZ */
+
+#endif
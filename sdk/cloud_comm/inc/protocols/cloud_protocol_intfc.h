@@ -48,8 +48,8 @@
 #define PROTO_GET_POLLING() ott_get_polling_interval()
 #define PROTO_SET_POLLING(new_value) ott_set_polling_interval((new_value));
 
-#define PROTO_INITIATE_QUIT(send_nack) do { \
-        ott_initiate_quit((send_nack)); \
+#define PROTO_END_CYCLE(next_call_ms) do { \
+        (next_call_ms) = ott_end_cycle((next_call_ms)); \
 } while(0)
 
 #define PROTO_SEND_MSG_TO_CLOUD(msg, sz, svc_id, cb, data) do {		\
@@ -77,6 +77,12 @@
 		} \
 } while(0)
 
+/* Bytes of proto_data kept with a stored message */
+#define PROTO_SEND_DATA_LEN(data) ((void)(data), 0)
+
+/* The outcome of every message is reported before the send routine returns */
+#define PROTO_SEND_IN_FLIGHT(cb) ((void)(cb), 0)
+
 #define PROTO_SEND_ACK() ott_send_ack()
 #define PROTO_SEND_NACK() ott_send_nack()
 
@@ -85,6 +91,11 @@
                 return CC_RECV_FAILED; \
 } while(0)
 
+/* Topic routing is specific to MQTT, no route is accepted */
+#define PROTO_ADD_TOPIC_ROUTE(filter, buf, sz, cb, ctx) \
+        ((void)(filter), (void)(buf), (void)(sz), (void)(cb), (void)(ctx), \
+         PROTO_INV_PARAM)
+
 #define PROTO_MAINTENANCE(poll_due, cur_ts) do { \
         (void)(cur_ts); \
         ott_maintenance((poll_due)); \
@@ -107,7 +118,7 @@
 
 #define PROTO_GET_POLLING() smsnas_get_polling_interval()
 
-#define PROTO_INITIATE_QUIT(send_nack)
+#define PROTO_END_CYCLE(next_call_ms) (void)(next_call_ms)
 
 #define PROTO_SEND_MSG_TO_CLOUD(msg, sz, svc_id, cb, data) do {		\
                 (void)data; \
@@ -134,6 +145,12 @@
                 } \
 } while(0)
 
+/* Bytes of proto_data kept with a stored message */
+#define PROTO_SEND_DATA_LEN(data) ((void)(data), 0)
+
+/* The outcome of every message is reported before the send routine returns */
+#define PROTO_SEND_IN_FLIGHT(cb) ((void)(cb), 0)
+
 #define PROTO_SEND_ACK() smsnas_send_ack()
 #define PROTO_SEND_NACK() smsnas_send_nack()
 
@@ -142,6 +159,11 @@
                 return CC_RECV_FAILED; \
 } while(0)
 
+/* Topic routing is specific to MQTT, no route is accepted */
+#define PROTO_ADD_TOPIC_ROUTE(filter, buf, sz, cb, ctx) \
+        ((void)(filter), (void)(buf), (void)(sz), (void)(cb), (void)(ctx), \
+         PROTO_INV_PARAM)
+
 #define PROTO_MAINTENANCE(poll_due, cur_ts) do { \
         smsnas_maintenance((poll_due), (cur_ts)); \
 } while(0)
@@ -187,7 +209,7 @@
 #define PROTO_GET_POLLING() mqtt_get_polling_interval()
 #define PROTO_SET_POLLING(new_value) (void)((new_value))
 
-#define PROTO_INITIATE_QUIT(send_nack)
+#define PROTO_END_CYCLE(next_call_ms) (void)(next_call_ms)
 
 #define PROTO_SEND_MSG_TO_CLOUD(msg, sz, svc_id, cb, topic) do {		\
 		if (mqtt_send_msg_to_cloud((msg), (sz), (svc_id), \
@@ -213,6 +235,13 @@
                 } \
 } while(0)
 
+/* Bytes of proto_data, the publish topic, kept with a stored message */
+#define PROTO_SEND_DATA_LEN(topic) \
+        ((topic) ? strlen((const char *)(topic)) + 1 : 0)
+
+/* Publishes awaiting acknowledgement report their outcome later */
+#define PROTO_SEND_IN_FLIGHT(cb) mqtt_send_in_flight((cb))
+
 #define PROTO_SEND_ACK()
 #define PROTO_SEND_NACK()
 
@@ -221,6 +250,13 @@
                 return CC_RECV_FAILED; \
 } while(0)
 
+/*
+ * PROTO_ERROR means the route was added but its subscription failed; it is
+ * subscribed again on the next connect
+ */
+#define PROTO_ADD_TOPIC_ROUTE(filter, buf, sz, cb, ctx) \
+        mqtt_add_route((filter), (buf), (sz), (cb), (ctx))
+
 #define PROTO_MAINTENANCE(poll_due, cur_ts) do { \
         (void)(poll_due); \
         mqtt_maintenance(cur_ts); \
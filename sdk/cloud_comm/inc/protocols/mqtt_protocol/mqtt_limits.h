@@ -19,4 +19,7 @@
 #define PROTO_MAX_SEND_BUF_SZ           PROTO_DATA_SZ
 #define PROTO_MAX_RECV_BUF_SZ           PROTO_DATA_SZ
 
+/* Largest publish topic passed as proto_data, including the terminator */
+#define PROTO_SEND_DATA_SZ              100
+
 #endif
@@ -101,6 +101,38 @@ proto_result mqtt_set_destination(const char *dest);
 proto_result mqtt_set_recv_buffer_cb(void *rcv_buf, uint32_t sz,
 				proto_callback rcv_cb);
 
+/*
+ * Callback invoked when a message arrives on a topic routed through
+ * mqtt_add_route().
+ * Parameters:
+ *	ctx   : Context given to mqtt_add_route().
+ *	sz    : Size of the message, which was copied into the route's buffer.
+ *	event : PROTO_RCVD_MSG, or PROTO_RCVD_MEM_OVRFL if the message did not
+ *	        fit and was dropped.
+ */
+typedef void (*mqtt_route_callback)(void *ctx, uint32_t sz, proto_event event);
+
+/*
+ * Subscribe to a topic filter and deliver the messages received on matching
+ * topics to a buffer and callback of their own instead of the receive buffer.
+ * Messages on the command topic always go to the receive buffer.
+ * Parameters:
+ *	filter  : NULL terminated topic filter, may contain the "+" and "#"
+ *	          wildcards. It is not copied and must remain valid.
+ *	rcv_buf : Buffer receiving the messages of this route.
+ *	sz      : Size of rcv_buf.
+ *	cb      : Callback invoked for every message of this route.
+ *	ctx     : Passed to cb.
+ * Returns:
+ * 	PROTO_OK        : Route was added, or updated if the filter was added
+ * 	                  before.
+ * 	PROTO_INV_PARAM : Invalid filter or parameters, or no room left.
+ * 	PROTO_ERROR     : The subscription failed. The route is kept and
+ * 	                  subscribed to again on the next connection.
+ */
+proto_result mqtt_add_route(const char *filter, void *rcv_buf, uint32_t sz,
+		mqtt_route_callback cb, void *ctx);
+
 /*
  * Sends a message to the cloud service and to command response topic.
  * This call is blocking in nature.
@@ -157,6 +189,20 @@ proto_result mqtt_send_status_msg_to_cloud(const void *buf, uint32_t sz,
  */
 proto_result mqtt_send_diag_msg_to_cloud(const void *buf, uint32_t sz, proto_callback cb);
 
+/*
+ * Tells whether the message just sent awaits its acknowledgement. Its outcome
+ * is then reported later through 'cb', PROTO_RCVD_ACK or PROTO_SEND_TIMEOUT
+ * along with its MQTT packet ID.
+ *
+ * Parameters:
+ *	cb     : Callback to report the outcome of the message to.
+ *
+ * Returns:
+ * 	Packet ID of the message if its outcome is still to be reported, 0
+ * 	otherwise.
+ */
+uint16_t mqtt_send_in_flight(proto_in_flight_callback cb);
+
 /*
  * Maintenance of the protocol which can be used to complete any
  * pending internal protocol activities before upper level possibly Application
@@ -142,6 +142,21 @@ proto_result ott_send_msg_to_cloud(const void *buf, uint32_t sz,
  */
 void ott_maintenance(bool poll_due);
 
+/*
+ * End of a service cycle. Closes the connection to the cloud unless the
+ * persistent session mode (OTT_PERSISTENT_SESSION) is enabled, in which case
+ * the connection is kept open for the next cycle.
+ *
+ * Parameters:
+ *	next_call_ms : Time in miliseconds until the next service cycle is
+ *	               planned, 0 if none is required.
+ *
+ * Returns:
+ *	Time in miliseconds until ott_maintenance() must be called next. This is
+ *	shorter than next_call_ms when a keepalive is due earlier.
+ */
+uint32_t ott_end_cycle(uint32_t next_call_ms);
+
 /*
  * Send a QUIT or NACK + QUIT and then close the connection and reset the state
  *
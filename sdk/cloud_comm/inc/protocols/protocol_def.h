@@ -66,49 +66,30 @@ typedef void (*proto_callback)(const void *buf, uint32_t sz,
 			       proto_event event, proto_service_id svc_id);
 
 /*
- * Define this to profile function execution time
- *
+ * Pointer to a callback routine reporting the outcome of a message the
+ * protocol kept in flight, identified by the non-zero id it was given.
  */
-/*#define PROTO_TIME_PROFILE*/
+typedef void (*proto_in_flight_callback)(uint16_t id, proto_event event);
 
 /*
- * Define this to explicitly show the time it takes to connect to the network /
- * send / receive data over the network.
- * PROTO_TIME_PROFILE must be defined for this to work.
+ * Define this to profile function execution time
+ *
  */
-/*#define PROTO_EXPLICIT_NETWORK_TIME*/
+/*#define PROTO_TIME_PROFILE*/
 
 
 #ifdef PROTO_TIME_PROFILE
-#ifdef PROTO_EXPLICIT_NETWORK_TIME
-
-extern uint32_t network_time_ms;
-extern uint32_t net_read_time;
-extern uint32_t net_write_time;
-
-#define PROTO_TIME_PROFILE_BEGIN() do { \
-	proto_begin = sys_get_tick_ms(); \
-	network_time_ms = 0; \
-	net_read_time = 0; \
-	net_write_time = 0; \
-} while(0)
-
-#define PROTO_TIME_PROFILE_END(label) do { \
-	dbg_printf("["label":%"PRIu32"]", (uint32_t)(sys_get_tick_ms() - proto_begin)); \
-	dbg_printf(" [NETW:%"PRIu32"~R%"PRIu32"+W%"PRIu32"]\n", network_time_ms, \
-			net_read_time, net_write_time); \
-} while(0)
-
-#else
 
+/*
+ * The share of the time spent in the network and on AT commands is in the
+ * proto_ms / net_ms / at_ms metrics, see cc_metrics.h.
+ */
 #define PROTO_TIME_PROFILE_BEGIN() \
 	proto_begin = sys_get_tick_ms()
 
 #define PROTO_TIME_PROFILE_END(label) \
 	dbg_printf("["label":%"PRIu32"]\n", (uint32_t)(sys_get_tick_ms() - proto_begin))
 
-#endif	/* PROTO_EXPLICIT_NETWORK_TIME */
-
 #else
 
 #define PROTO_TIME_PROFILE_BEGIN()
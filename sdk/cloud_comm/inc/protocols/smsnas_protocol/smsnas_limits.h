@@ -18,4 +18,7 @@
 #define PROTO_MAX_SEND_BUF_SZ           PROTO_DATA_SZ
 #define PROTO_MAX_RECV_BUF_SZ           PROTO_DATA_SZ
 
+/* proto_data is not used */
+#define PROTO_SEND_DATA_SZ              0
+
 #endif
@@ -43,7 +43,9 @@ proto_result smsnas_set_destination(const char *host);
 
 /*
  * Setting receiving buffer where all the incoming data will be stored and
- * callback to indicate received data to upper level
+ * callback to indicate received data to upper level. A single sms is decoded
+ * straight into the buffer, its content is undefined until the callback is
+ * invoked.
  * Parameters:
  * 	rcv_buf : Pointer to a buffer.
  * 	sz : Size of buffer.
@@ -74,12 +76,12 @@ proto_result smsnas_send_msg_to_cloud(const void *buf, proto_pl_sz sz,
                                 proto_service_id svc_id, proto_callback cb);
 
 /*
- * Maintenance of the protocol, Processes pending ack/nack and also calling
- * receive timeout event in case case of concatenated sms did not receive its
- * next segment in a due time
+ * Maintenance of the protocol, Processes pending ack/nack and also discards
+ * every concatenated sms that did not receive its next segment in a due time
  * Parameters:
  *	poll_due      : True if polling is due to check if concatenated sms's
- *			 next segement has arrived or not.
+ *			 next segement has arrived or not. Unused, each
+ *			 concatenated sms keeps its own timeout.
  *	cur_timestamp : current time stamp in milliseconds to check if
  *		        next segement of the concatenated message is processed.
  */
@@ -16,6 +16,7 @@ PROTOCOL_INC_DIR = smsnas_protocol
 else ifeq ($(PROTOCOL),MQTT_PROTOCOL)
 PROTOCOL_SRC = mqtt_protocol.c
 PROTOCOL_SRC += mqtt_timer_utils.c
+PROTOCOL_SRC += mqtt_route.c
 PROTOCOL_DIR = mqtt_protocol
 PROTOCOL_INC_DIR = mqtt_protocol
 
@@ -48,6 +49,20 @@ endif
 VENDOR_INC += -DMBEDTLS_CONFIG_FILE="\"mbedtls/config_$(DEV_BOARD_MOD).h\""
 VENDOR_LIB_DIRS += mbedtls
 VENDOR_LIB_FLAGS += -L. -lmbedtls -lmbedx509 -lmbedcrypto
+
+# On MCU targets mbed TLS allocates from a static arena instead of the heap,
+# see tls_mem.h. TLS_MEM_ARENA_SZ sizes it in bytes, 0 selects the heap.
+ifeq ($(DEV_BOARD),$(filter $(DEV_BOARD),raspberry_pi3 virtual))
+TLS_MEM_ARENA_SZ ?= 0
+else
+TLS_MEM_ARENA_SZ ?= 40960
+endif
+PROTOCOL_SRC += tls_mem.c
+# Parsed certificates and keys are kept across cc_set_*_credentials() calls
+PROTOCOL_SRC += tls_cred.c
+ifneq ($(TLS_MEM_ARENA_SZ),0)
+PROTOCOL_CFLAGS += -DTLS_MEM_ARENA_SZ=$(TLS_MEM_ARENA_SZ)
+endif
 endif
 
 # MQTT requires the Paho MQTT library. It uses -isystem instead of -I to avoid
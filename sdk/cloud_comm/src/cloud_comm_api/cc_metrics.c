@@ -0,0 +1,26 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include "cc_metrics_def.h"
+
+#ifndef CC_NO_METRICS
+cc_metrics cc_metrics_reg;
+#endif
+
+void cc_get_metrics(cc_metrics *m)
+{
+	if (!m)
+		return;
+#ifndef CC_NO_METRICS
+	*m = cc_metrics_reg;
+#else
+	memset(m, 0, sizeof(*m));
+#endif
+}
+
+void cc_reset_metrics(void)
+{
+#ifndef CC_NO_METRICS
+	memset(&cc_metrics_reg, 0, sizeof(cc_metrics_reg));
+#endif
+}
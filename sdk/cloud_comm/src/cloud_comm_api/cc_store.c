@@ -0,0 +1,279 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <stddef.h>
+#include <string.h>
+#include "cc_store.h"
+
+/*
+ * Each slot holds a header, the protocol specific data and the message, each
+ * of them starting on an 8 byte boundary so that flash memories programmed by
+ * double words can write them separately. A record is valid once its header
+ * was written. Records are numbered in the order they were stored; the
+ * sequence number of a slot also tells whether it is free.
+ */
+#define REC_ERASED	0xFFFFFFFF	/* Never written since the last erase */
+#define REC_CLEARED	0		/* Record was removed */
+
+#define DATA_OFF	CC_STORE_HDR_SZ
+#define MSG_OFF		(CC_STORE_HDR_SZ + CC_STORE_DATA_AREA_SZ)
+
+typedef struct {
+	uint32_t seq;
+	uint32_t check;			/* Covers everything that follows */
+	uint16_t msg_sz;
+	uint16_t data_sz;
+	uint8_t svc_id;
+	uint8_t kind;
+	uint16_t rsvd;
+} rec_hdr;
+
+__compile_time_assert(sizeof(rec_hdr) == CC_STORE_HDR_SZ,
+		rec_hdr_does_not_match_CC_STORE_HDR_SZ_on_line);
+
+static struct {
+	const cc_store_backend *be;
+	cc_store_policy policy;
+	uint16_t slots;
+	uint16_t head;			/* Slot of the oldest record */
+	uint16_t count;			/* Slots from the head to the newest
+					 * record, removed ones included */
+	uint16_t next;			/* Slot the next record goes to */
+	uint32_t seq;			/* Sequence number of the next record */
+} store;
+
+static inline uint32_t slot_off(uint16_t slot)
+{
+	return (uint32_t)slot * CC_STORE_SLOT_SZ;
+}
+
+/* FNV-1a */
+static uint32_t check_update(uint32_t c, const void *p, uint32_t sz)
+{
+	const uint8_t *b = p;
+	while (sz--) {
+		c ^= *b++;
+		c *= 16777619;
+	}
+	return c;
+}
+
+static uint32_t hdr_check(const rec_hdr *h)
+{
+	return check_update(2166136261u ^ h->seq, &h->msg_sz,
+			sizeof(*h) - offsetof(rec_hdr, msg_sz));
+}
+
+static bool hdr_is_sane(const rec_hdr *h, uint16_t msg_max)
+{
+	return h->seq != REC_ERASED && h->seq != REC_CLEARED &&
+		h->data_sz <= PROTO_SEND_DATA_SZ && h->msg_sz <= msg_max;
+}
+
+/* Check the body of a record against its header, reading it piecewise */
+static bool rec_is_intact(uint16_t slot, const rec_hdr *h)
+{
+	if (!hdr_is_sane(h, CC_MAX_SEND_BUF_SZ))
+		return false;
+
+	uint8_t chunk[32];
+	uint32_t c = hdr_check(h);
+	uint32_t off[2] = {slot_off(slot) + DATA_OFF, slot_off(slot) + MSG_OFF};
+	uint16_t left[2] = {h->data_sz, h->msg_sz};
+	for (uint8_t i = 0; i < 2; i++) {
+		while (left[i] > 0) {
+			uint16_t n = left[i] < sizeof(chunk) ?
+				left[i] : sizeof(chunk);
+			if (!store.be->read(off[i], chunk, n))
+				return false;
+			c = check_update(c, chunk, n);
+			off[i] += n;
+			left[i] -= n;
+		}
+	}
+	return c == h->check;
+}
+
+static bool clear_slot(uint16_t slot)
+{
+	static const uint8_t zero[8];
+	return store.be->write(slot_off(slot), zero, sizeof(zero));
+}
+
+static bool is_full(void)
+{
+	if (store.be->rewritable)
+		return store.count == store.slots;
+	return store.next == store.slots;
+}
+
+bool cc_store_open(const cc_store_backend *be, cc_store_policy policy)
+{
+	uint32_t size;
+	memset(&store, 0, sizeof(store));
+	if (!be || !be->init(&size))
+		return false;
+	uint32_t slots = size / CC_STORE_SLOT_SZ;
+	if (slots == 0)
+		return false;
+	if (slots > UINT16_MAX)
+		slots = UINT16_MAX;
+
+	store.be = be;
+	store.policy = policy;
+	store.slots = slots;
+	store.seq = 1;
+
+	uint32_t first = REC_ERASED;
+	uint32_t last = REC_CLEARED;
+	uint16_t tail = 0;
+	uint16_t used = 0;
+	for (uint16_t i = 0; i < slots; i++) {
+		rec_hdr h;
+		if (!be->read(slot_off(i), &h, sizeof(h)))
+			goto error;
+		if (h.seq != REC_ERASED)
+			used = i + 1;
+		if (!rec_is_intact(i, &h))
+			continue;
+		if (h.seq < first) {
+			first = h.seq;
+			store.head = i;
+		}
+		if (h.seq >= last) {
+			last = h.seq;
+			tail = i;
+		}
+	}
+
+	if (last == REC_CLEARED) {
+		/* Nothing stored, start over from an erased area */
+		store.head = 0;
+		if (used > 0 && !be->erase())
+			goto error;
+		return true;
+	}
+
+	store.count = (tail + slots - store.head) % slots + 1;
+	store.next = be->rewritable ? (tail + 1) % slots : used;
+	store.seq = last + 1;
+
+	/* Remove what a reset interrupted in the middle of being written */
+	uint16_t slot = store.head;
+	for (uint16_t n = 0; n < store.count; n++) {
+		rec_hdr h;
+		if (!be->read(slot_off(slot), &h, sizeof(h)))
+			goto error;
+		if (h.seq != REC_CLEARED && !rec_is_intact(slot, &h))
+			clear_slot(slot);
+		slot = (slot + 1) % slots;
+	}
+	return true;
+
+error:
+	store.be = NULL;
+	return false;
+}
+
+bool cc_store_push(const cc_store_rec *rec, const void *data, const void *msg)
+{
+	if (!store.be || rec->data_sz > PROTO_SEND_DATA_SZ ||
+			rec->msg_sz > CC_MAX_SEND_BUF_SZ)
+		return false;
+
+	if (is_full()) {
+		/* Sequentially written storage can only make room by an erase */
+		if (store.policy == CC_STORE_DROP_NEWEST ||
+				!store.be->rewritable)
+			return false;
+		cc_store_pop();
+	}
+
+	rec_hdr h = {
+		.seq = store.seq,
+		.msg_sz = rec->msg_sz,
+		.data_sz = rec->data_sz,
+		.svc_id = rec->svc_id,
+		.kind = rec->kind,
+		.rsvd = 0
+	};
+	h.check = check_update(hdr_check(&h), data, rec->data_sz);
+	h.check = check_update(h.check, msg, rec->msg_sz);
+
+	/* The header goes last so that an interrupted write leaves no record */
+	uint32_t off = slot_off(store.next);
+	bool ok = rec->data_sz == 0 ||
+		store.be->write(off + DATA_OFF, data, rec->data_sz);
+	ok = ok && store.be->write(off + MSG_OFF, msg, rec->msg_sz);
+	ok = ok && store.be->write(off, &h, sizeof(h));
+	if (!ok && store.be->rewritable)
+		return false;
+
+	/*
+	 * A slot of sequentially written storage that failed to be written is
+	 * skipped and left in the ring as a removed record.
+	 */
+	if (store.count == 0)
+		store.head = store.next;
+	store.count = (store.next + store.slots - store.head) % store.slots + 1;
+	if (store.be->rewritable)
+		store.next = (store.next + 1) % store.slots;
+	else
+		store.next++;
+	if (!ok) {
+		clear_slot(off / CC_STORE_SLOT_SZ);
+		return false;
+	}
+	store.seq++;
+	return true;
+}
+
+bool cc_store_peek(cc_store_rec *rec, void *data, void *msg, uint16_t msg_max)
+{
+	while (store.count > 0) {
+		rec_hdr h;
+		uint32_t off = slot_off(store.head);
+		if (!store.be->read(off, &h, sizeof(h)))
+			return false;
+		if (hdr_is_sane(&h, msg_max)) {
+			if (h.data_sz > 0 &&
+				!store.be->read(off + DATA_OFF, data, h.data_sz))
+				return false;
+			if (!store.be->read(off + MSG_OFF, msg, h.msg_sz))
+				return false;
+			uint32_t c = check_update(hdr_check(&h), data,
+					h.data_sz);
+			if (check_update(c, msg, h.msg_sz) == h.check) {
+				rec->svc_id = h.svc_id;
+				rec->kind = h.kind;
+				rec->data_sz = h.data_sz;
+				rec->msg_sz = h.msg_sz;
+				return true;
+			}
+		}
+		/* Removed, damaged or too large to be sent; skip it */
+		cc_store_pop();
+	}
+	return false;
+}
+
+void cc_store_pop(void)
+{
+	if (store.count == 0)
+		return;
+	clear_slot(store.head);
+	store.head = (store.head + 1) % store.slots;
+	store.count--;
+	if (store.count > 0 || store.be->rewritable)
+		return;
+
+	/* Everything was sent, make the whole area writable again */
+	if (store.be->erase()) {
+		store.head = 0;
+		store.next = 0;
+	}
+}
+
+uint16_t cc_store_len(void)
+{
+	return store.count;
+}
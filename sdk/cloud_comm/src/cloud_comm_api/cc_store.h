@@ -0,0 +1,47 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __CC_STORE
+#define __CC_STORE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cloud_comm.h"
+
+/*
+ * Ring of messages kept in a storage backend, one per fixed size slot, for
+ * the offline store of cloud_comm.c. See cc_enable_offline_store().
+ */
+
+typedef struct {
+	cc_service_id svc_id;
+	uint8_t kind;			/* cc_msg_kind of the message */
+	uint16_t data_sz;		/* Bytes of protocol specific data */
+	uint16_t msg_sz;		/* Bytes of the message */
+} cc_store_rec;
+
+/*
+ * Find the messages already present in the storage. Return false if the
+ * storage is unusable.
+ */
+bool cc_store_open(const cc_store_backend *be, cc_store_policy policy);
+
+/*
+ * Append a message after the newest one, dropping the oldest one first if the
+ * storage is full and the policy says so. Return false if the message was not
+ * stored.
+ */
+bool cc_store_push(const cc_store_rec *rec, const void *data, const void *msg);
+
+/*
+ * Retrieve the oldest message without removing it. 'data' must have room for
+ * PROTO_SEND_DATA_SZ bytes. Return false if there is none.
+ */
+bool cc_store_peek(cc_store_rec *rec, void *data, void *msg, uint16_t msg_max);
+
+/* Remove the oldest message */
+void cc_store_pop(void);
+
+/* Number of stored messages */
+uint16_t cc_store_len(void);
+
+#endif
@@ -0,0 +1,72 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/* For fileno(), fsync() and ftruncate() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cloud_comm.h"
+
+/* File holding the offline store and the number of messages it can hold */
+#ifndef CC_STORE_FILE_PATH
+#define CC_STORE_FILE_PATH	"cc_offline_store.bin"
+#endif
+#ifndef CC_STORE_FILE_MSGS
+#define CC_STORE_FILE_MSGS	64
+#endif
+
+#define AREA_SZ		((uint32_t)CC_STORE_FILE_MSGS * CC_STORE_SLOT_SZ)
+
+static FILE *fp;
+
+static bool in_area(uint32_t off, uint32_t len)
+{
+	return len <= AREA_SZ && off <= AREA_SZ - len;
+}
+
+static bool file_init(uint32_t *size)
+{
+	if (!fp)
+		fp = fopen(CC_STORE_FILE_PATH, "r+b");
+	if (!fp)
+		fp = fopen(CC_STORE_FILE_PATH, "w+b");
+	if (!fp)
+		return false;
+	*size = AREA_SZ;
+	return true;
+}
+
+/* The area past the end of the file reads as erased */
+static bool file_read(uint32_t off, void *dst, uint32_t len)
+{
+	if (!in_area(off, len) || fseek(fp, off, SEEK_SET) != 0)
+		return false;
+	size_t n = fread(dst, 1, len, fp);
+	if (ferror(fp)) {
+		clearerr(fp);
+		return false;
+	}
+	memset((uint8_t *)dst + n, 0xFF, len - n);
+	return true;
+}
+
+static bool file_write(uint32_t off, const void *src, uint32_t len)
+{
+	if (!in_area(off, len) || fseek(fp, off, SEEK_SET) != 0)
+		return false;
+	if (fwrite(src, 1, len, fp) != len) {
+		clearerr(fp);
+		return false;
+	}
+	return fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+}
+
+static bool file_erase(void)
+{
+	return fflush(fp) == 0 && ftruncate(fileno(fp), 0) == 0;
+}
+
+const cc_store_backend cc_store_file_backend = {
+	file_init, file_read, file_write, file_erase, true
+};
@@ -0,0 +1,10 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include "cloud_comm.h"
+#include "flash_hal.h"
+
+/* The flash data area is programmed sequentially and erased as a whole */
+const cc_store_backend cc_store_flash_backend = {
+	flash_data_init, flash_data_read, flash_data_write, flash_data_erase,
+	false
+};
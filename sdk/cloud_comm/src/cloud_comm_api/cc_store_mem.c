@@ -0,0 +1,48 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include "cloud_comm.h"
+
+/* Number of messages the RAM backend of the offline store can hold */
+#ifndef CC_STORE_MEM_MSGS
+#define CC_STORE_MEM_MSGS	4
+#endif
+
+static uint8_t area[CC_STORE_MEM_MSGS * CC_STORE_SLOT_SZ];
+
+static bool in_area(uint32_t off, uint32_t len)
+{
+	return len <= sizeof(area) && off <= sizeof(area) - len;
+}
+
+static bool mem_init(uint32_t *size)
+{
+	*size = sizeof(area);
+	return true;
+}
+
+static bool mem_read(uint32_t off, void *dst, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+	memcpy(dst, area + off, len);
+	return true;
+}
+
+static bool mem_write(uint32_t off, const void *src, uint32_t len)
+{
+	if (!in_area(off, len))
+		return false;
+	memcpy(area + off, src, len);
+	return true;
+}
+
+static bool mem_erase(void)
+{
+	memset(area, 0xFF, sizeof(area));
+	return true;
+}
+
+const cc_store_backend cc_store_mem_backend = {
+	mem_init, mem_read, mem_write, mem_erase, true
+};
@@ -0,0 +1,172 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include "cc_telemetry.h"
+
+/*
+ * Running out of buffer space is not fatal to tinycbor: encoding continues
+ * without writing so that the number of missing bytes can be reported. Any
+ * other error stops the encoder.
+ */
+static bool can_encode(const cc_telemetry *t)
+{
+	return t && t->start &&
+		(t->err == CborNoError || t->err == CborErrorOutOfMemory);
+}
+
+static bool record(cc_telemetry *t, CborError err)
+{
+	if (err != CborNoError && t->err == CborNoError)
+		t->err = err;
+	else if (err != CborNoError && err != CborErrorOutOfMemory)
+		t->err = err;
+	return t->err == CborNoError;
+}
+
+/* Encode the key of a record; array elements have none */
+static bool begin_record(cc_telemetry *t, const char *key)
+{
+	/* Nothing may be added once the top level map is closed */
+	if (!can_encode(t) || t->depth == 0)
+		return false;
+	if (t->is_array[t->depth] != (key == NULL))
+		return record(t, CborErrorIllegalType);
+	if (key == NULL)
+		return true;
+	return record(t, cbor_encode_text_stringz(&t->enc[t->depth], key)) ||
+		t->err == CborErrorOutOfMemory;
+}
+
+#define ADD_RECORD(t, key, encode)	do { \
+	if (!begin_record((t), (key))) \
+		return false; \
+	return record((t), (encode)); \
+} while (0)
+
+bool cc_telemetry_begin(cc_telemetry *t, cc_buffer_desc *buf,
+			cc_service_id svc_id)
+{
+	if (!t)
+		return false;
+	memset(t, 0, sizeof(*t));
+	uint8_t *start = cc_get_send_buffer_ptr(buf, svc_id);
+	if (!start)
+		return false;
+	size_t offset = start - (uint8_t *)buf->buf_ptr;
+	if (offset >= buf->bufsz)
+		return false;
+
+	t->start = start;
+	cbor_encoder_init(&t->enc[0], start, buf->bufsz - offset, 0);
+	/* The number of records isn't known up front */
+	t->depth = 1;
+	t->is_array[1] = false;
+	return record(t, cbor_encoder_create_map(&t->enc[0], &t->enc[1],
+				CborIndefiniteLength));
+}
+
+bool cc_telemetry_add_int(cc_telemetry *t, const char *key, int64_t val)
+{
+	ADD_RECORD(t, key, cbor_encode_int(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_uint(cc_telemetry *t, const char *key, uint64_t val)
+{
+	ADD_RECORD(t, key, cbor_encode_uint(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_float(cc_telemetry *t, const char *key, float val)
+{
+	ADD_RECORD(t, key, cbor_encode_float(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_double(cc_telemetry *t, const char *key, double val)
+{
+	ADD_RECORD(t, key, cbor_encode_double(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_bool(cc_telemetry *t, const char *key, bool val)
+{
+	ADD_RECORD(t, key, cbor_encode_boolean(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_str(cc_telemetry *t, const char *key, const char *val)
+{
+	if (!val)
+		return false;
+	ADD_RECORD(t, key, cbor_encode_text_stringz(&t->enc[t->depth], val));
+}
+
+bool cc_telemetry_add_bytes(cc_telemetry *t, const char *key,
+			    const uint8_t *val, size_t len)
+{
+	if (!val && len > 0)
+		return false;
+	ADD_RECORD(t, key,
+		cbor_encode_byte_string(&t->enc[t->depth], val, len));
+}
+
+static bool open_container(cc_telemetry *t, const char *key, bool is_array)
+{
+	if (!begin_record(t, key))
+		return false;
+	if (t->depth >= CC_TELEMETRY_MAX_DEPTH)
+		return record(t, CborErrorNestingTooDeep);
+
+	CborEncoder *parent = &t->enc[t->depth];
+	CborEncoder *child = &t->enc[t->depth + 1];
+	CborError err = is_array ?
+		cbor_encoder_create_array(parent, child, CborIndefiniteLength) :
+		cbor_encoder_create_map(parent, child, CborIndefiniteLength);
+	t->depth++;
+	t->is_array[t->depth] = is_array;
+	return record(t, err);
+}
+
+bool cc_telemetry_open_map(cc_telemetry *t, const char *key)
+{
+	return open_container(t, key, false);
+}
+
+bool cc_telemetry_open_array(cc_telemetry *t, const char *key)
+{
+	return open_container(t, key, true);
+}
+
+static bool close_container(cc_telemetry *t)
+{
+	CborError err = cbor_encoder_close_container(&t->enc[t->depth - 1],
+			&t->enc[t->depth]);
+	t->depth--;
+	return record(t, err);
+}
+
+bool cc_telemetry_close(cc_telemetry *t)
+{
+	/* The top level map is closed by cc_telemetry_end() */
+	if (!can_encode(t) || t->depth <= 1)
+		return false;
+	return close_container(t);
+}
+
+cc_data_sz cc_telemetry_end(cc_telemetry *t)
+{
+	if (!can_encode(t))
+		return 0;
+	while (t->depth > 0)
+		close_container(t);
+	if (t->err != CborNoError)
+		return 0;
+	return cbor_encoder_get_buffer_size(&t->enc[0], t->start);
+}
+
+size_t cc_telemetry_bytes_short(const cc_telemetry *t)
+{
+	if (!t || !t->start)
+		return 0;
+	/*
+	 * Only the encoder of the innermost container tracks the shortfall
+	 * until the container is closed.
+	 */
+	return cbor_encoder_get_extra_bytes_needed(&t->enc[t->depth]);
+}
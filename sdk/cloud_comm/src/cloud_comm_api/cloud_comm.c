@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include "sys.h"
 #include "cloud_comm_def.h"
+#include "cc_store.h"
+#include "cc_metrics_def.h"
 #include "cloud_protocol_intfc.h"
 #include "service_common.h"
 #include "cc_control_service.h"
@@ -23,13 +25,24 @@ static service_dispatch_entry service_table[2];
 static void dispatch_event_to_service(cc_service_id svc_id, cc_buffer_desc *buf,
 				      cc_event event);
 static service_dispatch_entry *lookup_service(cc_service_id svc_id);
-static cc_set_recv_result activate_buffer_for_recv(cc_buffer_desc *buf);
+static cc_set_recv_result activate_buffer_for_recv(cc_buffer_desc *buf,
+						    uint32_t used);
+static bool store_msg(const void *msg, uint32_t sz, cc_service_id svc_id,
+		      cc_msg_kind kind, void *proto_data);
+static bool push_msg(const void *msg, uint32_t sz, cc_service_id svc_id,
+		     cc_msg_kind kind, void *proto_data);
+
+/* Size of a receive buffer including the protocol overhead */
+#define RECV_BUF_SZ(buf)	((uint32_t)(buf)->bufsz + PROTO_OVERHEAD_SZ)
 
 /* Reset the connection (incoming and outgoing) and session structures */
 static inline void reset_conn_states(void)
 {
 	conn_out.send_in_progress = false;
 	conn_out.buf = NULL;
+	conn_out.done_cb = NULL;
+	conn_out.done_ctx = NULL;
+	conn_out.queued = false;
 }
 
 /* Receive callback invoked by the protocol layer */
@@ -38,23 +51,25 @@ static void cc_recv_cb(const void *buf, uint32_t sz,
 {
 	switch(event) {
 	case PROTO_RCVD_MSG:
+		CC_METRIC_INC(msgs_rcvd);
+		CC_METRIC_ADD(msg_bytes_rcvd, sz);
 		conn_in.buf->current_len = sz;
 		conn_in.recv_in_progress = false;
 		dispatch_event_to_service(svc_id, conn_in.buf, CC_EVT_RCVD_MSG);
-		activate_buffer_for_recv(conn_in.buf);
+		activate_buffer_for_recv(conn_in.buf, sz);
 		break;
 	case PROTO_RCVD_WRONG_MSG:
 		conn_in.buf->current_len = sz;
 		conn_in.recv_in_progress = false;
 		dispatch_event_to_service(svc_id, conn_in.buf,
 					CC_EVT_RCVD_WRONG_MSG);
-		activate_buffer_for_recv(conn_in.buf);
+		activate_buffer_for_recv(conn_in.buf, sz);
 		break;
 	case PROTO_RCVD_MEM_OVRFL:
 		conn_in.recv_in_progress = false;
 		dispatch_event_to_service(svc_id, conn_in.buf,
 					CC_EVT_RCVD_OVERFLOW);
-		activate_buffer_for_recv(conn_in.buf);
+		activate_buffer_for_recv(conn_in.buf, RECV_BUF_SZ(conn_in.buf));
 		break;
 	case PROTO_RCVD_QUIT:
 		reset_conn_states();
@@ -66,6 +81,96 @@ static void cc_recv_cb(const void *buf, uint32_t sz,
 
 }
 
+/*
+ * Remember a message the protocol has accepted but not reported on yet under
+ * the id it was given, along with whom to notify. Return false if the outcome
+ * of the message was reported already (id 0) or there is no room to do so.
+ */
+static bool track_in_flight(uint16_t id, cc_buffer_desc *buf, uint32_t sz,
+			    cc_service_id svc_id, cc_msg_kind kind,
+			    void *proto_data, bool replayed)
+{
+	if (id == 0)
+		return false;
+	for (uint8_t i = 0; i < CC_SEND_QUEUE_LEN; i++) {
+		cc_in_flight_msg *f = &in_flight.msg[i];
+		if (f->used)
+			continue;
+		f->used = true;
+		f->queued = conn_out.queued;
+		f->replayed = replayed;
+		f->id = id;
+		f->msg.buf = buf;
+		f->msg.sz = sz;
+		f->msg.svc_id = svc_id;
+		f->msg.kind = kind;
+		f->msg.proto_data = proto_data;
+		f->msg.cb = replayed ? NULL : conn_out.done_cb;
+		f->msg.ctx = conn_out.done_ctx;
+		return true;
+	}
+	dbg_printf("%s:%d: No room to track a message in flight\n",
+			__func__, __LINE__);
+	return false;
+}
+
+/* Message in flight the protocol gave 'id' */
+static cc_in_flight_msg *find_in_flight(uint16_t id)
+{
+	for (uint8_t i = 0; i < CC_SEND_QUEUE_LEN; i++) {
+		cc_in_flight_msg *f = &in_flight.msg[i];
+		if (f->used && f->id == id)
+			return f;
+	}
+	return NULL;
+}
+
+/*
+ * Notify the owner of a message in flight of its outcome. Unlike a message
+ * being sent, a queued message in flight is stored right here if it timed out
+ * since its buffer is still held.
+ */
+static void in_flight_done(cc_in_flight_msg *f, proto_event event)
+{
+	cc_in_flight_msg m = *f;
+	f->used = false;
+
+	cc_event ev;
+	switch (event) {
+	case PROTO_RCVD_ACK:
+		ev = CC_EVT_SEND_ACKED;
+		break;
+	case PROTO_RCVD_NACK:
+		ev = CC_EVT_SEND_NACKED;
+		break;
+	default:
+		ev = CC_EVT_SEND_TIMEOUT;
+		offline.link_up = false;
+		if (m.queued && offline.enabled && push_msg(m.msg.buf->buf_ptr,
+					m.msg.sz, m.msg.svc_id, m.msg.kind,
+					m.msg.proto_data))
+			ev = CC_EVT_SEND_STORED;
+		break;
+	}
+	/* Stored messages have nobody to notify */
+	if (m.replayed)
+		return;
+	dispatch_event_to_service(m.msg.svc_id, m.msg.buf, ev);
+	if (m.msg.cb)
+		m.msg.cb(m.msg.buf, ev, m.msg.ctx);
+}
+
+/*
+ * In-flight callback invoked by the protocol layer, possibly while another
+ * message is being sent
+ */
+static void cc_in_flight_cb(uint16_t id, proto_event event)
+{
+	cc_in_flight_msg *f = find_in_flight(id);
+	if (f)
+		in_flight_done(f, event);
+}
+
 /* Send callback invoked by the protocol layer */
 static void cc_send_cb(const void *buf, uint32_t sz, proto_event event,
 		       cc_service_id svc_id)
@@ -80,19 +185,60 @@ static void cc_send_cb(const void *buf, uint32_t sz, proto_event event,
 		break;
 	case PROTO_SEND_TIMEOUT:
 		ev = CC_EVT_SEND_TIMEOUT;
+		offline.timed_out = true;
+		if (conn_out.send_in_progress && store_msg(conn_out.buf->buf_ptr,
+					conn_out.sz, conn_out.svc_id,
+					conn_out.kind, conn_out.proto_data))
+			ev = CC_EVT_SEND_STORED;
 		break;
 	default:
 		dbg_printf("%s:%d: Unknown Send Event :%d\n", __func__,
 				__LINE__, event);
 		break;
 	}
+	if (offline.replaying) {
+		/* Stored messages have nobody to notify */
+		offline.replay_ev = ev;
+		activate_buffer_for_recv(conn_in.buf, RECV_BUF_SZ(conn_in.buf));
+		return;
+	}
 	dispatch_event_to_service(svc_id, conn_out.buf, ev);
-	activate_buffer_for_recv(conn_in.buf);
+	if (conn_out.done_cb) {
+		cc_send_done_cb cb = conn_out.done_cb;
+		conn_out.done_cb = NULL;
+		cb(conn_out.buf, ev, conn_out.done_ctx);
+	}
+	activate_buffer_for_recv(conn_in.buf, RECV_BUF_SZ(conn_in.buf));
+}
+
+/* Receive callback of a routed topic invoked by the protocol layer */
+static void cc_route_cb(void *ctx, uint32_t sz, proto_event event)
+{
+	cc_topic_route *r = ctx;
+	/* A message may arrive while the route is being subscribed to, before
+	 * its entry was filled in
+	 */
+	if (r - topic_routes.route >= topic_routes.count)
+		return;
+	if (event == PROTO_RCVD_MSG) {
+		CC_METRIC_INC(msgs_rcvd);
+		CC_METRIC_ADD(msg_bytes_rcvd, sz);
+		r->buf->current_len = sz;
+		r->cb(CC_EVT_RCVD_MSG, sz, r->buf);
+	} else {
+		r->buf->current_len = 0;
+		r->cb(CC_EVT_RCVD_OVERFLOW, sz, r->buf);
+	}
 }
 
 static inline void init_state(void)
 {
 	reset_conn_states();
+	topic_routes.count = 0;
+	send_queue.head = 0;
+	send_queue.count = 0;
+	memset(&in_flight, 0, sizeof(in_flight));
+	memset(&offline, 0, sizeof(offline));
 	timekeep.start_ts = 0;
 	timekeep.polling_int_ms = init_polling_ms;
 }
@@ -202,6 +348,62 @@ static service_dispatch_entry *cc_init_send_msg(cc_buffer_desc *buf,
 	return se;
 }
 
+/* The PROTO_SEND_* macros return early when the protocol fails to send */
+static cc_send_result __proto_send(const void *msg, uint32_t sz,
+				   cc_service_id svc_id, cc_msg_kind kind,
+				   void *proto_data)
+{
+	if (kind == CC_MSG_STATUS)
+		PROTO_SEND_STATUS_MSG_TO_CLOUD(msg, sz, cc_send_cb);
+	else
+		PROTO_SEND_MSG_TO_CLOUD(msg, sz, svc_id, cc_send_cb, proto_data);
+	return CC_SEND_SUCCESS;
+}
+
+/* Hand a message over to the protocol, CC_SEND_FAILED if it could not send it */
+static cc_send_result proto_send(const void *msg, uint32_t sz,
+				 cc_service_id svc_id, cc_msg_kind kind,
+				 void *proto_data)
+{
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
+	cc_send_result res = __proto_send(msg, sz, svc_id, kind, proto_data);
+	CC_METRIC_TIME_END(proto_ms, begin);
+	if (res == CC_SEND_SUCCESS) {
+		CC_METRIC_INC(msgs_sent);
+		CC_METRIC_ADD(msg_bytes_sent, sz);
+	} else {
+		CC_METRIC_INC(send_failures);
+	}
+	return res;
+}
+
+/* Send a message prepared by cc_init_send_msg(), storing it if that fails */
+static cc_send_result send_msg(cc_buffer_desc *buf, uint32_t sz,
+			       cc_service_id svc_id, cc_msg_kind kind,
+			       void *proto_data)
+{
+	conn_out.sz = sz;
+	conn_out.svc_id = svc_id;
+	conn_out.kind = kind;
+	conn_out.proto_data = proto_data;
+	offline.stored = false;
+	offline.timed_out = false;
+
+	cc_send_result res = proto_send(buf->buf_ptr, sz, svc_id, kind,
+			proto_data);
+	if (res != CC_SEND_SUCCESS)
+		store_msg(buf->buf_ptr, sz, svc_id, kind, proto_data);
+	else if (track_in_flight(PROTO_SEND_IN_FLIGHT(cc_in_flight_cb), buf,
+				sz, svc_id, kind, proto_data, false))
+		/* The completion routine is called with the outcome */
+		conn_out.done_cb = NULL;
+	offline.link_up = res == CC_SEND_SUCCESS && !offline.timed_out;
+	if (offline.stored)
+		res = CC_SEND_STORED;
+	conn_out.send_in_progress = false;
+	return res;
+}
+
 cc_send_result cc_send_svc_msg_to_cloud(cc_buffer_desc *buf,
 					cc_data_sz sz, cc_service_id svc_id,
 					void *proto_data)
@@ -211,10 +413,8 @@ cc_send_result cc_send_svc_msg_to_cloud(cc_buffer_desc *buf,
 	service_dispatch_entry *se = cc_init_send_msg(buf, sz, svc_id);
 	if (!se)
 		return CC_SEND_FAILED;
-	PROTO_SEND_MSG_TO_CLOUD(buf->buf_ptr, sz + se->descriptor->send_offset,
-				svc_id, cc_send_cb, proto_data);
-	conn_out.send_in_progress = false;
-	return CC_SEND_SUCCESS;
+	return send_msg(buf, sz + se->descriptor->send_offset, svc_id,
+			CC_MSG_SVC, proto_data);
 }
 
 cc_send_result cc_send_status_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz)
@@ -224,11 +424,8 @@ cc_send_result cc_send_status_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz)
 	service_dispatch_entry *se = cc_init_send_msg(buf, sz, CC_SERVICE_BASIC);
 	if (!se)
 		return CC_SEND_FAILED;
-
-	PROTO_SEND_STATUS_MSG_TO_CLOUD(buf->buf_ptr,
-		sz + se->descriptor->send_offset, cc_send_cb);
-	conn_out.send_in_progress = false;
-	return CC_SEND_SUCCESS;
+	return send_msg(buf, sz + se->descriptor->send_offset,
+			CC_SERVICE_BASIC, CC_MSG_STATUS, NULL);
 }
 
 cc_send_result cc_send_diag_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz)
@@ -241,15 +438,25 @@ cc_send_result cc_send_diag_msg_to_cloud(cc_buffer_desc *buf, cc_data_sz sz)
 		return CC_SEND_FAILED;
 	}
 	PROTO_SEND_DIAG_MSG_TO_CLOUD(buf->buf_ptr, sz + se->descriptor->send_offset, cc_send_cb);
+	track_in_flight(PROTO_SEND_IN_FLIGHT(cc_in_flight_cb), buf,
+			sz + se->descriptor->send_offset, CC_SERVICE_BASIC,
+			CC_MSG_SVC, NULL, false);
 	conn_out.send_in_progress = false;
 	return CC_SEND_SUCCESS;
 }
 
-static cc_set_recv_result activate_buffer_for_recv(cc_buffer_desc *buf)
+/*
+ * Make 'buf' receive the next message. Only its first 'used' bytes are
+ * cleared, the rest is still zero from the time it was first activated; the
+ * protocols write nothing beyond the length they report for a message.
+ */
+static cc_set_recv_result activate_buffer_for_recv(cc_buffer_desc *buf,
+						    uint32_t used)
 {
-	memset(buf->buf_ptr, 0, buf->bufsz + PROTO_OVERHEAD_SZ);
-	PROTO_SET_RECV_BUFFER_CB(buf->buf_ptr, buf->bufsz + PROTO_OVERHEAD_SZ,
-				cc_recv_cb);
+	if (used > RECV_BUF_SZ(buf))
+		used = RECV_BUF_SZ(buf);
+	memset(buf->buf_ptr, 0, used);
+	PROTO_SET_RECV_BUFFER_CB(buf->buf_ptr, RECV_BUF_SZ(buf), cc_recv_cb);
 
 	conn_in.recv_in_progress = true;
 	conn_in.buf = buf;
@@ -264,7 +471,190 @@ cc_set_recv_result cc_set_recv_buffer(cc_buffer_desc *buf)
 	if (conn_in.recv_in_progress)
 		return CC_RECV_BUSY;
 
-	return activate_buffer_for_recv(buf);
+	return activate_buffer_for_recv(buf, RECV_BUF_SZ(buf));
+}
+
+static cc_send_result queue_msg(cc_buffer_desc *buf, cc_data_sz sz,
+				cc_service_id svc_id, cc_msg_kind kind,
+				void *proto_data, cc_send_done_cb cb, void *ctx)
+{
+	if (!buf || !buf->buf_ptr || sz == 0 || !lookup_service(svc_id))
+		return CC_SEND_FAILED;
+	if (send_queue.count == CC_SEND_QUEUE_LEN)
+		return CC_SEND_BUSY;
+
+	uint8_t idx = (send_queue.head + send_queue.count) % CC_SEND_QUEUE_LEN;
+	cc_queued_msg *m = &send_queue.msg[idx];
+	m->buf = buf;
+	m->sz = sz;
+	m->svc_id = svc_id;
+	m->kind = kind;
+	m->proto_data = proto_data;
+	m->cb = cb;
+	m->ctx = ctx;
+	send_queue.count++;
+	return CC_SEND_SUCCESS;
+}
+
+cc_send_result cc_queue_svc_msg_to_cloud(cc_buffer_desc *buf,
+					 cc_data_sz sz, cc_service_id svc_id,
+					 void *proto_data,
+					 cc_send_done_cb cb, void *ctx)
+{
+	return queue_msg(buf, sz, svc_id, CC_MSG_SVC, proto_data, cb, ctx);
+}
+
+cc_send_result cc_queue_status_msg_to_cloud(cc_buffer_desc *buf,
+					    cc_data_sz sz,
+					    cc_send_done_cb cb, void *ctx)
+{
+	return queue_msg(buf, sz, CC_SERVICE_BASIC, CC_MSG_STATUS, NULL,
+			cb, ctx);
+}
+
+uint8_t cc_get_send_queue_len(void)
+{
+	return send_queue.count;
+}
+
+/*
+ * Send the messages queued so far, back to back so that the protocol can carry
+ * all of them over the same session. Messages queued by the completion
+ * routines are left for the next call. Stop at the first failure since the
+ * connection is then likely unusable; the remaining messages stay queued.
+ */
+static void drain_send_queue(void)
+{
+	uint8_t n = send_queue.count;
+	while (n-- > 0 && send_queue.count > 0) {
+		cc_queued_msg m = send_queue.msg[send_queue.head];
+		send_queue.head = (send_queue.head + 1) % CC_SEND_QUEUE_LEN;
+		send_queue.count--;
+
+		/*
+		 * A protocol that reports the outcome through cc_send_cb() does
+		 * so before the send routine returns, which in turn notifies
+		 * 'm.cb'. MQTT reports later, or not at all for QoS 0.
+		 */
+		conn_out.done_cb = m.cb;
+		conn_out.done_ctx = m.ctx;
+		conn_out.queued = true;
+		cc_send_result res;
+		if (m.kind == CC_MSG_STATUS)
+			res = cc_send_status_msg_to_cloud(m.buf, m.sz);
+		else
+			res = cc_send_svc_msg_to_cloud(m.buf, m.sz, m.svc_id,
+					m.proto_data);
+		bool notified = (conn_out.done_cb == NULL);
+		conn_out.done_cb = NULL;
+		conn_out.done_ctx = NULL;
+		conn_out.queued = false;
+		if (res == CC_SEND_SUCCESS) {
+			if (m.cb && !notified)
+				m.cb(m.buf, CC_EVT_SEND_DONE, m.ctx);
+			continue;
+		}
+		if (m.cb && !notified)
+			m.cb(m.buf, res == CC_SEND_STORED ? CC_EVT_SEND_STORED :
+					CC_EVT_SEND_FAILED, m.ctx);
+		break;
+	}
+}
+
+/*
+ * Keep a message that could not be sent in the offline store. Return true if
+ * the message is stored, which it may already have been by the send callback.
+ */
+static bool store_msg(const void *msg, uint32_t sz, cc_service_id svc_id,
+		      cc_msg_kind kind, void *proto_data)
+{
+	if (!offline.enabled || offline.replaying || offline.stored)
+		return offline.stored;
+	offline.stored = push_msg(msg, sz, svc_id, kind, proto_data);
+	return offline.stored;
+}
+
+/* Add a message to the offline store */
+static bool push_msg(const void *msg, uint32_t sz, cc_service_id svc_id,
+		     cc_msg_kind kind, void *proto_data)
+{
+	if (svc_id == CC_SERVICE_CONTROL || sz > offline.replay_buf->bufsz)
+		return false;
+
+	cc_store_rec rec = {
+		.svc_id = svc_id,
+		.kind = kind,
+		.data_sz = PROTO_SEND_DATA_LEN(proto_data),
+		.msg_sz = sz
+	};
+	bool stored = cc_store_push(&rec, proto_data, msg);
+	if (!stored)
+		dbg_printf("%s:%d: Offline store dropped a message\n",
+				__func__, __LINE__);
+	return stored;
+}
+
+/*
+ * Send stored messages, oldest first, as long as they go through. While the
+ * link is down, only try once every CC_STORE_RETRY_MS so that sending the
+ * backlog does not cost a connection attempt every cycle.
+ */
+static void replay_offline_store(uint64_t cur_ts)
+{
+	static char data[PROTO_SEND_DATA_SZ + 1];
+	cc_buffer_desc *b = offline.replay_buf;
+
+	if (!offline.enabled || cc_store_len() == 0 || conn_out.send_in_progress)
+		return;
+	if (!offline.link_up && cur_ts < offline.retry_ts)
+		return;
+	/* Responses to the stored messages arrive in the receive buffer */
+	if (!conn_in.recv_in_progress)
+		return;
+
+	for (uint16_t n = 0; n < CC_STORE_BATCH_LEN; n++) {
+		cc_store_rec rec;
+		if (!cc_store_peek(&rec, data, b->buf_ptr, b->bufsz))
+			break;
+		offline.replaying = true;
+		offline.replay_ev = CC_EVT_NONE;
+		CC_METRIC_INC(retries);
+		cc_send_result res = proto_send(b->buf_ptr, rec.msg_sz,
+				rec.svc_id, rec.kind,
+				rec.data_sz > 0 ? data : NULL);
+		offline.replaying = false;
+		if (res != CC_SEND_SUCCESS ||
+				offline.replay_ev == CC_EVT_SEND_TIMEOUT) {
+			offline.link_up = false;
+			offline.retry_ts = cur_ts + CC_STORE_RETRY_MS;
+			return;
+		}
+		track_in_flight(PROTO_SEND_IN_FLIGHT(cc_in_flight_cb), b,
+				rec.msg_sz, rec.svc_id, rec.kind, NULL, true);
+		/* A NACKed message would be refused again, so it goes too */
+		cc_store_pop();
+		offline.link_up = true;
+	}
+}
+
+bool cc_enable_offline_store(const cc_store_backend *backend,
+			     cc_store_policy policy,
+			     cc_buffer_desc *replay_buf)
+{
+	if (!replay_buf || !replay_buf->buf_ptr)
+		return false;
+	if (!cc_store_open(backend, policy))
+		return false;
+	offline.enabled = true;
+	offline.replay_buf = replay_buf;
+	offline.link_up = false;
+	offline.retry_ts = 0;
+	return true;
+}
+
+uint16_t cc_get_offline_store_len(void)
+{
+	return offline.enabled ? cc_store_len() : 0;
 }
 
 uint32_t cc_service_send_receive(uint64_t cur_ts)
@@ -275,7 +665,12 @@ uint32_t cc_service_send_receive(uint64_t cur_ts)
 		polling_due = cur_ts - timekeep.start_ts >=
 							timekeep.polling_int_ms;
 
+	replay_offline_store(cur_ts);
+	drain_send_queue();
+
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	PROTO_MAINTENANCE(polling_due, cur_ts);
+	CC_METRIC_TIME_END(proto_ms, begin);
 
 	/* Compute when this function needs to be called next */
 	timekeep.polling_int_ms = PROTO_GET_POLLING();
@@ -290,7 +685,9 @@ uint32_t cc_service_send_receive(uint64_t cur_ts)
 			next_call_time_ms = 0;
 	}
 
-	PROTO_INITIATE_QUIT(false);
+	begin = CC_METRIC_TIME_BEGIN();
+	PROTO_END_CYCLE(next_call_time_ms);
+	CC_METRIC_TIME_END(proto_ms, begin);
 	reset_conn_states();
 	return next_call_time_ms;
 }
@@ -315,6 +712,37 @@ bool cc_register_service(const cc_service_descriptor *svc_desc,
 	return true;
 }
 
+bool cc_register_topic_route(const char *topic_filter, cc_buffer_desc *buf,
+			     cc_svc_callback_rtn cb)
+{
+	if (!topic_filter || !buf || !buf->buf_ptr || !cb)
+		return false;
+
+	/* The protocol keeps pointing at the entry of a filter it already has */
+	uint8_t i;
+	for (i = 0; i < topic_routes.count; i++)
+		if (strcmp(topic_routes.route[i].filter, topic_filter) == 0)
+			break;
+	if (i == CC_MAX_TOPIC_ROUTES)
+		return false;
+
+	cc_topic_route *r = &topic_routes.route[i];
+	cc_topic_route entry = {
+		.filter = topic_filter,
+		.buf = buf,
+		.cb = cb
+	};
+	proto_result res = PROTO_ADD_TOPIC_ROUTE(topic_filter, buf->buf_ptr,
+			buf->bufsz + PROTO_OVERHEAD_SZ, cc_route_cb, r);
+	/* A route whose subscription failed was still added */
+	if (res != PROTO_OK && res != PROTO_ERROR)
+		return false;
+	*r = entry;
+	if (i == topic_routes.count)
+		topic_routes.count++;
+	return true;
+}
+
 static service_dispatch_entry *lookup_service(cc_service_id svc_id)
 {
 	if ((svc_id != CC_SERVICE_CONTROL && svc_id != CC_SERVICE_BASIC) ||
@@ -7,16 +7,89 @@
 #include <stdbool.h>
 #include "cloud_comm.h"
 
+typedef enum {
+	CC_MSG_SVC,			/* Sent through PROTO_SEND_MSG_TO_CLOUD */
+	CC_MSG_STATUS			/* Sent through PROTO_SEND_STATUS_... */
+} cc_msg_kind;
+
 static struct {
 	bool send_in_progress;		/* Set if a message is currently being sent */
 	cc_buffer_desc *buf;		/* Outgoing data buffer */
+	cc_send_done_cb done_cb;	/* Completion routine of a queued message */
+	void *done_ctx;
+	bool queued;			/* The message came from the send queue */
+	/* Message being sent, for storing it should sending fail */
+	uint32_t sz;
+	cc_service_id svc_id;
+	cc_msg_kind kind;
+	void *proto_data;
 } conn_out;
 
+typedef struct {
+	cc_buffer_desc *buf;
+	cc_data_sz sz;
+	cc_service_id svc_id;
+	cc_msg_kind kind;
+	void *proto_data;
+	cc_send_done_cb cb;
+	void *ctx;
+} cc_queued_msg;
+
+/* Outbound messages waiting for cc_service_send_receive(), oldest at head */
+static struct {
+	cc_queued_msg msg[CC_SEND_QUEUE_LEN];
+	uint8_t head;
+	uint8_t count;
+} send_queue;
+
+/*
+ * Messages whose outcome the protocol reports after the send routine returned,
+ * see PROTO_SEND_IN_FLIGHT(). 'cb' is NULL for messages sent directly. There
+ * are at most as many as the protocol keeps in flight, MAX_INFLIGHT_MESSAGES
+ * for MQTT, which is not to exceed CC_SEND_QUEUE_LEN.
+ */
+typedef struct {
+	bool used;
+	bool queued;			/* The buffer is held until 'cb' is called */
+	bool replayed;			/* Sent from the offline store */
+	uint16_t id;			/* Given by the protocol */
+	cc_queued_msg msg;
+} cc_in_flight_msg;
+
+static struct {
+	cc_in_flight_msg msg[CC_SEND_QUEUE_LEN];
+} in_flight;
+
+/* Messages kept while the link to the cloud is down */
+static struct {
+	bool enabled;
+	cc_buffer_desc *replay_buf;	/* Stored messages are sent from here */
+	bool stored;			/* The message being sent was stored */
+	bool timed_out;			/* The message being sent timed out */
+	bool replaying;			/* A stored message is being sent */
+	cc_event replay_ev;		/* Outcome of the stored message */
+	bool link_up;			/* The last message sent went through */
+	uint64_t retry_ts;		/* No replay attempt before this time
+					 * while the link is down */
+} offline;
+
 static struct {
 	bool recv_in_progress;		/* Set if a receive was scheduled */
 	cc_buffer_desc *buf;		/* Incoming data buffer */
 } conn_in;
 
+/* Receive buffers and callbacks of the routed topics */
+typedef struct {
+	const char *filter;
+	cc_buffer_desc *buf;
+	cc_svc_callback_rtn cb;
+} cc_topic_route;
+
+static struct {
+	cc_topic_route route[CC_MAX_TOPIC_ROUTES];
+	uint8_t count;
+} topic_routes;
+
 static struct {
 	uint64_t start_ts;		/* Polling interval measurement starts
 					 * from this timestamp */
@@ -7,18 +7,34 @@
 #include "at_core.h"
 #include "at_modem.h"
 #include "ts_sdk_modem_config.h"
+#include "cc_metrics_def.h"
 
 #define AT_UART_TX_WAIT_MS		10000
 #define IDLE_CHARS			10
 
 /*
- * Waiting arbitrarily as we do not know for how many
- * bytes we will be waiting for when modem does not send wrong response in
- * totality
+ * A wrong response may still be arriving when it is detected. It is drained
+ * until the line stays quiet for RSP_QUIET_MS, for at most RSP_BUF_DELAY.
  */
 #define RSP_BUF_DELAY			2000 /* In mili seconds */
+#define RSP_QUIET_MS			50
+
+/*
+ * Wait between the end of a response and the next command written to the
+ * modem. It starts at the floor passed to at_core_init(). A timeout or a
+ * wrong response, hinting that the modem was not ready, doubles it up to the
+ * ceiling, and it decays back towards the floor while commands keep being
+ * answered. Time spent by the caller between two commands counts towards the
+ * wait.
+ */
+static struct {
+	uint32_t min_ms;	/* Floor, as given to at_core_init() */
+	uint32_t max_ms;	/* Ceiling, as given to at_core_init() */
+	uint32_t gap_ms;	/* Current wait */
+	uint32_t rsp_end_ms;	/* Tick at which the last response ended */
+	bool pending;		/* No command written since that response */
+} pace;
 
-static uint32_t at_comm_delay_ms;
 static const char *rsp_header = "\r\n";
 static const char *rsp_trailer = "\r\n";
 static const char *err_str = "\r\nERROR\r\n";
@@ -32,7 +48,7 @@ typedef struct __attribute__((packed)) {
 } at_core_state;
 
 static volatile at_core_state state;
-static volatile bool process_rsp;
+static sys_completion rsp_done;	/* Signalled by the uart idle callback */
 static at_rx_callback serial_rx_callback;
 static at_urc_callback urc_callback;
 
@@ -99,36 +115,72 @@ static at_ret_code __at_wait_for_rsp(uint32_t *timeout)
 	state.waiting_resp = true;
 	at_ret_code result = AT_SUCCESS;
 	uint32_t start = sys_get_tick_ms();
-	uint32_t end = start;
-	while (!process_rsp) {
-		end = sys_get_tick_ms();
-		if ((end - start) > *timeout) {
-			result = AT_RSP_TIMEOUT;
-			DEBUG_V1("%s: RSP_TIMEOUT: out of %lu, waited %lu\n",
-					__func__, *timeout, (end - start));
-			*timeout = 0;
-			break;
-		}
-	}
+	/* Sleep until the uart idle callback reports a response */
+	bool done = sys_completion_wait(&rsp_done, *timeout);
+	uint32_t waited = sys_get_tick_ms() - start;
 	state.waiting_resp = false;
-	process_rsp = false;
-	if (*timeout != 0 && ((end - start) < *timeout))
-		*timeout = *timeout - (end - start);
+	if (!done) {
+		/* Drop a signal that raced with the timeout */
+		sys_completion_init(&rsp_done);
+		result = AT_RSP_TIMEOUT;
+		DEBUG_V1("%s: RSP_TIMEOUT: out of %lu, waited %lu\n",
+				__func__, *timeout, waited);
+		*timeout = 0;
+	} else if (waited < *timeout) {
+		*timeout = *timeout - waited;
+	}
 	return result;
 }
 
+static void __at_pace_wait(void)
+{
+	if (!pace.pending)
+		return;
+	uint32_t since = sys_get_tick_ms() - pace.rsp_end_ms;
+	if (since < pace.gap_ms)
+		sys_delay(pace.gap_ms - since);
+	pace.pending = false;
+}
+
+static void __at_pace_update(at_ret_code result)
+{
+	pace.rsp_end_ms = sys_get_tick_ms();
+	pace.pending = true;
+	if (result == AT_RSP_TIMEOUT || result == AT_WRONG_RSP)
+		pace.gap_ms = (pace.gap_ms * 2 < pace.max_ms) ?
+			pace.gap_ms * 2 : pace.max_ms;
+	else if (pace.gap_ms > pace.min_ms)
+		pace.gap_ms -= (pace.gap_ms - pace.min_ms + 3) / 4;
+}
+
+/* Let the rest of a wrong response come in so that it can be discarded */
+static void __at_drain_rsp(void)
+{
+	uint32_t start = sys_get_tick_ms();
+	buf_sz avail = uart_util_available();
+	while (sys_get_tick_ms() - start < RSP_BUF_DELAY) {
+		uint32_t quiet = RSP_QUIET_MS;
+		state.waiting_resp = true;
+		if (__at_wait_for_rsp(&quiet) == AT_RSP_TIMEOUT &&
+				uart_util_available() == avail)
+			break;
+		avail = uart_util_available();
+	}
+}
+
 static void at_core_cleanup(void)
 {
 	at_core_process_urc(true);
 	at_core_clear_rx();
 }
 
-static at_ret_code __at_comm_send_and_wait_rsp(char *comm, uint16_t len,
-                                                uint32_t *timeout)
+static at_ret_code __at_comm_send_and_wait_rsp(const uint8_t *comm,
+                                                uint16_t len, uint32_t *timeout)
 {
-        /* Process urcs if any before we send down new command
-         * and empty buffer
+        /* Give the modem time to get ready, then process urcs if any
+         * before we send down new command and empty buffer
          */
+        __at_pace_wait();
         at_core_cleanup();
         CHECK_NULL(comm, AT_FAILURE);
 
@@ -213,6 +265,8 @@ static bool emu_hwflctrl(pin_name_t rts, pin_name_t cts)
 #define CTS_TIMEOUT_MS			1500
 bool at_core_write(uint8_t *buf, uint16_t len)
 {
+	__at_pace_wait();
+
 #if defined(MODEM_EMULATED_CTS) && defined(MODEM_EMULATED_RTS)
 	if (m_rts != NC && m_cts != NC) {
 		gpio_write(m_rts, PIN_HIGH);
@@ -225,7 +279,7 @@ bool at_core_write(uint8_t *buf, uint16_t len)
 	}
 #endif
 
-	bool res = uart_tx(uart, buf, len, AT_UART_TX_WAIT_MS);
+	bool res = uart_tx_bulk(uart, buf, len, AT_UART_TX_WAIT_MS);
 
 #if defined(MODEM_EMULATED_CTS) && defined(MODEM_EMULATED_RTS)
 	if (m_rts != NC && m_cts != NC)
@@ -243,14 +297,15 @@ void at_core_clear_rx(void)
 /*
  * Generic utility to send command, wait for the response, and process response.
  * It is best suited for responses bound by delimiters with the exceptions
- * for write prompt command for tcp write, echo_off and modem_ok commands
+ * for write prompt command for tcp write, echo_off and modem_ok commands.
+ * 'out' is what is written to the modem, 'comm' the text the modem may echo
+ * ahead of the response.
  */
-at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line)
+static at_ret_code __at_wcmd(const at_command_desc *desc, const uint8_t *out,
+				uint16_t out_len, const char *comm,
+				bool read_line)
 {
-	CHECK_NULL(desc, AT_FAILURE);
-
 	at_ret_code result = AT_SUCCESS;
-	char *comm;
 	uint32_t timeout;
 	buf_sz read_bytes;
 	uint16_t wanted;
@@ -260,13 +315,15 @@ at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line)
 	 */
 	uint8_t tmp_want = 0;
 	char temp_buf[4];
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 
-	comm = desc->comm;
 	timeout = desc->comm_timeout;
 
-	DEBUG_V0("%s: sending %s\n", __func__, comm);
-	result = __at_comm_send_and_wait_rsp(comm, strlen(comm),
-			&timeout);
+	if (out == (const uint8_t *)comm)
+		DEBUG_V0("%s: sending %s\n", __func__, comm);
+	else
+		DEBUG_V0("%s: sending %u data bytes\n", __func__, out_len);
+	result = __at_comm_send_and_wait_rsp(out, out_len, &timeout);
 	if (result != AT_SUCCESS)
 		goto done;
 
@@ -332,7 +389,7 @@ at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line)
 			if (result == AT_WRONG_RSP) {
 				DEBUG_V0("%s: wrong response for command:%s\n",
 						__func__, comm);
-				sys_delay(RSP_BUF_DELAY);
+				__at_drain_rsp();
 				__at_dump_buffer(NULL, 0);
 				break;
 			}
@@ -381,7 +438,7 @@ at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line)
 			}
 		} else {
 			DEBUG_V0("%s: uart read failed (unlikely) for"
-					" command:%s\n", __func__,desc->comm);
+					" command:%s\n", __func__, comm);
 			result = AT_FAILURE;
 			break;
 		}
@@ -391,8 +448,15 @@ done:
 	state.proc_rsp = false;
 	state.waiting_resp = false;
 
-	/* Wait for a given amount of time before executing next command */
-	sys_delay(at_comm_delay_ms);
+	/* The next command waits for the modem from this point on */
+	__at_pace_update(result);
+
+	uint32_t elapsed = CC_METRIC_ELAPSED(begin);
+	CC_METRIC_INC(at_cmds);
+	if (result != AT_SUCCESS)
+		CC_METRIC_INC(at_cmd_errors);
+	CC_METRIC_ADD(at_ms, elapsed);
+	CC_METRIC_MAX(at_cmd_max_ms, elapsed);
 
 	/* check to see if we have urcs while command was executing
 	 * if result was wrong response, chances are that we are out of sync
@@ -403,6 +467,42 @@ done:
 	return result;
 }
 
+at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line)
+{
+	CHECK_NULL(desc, AT_FAILURE);
+	CHECK_NULL(desc->comm, AT_FAILURE);
+	return __at_wcmd(desc, (const uint8_t *)desc->comm, strlen(desc->comm),
+			desc->comm, read_line);
+}
+
+at_ret_code at_core_wdata(const at_command_desc *desc, const uint8_t *data,
+				uint16_t len, bool read_line)
+{
+	CHECK_NULL(desc, AT_FAILURE);
+	CHECK_NULL(data, AT_FAILURE);
+	return __at_wcmd(desc, data, len, "", read_line);
+}
+
+at_ret_code at_core_wcmd_seq(const at_seq_entry *seq, uint8_t n,
+				uint8_t *failed)
+{
+	CHECK_NULL(seq, AT_FAILURE);
+
+	for (uint8_t i = 0; i < n; i++) {
+		at_ret_code result = at_core_wcmd(seq[i].desc, seq[i].read_line);
+		if (seq[i].done)
+			result = seq[i].done(result, seq[i].data);
+		if (result != AT_SUCCESS) {
+			DEBUG_V0("%s: stopped at command %u: %d\n", __func__,
+					i, result);
+			if (failed)
+				*failed = i;
+			return result;
+		}
+	}
+	return AT_SUCCESS;
+}
+
 void at_core_process_urc(bool mode)
 {
 	if (mode)
@@ -458,7 +558,7 @@ static void at_core_uart_rx_callback(callback_event ev)
 	case UART_EVENT_RECVD_BYTES:
 		if (state.waiting_resp) {
 			DEBUG_V1("%s: got response\n", __func__);
-			process_rsp = true;
+			sys_completion_signal(&rsp_done);
 		} else {
 			serial_rx_callback();
 		}
@@ -473,7 +573,8 @@ static void at_core_uart_rx_callback(callback_event ev)
 	}
 }
 
-bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb, uint32_t d_ms)
+bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb,
+		uint32_t min_ms, uint32_t max_ms)
 {
 	CHECK_NULL(rx_cb, false);
 	serial_rx_callback = rx_cb;
@@ -484,7 +585,12 @@ bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb, uint32_t d_ms)
 	if (!emu_hwflctrl(MODEM_EMULATED_RTS, MODEM_EMULATED_CTS))
 		return false;
 #endif
-	at_comm_delay_ms = d_ms;
+	if (min_ms > max_ms)
+		return false;
+	pace.min_ms = min_ms;
+	pace.max_ms = max_ms;
+	pace.gap_ms = min_ms;
+	pace.pending = false;
 	const struct uart_pins pins = {
 		.tx = MODEM_UART_TX_PIN,
 		.rx = MODEM_UART_RX_PIN,
@@ -506,7 +612,7 @@ bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb, uint32_t d_ms)
 	CHECK_SUCCESS(res, true, false);
 
 	uart_util_reg_callback(at_core_uart_rx_callback);
-	process_rsp = false;
+	sys_completion_init(&rsp_done);
 	at_core_clear_rx();
 
 	if (!at_modem_init())
@@ -524,7 +630,27 @@ buf_sz at_core_rx_available(void)
 	return uart_util_available();
 }
 
+bool at_core_wait_rx(buf_sz wanted, uint32_t timeout_ms)
+{
+	/* Bytes arriving from here on wake up the wait below */
+	state.waiting_resp = true;
+	buf_sz rcvd = uart_util_available();
+	at_ret_code res = __at_wait_for_bytes(&rcvd, wanted, &timeout_ms);
+	state.waiting_resp = false;
+	return res == AT_SUCCESS;
+}
+
 int at_core_read(uint8_t *buf, buf_sz sz)
 {
 	return uart_util_read(buf, sz);
 }
+
+buf_sz at_core_rx_peek(uart_span span[UART_MAX_SPANS], buf_sz max)
+{
+	return uart_util_peek(span, max);
+}
+
+buf_sz at_core_rx_commit(buf_sz n)
+{
+	return uart_util_commit(n);
+}
@@ -90,6 +90,19 @@ static int __attribute__((unused)) debug_level;
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
 
+/*
+ * Wait in ms between a response and the next command, as passed by the modem
+ * drivers to at_core_init(). The datasheets of the supported modems ask for
+ * at least 20 ms; the ceiling bounds the back off after the modem times out or
+ * answers wrongly.
+ */
+#ifndef AT_COMM_MIN_DELAY_MS
+#define AT_COMM_MIN_DELAY_MS	20
+#endif
+#ifndef AT_COMM_MAX_DELAY_MS
+#define AT_COMM_MAX_DELAY_MS	100
+#endif
+
 /** response descriptor */
 typedef struct _at_rsp_desc {
         /** Hard coded expected response for the given command */
@@ -114,6 +127,22 @@ typedef struct _at_command_desc {
         const char *err;
 } at_command_desc;
 
+/** Entry of a command sequence run by at_core_wcmd_seq() */
+typedef struct _at_seq_entry {
+        /** Command to be sent */
+        const at_command_desc *desc;
+        /** Same as the read_line parameter of at_core_wcmd() */
+        bool read_line;
+        /**
+         * Optional, called with the result of the command. Its return value
+         * replaces the result, so returning AT_SUCCESS lets the sequence carry
+         * on past an expected failure.
+         */
+        at_ret_code (*done)(at_ret_code result, void *data);
+        /** private data passed to the done handler */
+        void *data;
+} at_seq_entry;
+
 /*
  * Serial data receive callback.
  *
@@ -141,7 +170,13 @@ typedef void (*at_urc_callback)(const char *urc);
  * Parameters:
  * 	rx_cb  - A pointer to the serial data receive callback
  * 	urc_cb - A pointer to the URC handler
- * 	d_ms   - Minimum wait time in ms between two successive AT commands
+ * 	min_ms - Shortest wait time in ms between a response and the next AT
+ * 	         command, no lower than what the modem datasheet requires. The
+ * 	         wait starts at this value.
+ * 	max_ms - Longest wait time in ms between a response and the next AT
+ * 	         command. A timeout or a wrong response doubles the wait up to
+ * 	         this value, it then shrinks back towards min_ms while the modem
+ * 	         keeps answering correctly.
  *
  * Returns:
  * 	True  - The AT core module was successfully initialized
@@ -149,7 +184,8 @@ typedef void (*at_urc_callback)(const char *urc);
  *
  * Note: This routine must be called before all other routines in this module.
  */
-bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb, uint32_t d_ms);
+bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb,
+		uint32_t min_ms, uint32_t max_ms);
 
 /*
  * Reset the modem.
@@ -167,7 +203,8 @@ bool at_core_init(at_rx_callback rx_cb, at_urc_callback urc_cb, uint32_t d_ms);
 at_ret_code at_core_modem_reset(void);
 
 /*
- * Write a set of bytes into the UART connecting the MCU and the modem.
+ * Write a set of bytes into the UART connecting the MCU and the modem. The
+ * whole buffer is handed to the UART driver as a single transfer.
  *
  * Parameters:
  * 	buf - Pointer to buffer containing the data to be written
@@ -193,6 +230,33 @@ bool at_core_write(uint8_t *buf, uint16_t len);
  */
 int at_core_read(uint8_t *buf, buf_sz sz);
 
+/*
+ * Look at unread bytes in the UART's read buffer without copying them out. The
+ * bytes are described by at most two spans, the second one being non-empty
+ * only when the unread region wraps around the end of the ring buffer. They
+ * remain in the buffer until released through 'at_core_rx_commit'.
+ *
+ * Parameters:
+ * 	span - Array of UART_MAX_SPANS spans to fill in.
+ * 	max  - Maximum number of bytes the spans should cover.
+ *
+ * Returns:
+ * 	Total number of bytes covered by the spans.
+ */
+buf_sz at_core_rx_peek(uart_span span[UART_MAX_SPANS], buf_sz max);
+
+/*
+ * Release bytes previously examined through 'at_core_rx_peek' from the UART's
+ * read buffer.
+ *
+ * Parameters:
+ * 	n - Number of bytes to release.
+ *
+ * Returns:
+ * 	Number of bytes actually released.
+ */
+buf_sz at_core_rx_commit(buf_sz n);
+
 /*
  * Utility function to scan the internal UART ring buffer to find the pattern or
  * substring.
@@ -223,6 +287,21 @@ int at_core_find_pattern(int start_idx, const uint8_t *pattern, buf_sz nlen);
  */
 buf_sz at_core_rx_available(void);
 
+/*
+ * Wait for at least 'wanted' unread bytes to be present in the buffer, sleeping
+ * until the UART reports more data instead of polling. Meant for response
+ * handlers which have to count out data following a response line.
+ *
+ * Parameters:
+ * 	wanted     - Number of unread bytes to wait for.
+ * 	timeout_ms - Maximum time to wait in milliseconds.
+ *
+ * Returns:
+ * 	True  - The bytes are present
+ * 	False - Timed out
+ */
+bool at_core_wait_rx(buf_sz wanted, uint32_t timeout_ms);
+
 /*
  * Clear the receive buffer associated with the UART link between the MCU and
  * the modem.
@@ -253,6 +332,43 @@ void at_core_clear_rx(void);
  */
 at_ret_code at_core_wcmd(const at_command_desc *desc, bool read_line);
 
+/*
+ * Write raw data over the UART link to the modem and receive a response, for
+ * data following a prompt. The 'comm' field of the descriptor is not used, the
+ * data is not expected to be echoed.
+ *
+ * Parameters:
+ * 	desc      - Responses to the data
+ * 	data      - Bytes to be written as they are
+ * 	len       - Number of bytes
+ * 	read_line - Expect the response to be contained in a single line
+ * 	            delimited by <CR><LF> before and after the line.
+ *
+ * Returns:
+ * 	Same as at_core_wcmd.
+ */
+at_ret_code at_core_wdata(const at_command_desc *desc, const uint8_t *data,
+				uint16_t len, bool read_line);
+
+/*
+ * Run a sequence of AT commands. Each command is written as soon as the
+ * previous one has been answered and the modem is ready to accept the next,
+ * and its response is matched before moving on. The sequence stops at the
+ * first command that does not succeed.
+ *
+ * Parameters:
+ * 	seq    - Array of commands to be sent in order
+ * 	n      - Number of entries in the array
+ * 	failed - Optional, set to the index of the command that stopped the
+ * 	         sequence. Untouched on success.
+ *
+ * Returns:
+ * 	AT_SUCCESS if every command succeeded, otherwise the result of the
+ * 	command that stopped the sequence (see at_core_wcmd).
+ */
+at_ret_code at_core_wcmd_seq(const at_seq_entry *seq, uint8_t n,
+                                uint8_t *failed);
+
 /*
  * Process any pending URCs.
  *
@@ -15,6 +15,11 @@
 #define MICRO_SEC_MUL		1000000
 #define TIM_BASE_FREQ_HZ	1000000
 #define TIMEOUT_BYTE_US		CEIL((8 * MICRO_SEC_MUL), MODEM_UART_BAUD_RATE)
+#define UART_BUF_MASK		(UART_BUF_SIZE - 1)
+
+#if (UART_BUF_SIZE & UART_BUF_MASK) != 0
+#error "UART_BUF_SIZE must be a power of two"
+#endif
 
 static uart_rx_cb recv_callback;
 static periph_t uart;
@@ -56,7 +61,7 @@ static void rx_char_cb(uint8_t data)
 	exceeded. */
 	if (rx.num_unread < UART_BUF_SIZE) {
 		rx.buffer[rx.widx] = data;
-		rx.widx = (rx.widx + 1) % UART_BUF_SIZE;
+		rx.widx = (rx.widx + 1) & UART_BUF_MASK;
 		rx.num_unread++;
 		dsb();
 	} else {
@@ -219,7 +224,7 @@ int uart_util_line_avail(const char *header, const char *trailer)
 	 * read location. This workaround is for the case where the header and
 	 * the trailer are the same.
 	 */
-	tidx = find_substr_in_ring_buffer(rx.ridx + hlen,
+	tidx = find_substr_in_ring_buffer((rx.ridx + hlen) & UART_BUF_MASK,
 			(uint8_t *)trailer, tlen);
 	if (tidx == -1)			/* Trailer not found. */
 		return 0;
@@ -232,6 +237,42 @@ int uart_util_line_avail(const char *header, const char *trailer)
 	return len;
 }
 
+buf_sz uart_util_peek(uart_span span[UART_MAX_SPANS], buf_sz max)
+{
+	if (!span)
+		return 0;
+
+	uart_irq_off(uart);
+	buf_sz num_unread = rx.num_unread;
+	uart_irq_on(uart);
+
+	/*
+	 * The producer only ever appends past the write index, so the region
+	 * described here stays stable until it is committed.
+	 */
+	buf_sz n_bytes = (max > num_unread) ? num_unread : max;
+	buf_sz head = UART_BUF_SIZE - rx.ridx;
+	if (head > n_bytes)
+		head = n_bytes;
+
+	span[0].data = (const uint8_t *)rx.buffer + rx.ridx;
+	span[0].len = head;
+	span[1].data = (const uint8_t *)rx.buffer;
+	span[1].len = n_bytes - head;
+	return n_bytes;
+}
+
+buf_sz uart_util_commit(buf_sz n)
+{
+	uart_irq_off(uart);
+	if (n > rx.num_unread)
+		n = rx.num_unread;
+	rx.ridx = (rx.ridx + n) & UART_BUF_MASK;
+	rx.num_unread -= n;
+	uart_irq_on(uart);
+	return n;
+}
+
 int uart_util_read(uint8_t *buf, buf_sz sz)
 {
 	/*
@@ -244,24 +285,12 @@ int uart_util_read(uint8_t *buf, buf_sz sz)
 	if (!buf)
 		return UART_BUF_INV_PARAM;
 
-	/*
-	 * Copy bytes into the supplied buffer and perform the necessary
-	 * book-keeping.
-	 */
-	uart_irq_off(uart);
-	buf_sz num_unread = rx.num_unread;
-	uart_irq_on(uart);
-
-	buf_sz n_bytes = (sz > num_unread) ? num_unread : sz;
-	buf_sz i = 0;
-	while ((n_bytes - i) > 0) {
-		buf[i++] = rx.buffer[rx.ridx];
-		rx.ridx = (rx.ridx + 1) % UART_BUF_SIZE;
-	}
-
-	uart_irq_off(uart);
-	rx.num_unread -= n_bytes;
-	uart_irq_on(uart);
+	/* Copy out at most two contiguous runs and release them. */
+	uart_span span[UART_MAX_SPANS];
+	buf_sz n_bytes = uart_util_peek(span, sz);
+	memcpy(buf, span[0].data, span[0].len);
+	memcpy(buf + span[0].len, span[1].data, span[1].len);
+	uart_util_commit(n_bytes);
 
 	return n_bytes;
 }
@@ -21,9 +21,17 @@ typedef uint16_t buf_sz;
 
 /**
  * \brief Maximum size of the UART receive buffer.
+ * \details Must be a power of two so that indices can be wrapped with a mask.
  */
 #define UART_BUF_SIZE		1024
 
+/**
+ * \brief Maximum number of spans needed to describe the unread bytes.
+ * \details The unread region is contiguous unless it wraps around the end of
+ * the buffer, in which case it is split into a head and a wrapped segment.
+ */
+#define UART_MAX_SPANS		2
+
 /**
  * \brief Return value that represents an invalid parameter.
  */
@@ -39,6 +47,14 @@ typedef uint16_t buf_sz;
  */
 #define UART_BUF_NOT_FOUND	-1
 
+/**
+ * \brief Describes a contiguous run of unread bytes inside the buffer.
+ */
+typedef struct {
+	const uint8_t *data;	/**< Pointer to the first byte of the run */
+	buf_sz len;		/**< Number of bytes in the run */
+} uart_span;
+
 /**
  * \brief Defines events that cause the receive callback to be invoked.
  */
@@ -137,6 +153,34 @@ int uart_util_line_avail(const char *header, const char *trailer);
  */
 int uart_util_read(uint8_t *buf, buf_sz sz);
 
+/**
+ * \brief Look at unread bytes in place without copying them out.
+ * \details Fills 'span' with the location of at most 'max' unread bytes. The
+ * second span is non-empty only if the unread region wraps around the end of
+ * the buffer. The bytes stay in the buffer until released through
+ * \ref uart_util_commit.
+ *
+ * \param[out] span Array of \ref UART_MAX_SPANS spans to fill in.
+ * \param[in] max Maximum number of bytes the spans should cover.
+ *
+ * \returns Total number of bytes covered by the spans.
+ * \pre \ref uart_util_init must have been called once.
+ */
+buf_sz uart_util_peek(uart_span span[UART_MAX_SPANS], buf_sz max);
+
+/**
+ * \brief Release bytes from the head of the buffer.
+ * \details Typically called after consuming the bytes returned by
+ * \ref uart_util_peek.
+ *
+ * \param[in] n Number of bytes to release.
+ *
+ * \returns Number of bytes actually released, which is smaller than 'n' if
+ * fewer bytes were unread.
+ * \pre \ref uart_util_init must have been called once.
+ */
+buf_sz uart_util_commit(buf_sz n);
+
 /**
  * \brief Flush the buffer.
  * \details This resets the read and write heads of the buffer, effectively
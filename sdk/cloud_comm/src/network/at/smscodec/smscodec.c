@@ -1,8 +1,6 @@
 /* Copyright (C) 2017 Verizon. All rights reserved. */
 
 #include "smscodec.h"
-#include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
 /* On failure, return _val */
@@ -51,7 +49,47 @@
 #define ISDN_NUM_TYPE		0x91	/* Number type */
 #define SCTS_LEN		0x07	/* Length of Service Center Timestamp */
 
-static bool udh_present;		/* Set if UDH is present in received SMS */
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/*
+ * Value of every hexadecimal digit character, with HEX_VALID set. Zero for the
+ * characters that are not hexadecimal digits.
+ */
+#define HEX_VALID		0x10
+static const uint8_t hex_val[256] = {
+	['0'] = HEX_VALID | 0x0, ['1'] = HEX_VALID | 0x1,
+	['2'] = HEX_VALID | 0x2, ['3'] = HEX_VALID | 0x3,
+	['4'] = HEX_VALID | 0x4, ['5'] = HEX_VALID | 0x5,
+	['6'] = HEX_VALID | 0x6, ['7'] = HEX_VALID | 0x7,
+	['8'] = HEX_VALID | 0x8, ['9'] = HEX_VALID | 0x9,
+	['A'] = HEX_VALID | 0xA, ['B'] = HEX_VALID | 0xB,
+	['C'] = HEX_VALID | 0xC, ['D'] = HEX_VALID | 0xD,
+	['E'] = HEX_VALID | 0xE, ['F'] = HEX_VALID | 0xF,
+	['a'] = HEX_VALID | 0xA, ['b'] = HEX_VALID | 0xB,
+	['c'] = HEX_VALID | 0xC, ['d'] = HEX_VALID | 0xD,
+	['e'] = HEX_VALID | 0xE, ['f'] = HEX_VALID | 0xF
+};
+
+/*
+ * Write the hex form of 'len' bytes from 'src' to the destination buffer,
+ * followed by a NULL character.
+ * Return 'true' on success and 'false' on failure.
+ * On a successful call, (*dest) is updated to point to the NULL character.
+ */
+static bool hexstr_buf(char **dest, const uint8_t *src, uint8_t len)
+{
+	if (dest == NULL || *dest == NULL)
+		return false;
+
+	char *d = *dest;
+	for (uint8_t i = 0; i < len; i++) {
+		*d++ = hex_digits[src[i] >> 4];
+		*d++ = hex_digits[src[i] & 0x0F];
+	}
+	*d = '\0';
+	*dest = d;
+	return true;
+}
 
 /*
  * Convert the byte into a string representing its hex form and write it to the
@@ -62,14 +100,7 @@ static bool udh_present;		/* Set if UDH is present in received SMS */
  */
 static bool hexstr(char **dest, uint8_t data)
 {
-	if (dest == NULL || *dest == NULL)
-		return false;
-
-	int written = snprintf(*dest, HEXLEN + 1, "%02X", data);
-	if (written <= 0)
-		return false;
-	*dest += written;
-	return true;
+	return hexstr_buf(dest, &data, 1);
 }
 
 /*
@@ -86,25 +117,34 @@ static bool hexnum(const char **src, uint8_t len, uint8_t *num)
 	if (src == NULL || *src == NULL || num == NULL)
 		return false;
 
-	memset(num, 0, len);
-	len *= HEXLEN;
-	for (uint8_t i = 0; i < len; i++) {
-		uint8_t digit = (*src)[i];
-
-		uint8_t idx = i >> 1;
-		num[idx] *= 16;
+	const uint8_t *s = (const uint8_t *)*src;
+	uint8_t i = 0;
 
-		if (digit >= '0' && digit <= '9')
-			num[idx] += (digit - '0');
-		else if (digit >= 'A' && digit <= 'F')
-			num[idx] += (10 + digit - 'A');
-		else if (digit >= 'a' && digit <= 'f')
-			num[idx] += (10 + digit - 'a');
-		else
+	/*
+	 * Four bytes at a time, checking the validity of all their digits at
+	 * once. A single invalid digit clears HEX_VALID from the combined value.
+	 */
+	for (; len - i >= 4; i += 4, s += 4 * HEXLEN) {
+		uint8_t v[4 * HEXLEN];
+		uint8_t valid = HEX_VALID;
+		for (uint8_t j = 0; j < 4 * HEXLEN; j++) {
+			v[j] = hex_val[s[j]];
+			valid &= v[j];
+		}
+		if (!valid)
+			return false;
+		for (uint8_t j = 0; j < 4; j++)
+			num[i + j] = (v[2 * j] << 4) | (v[2 * j + 1] & 0x0F);
+	}
+	for (; i < len; i++, s += HEXLEN) {
+		uint8_t hi = hex_val[s[0]];
+		uint8_t lo = hex_val[s[1]];
+		if (!(hi & lo & HEX_VALID))
 			return false;
+		num[i] = (hi << 4) | (lo & 0x0F);
 	}
 
-	*src += len;
+	*src = (const char *)s;
 	return true;
 }
 
@@ -133,7 +173,8 @@ static bool encode_addr(const char *intl_num, char **enc_intl_num)
 	}
 
 	/* The header for the encoded output is its length and number type */
-	if (snprintf(*enc_intl_num, ADDR_HDR_SZ + 1, "%02X91", enc_len) < 0)
+	char *hdr = *enc_intl_num;
+	if (!hexstr(&hdr, enc_len) || !hexstr(&hdr, ISDN_NUM_TYPE))
 		return false;
 
 	/*
@@ -174,20 +215,23 @@ static bool encode_ud(const sms_t *msg_to_send, char **dest)
 		ON_FAIL(hexstr(dest, msg_to_send->len), false);
 	}
 
-	for (uint8_t i = 0; i < msg_to_send->len; i++)
-		ON_FAIL(hexstr(dest, msg_to_send->buf[i]), false);
-	return true;
+	return hexstr_buf(dest, msg_to_send->buf, msg_to_send->len);
 }
 
 /*
- * Decode the address field of a 3GPP SMS. Returns 'true' on success and 'false'
- * on failure.
+ * Decode the address field of a 3GPP SMS, which must end before 'end'. Returns
+ * 'true' on success and 'false' on failure.
  */
-static bool decode_addr(const char **pdu, sms_t *recv_msg)
+static bool decode_addr(const char **pdu, const char *end, sms_t *recv_msg)
 {
+	if (end - *pdu < 2 * HEXLEN)
+		return false;
+
 	/* Get the length of the encoded address */
 	uint8_t len = 0;
 	ON_FAIL(hexnum(pdu, 1, &len), false);
+	if (len > ADDR_SZ || end - *pdu < HEXLEN + len + (len & 1))
+		return false;
 
 	/* Verify the type of the address */
 	uint8_t val = 0;
@@ -212,7 +256,8 @@ static bool decode_addr(const char **pdu, sms_t *recv_msg)
  * Decode the user data field into the segment structure. This function handles
  * both single part SMSes as well as segments of concatenated SMSes.
  */
-static bool decode_ud(uint16_t rem_len, const char **pdu, sms_t *recv_msg)
+static bool decode_ud(uint16_t rem_len, const char **pdu, bool udh_present,
+		sms_t *recv_msg, smscodec_buf_sel sel)
 {
 	/* Get the user data length and verify it against the remaining length */
 	uint8_t len = 0, val = 0;
@@ -222,6 +267,8 @@ static bool decode_ud(uint16_t rem_len, const char **pdu, sms_t *recv_msg)
 
 	if (udh_present) {
 		/* Parse User Data Header */
+		if (len < UDHL_VAL + 1)
+			return false;
 		recv_msg->len = len - UDHL_VAL - 1;
 		ON_FAIL(hexnum(pdu, 1, &val), false);
 		if (val != UDHL_VAL)
@@ -238,32 +285,41 @@ static bool decode_ud(uint16_t rem_len, const char **pdu, sms_t *recv_msg)
 		recv_msg->num_seg = val;
 		ON_FAIL(hexnum(pdu, 1, &val), false);
 		recv_msg->seq_no = val;
-
-		for (uint8_t i = 0; i < recv_msg->len; i++) {
-			ON_FAIL(hexnum(pdu, 1, &val), false);
-			recv_msg->buf[i] = val;
-		}
 	} else {
 		/* Format: Length field followed by raw 8-bit data */
 		recv_msg->len = len;
-		for (uint8_t i = 0; i < len; i++) {
-			ON_FAIL(hexnum(pdu, 1, &val), false);
-			recv_msg->buf[i] = val;
-		}
 		recv_msg->ref_no = 0;
 		recv_msg->num_seg = 1;
 		recv_msg->seq_no = 0;
 	}
+
+	/* Everything but the data is known, let the caller place the data */
+	if (sel) {
+		uint8_t *dest = sel(recv_msg);
+		if (dest)
+			recv_msg->buf = dest;
+	}
+	ON_FAIL(hexnum(pdu, recv_msg->len, recv_msg->buf), false);
 	return true;
 }
 
 bool smscodec_decode(uint16_t len, const char *pdu, sms_t *recv_msg)
+{
+	return smscodec_decode_to(len, pdu, recv_msg, NULL);
+}
+
+bool smscodec_decode_to(uint16_t len, const char *pdu, sms_t *recv_msg,
+		smscodec_buf_sel sel)
 {
 	if (pdu == NULL || recv_msg == NULL || recv_msg->buf == NULL ||
 			recv_msg->addr == NULL)
 		return false;
 
-	udh_present = false;
+	/*
+	 * The PDU need not be NULL terminated, every field is checked to lie
+	 * within its length before being read.
+	 */
+	const char *end = pdu + len;
 
 	/*
 	 * The first few bytes of the SMS-DELIVER PDU as reported by the modem
@@ -272,7 +328,9 @@ bool smscodec_decode(uint16_t len, const char *pdu, sms_t *recv_msg)
 	 */
 	const char *rptr = pdu;
 	uint8_t val = 0;
+	ON_FAIL(len >= HEXLEN, false);
 	ON_FAIL(hexnum(&rptr, 1, &val), false);
+	ON_FAIL(end - rptr >= (val + LEN_FO) * HEXLEN, false);
 	rptr += val * HEXLEN;
 
 	/* Retrieve the first octet */
@@ -282,12 +340,14 @@ bool smscodec_decode(uint16_t len, const char *pdu, sms_t *recv_msg)
 	uint8_t val_udhi_off = val & ~FO_UDHI_PRESENT;
 	if (val_udhi_off != fo_expected)
 		return false;
-	udh_present = ((val & FO_UDHI_PRESENT) == FO_UDHI_PRESENT);
+	bool udh_present = ((val & FO_UDHI_PRESENT) == FO_UDHI_PRESENT);
 
 	/* Decode the originating address */
-	ON_FAIL(decode_addr(&rptr, recv_msg), false);
+	ON_FAIL(decode_addr(&rptr, end, recv_msg), false);
 
 	/* Verify PID and DCS values */
+	ON_FAIL(end - rptr >= (LEN_PID + LEN_DCS + LEN_SCTS + LEN_UDL) * HEXLEN,
+			false);
 	uint8_t pid = 0, dcs = 0;
 	ON_FAIL(hexnum(&rptr, 1, &pid), false);
 	ON_FAIL(hexnum(&rptr, 1, &dcs), false);
@@ -298,7 +358,7 @@ bool smscodec_decode(uint16_t len, const char *pdu, sms_t *recv_msg)
 	rptr += SCTS_LEN * HEXLEN;
 
 	/* Decode the User Data */
-	ON_FAIL(decode_ud(len - (rptr - pdu), &rptr, recv_msg), false);
+	ON_FAIL(decode_ud(end - rptr, &rptr, udh_present, recv_msg, sel), false);
 	return true;
 }
 
@@ -77,4 +77,30 @@ uint16_t smscodec_encode(const sms_t *msg_to_send, char *pdu);
  */
 bool smscodec_decode(uint16_t len, const char *pdu, sms_t *recv_msg);
 
+/*
+ * Selects where the data of a segment being decoded is written. It is called
+ * once every field but the data itself has been decoded into recv_msg, i.e.
+ * len, ref_no, num_seg, seq_no and addr are valid. Returns a buffer of at least
+ * recv_msg->len bytes, or NULL to keep recv_msg->buf.
+ */
+typedef uint8_t *(*smscodec_buf_sel)(const sms_t *recv_msg);
+
+/*
+ * Same as smscodec_decode but the data is written to the buffer returned by
+ * 'sel', recv_msg->buf is updated to point to it.
+ *
+ * Parameters:
+ * 	len      - Length of the PDU hex string in bytes
+ * 	pdu      - PDU hex string
+ * 	recv_msg - A struct that will hold the decoded received segment along
+ * 	           with metadata needed to reconstruct the entire message.
+ * 	sel      - Selects the buffer for the data, may be NULL
+ *
+ * Returns:
+ * 	True  - If the decoding operation succeeded
+ * 	False - If the decoding operation failed
+ */
+bool smscodec_decode_to(uint16_t len, const char *pdu, sms_t *recv_msg,
+		smscodec_buf_sel sel);
+
 #endif
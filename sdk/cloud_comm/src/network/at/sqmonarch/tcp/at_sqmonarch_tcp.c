@@ -15,84 +15,218 @@
 
 #define MAX_TCP_CMD_LEN			70
 
+/* Time allowed for the data line of a +SQNSRECV response to arrive */
+#define RECV_DATA_WAIT_MS		500
+
+/* State of a single connection */
+enum conn_state {
+	/* Entry claimed by at_tcp_connect() */
+	CONN_USED = 1,
+	/* TCP successfully connected */
+	CONN_CONNECTED = 1 << 1,
+	/* Remote side disconnected, reported by +SQNSH */
+	CONN_REMOTE_DISCONN = 1 << 2
+};
+
 /*
- * Delay between successive commands in milisecond, datasheet recommends atleast
- * 20mS
+ * Entry 'i' of the table is connection ID 'i + 1' on the modem. The connection
+ * ID doubles as the socket handed out by at_tcp_connect().
  */
-#define AT_COMM_DELAY_MS		20
+static volatile struct {
+	uint8_t state;
+	/* Unread bytes held by the modem as last reported by +SQNSRING */
+	uint16_t pending;
+	rbuf *buf;		/* Received data not yet handed to the caller */
+} conns[AT_TCP_MAX_SOCKETS];
 
-/* Sequans Monarch supports only 1500 bytes of outgoing data at a time */
-#define MAX_DATA_LEN			1500
+static uint8_t rx_bufs[AT_TCP_MAX_SOCKETS][AT_TCP_RING_BUF_SZ];
 
-/* Store the received data into this buffer. at_tcp_recv() reads from here. */
-#define RING_BUF_SZ			2048
+/* Signalled when a connection receives data or is closed by the peer */
+static sys_completion rx_event;
 
-static uint8_t rx_buf[RING_BUF_SZ];
+/* Private data of the +SQNSRECV response handler */
+static struct {
+	int id;			/* Connection being read, 0 if none */
+	int len;		/* Bytes stored into its ring buffer, -1 on error */
+} read_req;
 
-static const uint8_t disconn_str[] = "\r\nNO CARRIER\r\n";
+/*
+ * Parse a decimal number at *str, not going past end. On success, *str is
+ * moved past the number.
+ */
+static bool __at_parse_uint(const char **str, const char *end, uint32_t *val)
+{
+	const char *p = *str;
+	uint32_t v = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = v * 10 + (*p - '0');
+		p++;
+	}
+	if (p == *str)
+		return false;
+	*str = p;
+	*val = v;
+	return true;
+}
 
-static volatile struct __attribute__((packed)) {
-	uint8_t connected : 1;		/* True when connected to the server */
-	uint8_t flag_peer_close : 1;	/* True: Closed by peer, False: Closed by us */
-	uint8_t online_mode : 1;	/* True when in online mode, false otherwise */
-	rbuf *buf;			/* Handle to ring buffer to store received data */
-} tcp_state = {
-	.connected = false,
-	.flag_peer_close = false,
-	.buf = NULL
-};
+/* Index into the connection table of a connection ID in use, -1 otherwise */
+static int __at_conn_idx(int s_id)
+{
+	if (s_id < 1 || s_id > AT_TCP_MAX_SOCKETS)
+		return -1;
+	if (!(conns[s_id - 1].state & CONN_USED))
+		return -1;
+	return s_id - 1;
+}
 
-static void at_uart_callback(void)
+static void __at_free_conn(int idx)
 {
-	/* URCs aren't received in modem's online mode operation */
-	if (!tcp_state.connected) {
-		if (!at_core_is_proc_rsp() && !at_core_is_proc_urc())
-			at_core_process_urc(false);
-		return;
+	conns[idx].state = 0;
+	conns[idx].pending = 0;
+	rbuf_clear(conns[idx].buf);
+}
+
+/* Handle "+SQNSH: <connId>" and "+SQNSRING: <connId>,<len>" */
+static bool __at_process_conn_urc(const char *urc, enum at_urc u_code)
+{
+	size_t pfx_len = strlen(at_urcs[u_code]);
+	if (strncmp(urc, at_urcs[u_code], pfx_len) != 0)
+		return false;
+
+	const char *p = urc + pfx_len;
+	const char *end = urc + strlen(urc);
+	uint32_t id;
+	if (!__at_parse_uint(&p, end, &id))
+		return true;
+	int idx = __at_conn_idx(id);
+	if (idx < 0) {
+		DEBUG_V0("%s: urc for unknown connection: %u\n", __func__,
+				(unsigned int)id);
+		return true;
 	}
 
-	/* Complete disconnect string found in the buffer */
-	if (at_core_find_pattern(UART_BUF_BEGIN, disconn_str,
-				sizeof (disconn_str) - 1) >= 0) {
-		tcp_state.connected = false;
-		tcp_state.flag_peer_close = true;
-		DEBUG_V0("%s: TCP conn closed by peer\n", __func__);
-	} else { /* Store data into the ring buffer */
-		buf_sz avail_bytes = at_core_rx_available();
-		if (avail_bytes > 0) {
-			uint8_t data;
-			for (buf_sz i = 0; i < avail_bytes; i++) {
-				at_core_read(&data, 1);
-				rbuf_wb(tcp_state.buf, data);
-			}
+	if (u_code == TCP_CLOSED) {
+		conns[idx].state &= ~CONN_CONNECTED;
+		conns[idx].state |= CONN_REMOTE_DISCONN;
+		DEBUG_V0("%s: TCP conn %u closed by peer\n", __func__,
+				(unsigned int)id);
+	} else {
+		uint32_t len;
+		if (p < end && *p == ',') {
+			p++;
+			if (__at_parse_uint(&p, end, &len))
+				conns[idx].pending = len;
 		}
+		DEBUG_V1("%s: %u bytes on connection %u\n", __func__,
+				conns[idx].pending, (unsigned int)id);
 	}
+	sys_completion_signal(&rx_event);
+	return true;
+}
+
+static void at_uart_callback(void)
+{
+	if (!at_core_is_proc_rsp() && !at_core_is_proc_urc())
+		at_core_process_urc(false);
+}
+
+static void urc_callback(const char *urc)
+{
+	if (__at_process_conn_urc(urc, DATA_READY))
+		return;
+	__at_process_conn_urc(urc, TCP_CLOSED);
 }
 
-static void process_urc(const char *urc, enum at_urc u_code)
+/*
+ * "+SQNSRECV: <connId>,<len>" is followed by the data and "\r\n". The data does
+ * not start with "\r\n" and may contain anything, so it is counted out of the
+ * UART buffer here straight into the ring buffer of the connection being read
+ * before the final OK is looked for.
+ */
+static void __at_parse_recv_rsp(void *rcv_rsp, int rcv_rsp_len,
+				const char *stored_rsp, void *data)
 {
-	if (strncmp(urc, at_urcs[u_code], strlen(at_urcs[u_code])) != 0)
+	read_req.len = -1;
+	int idx = __at_conn_idx(read_req.id);
+	if (idx < 0)
+		return;
+	const char *p = (const char *)rcv_rsp + strlen(stored_rsp);
+	const char *end = (const char *)rcv_rsp + rcv_rsp_len;
+	uint32_t id;
+	uint32_t len;
+	if (!__at_parse_uint(&p, end, &id) || p >= end || *p++ != ',' ||
+			!__at_parse_uint(&p, end, &len) ||
+			id != (uint32_t)read_req.id ||
+			len > AT_TCP_RX_CHUNK_SZ) {
+		DEBUG_V0("%s: malformed rsp\n", __func__);
 		return;
+	}
 
-	switch (u_code) {
-	case TCP_CLOSED:
-		tcp_state.connected = false;
-		tcp_state.flag_peer_close = true;
-		DEBUG_V0("%s: TCP conn closed by peer\n", __func__);
-		break;
-	default:
-		break;
+	if (!at_core_wait_rx(len + 2, RECV_DATA_WAIT_MS)) {
+		DEBUG_V0("%s: data timed out\n", __func__);
+		return;
 	}
+	uart_span span[UART_MAX_SPANS];
+	buf_sz n = at_core_rx_peek(span, len);
+	size_t stored = 0;
+	for (uint8_t i = 0; i < UART_MAX_SPANS; i++)
+		stored += rbuf_write(conns[idx].buf, span[i].data, span[i].len);
+	at_core_rx_commit(n);
+
+	uint8_t trailer[2];
+	if (n != len || at_core_read(trailer, 2) != 2 ||
+			trailer[0] != '\r' || trailer[1] != '\n') {
+		DEBUG_V0("%s: malformed data\n", __func__);
+		return;
+	}
+	read_req.len = stored;
 }
 
-static void urc_callback(const char *urc)
+/* Activate the PDP context and configure every connection ID of the table */
+static at_ret_code __at_conn_conf(void)
 {
-	process_urc(urc, TCP_CLOSED);
+	static const at_seq_entry sock_conf_seq[] = {
+		{ .desc = &tcp_commands[PDP_ACT], .read_line = true },
+		{ .desc = &tcp_commands[SOCK_CONF], .read_line = true },
+		{ .desc = &tcp_commands[SOCK_CONF_EXT], .read_line = true }
+	};
+	char conf[TEMP_COMM_LIMIT];
+	char conf_ext[TEMP_COMM_LIMIT];
+	tcp_commands[SOCK_CONF].comm = conf;
+	tcp_commands[SOCK_CONF_EXT].comm = conf_ext;
+
+	/* The PDP context is activated along with the first connection ID */
+	uint8_t first = 0;
+	for (int id = 1; id <= AT_TCP_MAX_SOCKETS; id++) {
+		snprintf(conf, sizeof(conf),
+				tcp_commands[SOCK_CONF].comm_sketch, id);
+		snprintf(conf_ext, sizeof(conf_ext),
+				tcp_commands[SOCK_CONF_EXT].comm_sketch, id);
+		at_ret_code res = at_core_wcmd_seq(sock_conf_seq + first,
+				ARRAY_SIZE(sock_conf_seq) - first, NULL);
+		CHECK_SUCCESS(res, AT_SUCCESS, res);
+		first = 1;
+	}
+	return AT_SUCCESS;
 }
 
 bool at_init()
 {
-	if (!at_core_init(at_uart_callback, urc_callback, AT_COMM_DELAY_MS))
+	/* Ring buffers are never released, set them up on the first call only */
+	for (uint8_t i = 0; i < AT_TCP_MAX_SOCKETS; i++) {
+		if (conns[i].buf == NULL)
+			conns[i].buf = rbuf_init(sizeof(rx_bufs[i]), rx_bufs[i]);
+		if (conns[i].buf == NULL) {
+			DEBUG_V0("%s: failed to initialize receive buffer\n",
+					__func__);
+			return false;
+		}
+		__at_free_conn(i);
+	}
+	sys_completion_init(&rx_event);
+
+	if (!at_core_init(at_uart_callback, urc_callback, AT_COMM_MIN_DELAY_MS,
+			AT_COMM_MAX_DELAY_MS))
 		return false;
 
 	/*
@@ -108,179 +242,201 @@ bool at_init()
 	/* Ensure the modem is in stable state before activating the PDP context */
 	sys_delay(500);
 
-	/* Activate PDP context and configure TCP socket */
-	at_ret_code res = at_core_wcmd(&tcp_commands[PDP_ACT], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, false);
-
-	res = at_core_wcmd(&tcp_commands[SOCK_CONF], true);
+	/* Activate PDP context and configure the TCP connections */
+	at_ret_code res = __at_conn_conf();
 	CHECK_SUCCESS(res, AT_SUCCESS, false);
 
-	res = at_core_wcmd(&tcp_commands[SOCK_CONF_EXT], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, false);
-
-	/* Initialize the ring buffer for TCP reads */
-	tcp_state.buf = rbuf_init(sizeof(rx_buf), rx_buf);
-	if (tcp_state.buf == NULL) {
-		DEBUG_V0("%s: failed to initialize receive buffer\n", __func__);
-		return false;
-	}
-
 	return true;
 }
 
 int at_tcp_connect(const char *host, const char *port)
 {
-	if (tcp_state.connected)
-		return AT_CONNECT_FAILED;
+	CHECK_NULL(host, AT_CONNECT_FAILED);
+	CHECK_NULL(port, AT_CONNECT_FAILED);
+
+	int idx = 0;
+	while (idx < AT_TCP_MAX_SOCKETS && (conns[idx].state & CONN_USED))
+		idx++;
+	if (idx == AT_TCP_MAX_SOCKETS) {
+		DEBUG_V0("%s: all %u connections are in use\n", __func__,
+				AT_TCP_MAX_SOCKETS);
+		return AT_SOCKET_FAILED;
+	}
+	int id = idx + 1;
+	/* Claim the entry before dialling so that URCs can find it */
+	conns[idx].state = CONN_USED;
 
 	char cmd[MAX_TCP_CMD_LEN];
 	at_command_desc *desc = &tcp_commands[SOCK_DIAL];
-	snprintf(cmd, sizeof(cmd), desc->comm_sketch, port, host);
+	snprintf(cmd, sizeof(cmd), desc->comm_sketch, id, port, host);
 	desc->comm = cmd;
-	if (at_core_wcmd(desc, true) != AT_SUCCESS)
+	if (at_core_wcmd(desc, true) != AT_SUCCESS) {
+		__at_free_conn(idx);
 		return AT_CONNECT_FAILED;
+	}
+
+	conns[idx].state |= CONN_CONNECTED;
+	DEBUG_V0("%s: connection %d created\n", __func__, id);
+	return id;
+}
 
-	tcp_state.connected = true;
-	tcp_state.flag_peer_close = false;
-	tcp_state.online_mode = true;
+/* Write at most AT_TCP_TX_CHUNK_SZ bytes, returns the number written */
+static int __at_tcp_tx(int idx, const uint8_t *buf, size_t len)
+{
+	if (len > AT_TCP_TX_CHUNK_SZ)
+		len = AT_TCP_TX_CHUNK_SZ;
 
-	DEBUG_V0("%s: socket("MODEM_SOCK_ID") created\n", __func__);
-	const char sock_id[] = MODEM_SOCK_ID;
-	return sock_id[0] - '0';
+	char cmd[TEMP_COMM_LIMIT];
+	at_command_desc *desc = &tcp_commands[SOCK_SEND];
+	snprintf(cmd, sizeof(cmd), desc->comm_sketch, idx + 1,
+			(unsigned int)len);
+	desc->comm = cmd;
+	at_ret_code result = at_core_wcmd(desc, false);
+	if (result == AT_SUCCESS)
+		result = at_core_wdata(&tcp_commands[SOCK_SEND_DATA], buf, len,
+				true);
+	if (result != AT_SUCCESS) {
+		if (conns[idx].state & CONN_REMOTE_DISCONN)
+			return AT_TCP_CONNECT_DROPPED;
+		return AT_TCP_SEND_FAIL;
+	}
+	return len;
 }
 
-/* Can send only MAX_DATA_LEN bytes at a time */
 int at_tcp_send(int s_id, const uint8_t *buf, size_t len)
 {
-	const char sock_id[] = MODEM_SOCK_ID;
-	if (s_id != sock_id[0] - '0' || len == 0 || buf == NULL)
+	int idx = __at_conn_idx(s_id);
+	if (idx < 0 || len == 0 || buf == NULL)
 		return AT_TCP_INVALID_PARA;
 
-	if (!tcp_state.connected) {
-		if (!tcp_state.flag_peer_close)
-			return 0;
+	if (!(conns[idx].state & CONN_CONNECTED)) {
 		DEBUG_V0("%s: tcp not connected to send\n", __func__);
 		return AT_TCP_SEND_FAIL;
 	}
 
-	if (!tcp_state.connected)
-		return AT_TCP_CONNECT_DROPPED;
-
-	len = (len > MAX_DATA_LEN) ? MAX_DATA_LEN : len;
-	for (size_t i = 0; i < len; i++)
-		if (tcp_state.connected) {
-			if (!at_core_write((uint8_t *)&buf[i], 1)) {
-				DEBUG_V0("%s: write failed", __func__);
-				return AT_TCP_SEND_FAIL;
-			}
-		} else {
-			DEBUG_V0("%s: tcp connection lost in middle of write\n",
-					__func__);
-			return AT_TCP_CONNECT_DROPPED;
+	size_t sent = 0;
+	while (sent < len) {
+		int res = __at_tcp_tx(idx, buf + sent, len - sent);
+		if (res < 0) {
+			DEBUG_V0("%s: write failed\n", __func__);
+			/* Report what made it out before the failure */
+			return (sent > 0) ? (int)sent : res;
 		}
+		sent += res;
+	}
+	return sent;
+}
 
-	return len;
+void at_tcp_wait_rx(uint32_t timeout_ms)
+{
+	sys_completion_wait(&rx_event, timeout_ms);
 }
 
 int at_read_available(int s_id)
 {
-	const char sock_id[] = MODEM_SOCK_ID;
-	if (s_id != sock_id[0] - '0')
+	int idx = __at_conn_idx(s_id);
+	if (idx < 0)
 		return AT_TCP_RCV_FAIL;
 
-	return rbuf_unread(tcp_state.buf);
+	size_t unread = rbuf_unread(conns[idx].buf);
+	if (unread > 0)
+		return unread;
+	if (conns[idx].pending > 0)
+		return conns[idx].pending;
+	if (!(conns[idx].state & CONN_CONNECTED))
+		return AT_TCP_RCV_FAIL;
+	return 0;
+}
+
+/* Move as much received data as fits from the modem into the ring buffer */
+static void __at_tcp_fill(int idx)
+{
+	size_t space = AT_TCP_RING_BUF_SZ - rbuf_unread(conns[idx].buf);
+	uint16_t wanted = (space > AT_TCP_RX_CHUNK_SZ) ?
+		AT_TCP_RX_CHUNK_SZ : space;
+	if (wanted == 0)
+		return;
+
+	char cmd[TEMP_COMM_LIMIT];
+	at_command_desc *desc = &tcp_commands[SOCK_RECV];
+	snprintf(cmd, sizeof(cmd), desc->comm_sketch, idx + 1, wanted);
+	desc->comm = cmd;
+	read_req.id = idx + 1;
+	read_req.len = -1;
+	at_ret_code result = at_core_wcmd(desc, true);
+	read_req.id = 0;
+	if (result != AT_SUCCESS || read_req.len < 0) {
+		/* A later +SQNSRING reports whatever is still there */
+		DEBUG_V0("%s: read failed: %d\n", __func__, result);
+		conns[idx].pending = 0;
+		return;
+	}
+
+	/*
+	 * Getting less than asked for means the modem has been drained. A full
+	 * read may have left more behind than the last +SQNSRING reported, so
+	 * keep looking until a read comes back short.
+	 */
+	if (read_req.len < wanted)
+		conns[idx].pending = 0;
+	else if (conns[idx].pending > read_req.len)
+		conns[idx].pending -= read_req.len;
+	else
+		conns[idx].pending = 1;
 }
 
 int at_tcp_recv(int s_id, uint8_t *buf, size_t len)
 {
-	const char sock_id[] = MODEM_SOCK_ID;
-	if (s_id != sock_id[0] - '0' || buf == NULL)
+	int idx = __at_conn_idx(s_id);
+	if (idx < 0 || buf == NULL)
 		return AT_TCP_INVALID_PARA;
 
 	if (len == 0)
 		return 0;
 
-	size_t unread = rbuf_unread(tcp_state.buf);
+	/* Bytes received before the remote side closed are still handed out */
+	if (rbuf_unread(conns[idx].buf) < len && conns[idx].pending > 0)
+		__at_tcp_fill(idx);
+
+	size_t unread = rbuf_unread(conns[idx].buf);
 	if (unread == 0) {
+		if (!(conns[idx].state & CONN_CONNECTED)) {
+			DEBUG_V0("%s: tcp not connected to recv\n", __func__);
+			return AT_TCP_RCV_FAIL;
+		}
 		errno = EAGAIN;
 		return AT_TCP_RCV_FAIL;
 	}
 
 	len = (len > unread) ? unread : len;
 
-	for (size_t i = 0; i < len; i++)
-		if (!rbuf_rb(tcp_state.buf, &buf[i])) {
-			DEBUG_V0("%s: read error\n", __func__);
-			return AT_TCP_RCV_FAIL;
-		}
+	if (rbuf_read(conns[idx].buf, buf, len) != len) {
+		DEBUG_V0("%s: read error\n", __func__);
+		return AT_TCP_RCV_FAIL;
+	}
 
 	return len;
 }
 
 void at_tcp_close(int s_id)
 {
-	const char sock_id[] = MODEM_SOCK_ID;
-	if (s_id != sock_id[0] - '0')
+	int idx = __at_conn_idx(s_id);
+	if (idx < 0)
 		return;
-	if (!tcp_state.connected) {
-		DEBUG_V0("%s: socket already closed\n", __func__);
-		return;
-	}
 
-	DEBUG_V0("%s: closing tcp socket\n", __func__);
-	if (!at_tcp_enter_cmd_mode()) {
-		DEBUG_V0("%s: unable to enter command mode\n", __func__);
+	if (conns[idx].state & CONN_REMOTE_DISCONN) {
+		DEBUG_V0("%s: connection %d already closed\n", __func__, s_id);
+		__at_free_conn(idx);
 		return;
 	}
-	at_core_wcmd(&tcp_commands[SOCK_CLOSE], true);
-	tcp_state.connected = false;
-	tcp_state.flag_peer_close = false;
-	tcp_state.online_mode = false;
-	rbuf_clear(tcp_state.buf);
-}
-
-bool at_tcp_leave_cmd_mode(void)
-{
-	if (!tcp_state.connected) {
-		tcp_state.online_mode = false;
-		DEBUG_V0("Not connected\n");
-		return true;
-	}
-	if (tcp_state.online_mode)
-		return true;
-	if (at_core_wcmd(&tcp_commands[SOCK_RESM], true) == AT_SUCCESS) {
-		tcp_state.online_mode = true;
-		return true;
-	} else {
-		tcp_state.online_mode = false;
-		return false;
-	}
-}
 
-bool at_tcp_enter_cmd_mode(void)
-{
-	if (!tcp_state.connected) {
-		tcp_state.online_mode = false;
-		DEBUG_V0("Not connected\n");
-		return true;
-	}
-	if (!tcp_state.online_mode)
-		return true;
-	/*
-	 * Arbitrary wait time before the escape sequence, to enable its
-	 * detection. AT manual is unclear about this.
-	 */
-	sys_delay(10);
-	if (!tcp_state.connected) {	/* Check again after delay */
-		tcp_state.online_mode = false;
-		DEBUG_V0("Not connected\n");
-		return true;
-	}
-	if (at_core_wcmd(&tcp_commands[SOCK_SUSP], true) == AT_SUCCESS) {
-		tcp_state.online_mode = false;
-		return true;
-	} else {
-		tcp_state.online_mode = true;
-		return false;
-	}
+	DEBUG_V0("%s: closing connection %d\n", __func__, s_id);
+	char cmd[TEMP_COMM_LIMIT];
+	at_command_desc *desc = &tcp_commands[SOCK_CLOSE];
+	snprintf(cmd, sizeof(cmd), desc->comm_sketch, s_id);
+	desc->comm = cmd;
+	if (at_core_wcmd(desc, true) != AT_SUCCESS)
+		DEBUG_V0("%s: could not close connection %d\n", __func__,
+				s_id);
+	__at_free_conn(idx);
 }
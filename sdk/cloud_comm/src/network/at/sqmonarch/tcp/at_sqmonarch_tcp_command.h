@@ -4,10 +4,14 @@
 #define AT_SQMONARCH_TCP_COMMAND_H
 
 #include "at_core.h"
+#include "at_tcp_defs.h"
 #include "ts_sdk_modem_config.h"
 
+#define TEMP_COMM_LIMIT		64
+
 enum at_urc {
 	TCP_CLOSED,	/* TCP connection closed URC */
+	DATA_READY,	/* Data received on a connection */
 	URC_END
 };
 
@@ -16,17 +20,28 @@ enum tcp_command {
 	SOCK_CONF,	/* Configure socket */
 	SOCK_CONF_EXT,	/* Configure extended socket parameters */
 	SOCK_DIAL,	/* Dial into a hostname:port / IP address:port */
+	SOCK_SEND,	/* Request to send data, answered by a prompt */
+	SOCK_SEND_DATA,	/* Binary data following the prompt */
+	SOCK_RECV,	/* Read received data */
 	SOCK_CLOSE,	/* Close the socket */
-	SOCK_SUSP,	/* Suspend online mode */
-	SOCK_RESM,	/* Resume online mode */
 	TCP_END
 };
 
 static const char *at_urcs[URC_END] = {
-	[TCP_CLOSED] = "\r\n+SQNSH: "MODEM_SOCK_ID"\r\n"
+	[TCP_CLOSED] = "\r\n+SQNSH: ",
+	[DATA_READY] = "\r\n+SQNSRING: "
 };
 
-/* XXX: Data sheet does not specify timeouts. They're arbitrary for now. */
+static void __at_parse_recv_rsp(void *rcv_rsp, int rcv_rsp_len,
+				const char *stored_rsp, void *data);
+
+/*
+ * Connections are dialled in command mode (connMode 1) and report received
+ * data as "+SQNSRING: <connId>,<len>" (srMode 1). Data is read and sent in
+ * binary (recvDataMode 0, sendDataMode 0).
+ *
+ * XXX: Data sheet does not specify timeouts. They're arbitrary for now.
+ */
 static at_command_desc tcp_commands[TCP_END] = {
 	[PDP_ACT] = {
 		.comm = "at+cgact=1,"MODEM_PDP_CTX"\r",
@@ -41,7 +56,7 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.comm_timeout = 5000
 	},
 	[SOCK_CONF] = {
-		.comm = "at+sqnscfg="MODEM_SOCK_ID","MODEM_PDP_CTX",0,600,600,50\r",
+		.comm_sketch = "at+sqnscfg=%d,"MODEM_PDP_CTX",0,600,600,50\r",
 		.rsp_desc = {
 			{
 				.rsp = "\r\nOK\r\n",
@@ -53,7 +68,7 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.comm_timeout = 5000
 	},
 	[SOCK_CONF_EXT] = {
-		.comm = "at+sqnscfgext="MODEM_SOCK_ID",0,0,0,0,0\r",
+		.comm_sketch = "at+sqnscfgext=%d,1,0,0,0,0\r",
 		.rsp_desc = {
 			{
 				.rsp = "\r\nOK\r\n",
@@ -65,10 +80,10 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.comm_timeout = 5000
 	},
 	[SOCK_DIAL] = {
-		.comm_sketch = "at+sqnsd="MODEM_SOCK_ID",0,%s,\"%s\",0,0,0\r",
+		.comm_sketch = "at+sqnsd=%d,0,%s,\"%s\",0,0,1\r",
 		.rsp_desc = {
 			{
-				.rsp = "\r\nCONNECT\r\n",
+				.rsp = "\r\nOK\r\n",
 				.rsp_handler = NULL,
 				.data= NULL
 			}
@@ -76,8 +91,19 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.err = "\r\n+CME ERROR: ",
 		.comm_timeout = 7000
 	},
-	[SOCK_SUSP] = {
-		.comm = "+++",
+	[SOCK_SEND] = {
+		.comm_sketch = "at+sqnssendext=%d,%u\r",
+		.rsp_desc = {
+			{
+				.rsp = "\r\n> ",
+				.rsp_handler = NULL,
+				.data = NULL
+			}
+		},
+		.err = "\r\n+CME ERROR: ",
+		.comm_timeout = 5000
+	},
+	[SOCK_SEND_DATA] = {
 		.rsp_desc = {
 			{
 				.rsp = "\r\nOK\r\n",
@@ -88,11 +114,16 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.err = "\r\n+CME ERROR: ",
 		.comm_timeout = 5000
 	},
-	[SOCK_RESM] = {
-		.comm = "at+sqnso="MODEM_SOCK_ID"\r",
+	[SOCK_RECV] = {
+		.comm_sketch = "at+sqnsrecv=%d,%u\r",
 		.rsp_desc = {
 			{
-				.rsp = "\r\nCONNECT\r\n",
+				.rsp = "\r\n+SQNSRECV: ",
+				.rsp_handler = __at_parse_recv_rsp,
+				.data = NULL
+			},
+			{
+				.rsp = "\r\nOK\r\n",
 				.rsp_handler = NULL,
 				.data = NULL
 			}
@@ -101,7 +132,7 @@ static at_command_desc tcp_commands[TCP_END] = {
 		.comm_timeout = 5000
 	},
 	[SOCK_CLOSE] = {
-		.comm = "at+sqnsh="MODEM_SOCK_ID"\r",
+		.comm_sketch = "at+sqnsh=%d\r",
 		.rsp_desc = {
 			{
 				.rsp = "\r\nOK\r\n",
@@ -0,0 +1,38 @@
+/* Copyright (C) 2017 Verizon. All rights reserved. */
+
+#ifndef AT_TCP_DEFS_H
+#define AT_TCP_DEFS_H
+
+#include <stdint.h>
+#include "uart_util.h"
+
+/*
+ * Number of TCP connections that can be open at the same time. The modem
+ * offers connection IDs 1 to 6; every one held here costs an
+ * AT_TCP_RING_BUF_SZ receive buffer.
+ */
+#ifndef AT_TCP_MAX_SOCKETS
+#define AT_TCP_MAX_SOCKETS	4
+#endif
+
+#if AT_TCP_MAX_SOCKETS > 6
+#error "The Sequans Monarch supports at most 6 socket connections"
+#endif
+
+/* Receive ring buffer of every connection, must be a power of 2 */
+#define AT_TCP_RING_BUF_SZ	1024
+
+/*
+ * Received data comes in binary and is counted out of the UART buffer, so a
+ * whole +SQNSRECV response has to fit into it, which bounds the size of a
+ * single read. Data to send goes out in binary after the prompt of
+ * +SQNSSENDEXT; the modem takes at most 1500 bytes per write.
+ */
+#define AT_TCP_RX_CHUNK_SZ	512
+#define AT_TCP_TX_CHUNK_SZ	1024
+
+#if (AT_TCP_RX_CHUNK_SZ + 32) > UART_BUF_SIZE
+#error "AT_TCP_RX_CHUNK_SZ is too large for the UART receive buffer"
+#endif
+
+#endif
@@ -5,6 +5,7 @@ struct rbuf {
 	volatile size_t ridx;
 	volatile size_t widx;
 	size_t sz;
+	size_t mask;
 	uint8_t *data;
 };
 
@@ -24,8 +25,12 @@ rbuf *rbuf_init(size_t len, uint8_t buffer[])
 	size_t idx = find_unused_rbuf();
 	if (idx == SIZE_MAX || buffer == NULL)
 		return NULL;
+	/* Indices are wrapped with a mask, so the size must be a power of 2 */
+	if (len == 0 || (len & (len - 1)) != 0)
+		return NULL;
 	rbuf_used[idx] = true;
 	rbufs[idx].sz = len;
+	rbufs[idx].mask = len - 1;
 	rbufs[idx].data = buffer;
 	rbuf_clear(&rbufs[idx]);
 	return &rbufs[idx];
@@ -37,7 +42,7 @@ bool rbuf_wb(rbuf *r, uint8_t data)
 		return false;
 	if (rbuf_unread(r) == r->sz)
 		return false;
-	const size_t idx = r->widx % r->sz;
+	const size_t idx = r->widx & r->mask;
 	r->data[idx] = data;
 	r->widx++;
 	return true;
@@ -49,12 +54,69 @@ bool rbuf_rb(rbuf *r, uint8_t *data)
 		return false;
 	if (rbuf_unread(r) == 0)
 		return false;
-	const size_t idx = r->ridx % r->sz;
+	const size_t idx = r->ridx & r->mask;
 	*data = r->data[idx];
 	r->ridx++;
 	return true;
 }
 
+size_t rbuf_write(rbuf *r, const uint8_t *data, size_t len)
+{
+	if (r == NULL || data == NULL)
+		return 0;
+	const size_t space = r->sz - rbuf_unread(r);
+	if (len > space)
+		len = space;
+	const size_t idx = r->widx & r->mask;
+	size_t head = r->sz - idx;
+	if (head > len)
+		head = len;
+	memcpy(r->data + idx, data, head);
+	memcpy(r->data, data + head, len - head);
+	r->widx += len;
+	return len;
+}
+
+size_t rbuf_peek(const rbuf * const r, rbuf_span span[RBUF_MAX_SPANS],
+		size_t max)
+{
+	if (r == NULL || span == NULL)
+		return 0;
+	const size_t unread = rbuf_unread(r);
+	const size_t len = (max > unread) ? unread : max;
+	const size_t idx = r->ridx & r->mask;
+	size_t head = r->sz - idx;
+	if (head > len)
+		head = len;
+	span[0].data = r->data + idx;
+	span[0].len = head;
+	span[1].data = r->data;
+	span[1].len = len - head;
+	return len;
+}
+
+bool rbuf_commit(rbuf *r, size_t n)
+{
+	if (r == NULL || n > rbuf_unread(r))
+		return false;
+	r->ridx += n;
+	return true;
+}
+
+size_t rbuf_read(rbuf *r, uint8_t *data, size_t len)
+{
+	if (data == NULL)
+		return 0;
+	rbuf_span span[RBUF_MAX_SPANS];
+	len = rbuf_peek(r, span, len);
+	if (len == 0)
+		return 0;
+	memcpy(data, span[0].data, span[0].len);
+	memcpy(data + span[0].len, span[1].data, span[1].len);
+	rbuf_commit(r, len);
+	return len;
+}
+
 size_t rbuf_unread(const rbuf * const r)
 {
 	if (r == NULL)
@@ -10,11 +10,18 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "at_tcp_defs.h"
 
 /**
- * @brief Maximum number of ring buffers that can be simultaneously be instantiated
+ * @brief Maximum number of ring buffers that can be simultaneously be instantiated,
+ * one for every TCP connection
  */
-#define MAX_RING_BUFS		1
+#define MAX_RING_BUFS		AT_TCP_MAX_SOCKETS
+
+/**
+ * @brief Maximum number of spans needed to describe a region of the ring buffer.
+ */
+#define RBUF_MAX_SPANS		2
 
 struct rbuf;
 
@@ -23,12 +30,48 @@ struct rbuf;
  */
 typedef struct rbuf rbuf;
 
+/**
+ * @brief Contiguous run of unread bytes inside the ring buffer.
+ */
+typedef struct {
+	const uint8_t *data;
+	size_t len;
+} rbuf_span;
+
+/**
+ * @brief Initialize a ring buffer backed by 'buffer'. 'len' must be a power of
+ * two.
+ */
 rbuf *rbuf_init(size_t len, uint8_t buffer[]);
 
 bool rbuf_wb(rbuf *r, uint8_t data);
 
 bool rbuf_rb(rbuf *r, uint8_t *data);
 
+/**
+ * @brief Append up to 'len' bytes. Returns the number of bytes stored, which is
+ * less than 'len' if the ring buffer fills up.
+ */
+size_t rbuf_write(rbuf *r, const uint8_t *data, size_t len);
+
+/**
+ * @brief Copy out and consume up to 'len' unread bytes. Returns the number of
+ * bytes read.
+ */
+size_t rbuf_read(rbuf *r, uint8_t *data, size_t len);
+
+/**
+ * @brief Describe up to 'max' unread bytes in place through at most two spans
+ * without consuming them. Returns the number of bytes covered.
+ */
+size_t rbuf_peek(const rbuf * const r, rbuf_span span[RBUF_MAX_SPANS],
+		size_t max);
+
+/**
+ * @brief Consume 'n' unread bytes, usually after a call to rbuf_peek().
+ */
+bool rbuf_commit(rbuf *r, size_t n);
+
 size_t rbuf_unread(const rbuf * const r);
 
 bool rbuf_clear(rbuf *r);
@@ -547,26 +547,23 @@ bool at_modem_sw_reset(void)
 	return false;
 }
 
-bool at_modem_configure(void)
-{
+static const at_seq_entry modem_conf_seq[] = {
 	/* Switch off TX echo */
-	at_ret_code result = at_core_wcmd(&modem_core[ECHO_OFF], false);
-	CHECK_SUCCESS(result, AT_SUCCESS, false);
-
+	{ .desc = &modem_core[ECHO_OFF], .read_line = false },
 	/* Check if the SIM card is present */
-	result = at_core_wcmd(&modem_core[SIM_READY], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, false);
-
+	{ .desc = &modem_core[SIM_READY], .read_line = true },
 	/* Set error format to numerical */
-	result = at_core_wcmd(&modem_core[CME_CONF], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, false);
-
+	{ .desc = &modem_core[CME_CONF], .read_line = true },
 	/* Enable the Extended Packet Switched network registration URC */
-	result = at_core_wcmd(&modem_core[ExPS_URC_SET], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, false);
-
+	{ .desc = &modem_core[ExPS_URC_SET], .read_line = true },
 	/* Enable the EPS network registration URC */
-	result = at_core_wcmd(&modem_core[EPS_URC_SET], true);
+	{ .desc = &modem_core[EPS_URC_SET], .read_line = true }
+};
+
+bool at_modem_configure(void)
+{
+	at_ret_code result = at_core_wcmd_seq(modem_conf_seq,
+			ARRAY_SIZE(modem_conf_seq), NULL);
 	CHECK_SUCCESS(result, AT_SUCCESS, false);
 
 	return true;
@@ -638,27 +635,16 @@ bool at_modem_init(void)
 
 static bool get_param(enum modem_query_commands cmd, char *buf)
 {
-	bool ret = false;
 	if (buf == NULL)
-		goto exit_func;
-
-	if (!at_tcp_enter_cmd_mode())
-		goto exit_func;
+		return false;
 
 	memset(buf, 0, buf_len[cmd]);
 	modem_query[cmd].rsp_desc[0].data = buf;
 
 	if (at_core_wcmd(&modem_query[cmd], true) != AT_SUCCESS)
-		goto exit_func;
-
-	if (buf[0] == 0x00)
-		goto exit_func;
+		return false;
 
-	ret = true;
-exit_func:
-	if (!at_tcp_leave_cmd_mode())
-		ret = false;
-	return ret;
+	return buf[0] != 0x00;
 }
 
 bool at_modem_get_ip(char *ip)
@@ -7,12 +7,8 @@
 #include "at_modem.h"
 #include "at_toby201_sms_command.h"
 #include "sys.h"
+#include "cc_metrics_def.h"
 
-/*
- * Delay between successive commands in milisecond, datasheet recommends atleast
- * 20mS
- */
-#define AT_COMM_DELAY_MS		20
 #define CHECK_MODEM_DELAY		5000	/* In ms, polling for modem */
 
 #define MAX_TRIES_MODEM_CONFIG	3		/* Retries at configuring modem */
@@ -21,6 +17,7 @@
 #define OUT_PDU_OFFSET		0x02		/* Offset where actual PDU begins */
 
 static at_sms_cb sms_rx_cb;			/* Receive callback */
+static at_sms_buf_cb sms_rx_buf_cb;		/* Picks where data is decoded */
 static at_msg_t msg;				/* Stores SMS segment */
 
 static char addr[ADDR_SZ + 1];			/* Null terminated address */
@@ -42,10 +39,27 @@ static void attempt_pdu_retrieval(void)
 {
 	if (recv_pdu_in_progress) {
 		if (at_core_rx_available() >= wanted_bytes) {
-			/* Read the URC data (PDU string) and decode it into an
-			 * SMS segment */
-			at_core_read((uint8_t *)in_pdu, wanted_bytes);
-			if (!smscodec_decode(wanted_bytes, in_pdu, &msg)) {
+			/*
+			 * Decode the URC data (PDU string) into an SMS segment.
+			 * The PDU is decoded in place unless it wraps around
+			 * the end of the UART buffer.
+			 */
+			uart_span span[UART_MAX_SPANS];
+			const char *pdu = in_pdu;
+			at_core_rx_peek(span, wanted_bytes);
+			if (span[1].len == 0) {
+				pdu = (const char *)span[0].data;
+			} else {
+				memcpy(in_pdu, span[0].data, span[0].len);
+				memcpy(in_pdu + span[0].len, span[1].data,
+						span[1].len);
+			}
+			msg.buf = buf;
+			bool decoded = smscodec_decode_to(wanted_bytes, pdu, &msg,
+					sms_rx_buf_cb);
+			at_core_rx_commit(wanted_bytes);
+			CC_METRIC_ADD(wire_bytes_rcvd, wanted_bytes / 2);
+			if (!decoded) {
 				DEBUG_V0("%s: Unlikely - Failed to decode PDU\n",
 						__func__);
 				return;
@@ -54,8 +68,8 @@ static void attempt_pdu_retrieval(void)
 			if (sms_rx_cb)
 				sms_rx_cb(&msg);
 
-			/* Read the trailing CRLF */
-			at_core_read((uint8_t *)in_pdu, 2);
+			/* Discard the trailing CRLF */
+			at_core_rx_commit(2);
 
 			wanted_bytes = 0;
 			recv_pdu_in_progress = false;
@@ -146,6 +160,17 @@ static at_ret_code check_network_registration(void)
 	return AT_SUCCESS;
 }
 
+static const at_seq_entry sms_conf_seq[] = {
+	/* Enable Phase 2+ features */
+	{ .desc = &sms_cmd[SMS_SET_CSMS], .read_line = true },
+	/* Set CNMI */
+	{ .desc = &sms_cmd[SMS_SET_CNMI], .read_line = true },
+	/* Enter PDU mode */
+	{ .desc = &sms_cmd[SMS_ENTER_PDU_MODE], .read_line = true },
+	/* Delete all stored SMSes */
+	{ .desc = &sms_cmd[SMS_DEL_ALL_MSG], .read_line = true }
+};
+
 static at_ret_code config_modem_for_sms(void)
 {
 	at_ret_code res = AT_FAILURE;
@@ -185,23 +210,7 @@ static at_ret_code config_modem_for_sms(void)
 		return res;
 	}
 
-	/* Enable Phase 2+ features */
-	res = at_core_wcmd(&sms_cmd[SMS_SET_CSMS], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, res);
-
-	/* Set CNMI */
-	res = at_core_wcmd(&sms_cmd[SMS_SET_CNMI], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, res);
-
-	/* Enter PDU mode */
-	res = at_core_wcmd(&sms_cmd[SMS_ENTER_PDU_MODE], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, res);
-
-	/* Delete all stored SMSes */
-	res = at_core_wcmd(&sms_cmd[SMS_DEL_ALL_MSG], true);
-	CHECK_SUCCESS(res, AT_SUCCESS, res);
-
-	return res;
+	return at_core_wcmd_seq(sms_conf_seq, ARRAY_SIZE(sms_conf_seq), NULL);
 }
 
 bool at_init(void)
@@ -210,7 +219,8 @@ bool at_init(void)
 	msg.buf = buf;
 	msg.addr = addr;
 
-	if (!at_core_init(uart_cb, urc_cb, AT_COMM_DELAY_MS))
+	if (!at_core_init(uart_cb, urc_cb, AT_COMM_MIN_DELAY_MS,
+			AT_COMM_MAX_DELAY_MS))
 		return false;
 
 	at_ret_code res = at_core_modem_reset();
@@ -243,15 +253,25 @@ bool at_init(void)
 	return true;
 }
 
-bool at_sms_send(const at_msg_t *sms_seg)
+/*
+ * Encode the segment into out_pdu. Returns the length of the PDU string, not
+ * counting the SMSC address prefix and the trailing Ctrl+Z, or 0 on failure.
+ */
+static uint16_t encode_pdu(const at_msg_t *sms_seg)
 {
-	/* Encode the message into a PDU string and retrieve its length */
 	uint16_t pdu_strlen = smscodec_encode(sms_seg, out_pdu + OUT_PDU_OFFSET);
+	if (pdu_strlen == 0)
+		return 0;
 	out_pdu[0] = '0';
 	out_pdu[1] = '0';
 	out_pdu[OUT_PDU_OFFSET + pdu_strlen] = CTRL_Z;
 	out_pdu[OUT_PDU_OFFSET + pdu_strlen + 1] = '\0';
+	return pdu_strlen;
+}
 
+/* Send the PDU held in out_pdu and wait for the network to confirm it */
+static bool send_pdu(uint16_t pdu_strlen)
+{
 	/* Issue the command to send the PDU over the network */
 	char cmd[13];	/* Enough to store "AT+CMGS=xxx\r\0" */
 	snprintf(cmd, sizeof(cmd), sms_cmd[SMS_SEND].comm_sketch, pdu_strlen / 2);
@@ -263,9 +283,61 @@ bool at_sms_send(const at_msg_t *sms_seg)
 	sms_cmd[SMS_SEND_DATA].comm = out_pdu;
 	res = at_core_wcmd(&sms_cmd[SMS_SEND_DATA], true);
 	CHECK_SUCCESS(res, AT_SUCCESS, false);
+	CC_METRIC_ADD(wire_bytes_sent, pdu_strlen / 2);
 	return true;
 }
 
+bool at_sms_send(const at_msg_t *sms_seg)
+{
+	/* Encode the message into a PDU string and retrieve its length */
+	uint16_t pdu_strlen = encode_pdu(sms_seg);
+	if (pdu_strlen == 0)
+		return false;
+	return send_pdu(pdu_strlen);
+}
+
+bool at_sms_send_multi(const at_msg_t *sms_segs, uint8_t num_segs,
+		uint8_t retries)
+{
+	if (sms_segs == NULL || num_segs == 0)
+		return false;
+
+	/*
+	 * Keep the relay link to the SMSC open between the segments. Without
+	 * it they still go out, each over a link of its own.
+	 */
+	bool link_held = false;
+	if (num_segs > 1)
+		link_held = at_core_wcmd(&sms_cmd[SMS_LINK_HOLD], true) ==
+			AT_SUCCESS;
+
+	bool sent = true;
+	uint16_t pdu_strlen = encode_pdu(&sms_segs[0]);
+	for (uint8_t i = 0; i < num_segs && sent; i++) {
+		sent = false;
+		for (uint8_t try = 0; pdu_strlen > 0 && try <= retries; try++) {
+			if (try > 0)
+				CC_METRIC_INC(retries);
+			sent = send_pdu(pdu_strlen);
+			if (sent)
+				break;
+			DEBUG_V0("%s: Attempt %u at segment %u failed\n",
+					__func__, try, i);
+		}
+		/*
+		 * The next PDU is encoded right away, while the AT layer waits
+		 * out the modem's delay between commands.
+		 */
+		if (sent && i + 1 < num_segs)
+			pdu_strlen = encode_pdu(&sms_segs[i + 1]);
+	}
+
+	if (link_held && at_core_wcmd(&sms_cmd[SMS_LINK_RELEASE], true) !=
+			AT_SUCCESS)
+		DEBUG_V0("%s: Could not release the relay link\n", __func__);
+	return sent;
+}
+
 void at_sms_set_rcv_cb(at_sms_cb cb)
 {
 	if (cb != NULL)
@@ -273,6 +345,11 @@ void at_sms_set_rcv_cb(at_sms_cb cb)
 	return;
 }
 
+void at_sms_set_rcv_buf_cb(at_sms_buf_cb cb)
+{
+	sms_rx_buf_cb = cb;
+}
+
 bool at_sms_ack(void)
 {
 	return (at_core_wcmd(&sms_cmd[SMS_SEND_ACK], true) == AT_SUCCESS) ?
@@ -27,6 +27,8 @@ enum at_modem_sms_commands {
 	SMS_SEND_ACK,
 	SMS_SEND_NACK,
 	SMS_DEL_ALL_MSG,
+	SMS_LINK_HOLD,
+	SMS_LINK_RELEASE,
 	NUM_SMS_COMMANDS
 };
 
@@ -147,6 +149,30 @@ static at_command_desc sms_cmd[NUM_SMS_COMMANDS] = {
 		},
 		.err = "\r\n+CMS ERROR: ",
 		.comm_timeout = 55000
+	},
+	[SMS_LINK_HOLD] = {
+		.comm = "at+cmms=1\r",
+		.rsp_desc = {
+			{
+				.rsp = "\r\nOK\r\n",
+				.rsp_handler = NULL,
+				.data = NULL
+			}
+		},
+		.err = "\r\n+CMS ERROR: ",
+		.comm_timeout = 100
+	},
+	[SMS_LINK_RELEASE] = {
+		.comm = "at+cmms=0\r",
+		.rsp_desc = {
+			{
+				.rsp = "\r\nOK\r\n",
+				.rsp_handler = NULL,
+				.data = NULL
+			}
+		},
+		.err = "\r\n+CMS ERROR: ",
+		.comm_timeout = 100
 	}
 };
 
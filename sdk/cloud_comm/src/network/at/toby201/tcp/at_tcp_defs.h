@@ -11,45 +11,60 @@
 
 #include "at_core.h"
 
+/*
+ * Number of TCP connections that can be open at the same time. The modem
+ * supports up to 7 sockets; every one held here costs an AT_TCP_RX_BUF_SZ
+ * receive buffer.
+ */
+#ifndef AT_TCP_MAX_SOCKETS
+#define AT_TCP_MAX_SOCKETS	4
+#endif
+
+/*
+ * Socket data is read in hex mode (AT+UDCONF=1,1), so every byte takes two
+ * characters on the UART. A whole +USORD response has to fit into the UART
+ * receive buffer, which bounds the size of a single read. Writes go out in
+ * binary after the '@' prompt of +USOWR, the modem takes up to 1024 bytes at a
+ * time.
+ */
+#define AT_TCP_RX_BUF_SZ	256
+#define AT_TCP_TX_CHUNK_SZ	1024
+
+#if (2 * AT_TCP_RX_BUF_SZ + 32) > UART_BUF_SIZE
+#error "AT_TCP_RX_BUF_SZ is too large for the UART receive buffer"
+#endif
+
 /* AT layer internal state machine for TCP */
 typedef enum at_states {
         IDLE = 1,
         /* Network lost indication from cereg and ureg */
         NETWORK_LOST = 1 << 2,
-        /* TCP successfully connected */
-        TCP_CONNECTED = 1 << 3,
-        /* TCP closed gracefully */
-        TCP_CONN_CLOSED = 1 << 4,
-        /* Connected in Direct link (DL) mode which makes socket to UART
-         * connection transparent
-         */
-        DL_MODE = 1 << 7,
-        /* Processing TCP receive call at the moment */
-        TCP_DL_RX = 1 << 8,
-        /* remote side disconnected, to handle this scenario in DL mode, new set
-         * of disconnect state machine is being used as below
-         */
-        TCP_REMOTE_DISCONN = 1 << 9,
         AT_INVALID = 1 << 10
 } at_states;
 
-/* state machine just to process abrupt remote disconnect sequence in dl mode
- */
-typedef enum dis_states {
-        DIS_IDLE = 1,
-        /* disconnect or dl mode escape sequence is partially received */
-        DIS_PARTIAL = 2,
-        DIS_FULL = 3
-} dis_states;
-
-/* It will be used when partial matched bytes are the only left to read out */
-#define DL_PARTIAL_WAIT      1000 /* In mili seconds */
-
-/* Error codes just to process partial escape or disconnect from dl mode
- * sequence when tcp receive is being called
- */
-#define DL_PARTIAL_TO_FULL      -4
-#define DL_PARTIAL_ERROR        -5
-#define DL_PARTIAL_SUC          0
+/* State of a single socket */
+typedef enum at_sock_states {
+        /* Created on the modem through +USOCR */
+        SOCK_CREATED = 1,
+        /* TCP successfully connected */
+        SOCK_CONNECTED = 1 << 1,
+        /* remote side disconnected, reported by +UUSOCL */
+        SOCK_REMOTE_DISCONN = 1 << 2
+} at_sock_states;
+
+/* Entry of the socket table */
+typedef struct _at_socket {
+        /* Socket id assigned by the modem, -1 when the entry is free */
+        int s_id;
+        volatile uint8_t state;
+        /* Unread bytes held by the modem as last reported by +UUSORD or
+         * +USORD
+         */
+        volatile uint16_t pending;
+        /* Bytes read from the modem not yet handed to the caller */
+        uint8_t rx_buf[AT_TCP_RX_BUF_SZ];
+        uint16_t rx_off;
+        uint16_t rx_len;
+} at_socket;
 
 #endif	/* at_tcp_defs.h */
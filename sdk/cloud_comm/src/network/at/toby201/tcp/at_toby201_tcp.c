@@ -17,36 +17,13 @@
 #include "dbg.h"
 #include "at_modem.h"
 
-/*
- * Delay between successive commands in milisecond, datasheet recommends atleast
- * 20mS
- */
-#define AT_COMM_DELAY_MS	20
 #define CHECK_MODEM_DELAY	5000	/* In ms, polling for modem */
 
-/*
- * Intermediate buffer to hold data from uart buffer when disconnect string
- * is detected fully, disconnect string is from the dl mode
- */
-typedef struct _at_intr_buf {
-        /* This buffer does not overflow as it is only being filled when whole
-         * dl disconnect string sequence is detected, total capacity of this
-         * buffer can not exceed beyond UART_RX_BUFFER_SIZE - disconnect string
-         */
-        uint8_t buf[UART_BUF_SIZE];
-        buf_sz ridx;
-        buf_sz buf_unread;
-} at_intr_buf;
-
-/* structure to hold dl mode related information */
-static volatile struct {
-	/* dl mode escape indication string from modem */
-	const char *dis_str;
-        buf_sz l_matched_pos;
-        uint8_t matched_bytes;
-        dis_states dis_state;
-        at_intr_buf dl_buf;
-} dl;
+/* Table of open sockets, an entry is free when its s_id is -1 */
+static at_socket socks[AT_TCP_MAX_SOCKETS];
+
+/* Signalled when a socket receives data or is closed by the remote side */
+static sys_completion rx_event;
 
 static volatile at_states state;
 
@@ -64,224 +41,110 @@ static volatile bool pdp_conf;
  */
 #define PDP_CTX_STABLE_MS	500
 
-static at_ret_code __at_process_dl_close_urc(const char *urc, at_urc u_code)
+/* The modem wants at least this long between the '@' prompt and the data */
+#define WRITE_PROMPT_DELAY_MS	50
+
+/* Private data of the +USORD response handler */
+static struct {
+        at_socket *sock;
+        uint16_t wanted;
+} read_req;
+
+static int __at_hex_val(char c)
 {
-        if (strncmp(urc, at_urcs[u_code], strlen(at_urcs[u_code])) == 0) {
-                state &= ~DL_MODE;
-                DEBUG_V0("%s:%d: direct link mode closed\n", __func__, __LINE__);
-                return AT_SUCCESS;
-        } else
-                return AT_FAILURE;
+        if (c >= '0' && c <= '9')
+                return c - '0';
+        if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+        return -1;
 }
 
-static at_ret_code __at_process_pdp_tcp_close_urc(const char *urc, at_urc u_code)
+/*
+ * Parse a decimal number at *str, not going past end. On success, *str is
+ * moved past the number.
+ */
+static bool __at_parse_uint(const char **str, const char *end, uint32_t *val)
 {
-	if (strncmp(urc, at_urcs[u_code], strlen(at_urcs[u_code])) == 0) {
-		switch (u_code) {
-			case TCP_CLOSED:
-				state = TCP_REMOTE_DISCONN;
-				DEBUG_V0("%s: tcp closed\n", __func__);
-				return AT_SUCCESS;
-			case PDP_DEACT:
-				DEBUG_V0("%s: pdp closed\n", __func__);
-				pdp_conf = false;
-				return AT_SUCCESS;
-			default:
-				break;
-		}
-	}
-	return AT_FAILURE;
+        const char *p = *str;
+        uint32_t v = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+                v = v * 10 + (*p - '0');
+                p++;
+        }
+        if (p == *str)
+                return false;
+        *str = p;
+        *val = v;
+        return true;
 }
 
-static void __at_lookup_dl_esc_str(void)
+static at_socket *__at_find_sock(int s_id)
 {
-        int nw_f;
-        int cur_f = 0;
-        uint8_t itr = 0;
-        for (; itr < strlen(dl.dis_str); itr++) {
-                nw_f = at_core_find_pattern(-1, (uint8_t *)dl.dis_str, itr + 1);
-                if (nw_f == -1) {
-                        if (dl.dis_state == DIS_IDLE) {
-                                if (itr > 0) {
-                                        /* this may happen when string
-                                         * truely is partially received and
-                                         * buffer is scanned completely
-                                         */
-                                        dl.dis_state = DIS_PARTIAL;
-                                        dl.matched_bytes = itr;
-                                        dl.l_matched_pos = cur_f;
-                                }
-                        } else if (dl.dis_state == DIS_PARTIAL) {
-                                if (itr == 0) {
-                                        /* this condition is possible if tcp
-                                         * rcv happend before this
-                                         * and new chunk does not match
-                                         * in that case back to reset
-                                         */
-                                         dl.dis_state = DIS_IDLE;
-                                         dl.matched_bytes = 0;
-                                         dl.l_matched_pos = -1;
-                                } else {
-                                        /* this is possible when partial pattern
-                                         * just happens to be in the binary data
-                                         * and has not received escape pattern
-                                         * yet
-                                         * reset everything and start over for
-                                         * the new chunk of data arrives
-                                         *
-                                         * there is no possibility that it may
-                                         * find same number of bytes somewhere
-                                         * else since pattern finding logic just
-                                         * returns as soon as it finds position
-                                         */
-                                        if (dl.matched_bytes == itr) {
-                                                if (dl.l_matched_pos == cur_f) {
-                                                        dl.dis_state = DIS_IDLE;
-                                                        dl.matched_bytes = 0;
-                                                        dl.l_matched_pos = -1;
-                                                } else
-                                                        DEBUG_V0("%d:UERR#@$\n",
-                                                                __LINE__);
-
-                                        } else {
-                                        /* new chunk received has matched new
-                                         * set of bytes and may be new
-                                         * position, itr can be greater or less
-                                         * from previously matched bytes based
-                                         * if tcp rcv call happened before this
-                                         * new arrival
-                                         */
-                                                dl.matched_bytes = itr;
-                                                dl.l_matched_pos = cur_f;
-                                        }
-                                }
-                        } else
-                                DEBUG_V0("%d:UERR\n", __LINE__);
-                        return;
-                } else
-                        cur_f = nw_f;
-        }
-        dl.dis_state = DIS_FULL;
-        dl.matched_bytes = 0;
-        dl.l_matched_pos = -1;
+        for (uint8_t i = 0; i < AT_TCP_MAX_SOCKETS; i++)
+                if (socks[i].s_id == s_id)
+                        return &socks[i];
+        return NULL;
 }
 
-/* Function will be called when full disconnect string is detected when remote
- * side closes connection abruptly
- * It will transfer binary data into AT layer intermediate buffer till
- * end of the disconnect string by comparing every character it reads to the
- * hardcoded disconnect string, after that it will process all remaining bytes
- * from the uart buffer as it may contain URCs while in a DL mode
- * For example: UART buffer possible state as below:
- *		[<binary data>,<disconnect string>,<URCs>]
- *		Function will transfer "binary data " to intermediate buffer
- *		Optionally can proces "URCs" if present
- */
+static void __at_free_sock(at_socket *sock)
+{
+        sock->s_id = -1;
+        sock->state = 0;
+        sock->pending = 0;
+        sock->rx_off = 0;
+        sock->rx_len = 0;
+}
 
-static void __at_xfer_to_buf()
+/* Handle "+UUSOCL: <s_id>" and "+UUSORD: <s_id>,<len>" */
+static at_ret_code __at_process_sock_urc(const char *urc, at_urc u_code)
 {
-	dl.dl_buf.ridx = 0;
-	buf_sz sz = at_core_rx_available();
-	if (sz == 0) {
-		DEBUG_V0("%d:UERR\n", __LINE__);
-		dl.dl_buf.buf_unread = 0;
-		return;
-	}
-	DEBUG_V0("%d:SZ_A:%d\n", __LINE__, sz);
-	/* 3 is to account for trailing x\r\n, where x is socket id */
-	if ((sz - (strlen(dl.dis_str) + 3)) == 0)
-		at_core_clear_rx();
-	else {
-		buf_sz start_idx = 0;
-		/* Index to keep track matched characters from dl.dis_str string
-		*/
-		buf_sz match_idx = 0;
-		/* Index to starting position of the matched string, we need
-		 * this to use it as a size of binary data as from found_idx till
-		 * strlen(dl.dis_str) + 3 will be disconnect string and will be
-		 * ignored
-		 */
-		buf_sz found_idx = 0;
-		bool found_start = false;
-		/* This will be set to reset match_idx when partial disconnect
-		 * string (can be binary data) and actual disconnect string are
-		 * adjacent, for example: "matcmatched", where "matched" is the
-		 * string we are looking for and "matc" just happens to be binary
-		 * data placed togather
-		 */
-		bool skip_read = false;
-		while (1) {
-			if (start_idx >= sz)
-				break;
-			if (!skip_read) {
-				if (at_core_read((uint8_t *)dl.dl_buf.buf +
-							start_idx, 1) != 1)
-					break;
-			}
-			if (dl.dis_str[match_idx] == dl.dl_buf.buf[start_idx]) {
-				if (!found_start) {
-					found_start = true;
-					found_idx = start_idx;
-				}
-				match_idx++;
-				start_idx++;
-				skip_read = false;
-			} else {
-				if (found_start) {
-					found_start = false;
-					skip_read = true;
-				} else {
-					start_idx++;
-					skip_read = false;
-				}
-				found_idx = 0;
-				match_idx = 0;
-			}
-			if (found_start && (match_idx == strlen(dl.dis_str)))
-				break;
-		}
-
-		if (!found_start || (found_idx == 0)) {
-			DEBUG_V0("%d:UERR\n", __LINE__);
-			goto done;
-		}
-		/* we are only interested in data till found_idx as after that it
-		 * will be dl.dl_str string which we don't care
-		 */
-		dl.dl_buf.buf_unread = found_idx;
-		/* 3 is to account for trailing x\r\n, where x is socket id */
-		uint8_t temp_buf[3];
-		if (at_core_read(temp_buf, 3) != 3) {
-			DEBUG_V0("%d:UERR\n", __LINE__);
-			goto done;
-		}
-		/* Since we processed all the disconnect string, there may be
-		 * other URCs buffered in the modem while we were in DL Mode
-		 */
-		at_core_process_urc(true);
+        size_t pfx_len = strlen(at_urcs[u_code]);
+        if (strncmp(urc, at_urcs[u_code], pfx_len) != 0)
+                return AT_FAILURE;
 
-		return;
-done:
-		dl.dl_buf.buf_unread = 0;
-		dl.dl_buf.ridx = 0;
-		at_core_clear_rx();
-		return;
+        const char *p = urc + pfx_len;
+        const char *end = urc + strlen(urc);
+        uint32_t s_id;
+        if (!__at_parse_uint(&p, end, &s_id))
+                return AT_SUCCESS;
+        at_socket *sock = __at_find_sock(s_id);
+        if (!sock) {
+                DEBUG_V0("%s: urc for unknown socket: %u\n", __func__, s_id);
+                return AT_SUCCESS;
+        }
+
+        if (u_code == TCP_CLOSED) {
+                sock->state &= ~SOCK_CONNECTED;
+                sock->state |= SOCK_REMOTE_DISCONN;
+                DEBUG_V0("%s: tcp closed: %u\n", __func__, s_id);
+        } else {
+                uint32_t len;
+                if (p < end && *p == ',') {
+                        p++;
+                        if (__at_parse_uint(&p, end, &len))
+                                sock->pending = len;
+                }
+                DEBUG_V1("%s: %u bytes on socket %u\n", __func__,
+                                sock->pending, s_id);
         }
+        sys_completion_signal(&rx_event);
+        return AT_SUCCESS;
+}
+
+static at_ret_code __at_process_pdp_close_urc(const char *urc)
+{
+	if (strncmp(urc, at_urcs[PDP_DEACT], strlen(at_urcs[PDP_DEACT])) != 0)
+		return AT_FAILURE;
+	DEBUG_V0("%s: pdp closed\n", __func__);
+	pdp_conf = false;
+	return AT_SUCCESS;
 }
 
 static void at_uart_callback(void)
 {
-	if (((state & DL_MODE) == DL_MODE) &&
-			((state & TCP_DL_RX) != TCP_DL_RX)) {
-		if (dl.dis_state < DIS_FULL) {
-			__at_lookup_dl_esc_str();
-			if (dl.dis_state == DIS_FULL) {
-				state = TCP_REMOTE_DISCONN;
-				__at_xfer_to_buf();
-			}
-		}
-	} else if (!at_core_is_proc_rsp() && !at_core_is_proc_urc() &&
-			((state & DL_MODE) != DL_MODE)) {
+	if (!at_core_is_proc_rsp() && !at_core_is_proc_urc()) {
 		DEBUG_V1("%s: urc from callback:%d\n",
 				__func__, state);
 		at_core_process_urc(false);
@@ -292,15 +155,13 @@ static void at_uart_callback(void)
 
 static void urc_callback(const char *urc)
 {
-	at_ret_code result = __at_process_pdp_tcp_close_urc(urc, TCP_CLOSED);
-	if (result == AT_SUCCESS)
+	if (__at_process_sock_urc(urc, DATA_READY) == AT_SUCCESS)
 		return;
 
-	result = __at_process_dl_close_urc(urc, DISCONNECT);
-	if (result == AT_SUCCESS)
+	if (__at_process_sock_urc(urc, TCP_CLOSED) == AT_SUCCESS)
 		return;
 
-	result = __at_process_pdp_tcp_close_urc(urc, PDP_DEACT);
+	__at_process_pdp_close_urc(urc);
 }
 
 static inline at_ret_code __at_check_network_registration()
@@ -314,12 +175,8 @@ static at_ret_code __at_modem_conf()
 {
         at_ret_code result = AT_SUCCESS;
 
-        /* set escape sequence delay */
-        char temp_comm[TEMP_COMM_LIMIT];
-        at_command_desc *desc = &tcp_comm[ESCAPE_TIME_CONF];
-        snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, DL_MODE_ESC_TIME);
-        desc->comm = temp_comm;
-        result = at_core_wcmd(desc, true);
+        /* Socket data is exchanged hex encoded */
+        result = at_core_wcmd(&tcp_comm[HEX_MODE_CONF], true);
         CHECK_SUCCESS(result, AT_SUCCESS, result);
 
         /* Check MNO configuration, if it is not set for the Verizon, configure
@@ -364,14 +221,12 @@ static at_ret_code __at_modem_conf()
 
 bool at_init()
 {
-        dl.dis_str = "\r\nDISCONNECT\r\n\r\nOK\r\n\r\n+UUSOCL: ";
-        dl.l_matched_pos = -1;
-        dl.matched_bytes = 0;
-        dl.dl_buf.buf_unread = 0;
-        dl.dl_buf.ridx= 0;
-        dl.dis_state = DIS_IDLE;
-
-	bool res = at_core_init(at_uart_callback, urc_callback, AT_COMM_DELAY_MS);
+        for (uint8_t i = 0; i < AT_TCP_MAX_SOCKETS; i++)
+                __at_free_sock(&socks[i]);
+        sys_completion_init(&rx_event);
+
+	bool res = at_core_init(at_uart_callback, urc_callback, AT_COMM_MIN_DELAY_MS,
+			AT_COMM_MAX_DELAY_MS);
 	CHECK_SUCCESS(res, true, false);
 
         state = IDLE;
@@ -398,61 +253,6 @@ bool at_init()
 
 }
 
-static void __at_reset_dl_state(void)
-{
-        dl.dis_state = DIS_IDLE;
-        dl.dl_buf.buf_unread = 0;
-        dl.dl_buf.ridx = 0;
-        dl.l_matched_pos = -1;
-        dl.matched_bytes = 0;
-}
-
-static at_ret_code __at_esc_dl_mode(void)
-{
-        sys_delay(DL_ESC_TIME_MS);
-        at_command_desc *desc = &tcp_comm[ESCAPE_DL_MODE];
-        at_ret_code result = at_core_wcmd(desc, true);
-        if (AT_COMM_DELAY_MS < DL_ESC_TIME_MS)
-                sys_delay(DL_ESC_TIME_MS - DL_ESC_TIME_MS);
-
-        if (result != AT_SUCCESS)
-                DEBUG_V0("%s:%d: unable to exit dl mode\n", __func__, __LINE__);
-        else
-                DEBUG_V0("%s:%d: exited from dl mode\n", __func__, __LINE__);
-        state &= ~DL_MODE;
-        return result;
-}
-
-static at_ret_code __at_set_dl_mode(int s_id)
-{
-        if ((state & TCP_CONNECTED) != TCP_CONNECTED)
-                return AT_FAILURE;
-        at_command_desc *desc = &tcp_comm[TCP_DL_MODE];
-        char temp_comm[TEMP_COMM_LIMIT];
-        snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, s_id);
-
-        desc->comm = temp_comm;
-        at_ret_code result = at_core_wcmd(desc, true);
-        if (result == AT_SUCCESS) {
-                state |= DL_MODE;
-                DEBUG_V0("%s:%d: direct mode enabled\n", __func__, __LINE__);
-        } else
-                state &= ~DL_MODE;
-
-        return result;
-
-}
-
-static at_ret_code __at_conf_dl_mode(int s_id)
-{
-        at_command_desc *desc = &tcp_comm[DL_CONG_CONF];
-        char temp_comm[TEMP_COMM_LIMIT];
-        snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, s_id);
-
-        desc->comm = temp_comm;
-        return at_core_wcmd(desc, true);
-}
-
 static void __at_parse_tcp_conf_rsp(void *rcv_rsp, int rcv_rsp_len,
                                 const char *stored_rsp , void *data)
 {
@@ -465,13 +265,81 @@ static void __at_parse_tcp_conf_rsp(void *rcv_rsp, int rcv_rsp_len,
                 *((int *)data) = -1;
                 return;
         }
-        int s_id = (*((char *)(rcv_rsp + count))) - '0';
+        const char *p = (const char *)rcv_rsp + count;
+        uint32_t s_id;
+        if (!__at_parse_uint(&p, (const char *)rcv_rsp + rcv_rsp_len, &s_id)) {
+                DEBUG_V0("%s: malformed rsp\n", __func__);
+                *((int *)data) = -1;
+                return;
+        }
         *((int *)data) = s_id;
         DEBUG_V1("%s: processed tcp config rsp: %d\n",
                                 __func__, *((int *)data));
 }
 
-static int __at_tcp_connect(const char *host, const char *port)
+/* "+USOWR: <s_id>,<len>", stores the number of bytes the modem accepted */
+static void __at_parse_write_rsp(void *rcv_rsp, int rcv_rsp_len,
+                                const char *stored_rsp, void *data)
+{
+        if (!data)
+                return;
+        const char *p = (const char *)rcv_rsp + strlen(stored_rsp);
+        const char *end = (const char *)rcv_rsp + rcv_rsp_len;
+        uint32_t s_id;
+        uint32_t len;
+        *((int *)data) = -1;
+        if (!__at_parse_uint(&p, end, &s_id) || p >= end || *p++ != ',' ||
+                        !__at_parse_uint(&p, end, &len)) {
+                DEBUG_V0("%s: malformed rsp\n", __func__);
+                return;
+        }
+        *((int *)data) = len;
+}
+
+/*
+ * "+USORD: <s_id>,<len>,"<hex data>"", decodes the data into the receive
+ * buffer of the socket being read and updates the count of bytes the modem
+ * still holds.
+ */
+static void __at_parse_read_rsp(void *rcv_rsp, int rcv_rsp_len,
+                                const char *stored_rsp, void *data)
+{
+        if (!read_req.sock)
+                return;
+        at_socket *sock = read_req.sock;
+        const char *p = (const char *)rcv_rsp + strlen(stored_rsp);
+        const char *end = (const char *)rcv_rsp + rcv_rsp_len;
+        uint32_t s_id;
+        uint32_t len;
+        if (!__at_parse_uint(&p, end, &s_id) || p >= end || *p++ != ',' ||
+                        !__at_parse_uint(&p, end, &len) ||
+                        len > AT_TCP_RX_BUF_SZ ||
+                        end - p < (int)(2 * len + 3) ||
+                        p[0] != ',' || p[1] != '"') {
+                DEBUG_V0("%s: malformed rsp\n", __func__);
+                return;
+        }
+        p += 2;
+        for (uint32_t i = 0; i < len; i++) {
+                int hi = __at_hex_val(p[2 * i]);
+                int lo = __at_hex_val(p[2 * i + 1]);
+                if (hi < 0 || lo < 0) {
+                        DEBUG_V0("%s: invalid hex data\n", __func__);
+                        return;
+                }
+                sock->rx_buf[i] = (hi << 4) | lo;
+        }
+        sock->rx_off = 0;
+        sock->rx_len = len;
+        /* Getting less than asked for means the modem has been drained */
+        if (len < read_req.wanted || len >= sock->pending)
+                sock->pending = 0;
+        else
+                sock->pending -= len;
+}
+
+static int __at_tcp_connect(at_socket *sock, const char *host,
+                                const char *port)
 {
         int s_id = -1;
         at_ret_code result = AT_SUCCESS;
@@ -480,11 +348,14 @@ static int __at_tcp_connect(const char *host, const char *port)
 
         /* Configure tcp connection first to be tcp client */
         result = at_core_wcmd(desc, true);
-        CHECK_SUCCESS(result, AT_SUCCESS, -1);
+        CHECK_SUCCESS(result, AT_SUCCESS, AT_SOCKET_FAILED);
         if (s_id < 0) {
                 DEBUG_V0("%s: could not get socket: %d\n", __func__, s_id);
                 return AT_SOCKET_FAILED;
         }
+        /* Claim the entry before connecting so that URCs can find it */
+        sock->s_id = s_id;
+        sock->state = SOCK_CREATED;
 
         /* Now make remote connection */
         desc = &tcp_comm[TCP_CONN];
@@ -494,48 +365,46 @@ static int __at_tcp_connect(const char *host, const char *port)
 
         desc->comm = temp_comm;
         result = at_core_wcmd(desc, true);
+        if (result != AT_SUCCESS) {
+                at_tcp_close(s_id);
+                return AT_CONNECT_FAILED;
+        }
 
-        CHECK_SUCCESS(result, AT_SUCCESS, AT_CONNECT_FAILED);
-
-        state |= TCP_CONNECTED;
-        state &= ~TCP_CONN_CLOSED;
-        state &= ~TCP_REMOTE_DISCONN;
+        sock->state |= SOCK_CONNECTED;
         DEBUG_V0("%s: socket:%d created\n", __func__, s_id);
         return s_id;
 }
 
-static at_ret_code __at_pdp_conf(void)
-{
-	at_ret_code result = AT_FAILURE;
+static const at_seq_entry pdp_conf_seq[] = {
 #if SIM_TYPE == M2M
-	result = at_core_wcmd(&pdp_conf_comm[ADD_PDP_CTX], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, result);
-	result = at_core_wcmd(&pdp_conf_comm[ACT_PDP_CTX], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, result);
-	result = at_core_wcmd(&pdp_conf_comm[MAP_PDP_PROFILE], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, result);
+	{ .desc = &pdp_conf_comm[ADD_PDP_CTX], .read_line = true },
+	{ .desc = &pdp_conf_comm[ACT_PDP_CTX], .read_line = true },
+	{ .desc = &pdp_conf_comm[MAP_PDP_PROFILE], .read_line = true },
 #endif
-	result = at_core_wcmd(&pdp_conf_comm[SEL_IPV4], true);
-	CHECK_SUCCESS(result, AT_SUCCESS, result);
-	return at_core_wcmd(&pdp_conf_comm[ACT_PDP_PROFILE], true);
+	{ .desc = &pdp_conf_comm[SEL_IPV4], .read_line = true },
+	{ .desc = &pdp_conf_comm[ACT_PDP_PROFILE], .read_line = true }
+};
+
+static at_ret_code __at_pdp_conf(void)
+{
+	return at_core_wcmd_seq(pdp_conf_seq, ARRAY_SIZE(pdp_conf_seq), NULL);
 }
 
 int at_tcp_connect(const char *host, const char *port)
 {
 
         CHECK_NULL(host, -1);
-        if ((state & DL_MODE) == DL_MODE) {
-                DEBUG_V0("%s: Direct link mode is already on, tcp connect not "
-                        "possible, state :%u\n",__func__, state);
+        CHECK_NULL(port, -1);
+        if (state != IDLE) {
+                DEBUG_V0("%s: TCP connect not possible, state :%u\n",
+                                __func__, state);
                 return -1;
         }
-        if (state > IDLE) {
-		if ((state & TCP_CONN_CLOSED) != TCP_CONN_CLOSED &&
-			(state & TCP_REMOTE_DISCONN) != TCP_REMOTE_DISCONN) {
-			DEBUG_V0("%s: TCP connect not possible, state :%u\n",
-					__func__, state);
-			return -1;
-		}
+        at_socket *sock = __at_find_sock(-1);
+        if (!sock) {
+                DEBUG_V0("%s: all %u sockets are in use\n", __func__,
+                                AT_TCP_MAX_SOCKETS);
+                return AT_SOCKET_FAILED;
         }
         if (!pdp_conf) {
                 if (__at_pdp_conf() != AT_SUCCESS) {
@@ -545,35 +414,34 @@ int at_tcp_connect(const char *host, const char *port)
                 pdp_conf = true;
 		sys_delay(PDP_CTX_STABLE_MS);
         }
-        int s_id = __at_tcp_connect(host, port);
-        if (s_id >= 0) {
-                at_ret_code result1 = __at_conf_dl_mode(s_id);
-                at_ret_code result2 = __at_set_dl_mode(s_id);
-                if ((result1 != AT_SUCCESS) || (result2 != AT_SUCCESS)) {
-                        DEBUG_V0("%s:%d: setting dl mode failed\n",
-                                        __func__, __LINE__);
-                        at_tcp_close(s_id);
-                        return AT_CONNECT_FAILED;
-                }
-        }
-        __at_reset_dl_state();
-        return s_id;
+        return __at_tcp_connect(sock, host, port);
 }
 
-static int __at_tcp_tx(const uint8_t *buf, size_t len)
+/* Write at most AT_TCP_TX_CHUNK_SZ bytes, returns the number accepted */
+static int __at_tcp_tx(at_socket *sock, const uint8_t *buf, size_t len)
 {
-        for (int i = 0; i < len; i++) {
-                if ((state & TCP_CONNECTED) == TCP_CONNECTED) {
-                        if (!at_core_write(((uint8_t *)buf + i), 1))
-                                return AT_TCP_SEND_FAIL;
-                } else {
-                        DEBUG_V0("%s: diconnected in middle of the write\n",
-                                __func__);
-                        state &= ~TCP_CONN_CLOSED;
+        if (len > AT_TCP_TX_CHUNK_SZ)
+                len = AT_TCP_TX_CHUNK_SZ;
+
+        int written = -1;
+        char temp_comm[TEMP_COMM_LIMIT];
+        at_command_desc *desc = &tcp_comm[TCP_WRITE];
+        snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, sock->s_id,
+                        (unsigned int)len);
+        desc->comm = temp_comm;
+        at_ret_code result = at_core_wcmd(desc, false);
+        if (result == AT_SUCCESS) {
+                sys_delay(WRITE_PROMPT_DELAY_MS);
+                desc = &tcp_comm[TCP_WRITE_DATA];
+                desc->rsp_desc[0].data = &written;
+                result = at_core_wdata(desc, buf, len, true);
+        }
+        if (result != AT_SUCCESS || written < 0) {
+                if ((sock->state & SOCK_REMOTE_DISCONN) == SOCK_REMOTE_DISCONN)
                         return AT_TCP_CONNECT_DROPPED;
-                }
+                return AT_TCP_SEND_FAIL;
         }
-        return 0;
+        return written;
 }
 
 int at_tcp_send(int s_id, const unsigned char *buf, size_t len)
@@ -582,173 +450,71 @@ int at_tcp_send(int s_id, const unsigned char *buf, size_t len)
         if ((s_id < 0) || (len == 0))
                 return AT_TCP_INVALID_PARA;
 
-        if ((state & TCP_CONNECTED) != TCP_CONNECTED) {
-                if ((state & TCP_CONN_CLOSED) == TCP_CONN_CLOSED)
-                        return 0;
+        at_socket *sock = __at_find_sock(s_id);
+        if (!sock)
+                return AT_TCP_INVALID_PARA;
+        if ((sock->state & SOCK_CONNECTED) != SOCK_CONNECTED) {
                 DEBUG_V0("%s: tcp not connected\n", __func__);
                 return AT_TCP_SEND_FAIL;
         }
 
-        if ((state & DL_MODE) == DL_MODE) {
-                int result = __at_tcp_tx(buf, len);
-                if (result != 0) {
+        size_t sent = 0;
+        while (sent < len) {
+                int res = __at_tcp_tx(sock, buf + sent, len - sent);
+                if (res <= 0) {
                         DEBUG_V0("%s:%d: write failed\n", __func__, __LINE__);
-                        return result;
+                        /* Report what made it out before the failure */
+                        return (sent > 0) ? (int)sent :
+                                ((res == 0) ? AT_TCP_SEND_FAIL : res);
                 }
-                DEBUG_V1("%s: data written in dl mode: %d\n", __func__, len);
-                return len;
-        } else {
-                DEBUG_V0("%s:%d: data send failed (no dl mode)\n",
-                        __func__, __LINE__);
-                return AT_TCP_SEND_FAIL;
-        }
-}
-
-int at_read_available(int s_id)
-{
-
-        (void)(s_id);
-        if ((state & TCP_CONNECTED) != TCP_CONNECTED) {
-                if ((state & TCP_CONN_CLOSED) == TCP_CONN_CLOSED)
-                        return 0;
-                if (dl.dl_buf.buf_unread > 0)
-                        return dl.dl_buf.buf_unread;
-                DEBUG_V0("%s: tcp not connected to read\n", __func__);
-                return AT_TCP_RCV_FAIL;
+                sent += res;
         }
-
-        if ((state & DL_MODE) != DL_MODE) {
-                DEBUG_V0("%s:%d: dl mode is off\n", __func__, __LINE__);
-                return AT_TCP_RCV_FAIL;
-        }
-        return at_core_rx_available();
+        DEBUG_V1("%s: data written: %d\n", __func__, (int)len);
+        return sent;
 }
 
-static int __at_calc_new_len(void)
+void at_tcp_wait_rx(uint32_t timeout_ms)
 {
-        buf_sz n_sz = at_core_rx_available();
-        if (dl.matched_bytes > n_sz) {
-                DEBUG_V0("%s:%d: Unlkly error\n", __func__, __LINE__);
-                __at_reset_dl_state();
-                return DL_PARTIAL_ERROR;
-        }
-        buf_sz a_avail = n_sz - dl.matched_bytes;
-        DEBUG_V0("%s:%d: New avail in partial mode:%u, matched bytes:%u\n",
-                __func__, __LINE__, a_avail, dl.matched_bytes);
-        return a_avail;
+        sys_completion_wait(&rx_event, timeout_ms);
 }
 
-static int __at_process_intr_buffer(unsigned char *buf, size_t len)
+int at_read_available(int s_id)
 {
-        if (dl.dl_buf.buf_unread == 0) {
-                dl.dl_buf.ridx = 0;
-                return 0;
+        at_socket *sock = __at_find_sock(s_id);
+        if (s_id < 0 || !sock)
+                return AT_TCP_RCV_FAIL;
+        if (sock->rx_len > 0)
+                return sock->rx_len;
+        if (sock->pending > 0)
+                return sock->pending;
+        if ((sock->state & SOCK_CONNECTED) != SOCK_CONNECTED) {
+                DEBUG_V0("%s: tcp not connected to read\n", __func__);
+                return AT_TCP_RCV_FAIL;
         }
-
-        size_t read_b = (len < dl.dl_buf.buf_unread) ? len : dl.dl_buf.buf_unread;
-        memcpy(buf, (uint8_t *)dl.dl_buf.buf + dl.dl_buf.ridx, read_b);
-        dl.dl_buf.buf_unread = dl.dl_buf.buf_unread - read_b;
-        dl.dl_buf.ridx += read_b;
-        return read_b;
+        return 0;
 }
 
-static int __at_test_dl_partial_state()
+/* Read as much as fits into the socket's receive buffer from the modem */
+static void __at_tcp_fill(at_socket *sock)
 {
-	switch (dl.dis_state) {
-	case DIS_PARTIAL:
-                DEBUG_V1("%s:%d: unchanged state\n",__func__, __LINE__);
-                return DL_PARTIAL_SUC;
-	case DIS_FULL:
-                DEBUG_V1("%s:%d: partial became full\n", __func__, __LINE__);
-                return DL_PARTIAL_TO_FULL;
-	case DIS_IDLE:
-                DEBUG_V1("%s:%d: fake partial detected\n",__func__, __LINE__);
-		/* Fall through */
-	default:
-                return DL_PARTIAL_ERROR;
-	}
-}
+        uint16_t wanted = sock->pending;
+        if (wanted > AT_TCP_RX_BUF_SZ)
+                wanted = AT_TCP_RX_BUF_SZ;
 
-static int __at_process_rcv_dl_partial(size_t len)
-{
-        buf_sz prev_matched = dl.matched_bytes;
-        buf_sz prev_pos = dl.l_matched_pos;
-        buf_sz sz = at_core_rx_available();
-
-        if (prev_matched > sz) {
-                DEBUG_V0("%s:%d: matched bytes (%u) greater then avail (%u)\n",
-                        __func__, __LINE__, prev_matched, sz);
-                __at_reset_dl_state();
-                return DL_PARTIAL_ERROR;
+        at_command_desc *desc = &tcp_comm[TCP_READ];
+        char temp_comm[TEMP_COMM_LIMIT];
+        snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, sock->s_id,
+                        wanted);
+        desc->comm = temp_comm;
+        read_req.sock = sock;
+        read_req.wanted = wanted;
+        at_ret_code result = at_core_wcmd(desc, true);
+        read_req.sock = NULL;
+        if (result != AT_SUCCESS) {
+                /* A later +UUSORD reports whatever is still there */
+                DEBUG_V0("%s: read failed: %d\n", __func__, result);
+                sock->pending = 0;
         }
-        buf_sz a_avail = sz - prev_matched;
-        DEBUG_V0("%s:%d: In partial mode:%u,bytes matched:%u\n",
-                __func__, __LINE__, a_avail, prev_matched);
-
-        /* we have read it out all the bytes but the matched partial
-         * response bytes, look for escape string again and check state machine
-         * if it has not changed, give a last try wait for some time to check if
-         * partial response is really a part of the dl escape sequence or just
-         * binary blob happen to be residing at the bottom of buffer matching
-         * partially
-         */
-        if (a_avail == 0) {
-                DEBUG_V0("%s:%d: Only partial matched byte is available\n",
-                        __func__, __LINE__);
-
-                state |= TCP_DL_RX;
-                __at_lookup_dl_esc_str();
-                state &= ~TCP_DL_RX;
-
-                int r = __at_test_dl_partial_state();
-                if (r != DL_PARTIAL_SUC)
-                        return r;
-
-                DEBUG_V0("%s:%d: Waiting for more bytes if any\n",
-                        __func__, __LINE__);
-
-                sys_delay(DL_PARTIAL_WAIT);
-
-                r = __at_test_dl_partial_state();
-                if (r != DL_PARTIAL_SUC)
-                        return r;
-
-                /* chances that last bytes are binary remnants , check if it
-                 * still partial state assuming during that delay new bytes have
-                 * arrived
-                 */
-                if (prev_pos != dl.l_matched_pos) {
-                        int res = __at_calc_new_len();
-                        if (res == DL_PARTIAL_ERROR)
-                                return DL_PARTIAL_ERROR;
-                        DEBUG_V0("%s:%d: new available: (%u)\n",
-                                __func__, __LINE__, res);
-                        a_avail = (buf_sz)res;
-                } else {
-                        if (prev_matched == dl.matched_bytes) {
-                                /* no change in data, consider this as a
-                                 * binary blob and reset dl escape mode
-                                 * state machine
-                                 */
-                                a_avail = at_core_rx_available();
-                                __at_reset_dl_state();
-                        } else if (dl.matched_bytes > prev_matched) {
-                                DEBUG_V0("%s:%d: Escape response"
-                                        " is still in progress\n",
-                                        __func__, __LINE__);
-                                errno = EAGAIN;
-                                return AT_TCP_RCV_FAIL;
-                        } else {
-                                DEBUG_V0("%s:%d: Unlikely error\n",
-                                        __func__, __LINE__);
-                                __at_reset_dl_state();
-                                return DL_PARTIAL_ERROR;
-                        }
-
-                }
-        } /* available if ends */
-
-        return a_avail;
 }
 
 int at_tcp_recv(int s_id, unsigned char *buf, size_t len)
@@ -757,100 +523,57 @@ int at_tcp_recv(int s_id, unsigned char *buf, size_t len)
                 DEBUG_V0("%s: socket or buffer invalid\n", __func__);
                 return AT_TCP_INVALID_PARA;
         }
-        (void)(s_id);
-        if ((state & TCP_CONNECTED) != TCP_CONNECTED) {
-                if ((state & TCP_CONN_CLOSED) == TCP_CONN_CLOSED)
-                        return 0;
-                /* Look into intermediate buffer before returning an error
-                 * possiblity that it may have received bytes before remote
-                 * site closed connection
-                 */
-                int res = __at_process_intr_buffer(buf, len);
-                if (res != 0)
-                        return res;
-                DEBUG_V0("%s: tcp not connected to recv\n", __func__);
-                return AT_TCP_RCV_FAIL;
-        }
+        at_socket *sock = __at_find_sock(s_id);
+        if (!sock)
+                return AT_TCP_INVALID_PARA;
 
-        if ((state & DL_MODE) == DL_MODE) {
-                if (dl.dis_state == DIS_PARTIAL) {
-
-                        int res = __at_process_rcv_dl_partial(len);
-                        if (res == DL_PARTIAL_ERROR)
-                                len = at_core_rx_available();
-                        else if (res == DL_PARTIAL_TO_FULL)
-                                return __at_process_intr_buffer(buf, len);
-                        else if (res > DL_PARTIAL_ERROR) {
-                                DEBUG_V1("%s:%d: request (%u), available (%u)\n",
-                                        __func__, __LINE__, len, res);
-                                if (len > res)
-                                        len = res;
-                        } else
-                                DEBUG_V0("%s:%d: Unlikly Err\n",
-                                        __func__, __LINE__);
-                }
-                int rdb = at_core_read(buf, len);
-                if (rdb == 0) {
-                        DEBUG_V1("%s:%d: read again\n", __func__, __LINE__);
-                        errno = EAGAIN;
+        /* Bytes received before the remote side closed are still handed out */
+        if (sock->rx_len == 0 && sock->pending > 0)
+                __at_tcp_fill(sock);
+
+        if (sock->rx_len == 0) {
+                if ((sock->state & SOCK_CONNECTED) != SOCK_CONNECTED) {
+                        DEBUG_V0("%s: tcp not connected to recv\n", __func__);
                         return AT_TCP_RCV_FAIL;
                 }
-                DEBUG_V1("%s:%d: read:%d, wanted:%d in a dl\n",
-                                __func__, __LINE__, rdb, len);
-                return rdb;
-        } else {
-                DEBUG_V0("%s:%d: dl mode not on\n", __func__, __LINE__);
+                DEBUG_V1("%s:%d: read again\n", __func__, __LINE__);
+                errno = EAGAIN;
                 return AT_TCP_RCV_FAIL;
         }
+
+        if (len > sock->rx_len)
+                len = sock->rx_len;
+        memcpy(buf, sock->rx_buf + sock->rx_off, len);
+        sock->rx_off += len;
+        sock->rx_len -= len;
+        DEBUG_V1("%s:%d: read:%d\n", __func__, __LINE__, (int)len);
+        return len;
 }
 
 void at_tcp_close(int s_id)
 {
 	if (s_id < 0)
 		return;
+	at_socket *sock = __at_find_sock(s_id);
+	if (!sock)
+		return;
 
-	dl.dl_buf.buf_unread = 0;
-	dl.dl_buf.ridx = 0;
-
-	if ((state & TCP_REMOTE_DISCONN) == TCP_REMOTE_DISCONN) {
+	if ((sock->state & SOCK_REMOTE_DISCONN) == SOCK_REMOTE_DISCONN) {
 		DEBUG_V0("%s:%d: tcp already closed\n", __func__, __LINE__);
-		__at_reset_dl_state();
-		at_core_process_urc(true);
-		at_core_clear_rx();
-		state = IDLE;
+		__at_free_sock(sock);
 		return;
 	}
 
-	if ((state & DL_MODE) == DL_MODE)
-		__at_esc_dl_mode();
-
-
 	at_command_desc *desc = &tcp_comm[TCP_CLOSE];
 	char temp_comm[TEMP_COMM_LIMIT];
 	snprintf(temp_comm, TEMP_COMM_LIMIT, desc->comm_sketch, s_id);
 	desc->comm = temp_comm;
 	at_ret_code result = at_core_wcmd(desc, true);
-	if (result == AT_RSP_TIMEOUT) {
+	if (result == AT_RSP_TIMEOUT)
 		DEBUG_V0("%s: tcp close command timedout\n", __func__);
-		return;
-	} else if (result == AT_FAILURE)
+	else if (result == AT_FAILURE)
 		DEBUG_V0("%s: could not close socket,"
 				" connection may be already closed\n", __func__);
 
-	state = IDLE;
-	state |= TCP_CONN_CLOSED;
-	__at_reset_dl_state();
-	return;
-}
-
-bool at_tcp_leave_cmd_mode(void)
-{
-	/* XXX: Stub for now */
-	return true;
-}
-
-bool at_tcp_enter_cmd_mode(void)
-{
-	/* XXX: Stub for now */
-	return true;
+	__at_free_sock(sock);
 }
@@ -16,21 +16,18 @@
 /* Upper limit for commands which need formatting before sending to modem */
 #define TEMP_COMM_LIMIT            64
 
-/* Time interval between sending escape sequence characters to get out from
- * direct link mode, time interval is in fiftieth of second, configure it for
- * 100ms, minimum is 20mS
- */
-#define DL_MODE_ESC_TIME           5
-#define DL_ESC_TIME_MS             (DL_MODE_ESC_TIME * 20)
-
 static void __at_parse_tcp_conf_rsp(void *rcv_rsp, int rcv_rsp_len,
                                         const char *stored_rsp, void *data);
+static void __at_parse_write_rsp(void *rcv_rsp, int rcv_rsp_len,
+                                        const char *stored_rsp, void *data);
+static void __at_parse_read_rsp(void *rcv_rsp, int rcv_rsp_len,
+                                        const char *stored_rsp, void *data);
 
 /** Unsolicited result codes */
 typedef enum at_urc {
         TCP_CLOSED, /** TCP close */
         PDP_DEACT, /** PDP connection is deactivated by network */
-        DISCONNECT, /** disconnect from direct link mode */
+        DATA_READY, /** Data received on a socket */
         URC_END
 } at_urc;
 
@@ -58,10 +55,10 @@ typedef enum at_tcp_command {
         TCP_CONF = 0, /** TCP connection configuration */
         TCP_CONN, /** TCP connection */
         TCP_CLOSE,
-        TCP_DL_MODE,
-        DL_CONG_CONF,
-        ESCAPE_DL_MODE,
-        ESCAPE_TIME_CONF,
+        TCP_WRITE, /** Announce binary data to be written to a socket */
+        TCP_WRITE_DATA, /** The data itself, following the '@' prompt */
+        TCP_READ, /** Read hex encoded data from a socket */
+        HEX_MODE_CONF, /** Exchange socket data in hex mode */
         TCP_END
 } at_tcp_command;
 
@@ -69,7 +66,7 @@ typedef enum at_tcp_command {
 static const char *at_urcs[URC_END] = {
                 [TCP_CLOSED] = "\r\n+UUSOCL: ",
                 [PDP_DEACT] = "\r\n+UUPSDD: ",
-                [DISCONNECT] = "\r\nDISCONNECT\r\n"
+                [DATA_READY] = "\r\n+UUSORD: "
 };
 
 static const at_command_desc modem_net_status_comm[MOD_END] = {
@@ -217,24 +214,23 @@ static at_command_desc tcp_comm[TCP_END] = {
                 .err = "\r\n+CME ERROR: ",
                 .comm_timeout = 15000
         },
-        [TCP_DL_MODE] = {
-                .comm_sketch = "at+usodl=%d\r",
+        [TCP_WRITE] = {
+                .comm_sketch = "at+usowr=%d,%u\r",
                 .rsp_desc = {
                         {
-                                .rsp = "\r\nCONNECT\r\n",
+                                .rsp = "\r\n@",
                                 .rsp_handler = NULL,
                                 .data = NULL
-                        },
+                        }
                 },
                 .err = "\r\n+CME ERROR: ",
-                .comm_timeout = 15000
+                .comm_timeout = 5000
         },
-        [ESCAPE_DL_MODE] = {
-                .comm = "+++",
+        [TCP_WRITE_DATA] = {
                 .rsp_desc = {
                         {
-                                .rsp = "\r\nDISCONNECT\r\n",
-                                .rsp_handler = NULL,
+                                .rsp = "\r\n+USOWR: ",
+                                .rsp_handler = __at_parse_write_rsp,
                                 .data = NULL
                         },
                         {
@@ -244,22 +240,27 @@ static at_command_desc tcp_comm[TCP_END] = {
                         }
                 },
                 .err = "\r\n+CME ERROR: ",
-                .comm_timeout = 2000
+                .comm_timeout = 10000
         },
-        [ESCAPE_TIME_CONF] = {
-                .comm_sketch = "ats12=%d\r",
+        [TCP_READ] = {
+                .comm_sketch = "at+usord=%d,%u\r",
                 .rsp_desc = {
+                        {
+                                .rsp = "\r\n+USORD: ",
+                                .rsp_handler = __at_parse_read_rsp,
+                                .data = NULL
+                        },
                         {
                                 .rsp = "\r\nOK\r\n",
                                 .rsp_handler = NULL,
                                 .data = NULL
-                        },
+                        }
                 },
                 .err = "\r\n+CME ERROR: ",
-                .comm_timeout = 100
+                .comm_timeout = 5000
         },
-        [DL_CONG_CONF] = {
-                .comm_sketch = "at+udconf=8,%d,0\r",
+        [HEX_MODE_CONF] = {
+                .comm = "at+udconf=1,1\r",
                 .rsp_desc = {
                         {
                                 .rsp = "\r\nOK\r\n",
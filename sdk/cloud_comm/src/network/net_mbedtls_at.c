@@ -18,59 +18,9 @@
 #include <stdint.h>
 #include "at_tcp.h"
 #include "mbedtls/net.h"
+#include "net_poll.h"
 #include "sys.h"
-
-#ifdef CALC_TLS_OVRHD_BYTES
-bool ovrhd_profile_flag;
-uint32_t num_bytes_recvd;
-uint32_t num_bytes_sent;
-#define INIT_COUNTERS()		do { \
-	ovrhd_profile_flag = false; \
-	num_bytes_recvd = 0; \
-	num_bytes_sent = 0; \
-} while (0)
-#define ADD_TO_RECVD(x)		do { \
-	if (ovrhd_profile_flag) \
-		num_bytes_recvd += (x); \
-} while (0)
-#define ADD_TO_SEND(x)		do { \
-	if (ovrhd_profile_flag) \
-		(num_bytes_sent += (x)); \
-} while (0)
-#else
-#define INIT_COUNTERS()
-#define ADD_TO_RECVD(x)
-#define ADD_TO_SEND(x)
-#endif	/* CALC_TLS_OVRHD_BYTES */
-
-#if defined(OTT_EXPLICIT_NETWORK_TIME) && defined(OTT_TIME_PROFILE)
-
-uint32_t network_time_ms;
-uint32_t net_read_time;
-uint32_t net_write_time;
-static uint64_t net_begin;
-static uint64_t now;
-
-#define NET_TIME_PROFILE_BEGIN() \
-	net_begin = sys_get_tick_ms()
-
-#define NET_TIME_PROFILE_END() \
-	network_time_ms += ((now = sys_get_tick_ms()) - net_begin)
-
-#define NET_TIME_RECV_ADD() \
-	net_read_time += (now - net_begin)
-
-#define NET_TIME_WRITE_ADD() \
-	net_write_time += (now - net_begin)
-
-#else
-
-#define NET_TIME_PROFILE_BEGIN()
-#define NET_TIME_PROFILE_END()
-#define NET_TIME_RECV_ADD()
-#define NET_TIME_WRITE_ADD()
-
-#endif	/* OTT_EXPLICIT_NETWORK_TIME && OTT_TIME_PROFILE */
+#include "cc_metrics_def.h"
 
 #ifdef DEBUG_NET
 #define DEBUG(...)              printf(__VA_ARGS__)
@@ -100,20 +50,22 @@ static uint64_t now;
 /* flag to indicate if init is done successfully */
 static bool init_flag;
 
+/* Number of connected contexts, the modem is only reset when there are none */
+static uint8_t num_open;
+
 /*
  * Initialize a context
  */
 void mbedtls_net_init(mbedtls_net_context *ctx)
 {
-	INIT_COUNTERS();
-	NET_TIME_PROFILE_BEGIN();
-	init_flag = false;
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	if (!ctx)
 		return;
 	ctx->fd = -1;
-	if (at_init())
-		init_flag = true;
-	NET_TIME_PROFILE_END();
+	/* Do not pull the modem from under connections of other contexts */
+	if (!init_flag || num_open == 0)
+		init_flag = at_init();
+	CC_METRIC_TIME_END(net_ms, begin);
 }
 
 /*
@@ -122,7 +74,7 @@ void mbedtls_net_init(mbedtls_net_context *ctx)
 int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
 		const char *port, int proto)
 {
-	NET_TIME_PROFILE_BEGIN();
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	CHECK_NULL(ctx, MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	CHECK_NULL(host, MBEDTLS_ERR_NET_SOCKET_FAILED);
 	CHECK_SUCCESS(init_flag, true, MBEDTLS_ERR_NET_SOCKET_FAILED);
@@ -132,13 +84,14 @@ int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
 		return MBEDTLS_ERR_NET_SOCKET_FAILED;
 
 	ret = at_tcp_connect(host, port);
+	CC_METRIC_TIME_END(net_ms, begin);
 	if (ret == AT_CONNECT_FAILED)
 		return MBEDTLS_ERR_NET_CONNECT_FAILED;
 	else if (ret == AT_SOCKET_FAILED)
 		return MBEDTLS_ERR_NET_SOCKET_FAILED;
 
 	ctx->fd = ret;
-	NET_TIME_PROFILE_END();
+	num_open++;
 	return 0;
 }
 
@@ -147,7 +100,7 @@ int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
  */
 int mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len)
 {
-	NET_TIME_PROFILE_BEGIN();
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	CHECK_NULL(ctx, MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	CHECK_NULL(buf, MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	CHECK_SUCCESS(init_flag, true, MBEDTLS_ERR_NET_INVALID_CONTEXT);
@@ -159,29 +112,22 @@ int mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len)
 		return MBEDTLS_ERR_NET_INVALID_CONTEXT;
 
 	ret = read(fd, buf, len);
+	CC_METRIC_TIME_END(net_ms, begin);
 	if (ret < 0) {
 		if (ret == AT_TCP_CONNECT_DROPPED) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_RECV_ADD();
 			DEBUG("%s: connection dropped\n", __func__);
 			return MBEDTLS_ERR_SSL_WANT_READ;
 		}
 		if (errno == EPIPE || errno == ECONNRESET) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_RECV_ADD();
 			return MBEDTLS_ERR_NET_CONN_RESET;
 		}
 
 		if (errno == EINTR || errno == EAGAIN) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_RECV_ADD();
 			return MBEDTLS_ERR_SSL_WANT_READ;
 		}
 		return MBEDTLS_ERR_NET_RECV_FAILED;
 	}
-	NET_TIME_PROFILE_END();
-	NET_TIME_RECV_ADD();
-	ADD_TO_RECVD(ret);
+	CC_METRIC_ADD(wire_bytes_rcvd, ret);
 	return ret;
 }
 
@@ -200,16 +146,20 @@ int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf,
 
 	if (fd < 0)
 		return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	ret = at_read_available(fd);
 	uint32_t start = sys_get_tick_ms();
 	bool timeout_flag = false;
-	while (ret <= 0) {
-		if ((sys_get_tick_ms() - start) > timeout) {
+	while (ret == 0) {
+		uint32_t elapsed = sys_get_tick_ms() - start;
+		if (elapsed > timeout) {
 			timeout_flag = true;
 			break;
-		} else
-			ret = at_read_available(fd);
+		}
+		at_tcp_wait_rx(timeout - elapsed);
+		ret = at_read_available(fd);
 	}
+	CC_METRIC_TIME_END(net_ms, begin);
 
 	if (ret == AT_TCP_CONNECT_DROPPED) {
 		DEBUG("%s: connection dropped\n", __func__);
@@ -223,12 +173,46 @@ int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf,
 	return mbedtls_net_recv(ctx, buf, len);
 }
 
+/*
+ * Wait for the connection to become readable and / or writable. Writes over
+ * AT commands block until the modem accepts the data, so the connection is
+ * always considered writable.
+ */
+int net_poll(mbedtls_net_context *ctx, uint32_t rw, uint32_t timeout_ms)
+{
+	CHECK_NULL(ctx, MBEDTLS_ERR_NET_INVALID_CONTEXT);
+	CHECK_SUCCESS(init_flag, true, MBEDTLS_ERR_NET_INVALID_CONTEXT);
+
+	if (ctx->fd < 0)
+		return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+	if (rw & NET_POLL_WRITE)
+		return rw;
+
+	uint64_t start = sys_get_tick_ms();
+	int ret = at_read_available(ctx->fd);
+	while (ret == 0) {
+		uint64_t elapsed = sys_get_tick_ms() - start;
+		if (elapsed >= timeout_ms)
+			break;
+		at_tcp_wait_rx(timeout_ms - elapsed);
+		ret = at_read_available(ctx->fd);
+	}
+	CC_METRIC_TIME_END(net_ms, start);
+
+	/* Let the following read report a dropped connection */
+	if (ret == AT_TCP_CONNECT_DROPPED)
+		return NET_POLL_READ;
+	if (ret < 0)
+		return MBEDTLS_ERR_NET_RECV_FAILED;
+	return (ret > 0) ? NET_POLL_READ : 0;
+}
+
 /*
  * Write at most 'len' characters
  */
 int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
 {
-	NET_TIME_PROFILE_BEGIN();
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	CHECK_NULL(ctx, MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	CHECK_NULL(buf, MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	CHECK_SUCCESS(init_flag, true, MBEDTLS_ERR_NET_INVALID_CONTEXT);
@@ -240,30 +224,23 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
 		return MBEDTLS_ERR_NET_INVALID_CONTEXT;
 
 	ret = write(fd, buf, len);
+	CC_METRIC_TIME_END(net_ms, begin);
 	if (ret < 0) {
 		if (ret == AT_TCP_CONNECT_DROPPED) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_WRITE_ADD();
 			DEBUG("%s: connection dropped\n", __func__);
 			return MBEDTLS_ERR_SSL_WANT_WRITE;
 		}
 		if (errno == EPIPE || errno == ECONNRESET) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_WRITE_ADD();
 			return MBEDTLS_ERR_NET_CONN_RESET;
 		}
 
 		if (errno == EINTR) {
-			NET_TIME_PROFILE_END();
-			NET_TIME_WRITE_ADD();
 			return MBEDTLS_ERR_SSL_WANT_WRITE;
 		}
 
 		return MBEDTLS_ERR_NET_SEND_FAILED;
 	}
-	NET_TIME_PROFILE_END();
-	NET_TIME_WRITE_ADD();
-	ADD_TO_SEND(ret);
+	CC_METRIC_ADD(wire_bytes_sent, ret);
 	return ret;
 }
 
@@ -272,14 +249,16 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
  */
 void mbedtls_net_free(mbedtls_net_context *ctx)
 {
-	NET_TIME_PROFILE_BEGIN();
+	uint64_t begin = CC_METRIC_TIME_BEGIN();
 	if (!ctx)
 		return;
 	if (ctx->fd == -1)
 		return;
 	close(ctx->fd);
 	ctx->fd = -1;
-	NET_TIME_PROFILE_END();
+	if (num_open > 0)
+		num_open--;
+	CC_METRIC_TIME_END(net_ms, begin);
 }
 
 int mbedtls_net_set_nonblock( mbedtls_net_context *ctx )
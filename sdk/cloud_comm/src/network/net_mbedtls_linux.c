@@ -33,6 +33,8 @@
 #endif
 
 #include "mbedtls/net.h"
+#include "net_poll.h"
+#include "cc_metrics_def.h"
 
 #include <string.h>
 
@@ -42,6 +44,7 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <poll.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <netdb.h>
@@ -88,6 +91,7 @@ int mbedtls_net_connect( mbedtls_net_context *ctx, const char *host, const char
         return( MBEDTLS_ERR_NET_UNKNOWN_HOST );
 
     /* Try the sockaddrs until a connection succeeds */
+    uint64_t begin = CC_METRIC_TIME_BEGIN();
     ret = MBEDTLS_ERR_NET_UNKNOWN_HOST;
     for( cur = addr_list; cur != NULL; cur = cur->ai_next )
     {
@@ -110,6 +114,7 @@ int mbedtls_net_connect( mbedtls_net_context *ctx, const char *host, const char
     }
 
     freeaddrinfo( addr_list );
+    CC_METRIC_TIME_END( net_ms, begin );
 
     return( ret );
 }
@@ -363,6 +368,55 @@ int mbedtls_net_set_nonblock( mbedtls_net_context *ctx )
     return( set_async_io( ctx ) );
 }
 
+/*
+ * Wait for the socket to become readable and / or writable
+ */
+int net_poll( mbedtls_net_context *ctx, uint32_t rw, uint32_t timeout_ms )
+{
+    int ret;
+    struct pollfd pfd;
+
+    if( ctx == NULL || ctx->fd < 0 )
+        return( MBEDTLS_ERR_NET_INVALID_CONTEXT );
+
+    pfd.fd = ctx->fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    if( rw & NET_POLL_READ )
+        pfd.events |= POLLIN;
+    if( rw & NET_POLL_WRITE )
+        pfd.events |= POLLOUT;
+
+    uint64_t begin = CC_METRIC_TIME_BEGIN();
+    ret = poll( &pfd, 1, (int) timeout_ms );
+    CC_METRIC_TIME_END( net_ms, begin );
+    if( ret == 0 )
+        return( 0 );
+
+    if( ret < 0 )
+    {
+        /* Interrupted, e.g. by SIGIO: let the caller retry the operation */
+        if( errno == EINTR )
+            return( (int) rw );
+
+        return( MBEDTLS_ERR_NET_RECV_FAILED );
+    }
+
+    /*
+     * Errors and hang ups are reported as readiness so that the following
+     * read or write surfaces the actual error.
+     */
+    if( pfd.revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+        return( (int) rw );
+
+    ret = 0;
+    if( pfd.revents & POLLIN )
+        ret |= NET_POLL_READ;
+    if( pfd.revents & POLLOUT )
+        ret |= NET_POLL_WRITE;
+    return( ret );
+}
+
 /*
  * Portable usleep helper
  */
@@ -406,6 +460,7 @@ int mbedtls_net_recv( void *ctx, unsigned char *buf, size_t len )
         return( MBEDTLS_ERR_NET_RECV_FAILED );
     }
 
+    CC_METRIC_ADD( wire_bytes_rcvd, ret );
     return( ret );
 }
 
@@ -429,7 +484,9 @@ int mbedtls_net_recv_timeout( void *ctx, unsigned char *buf, size_t len,
     tv.tv_sec  = timeout / 1000;
     tv.tv_usec = ( timeout % 1000 ) * 1000;
 
+    uint64_t begin = CC_METRIC_TIME_BEGIN();
     ret = select( fd + 1, &read_fds, NULL, NULL, timeout == 0 ? NULL : &tv );
+    CC_METRIC_TIME_END( net_ms, begin );
 
     /* Zero fds ready means we timed out */
     if( ret == 0 )
@@ -474,6 +531,7 @@ int mbedtls_net_send( void *ctx, const unsigned char *buf, size_t len )
         return( MBEDTLS_ERR_NET_SEND_FAILED );
     }
 
+    CC_METRIC_ADD( wire_bytes_sent, ret );
     return( ret );
 }
 
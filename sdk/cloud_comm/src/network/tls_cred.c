@@ -0,0 +1,66 @@
+/* Copyright (C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include "mbedtls/sha256.h"
+#include "tls_cred.h"
+#include "tls_mem.h"
+
+tls_cred_result tls_cred_load_crt(mbedtls_x509_crt *crt, const uint8_t *der,
+		uint32_t len)
+{
+	/*
+	 * The parsed certificate keeps a copy of its DER encoding, so it can be
+	 * compared exactly without storing anything else.
+	 */
+	if (crt->raw.p && !crt->next && crt->raw.len == len &&
+			memcmp(crt->raw.p, der, len) == 0)
+		return TLS_CRED_CACHED;
+
+	tls_mem_phase prev = tls_mem_set_phase(TLS_MEM_IDLE);
+	mbedtls_x509_crt_free(crt);
+	mbedtls_x509_crt_init(crt);
+	int ret = mbedtls_x509_crt_parse_der(crt, der, len);
+	tls_mem_set_phase(prev);
+	if (ret < 0) {
+		mbedtls_x509_crt_free(crt);
+		mbedtls_x509_crt_init(crt);
+		return TLS_CRED_ERROR;
+	}
+	return TLS_CRED_PARSED;
+}
+
+void tls_cred_key_init(tls_cred_key *key)
+{
+	mbedtls_pk_init(&key->pk);
+	memset(key->digest, 0, sizeof(key->digest));
+}
+
+tls_cred_result tls_cred_load_key(tls_cred_key *key, const uint8_t *buf,
+		uint32_t len)
+{
+	/* The parsed key keeps nothing of its encoding, compare digests instead */
+	unsigned char digest[sizeof(key->digest)];
+	mbedtls_sha256(buf, len, digest, 0);
+	if (mbedtls_pk_get_type(&key->pk) != MBEDTLS_PK_NONE &&
+			memcmp(digest, key->digest, sizeof(digest)) == 0)
+		return TLS_CRED_CACHED;
+
+	tls_mem_phase prev = tls_mem_set_phase(TLS_MEM_IDLE);
+	tls_cred_key_free(key);
+	tls_cred_key_init(key);
+	int ret = mbedtls_pk_parse_key(&key->pk, buf, len, NULL, 0);
+	tls_mem_set_phase(prev);
+	if (ret != 0) {
+		tls_cred_key_free(key);
+		tls_cred_key_init(key);
+		return TLS_CRED_ERROR;
+	}
+	memcpy(key->digest, digest, sizeof(digest));
+	return TLS_CRED_PARSED;
+}
+
+void tls_cred_key_free(tls_cred_key *key)
+{
+	mbedtls_pk_free(&key->pk);
+	memset(key->digest, 0, sizeof(key->digest));
+}
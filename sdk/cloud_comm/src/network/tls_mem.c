@@ -0,0 +1,207 @@
+/* Copyright (C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Size class arena for mbed TLS.
+ *
+ * The arena is a single static buffer shared by two regions. Persistent blocks
+ * are carved upwards from the bottom, connection blocks downwards from the top;
+ * the two meet only when the arena is exhausted. Every block starts with an
+ * 8 byte header holding its size class. Released blocks are kept on a free list
+ * per class and region and handed out again for requests of the same class;
+ * blocks are never split or merged, which keeps allocation and release O(1).
+ *
+ * Size classes are 8, 16, 24 and 32 bytes, followed by four classes per power
+ * of two (40, 48, 56, 64, 80, 96, ...) so that rounding up wastes at most a
+ * quarter of a block.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#ifdef TLS_MEM_ARENA_SZ
+
+#include <stdlib.h>
+#include <string.h>
+#include "mbedtls/platform.h"
+#include "tls_mem.h"
+
+#define HDR_SZ			8
+#define ALIGN_SZ		8
+#define TINY_CLASSES		3	/* 8, 16 and 24 bytes */
+#define FIRST_OCTAVE		5	/* First power of two split in four */
+#define LAST_OCTAVE		15	/* Largest block is 7 << 13 = 56 KiB */
+#define NUM_CLASSES		(TINY_CLASSES + \
+				(LAST_OCTAVE - FIRST_OCTAVE + 1) * 4)
+
+#ifndef MBEDTLS_PLATFORM_MEMORY
+#error "TLS_MEM_ARENA_SZ requires MBEDTLS_PLATFORM_MEMORY in the mbed TLS config"
+#endif
+
+#if (TLS_MEM_ARENA_SZ % ALIGN_SZ) != 0
+#error "TLS_MEM_ARENA_SZ must be a multiple of 8"
+#endif
+
+typedef union {
+	uint32_t cls;
+	uint64_t align;
+} blk_hdr;
+
+struct free_blk {
+	struct free_blk *next;
+};
+
+struct region {
+	struct free_blk *free[NUM_CLASSES];
+	size_t in_use;
+};
+
+static uint64_t arena_mem[TLS_MEM_ARENA_SZ / sizeof(uint64_t)];
+static uint8_t * const arena = (uint8_t *)arena_mem;
+
+static struct region persist;
+static struct region conn;
+static size_t lo;			/* Top of the persistent region */
+static size_t hi = TLS_MEM_ARENA_SZ;	/* Bottom of the connection region */
+static tls_mem_phase phase;
+static tls_mem_stats stats = { .arena_sz = TLS_MEM_ARENA_SZ };
+
+static unsigned int log2_floor(size_t v)
+{
+	return (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(v);
+}
+
+static size_t class_size(unsigned int c)
+{
+	if (c < TINY_CLASSES)
+		return (c + 1) * 8;
+	c -= TINY_CLASSES;
+	unsigned int e = FIRST_OCTAVE + c / 4;
+	return (size_t)(4 + c % 4) << (e - 2);
+}
+
+/* Smallest class whose blocks hold 'sz' bytes */
+static unsigned int size_class(size_t sz)
+{
+	if (sz <= 8 * TINY_CLASSES)
+		return (sz - 1) / 8;
+	if (sz <= (1 << FIRST_OCTAVE))
+		return TINY_CLASSES;
+	size_t v = sz - 1;
+	unsigned int e = log2_floor(v);
+	unsigned int sub = (v >> (e - 2)) - 4 + 1;
+	if (sub == 4) {
+		e++;
+		sub = 0;
+	}
+	return TINY_CLASSES + (e - FIRST_OCTAVE) * 4 + sub;
+}
+
+static void update_peaks(void)
+{
+	stats.in_use = persist.in_use + conn.in_use;
+	stats.footprint = lo + (TLS_MEM_ARENA_SZ - hi);
+	if (stats.in_use > stats.peak[phase])
+		stats.peak[phase] = stats.in_use;
+	if (stats.footprint > stats.peak_footprint)
+		stats.peak_footprint = stats.footprint;
+}
+
+static void *arena_calloc(size_t n, size_t size)
+{
+	if (n == 0 || size == 0 || size > SIZE_MAX / n)
+		return NULL;
+	size_t total = n * size;
+	unsigned int c = (total > class_size(NUM_CLASSES - 1)) ?
+		NUM_CLASSES : size_class(total);
+	if (c >= NUM_CLASSES) {
+		stats.failed++;
+		return NULL;
+	}
+
+	struct region *r = (phase == TLS_MEM_IDLE) ? &persist : &conn;
+	size_t blk_sz = HDR_SZ + class_size(c);
+	uint8_t *blk;
+	blk_hdr *h;
+	if (r->free[c]) {
+		blk = (uint8_t *)r->free[c] - HDR_SZ;
+		r->free[c] = r->free[c]->next;
+	} else if (hi - lo < blk_sz) {
+		stats.failed++;
+		return NULL;
+	} else if (r == &persist) {
+		blk = arena + lo;
+		lo += blk_sz;
+	} else {
+		hi -= blk_sz;
+		blk = arena + hi;
+	}
+
+	h = (void *)blk;
+	h->cls = c;
+	r->in_use += blk_sz;
+	update_peaks();
+	memset(blk + HDR_SZ, 0, total);
+	return blk + HDR_SZ;
+}
+
+static void arena_free(void *ptr)
+{
+	uint8_t *p = ptr;
+	if (p == NULL)
+		return;
+	if (p < arena || p >= arena + TLS_MEM_ARENA_SZ) {
+		/* Allocated from the C heap before tls_mem_init() */
+		free(ptr);
+		return;
+	}
+
+	const blk_hdr *h = (const void *)(p - HDR_SZ);
+	unsigned int c = h->cls;
+	struct region *r = (p < arena + lo) ? &persist : &conn;
+	struct free_blk *f = ptr;
+	f->next = r->free[c];
+	r->free[c] = f;
+	r->in_use -= HDR_SZ + class_size(c);
+	stats.in_use = persist.in_use + conn.in_use;
+}
+
+bool tls_mem_init(void)
+{
+	return mbedtls_platform_set_calloc_free(arena_calloc, arena_free) == 0;
+}
+
+tls_mem_phase tls_mem_set_phase(tls_mem_phase p)
+{
+	tls_mem_phase prev = phase;
+	if (p < TLS_MEM_NUM_PHASES)
+		phase = p;
+	return prev;
+}
+
+void tls_mem_conn_reset(void)
+{
+	memset(conn.free, 0, sizeof(conn.free));
+	conn.in_use = 0;
+	hi = TLS_MEM_ARENA_SZ;
+	phase = TLS_MEM_IDLE;
+	update_peaks();
+}
+
+void tls_mem_get_stats(tls_mem_stats *s)
+{
+	if (s)
+		*s = stats;
+}
+
+void tls_mem_reset_peaks(void)
+{
+	memset(stats.peak, 0, sizeof(stats.peak));
+	stats.peak_footprint = 0;
+	stats.failed = 0;
+	update_peaks();
+}
+
+#endif	/* TLS_MEM_ARENA_SZ */
@@ -21,7 +21,6 @@
 #define MQTT_OVERHEAD_SZ	14
 
 #define MQTT_SEND_SZ		(MQTT_OVERHEAD_SZ + PROTO_MAX_MSG_SZ)
-#define MQTT_RCV_SZ		(MQTT_OVERHEAD_SZ + PROTO_MAX_MSG_SZ)
 
 /* defines related to mqtt protocol */
 #define MQTT_WILL		0
@@ -37,6 +36,13 @@
 #define MQTT_TOPIC_SZ 			100
 #define MQTT_DEVICE_ID_SZ		50
 
+/*
+ * Payloads of incoming messages are read directly into the receive buffers,
+ * so the read buffer of the client holds the packet headers and topic only.
+ * Messages on topics longer than MQTT_TOPIC_SZ are acknowledged and dropped.
+ */
+#define MQTT_RCV_SZ		(MQTT_OVERHEAD_SZ + MQTT_TOPIC_SZ)
+
 #define SEC_TO_MS		1000
 
 #define INIT_POLLING_MS		((uint32_t)(MQTT_KEEPALIVE_INT_SEC * SEC_TO_MS))
@@ -45,10 +51,23 @@
 /* Special care needs to be taken care for cat m1 modems as they are slow */
 #ifdef MODEM_SQMONARCH
 #define MQTT_TIMEOUT_MS		30000
+#define MQTT_RETRY_MS		30000
 #else
 #define MQTT_TIMEOUT_MS		1000
+#define MQTT_RETRY_MS		5000
 #endif
 
+/*
+ * Publishes in flight (MAX_INFLIGHT_MESSAGES in paho_mqtt_port.h) that are not
+ * acknowledged within MQTT_RETRY_MS are sent again, at most MQTT_MAX_RETRIES
+ * times, before being reported as timed out. Every one of them is kept
+ * serialized in a slot large enough for the longest topic and message.
+ */
+#define MQTT_MAX_RETRIES	3
+/* Granularity of the wait for the last acknowledgements before quitting */
+#define MQTT_DRAIN_POLL_MS	100
+#define MQTT_INFLIGHT_SLOT_SZ	(MQTT_SEND_SZ + MQTT_TOPIC_SZ)
+
 
 /* Defines to enable printing of all the error strings */
 #define DEBUG_ERROR
@@ -90,10 +109,10 @@ static struct {
 } session;
 
 /*
- * Define this to profile the maximum heap used by mbedTLS. This is done by
- * providing a custom implementation of calloc(). Everytime the connection is
- * closed through ott_close_connection(), the maximum amount of heap used until
- * that point of time is printed to the debug UART.
+ * Define this to profile the memory used by mbedTLS. Everytime the connection
+ * is closed through mqtt_net_disconnect(), the peak footprint of the TLS arena
+ * followed by the peak usage during the handshake, steady and close phases is
+ * printed to the debug UART. Requires TLS_MEM_ARENA_SZ (see tls_mem.h).
  */
 /*#define MQTT_HEAP_PROFILE*/
 
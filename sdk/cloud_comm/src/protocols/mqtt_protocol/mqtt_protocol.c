@@ -6,6 +6,7 @@
 #include "mqtt_def.h"
 #include "mqtt_protocol.h"
 #include "paho_mqtt_port.h"
+#include "mqtt_route.h"
 #include "MQTTClient.h"
 
 #include "sys.h"
@@ -13,6 +14,10 @@
 #include "dbg.h"
 
 #include "mbedtls/net.h"
+#include "net_poll.h"
+#include "tls_cred.h"
+#include "tls_mem.h"
+#include "cc_metrics_def.h"
 #include "mbedtls/ssl.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/ctr_drbg.h"
@@ -67,21 +72,6 @@ static void my_debug(void *ctx, int level,
 #define TIMEOUT_MS			5000
 #endif
 
-#ifdef CALC_TLS_OVRHD_BYTES
-extern bool ovrhd_profile_flag;
-extern uint32_t num_bytes_recvd;
-extern uint32_t num_bytes_sent;
-#define START_CALC_OVRHD_BYTES()	ovrhd_profile_flag = true
-#define STOP_CALC_OVRHD_BYTES()		ovrhd_profile_flag = false
-#define PRINT_OVRHD_SENT()		dbg_printf("OVS:%"PRIu32"\n", num_bytes_sent);
-#define PRINT_OVRHD_RECVD()		dbg_printf("OVR:%"PRIu32"\n", num_bytes_recvd);
-#else
-#define START_CALC_OVRHD_BYTES()
-#define STOP_CALC_OVRHD_BYTES()
-#define PRINT_OVRHD_SENT()
-#define PRINT_OVRHD_RECVD()
-#endif	/* CALC_TLS_OVRHD_BYTES */
-
 /* mbedTLS specific variables */
 static mbedtls_net_context ctx;
 static mbedtls_entropy_context entropy;
@@ -90,7 +80,8 @@ static mbedtls_ssl_context ssl;
 static mbedtls_ssl_config conf;
 static mbedtls_x509_crt cacert;
 static mbedtls_x509_crt cl_cert;
-static mbedtls_pk_context cl_key;
+static tls_cred_key cl_key;
+static bool own_cert_conf;	/* cl_cert and cl_key are registered with conf */
 
 /* seed for random number used in mbedtls lib */
 static const char pers[] = "mqtt_ts_sdk";
@@ -114,19 +105,79 @@ static Network net;
 static MQTTClient mclient;
 static MQTTMessage msg;
 
+#if MAX_INFLIGHT_MESSAGES > 0
+/* Serialized publishes awaiting acknowledgement, kept for retransmission */
+static unsigned char inflight_buf[MAX_INFLIGHT_MESSAGES][MQTT_INFLIGHT_SLOT_SZ];
+
+/* Whom to tell the outcome of the publishes in flight */
+static proto_in_flight_callback inflight_cb;
+
+/*
+ * Invoked by the Paho client once a publish made through MQTTPublishAsync()
+ * is acknowledged or given up on.
+ */
+static void mqtt_publish_done(MQTTClient *c, unsigned short id, int rc)
+{
+	(void)c;
+	if (rc != SUCCESS)
+		dbg_printf("%s:%d: Publication %u was not acknowledged\n",
+				__func__, __LINE__, id);
+	if (inflight_cb)
+		inflight_cb(id, rc == SUCCESS ? PROTO_RCVD_ACK :
+				PROTO_SEND_TIMEOUT);
+}
+#endif
+
+uint16_t mqtt_send_in_flight(proto_in_flight_callback cb)
+{
+#if MAX_INFLIGHT_MESSAGES > 0
+	/* The Paho client keeps the publishes awaiting an acknowledgement */
+	for (uint8_t i = 0; i < MAX_INFLIGHT_MESSAGES; i++) {
+		if (msg.id == 0 || mclient.inflight[i].awaiting == 0 ||
+				mclient.inflight[i].id != msg.id)
+			continue;
+		inflight_cb = cb;
+		return msg.id;
+	}
+#endif
+	(void)cb;
+	return 0;
+}
+
 static void cleanup_mbedtls(void)
 {
 	/* Free network interface resources. */
 	mbedtls_net_free(&ctx);
 	mbedtls_x509_crt_free(&cacert);
 	mbedtls_x509_crt_free(&cl_cert);
-	mbedtls_pk_free(&cl_key);
+	tls_cred_key_free(&cl_key);
 	mbedtls_ssl_free(&ssl);
 	mbedtls_ssl_config_free(&conf);
+	own_cert_conf = false;
 	mbedtls_ctr_drbg_free(&ctr_drbg);
 	mbedtls_entropy_free(&entropy);
 }
 
+/*
+ * Sleep until the connection is ready for the operation mbedTLS asked for
+ * through 'want' (MBEDTLS_ERR_SSL_WANT_READ / WANT_WRITE) or until the
+ * remainder of 'timeout_ms' counted from 'start_time' has passed.
+ * Return 1 if the operation should be retried, 0 on timeout and -1 on error.
+ */
+static int wait_ready(int want, uint64_t start_time, int timeout_ms)
+{
+	uint64_t elapsed = sys_get_tick_ms() - start_time;
+	if (timeout_ms <= 0 || elapsed >= (uint64_t)timeout_ms)
+		return 0;
+
+	uint32_t rw = (want == MBEDTLS_ERR_SSL_WANT_WRITE) ?
+		NET_POLL_WRITE : NET_POLL_READ;
+	int ret = net_poll(&ctx, rw, (uint32_t)(timeout_ms - elapsed));
+	if (ret < 0)
+		return -1;
+	return (ret > 0) ? 1 : 0;
+}
+
 /*
  * Attempt to read 'len' bytes from the TCP/TLS stream into buffer 'b' within
  * 'timeout_ms' ms.
@@ -139,15 +190,23 @@ static int read_fn(Network *n, unsigned char *b, int len, int timeout_ms)
 		int recvd = mbedtls_ssl_read(&ssl, b + nbytes, len - nbytes);
 		if (recvd == 0)
 			return 0;
-		if (recvd < 0 && recvd != MBEDTLS_ERR_SSL_WANT_READ &&
+		if (recvd > 0) {
+			nbytes += recvd;
+			continue;
+		}
+		if (recvd != MBEDTLS_ERR_SSL_WANT_READ &&
 				recvd != MBEDTLS_ERR_SSL_WANT_WRITE) {
 			printf("%s:%d: recvd error:%d\n", __func__, __LINE__,
 				recvd);
 			return -1;
 		}
-		if (recvd > 0)
-			nbytes += recvd;
-	} while (nbytes < len && sys_get_tick_ms() - start_time < timeout_ms);
+		/* Nothing buffered by mbedTLS, wait for the socket */
+		int ready = wait_ready(recvd, start_time, timeout_ms);
+		if (ready < 0)
+			return -1;
+		if (ready == 0)
+			break;
+	} while (nbytes < len);
 	return nbytes;
 }
 
@@ -162,43 +221,64 @@ static int write_fn(Network *n, unsigned char *b, int len, int timeout_ms)
 	int nbytes = 0;
 	do {
 		int ret = mbedtls_ssl_write(&ssl, b + nbytes, len - nbytes);
-		if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+		if (ret > 0) {
+			nbytes += ret;
+			continue;
+		}
+		/* Nothing accepted, wait as if asked to and watch the time */
+		if (ret == 0)
+			ret = MBEDTLS_ERR_SSL_WANT_WRITE;
+		if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
 				ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 			mbedtls_ssl_session_reset(&ssl);
 			return -1;
 		}
-		if (ret >= 0)
-			nbytes += ret;
-	} while (nbytes < len && sys_get_tick_ms() - start_time < timeout_ms);
+		int ready = wait_ready(ret, start_time, timeout_ms);
+		if (ready < 0) {
+			mbedtls_ssl_session_reset(&ssl);
+			return -1;
+		}
+		if (ready == 0)
+			break;
+	} while (nbytes < len);
 	return nbytes;
 }
 
 static bool init_own_certs(const uint8_t *cli_cert, uint32_t cert_len,
 			const uint8_t *cli_key, uint32_t key_len)
 {
-	/* Load the client certificate */
-	if (mbedtls_x509_crt_parse_der(&cl_cert, cli_cert, cert_len) < 0) {
+	/*
+	 * Load the client certificate and key. Either is only parsed when it
+	 * differs from the one already loaded.
+	 */
+	if (tls_cred_load_crt(&cl_cert, cli_cert, cert_len) == TLS_CRED_ERROR) {
 		cleanup_mbedtls();
 		return false;
 	}
 
-	/* Load the client key */
-	if (mbedtls_pk_parse_key(&cl_key, cli_key, key_len, NULL, 0) != 0) {
+	if (tls_cred_load_key(&cl_key, cli_key, key_len) == TLS_CRED_ERROR) {
 		cleanup_mbedtls();
 		return false;
 	}
 
-	if (mbedtls_ssl_conf_own_cert(&conf, &cl_cert, &cl_key) != 0) {
+	/*
+	 * The configuration refers to cl_cert and cl_key, which are reloaded in
+	 * place, so they only need registering once.
+	 */
+	if (own_cert_conf)
+		return true;
+	if (mbedtls_ssl_conf_own_cert(&conf, &cl_cert, &cl_key.pk) != 0) {
 		cleanup_mbedtls();
 		return false;
 	}
+	own_cert_conf = true;
 	return true;
 }
 
 static bool init_remote_certs(const uint8_t *serv_cert, uint32_t cert_len)
 {
-	/* Load the CA root certificate */
-	if (mbedtls_x509_crt_parse_der(&cacert, serv_cert, cert_len) < 0) {
+	/* Load the CA root certificate, unless it is the one already loaded */
+	if (tls_cred_load_crt(&cacert, serv_cert, cert_len) == TLS_CRED_ERROR) {
 		cleanup_mbedtls();
 		return false;
 	}
@@ -228,6 +308,10 @@ static void mqtt_init_state(void)
 proto_result mqtt_protocol_init(void)
 {
 	mqtt_init_state();
+	mqtt_route_reset();
+
+	if (!tls_mem_init())
+		return PROTO_ERROR;
 
 #ifdef MBEDTLS_DEBUG_C
 	mbedtls_debug_set_threshold(1);
@@ -242,7 +326,7 @@ proto_result mqtt_protocol_init(void)
 	mbedtls_ssl_config_init(&conf);
 	mbedtls_x509_crt_init(&cacert);
 	mbedtls_x509_crt_init(&cl_cert);
-	mbedtls_pk_init(&cl_key);
+	tls_cred_key_init(&cl_key);
 	mbedtls_ctr_drbg_init(&ctr_drbg);
 
 	/* Seed the RNG */
@@ -273,7 +357,9 @@ proto_result mqtt_protocol_init(void)
 static int mqtt_net_connect()
 {
 	int ret = 0;
-	START_CALC_OVRHD_BYTES();
+	uint32_t hs_wire = CC_METRIC_GET(wire_bytes_sent) +
+		CC_METRIC_GET(wire_bytes_rcvd);
+	tls_mem_set_phase(TLS_MEM_HANDSHAKE);
 	/* Connect to the cloud services over TCP */
 	if (mbedtls_net_connect(&ctx, session.host, session.port,
 		MBEDTLS_NET_PROTO_TCP) < 0) {
@@ -287,7 +373,6 @@ static int mqtt_net_connect()
 
 	/* Set up the SSL context */
 	if (mbedtls_ssl_setup(&ssl, &conf) != 0) {
-		mbedtls_net_free(&ctx);
 		ret = -1;
 		goto exit_func;
 	}
@@ -313,16 +398,10 @@ static int mqtt_net_connect()
 	while (ret != 0) {
 		if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
 				ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-			mbedtls_ssl_session_reset(&ssl);
-			mbedtls_ssl_free(&ssl);
-			mbedtls_net_free(&ctx);
 			ret = -1;
 			goto exit_func;
 		}
 		if (sys_get_tick_ms() - start > TIMEOUT_MS) {
-			mbedtls_ssl_session_reset(&ssl);
-			mbedtls_ssl_free(&ssl);
-			mbedtls_net_free(&ctx);
 			ret = -2;
 			goto exit_func;
 		}
@@ -330,14 +409,89 @@ static int mqtt_net_connect()
 	}
 
 exit_func:
-	STOP_CALC_OVRHD_BYTES();
-	PRINT_OVRHD_SENT();
-	PRINT_OVRHD_RECVD();
+	if (ret != 0) {
+		/* Release whatever the failed attempt has allocated so far */
+		mbedtls_ssl_free(&ssl);
+		mbedtls_net_free(&ctx);
+		tls_mem_conn_reset();
+	} else {
+		tls_mem_set_phase(TLS_MEM_STEADY);
+		CC_METRIC_INC(tls_handshakes);
+		CC_METRIC_ADD(tls_hs_bytes, CC_METRIC_GET(wire_bytes_sent) +
+				CC_METRIC_GET(wire_bytes_rcvd) - hs_wire);
+	}
 	return ret;
 }
 
+static bool is_command_topic(const MQTTString *t)
+{
+	return strlen(sub_command) == (size_t)t->lenstring.len &&
+		strncmp(sub_command, t->lenstring.data, t->lenstring.len) == 0;
+}
+
+/* Length of the payload being read into a loaned buffer */
+static size_t loan_sz;
+
+/*
+ * Payload loan handler of the Paho client: the payload of a message goes
+ * straight into the buffer it is delivered to, provided it fits. Otherwise
+ * the client drops it and mqtt_rcvd_msg() reports an overflow.
+ */
+static unsigned char *mqtt_loan_payload(void *ctx, MQTTString *topic,
+		size_t payloadlen)
+{
+	loan_sz = payloadlen;
+	if (!is_command_topic(topic)) {
+		const mqtt_route *r = mqtt_route_match(topic->lenstring.data,
+				topic->lenstring.len);
+		if (r && payloadlen <= r->rcv_sz)
+			return r->rcv_buf;
+		return NULL;
+	}
+	if (session.rcv_buf && session.rcv_cb && payloadlen <= session.rcv_sz)
+		return session.rcv_buf;
+	return NULL;
+}
+
+/*
+ * Payload return handler of the Paho client. A negative length means the
+ * payload could not be read in full; clear the loaned region so that a partial
+ * payload is not mistaken for received data.
+ */
+static void mqtt_return_payload(void *ctx, unsigned char *buf, int payloadlen)
+{
+	if (payloadlen < 0)
+		memset(buf, 0, loan_sz);
+}
+
+/* Deliver a message to the buffer and callback of its route */
+static void mqtt_route_msg(const mqtt_route *r, const MQTTMessage *m)
+{
+	if ((uint32_t)m->payloadlen > r->rcv_sz || !m->payload) {
+		dbg_printf("%s:%d, rcvd payload len %d is greater then "
+			"route buffer sz %"PRIu32" for %s\n", __func__, __LINE__,
+			(int)m->payloadlen, r->rcv_sz, r->filter);
+		r->cb(r->ctx, m->payloadlen, PROTO_RCVD_MEM_OVRFL);
+		return;
+	}
+	if (m->payload != r->rcv_buf)
+		memcpy(r->rcv_buf, m->payload, m->payloadlen);
+	r->cb(r->ctx, m->payloadlen, PROTO_RCVD_MSG);
+}
+
+/* Default message handler of the Paho client, invoked for every subscription */
 static void mqtt_rcvd_msg(MessageData *md)
 {
+	MQTTString *t = md->topicName;
+	if ((int)md->message->payloadlen > 0 && !is_command_topic(t)) {
+		const mqtt_route *r = mqtt_route_match(t->lenstring.data,
+				t->lenstring.len);
+		if (r) {
+			mqtt_route_msg(r, md->message);
+			return;
+		}
+	}
+
 	if (!session.rcv_buf || !session.rcv_cb) {
 		dbg_printf("%s:%d, mqtt_set_recv_buffer_cb needs to be called "
 		"to receive new messages\n", __func__, __LINE__);
@@ -367,11 +521,18 @@ static void mqtt_rcvd_msg(MessageData *md)
 		return;
 	}
 
-	memcpy(session.rcv_buf, m->payload, m->payloadlen);
+	if (m->payload != session.rcv_buf)
+		memcpy(session.rcv_buf, m->payload, m->payloadlen);
 	INVOKE_RECV_CALLBACK(session.rcv_buf, m->payloadlen, PROTO_RCVD_MSG,
 		CC_SERVICE_BASIC);
 }
 
+static bool mqtt_subscribe(const char *filter)
+{
+	/* Messages reach mqtt_rcvd_msg() through the default handler */
+	return MQTTSubscribe(&mclient, filter, MQTT_QOS_LVL, NULL) == 0;
+}
+
 static bool reg_pub_sub(void)
 {
 	snprintf(pub_diagnostic_topic, sizeof(pub_diagnostic_topic), MQTT_PUBL_DIAG_TOPIC, device_id);
@@ -379,13 +540,20 @@ static bool reg_pub_sub(void)
 		device_id);
 	snprintf(pub_unit_on_board, sizeof(pub_unit_on_board),
 		MQTT_PUBL_UNIT_ON_BOARD, device_id);
-	if (MQTTSubscribe(&mclient, sub_command, MQTT_QOS_LVL,
-		mqtt_rcvd_msg) < 0) {
+	if (!mqtt_subscribe(sub_command)) {
 		dbg_printf("%s:%d: MQTT Subscription failed\n",
 			__func__, __LINE__);
 		return false;
 	}
 	PRINTF("Subscribed to topic %s successful\n", sub_command);
+	for (uint8_t i = 0; i < mqtt_route_count(); i++) {
+		const char *filter = mqtt_route_get(i)->filter;
+		if (!mqtt_subscribe(filter)) {
+			dbg_printf("%s:%d: MQTT Subscription to %s failed\n",
+				__func__, __LINE__, filter);
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -393,6 +561,14 @@ static bool mqtt_client_and_topic_init(void)
 {
 	MQTTClientInit(&mclient, &net, MQTT_TIMEOUT_MS,
 		send_intr_buf, MQTT_SEND_SZ, recv_intr_buf, MQTT_RCV_SZ);
+	mclient.defaultMessageHandler = mqtt_rcvd_msg;
+	MQTTSetPayloadLoan(&mclient, mqtt_loan_payload, mqtt_return_payload,
+			NULL);
+#if MAX_INFLIGHT_MESSAGES > 0
+	MQTTSetInflightWindow(&mclient, &inflight_buf[0][0],
+			MQTT_INFLIGHT_SLOT_SZ, MQTT_RETRY_MS, MQTT_MAX_RETRIES,
+			mqtt_publish_done);
+#endif
 	if (!utils_get_device_id(device_id, MQTT_DEVICE_ID_SZ, NET_INTERFACE)) {
 		dbg_printf("%s:%d: Can not retrieve device id\n",
 			__func__, __LINE__);
@@ -425,16 +601,21 @@ static bool __mqtt_net_connect(bool flag, bool cred_flag)
 		if (ret == -1) {
 			dbg_printf("%s:%d: Error in SSL handshake\n",
 				__func__, __LINE__);
+			CC_METRIC_INC(connect_failures);
 			return false;
 		}
 		if (ret == -2) {
 			dbg_printf("%s:%d: SSL handshake timeout\n",
 				 __func__, __LINE__);
+			CC_METRIC_INC(connect_failures);
 			return false;
 		}
-		if (!mqtt_client_and_topic_init())
+		if (!mqtt_client_and_topic_init()) {
+			CC_METRIC_INC(connect_failures);
 			return false;
+		}
 		session.conn_valid = true;
+		CC_METRIC_INC(connects);
 	}
 	return true;
 }
@@ -501,6 +682,19 @@ proto_result mqtt_set_destination(const char *dest)
 	return PROTO_OK;
 }
 
+proto_result mqtt_add_route(const char *filter, void *rcv_buf, uint32_t sz,
+		mqtt_route_callback cb, void *ctx)
+{
+	if (!filter || !rcv_buf || sz == 0 || !cb)
+		RETURN_ERROR("route parameters invalid", PROTO_INV_PARAM);
+	if (!mqtt_route_add(filter, rcv_buf, sz, cb, ctx))
+		RETURN_ERROR("route filter invalid or no room left",
+			PROTO_INV_PARAM);
+	if (session.conn_valid && !mqtt_subscribe(filter))
+		RETURN_ERROR("route subscription failed", PROTO_ERROR);
+	return PROTO_OK;
+}
+
 proto_result mqtt_set_recv_buffer_cb(void *rcv_buf, uint32_t sz,
 		proto_callback rcv_cb)
 {
@@ -538,7 +732,18 @@ static proto_result initialize_send(const void *buf, uint32_t sz,
 
 static proto_result mqtt_publish_msg(char *topic, const void *buf, uint32_t sz)
 {
-	if (MQTTPublish(&mclient, topic, &msg) == FAILURE) {
+	/*
+	 * With an in-flight window the message is copied and the call returns
+	 * once it has been written; it does not wait for the acknowledgement.
+	 * The packet ID it is given tells it apart from then on.
+	 */
+	msg.id = 0;
+#if MAX_INFLIGHT_MESSAGES > 0
+	int rc = MQTTPublishAsync(&mclient, topic, &msg);
+#else
+	int rc = MQTTPublish(&mclient, topic, &msg);
+#endif
+	if (rc == FAILURE) {
 		dbg_printf("%s:%d: Publication failed on topic: %s\n",
 			__func__, __LINE__, topic);
 		INVOKE_SEND_CALLBACK(buf, sz, PROTO_SEND_FAILED);
@@ -618,18 +823,39 @@ error:
 	return result;
 }
 
+/* Account for the publishes the Paho client has sent again */
+static void collect_resent(void)
+{
+#if MAX_INFLIGHT_MESSAGES > 0
+	CC_METRIC_ADD(retries, mclient.inflight_resent);
+	mclient.inflight_resent = 0;
+#endif
+}
+
 void mqtt_maintenance(uint64_t cur_ts)
 {
 	if (MQTTYield(&mclient, MQTT_TIMEOUT_MS) == FAILURE)
 		dbg_printf("%s:%d: MQTT operation failed\n",
 			__func__, __LINE__);
+	collect_resent();
 }
 
 static bool mqtt_net_disconnect(void)
 {
+	tls_mem_set_phase(TLS_MEM_CLOSE);
 	int s = mbedtls_ssl_close_notify(&ssl);
 	mbedtls_ssl_free(&ssl);
 	mbedtls_net_free(&ctx);
+	tls_mem_conn_reset();
+
+#ifdef MQTT_HEAP_PROFILE
+	tls_mem_stats st;
+	tls_mem_get_stats(&st);
+	dbg_printf("[HP:%u,%u,%u,%u]\n", (unsigned)st.peak_footprint,
+			(unsigned)st.peak[TLS_MEM_HANDSHAKE],
+			(unsigned)st.peak[TLS_MEM_STEADY],
+			(unsigned)st.peak[TLS_MEM_CLOSE]);
+#endif
 	if (s == 0)
 		return true;
 	else
@@ -638,6 +864,15 @@ static bool mqtt_net_disconnect(void)
 
 void mqtt_initiate_quit(void)
 {
+#if MAX_INFLIGHT_MESSAGES > 0
+	/* Give the publishes still in flight a chance to be acknowledged */
+	uint64_t start = sys_get_tick_ms();
+	while (MQTTInflightCount(&mclient) > 0 &&
+			sys_get_tick_ms() - start < MQTT_TIMEOUT_MS)
+		if (MQTTYield(&mclient, MQTT_DRAIN_POLL_MS) == FAILURE)
+			break;
+	collect_resent();
+#endif
 	MQTTDisconnect(&mclient);
 	mqtt_net_disconnect();
 	mqtt_reset_state();
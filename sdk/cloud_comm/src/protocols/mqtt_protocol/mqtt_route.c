@@ -0,0 +1,204 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#include <string.h>
+#include "mqtt_route.h"
+
+#define NONE		(-1)
+
+/* One level of a topic filter, e.g. "cmd" or "+" */
+typedef struct {
+	const char *level;	/* Points into the filter, not NULL terminated */
+	uint8_t len;
+	int8_t child;		/* First node of the next level */
+	int8_t next;		/* Next node of the same level */
+	int8_t route;		/* Route of the filter ending at this level */
+} route_node;
+
+static mqtt_route routes[MQTT_MAX_ROUTES];
+static uint8_t num_routes;
+
+static route_node nodes[MQTT_ROUTE_NODES];
+static uint8_t num_nodes;
+static int8_t root = NONE;	/* First node of the first level */
+
+static bool is_level(const route_node *n, const char *level, size_t len)
+{
+	return n->len == len && memcmp(n->level, level, len) == 0;
+}
+
+static bool is_wildcard(const route_node *n, char w)
+{
+	return n->len == 1 && n->level[0] == w;
+}
+
+/* Length of the level starting at 's', which ends at a '/' or at 'end' */
+static size_t level_len(const char *s, const char *end)
+{
+	const char *sep = memchr(s, '/', end - s);
+	return (sep ? sep : end) - s;
+}
+
+static int8_t find_level(int8_t first, const char *level, size_t len)
+{
+	for (int8_t n = first; n != NONE; n = nodes[n].next)
+		if (is_level(&nodes[n], level, len))
+			return n;
+	return NONE;
+}
+
+/*
+ * Check that "+" and "#" fill a level on their own and that "#" is last, and
+ * count the nodes the filter needs beyond those already in the trie. 'last' is
+ * set to the node of the last level if the trie already has it, NONE otherwise.
+ */
+static bool check_filter(const char *filter, uint8_t *new_nodes, int8_t *last)
+{
+	const char *end = filter + strlen(filter);
+	const char *s = filter;
+	int8_t first = root;
+	*new_nodes = 0;
+	*last = NONE;
+	if (s == end)
+		return false;
+	while (true) {
+		size_t len = level_len(s, end);
+		if (len > UINT8_MAX)
+			return false;
+		const char *w = memchr(s, '+', len);
+		if (!w)
+			w = memchr(s, '#', len);
+		if (w && len != 1)
+			return false;
+		if (*s == '#' && s + len != end)
+			return false;
+		int8_t n = (first == NONE) ? NONE : find_level(first, s, len);
+		if (n == NONE)
+			(*new_nodes)++;
+		first = (n == NONE) ? NONE : nodes[n].child;
+		if (s + len == end) {
+			*last = n;
+			return true;
+		}
+		s += len + 1;
+	}
+}
+
+void mqtt_route_reset(void)
+{
+	num_routes = 0;
+	num_nodes = 0;
+	root = NONE;
+}
+
+const mqtt_route *mqtt_route_add(const char *filter, void *rcv_buf,
+		uint32_t rcv_sz, mqtt_route_callback cb, void *ctx)
+{
+	uint8_t new_nodes;
+	int8_t last;
+	if (!filter || !check_filter(filter, &new_nodes, &last))
+		return NULL;
+	/* Check for room before touching the trie, so a failure leaves it as is */
+	if (num_nodes + new_nodes > MQTT_ROUTE_NODES)
+		return NULL;
+	if ((last == NONE || nodes[last].route == NONE) &&
+			num_routes == MQTT_MAX_ROUTES)
+		return NULL;
+
+	/* Walk the levels of the filter, adding the ones not in the trie */
+	const char *end = filter + strlen(filter);
+	const char *s = filter;
+	int8_t *link = &root;
+	int8_t n;
+	while (true) {
+		size_t len = level_len(s, end);
+		n = find_level(*link, s, len);
+		if (n == NONE) {
+			n = num_nodes++;
+			nodes[n].level = s;
+			nodes[n].len = len;
+			nodes[n].child = NONE;
+			nodes[n].next = *link;
+			nodes[n].route = NONE;
+			*link = n;
+		}
+		if (s + len == end)
+			break;
+		link = &nodes[n].child;
+		s += len + 1;
+	}
+
+	if (nodes[n].route == NONE)
+		nodes[n].route = num_routes++;
+	mqtt_route *r = &routes[(uint8_t)nodes[n].route];
+	r->filter = filter;
+	r->rcv_buf = rcv_buf;
+	r->rcv_sz = rcv_sz;
+	r->cb = cb;
+	r->ctx = ctx;
+	return r;
+}
+
+static int8_t match_level(int8_t first, const char *s, const char *end,
+		bool top);
+
+/* Continue the match below node 'n', whose level ends at 'lend' */
+static int8_t match_below(int8_t n, const char *lend, const char *end)
+{
+	if (lend != end)
+		return match_level(nodes[n].child, lend + 1, end, false);
+	if (nodes[n].route != NONE)
+		return nodes[n].route;
+	/* "a/#" matches "a" as well */
+	for (int8_t c = nodes[n].child; c != NONE; c = nodes[c].next)
+		if (is_wildcard(&nodes[c], '#'))
+			return nodes[c].route;
+	return NONE;
+}
+
+static int8_t match_level(int8_t first, const char *s, const char *end,
+		bool top)
+{
+	size_t len = level_len(s, end);
+	const char *lend = s + len;
+	int8_t plus = NONE;
+	int8_t hash = NONE;
+	int8_t r;
+	for (int8_t n = first; n != NONE; n = nodes[n].next) {
+		if (is_wildcard(&nodes[n], '+')) {
+			plus = n;
+		} else if (is_wildcard(&nodes[n], '#')) {
+			hash = n;
+		} else if (is_level(&nodes[n], s, len)) {
+			r = match_below(n, lend, end);
+			if (r != NONE)
+				return r;
+		}
+	}
+	/* Wildcards do not match the first level of topics such as $SYS */
+	if (top && len > 0 && *s == '$')
+		return NONE;
+	if (plus != NONE) {
+		r = match_below(plus, lend, end);
+		if (r != NONE)
+			return r;
+	}
+	return (hash != NONE) ? nodes[hash].route : NONE;
+}
+
+const mqtt_route *mqtt_route_match(const char *topic, uint16_t len)
+{
+	if (!topic || root == NONE)
+		return NULL;
+	int8_t r = match_level(root, topic, topic + len, true);
+	return (r != NONE) ? &routes[(uint8_t)r] : NULL;
+}
+
+uint8_t mqtt_route_count(void)
+{
+	return num_routes;
+}
+
+const mqtt_route *mqtt_route_get(uint8_t idx)
+{
+	return (idx < num_routes) ? &routes[idx] : NULL;
+}
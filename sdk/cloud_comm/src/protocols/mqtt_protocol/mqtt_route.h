@@ -0,0 +1,63 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+#ifndef __MQTT_ROUTE
+#define __MQTT_ROUTE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_protocol.h"
+
+/*
+ * Routing of received publications by topic. Topic filters, which may contain
+ * the "+" and "#" wildcards, are compiled into a trie of topic levels as they
+ * are added, so a received topic is resolved in a single walk over its levels.
+ * Filters are not copied and must remain valid.
+ */
+
+/* Topic filters that can be routed, and topic levels of all of them together */
+#define MQTT_MAX_ROUTES		4
+#define MQTT_ROUTE_NODES	24
+
+#if MQTT_ROUTE_NODES > 127
+#error "Trie nodes are indexed by int8_t"
+#endif
+
+typedef struct {
+	const char *filter;
+	void *rcv_buf;
+	uint32_t rcv_sz;
+	mqtt_route_callback cb;
+	void *ctx;
+} mqtt_route;
+
+/* Forget every route */
+void mqtt_route_reset(void);
+
+/*
+ * Add a route, or update the destination of the route already registered for
+ * the same filter.
+ *
+ * Returns:
+ * 	The route, or NULL if the filter is invalid or there is no room left.
+ */
+const mqtt_route *mqtt_route_add(const char *filter, void *rcv_buf,
+		uint32_t rcv_sz, mqtt_route_callback cb, void *ctx);
+
+/*
+ * Find the route of a topic. When several filters match, a level that matches
+ * literally wins over "+", which wins over "#".
+ *
+ * Parameters:
+ *	topic : Topic name, need not be NULL terminated.
+ *	len   : Length of the topic name.
+ *
+ * Returns:
+ * 	The route, or NULL if no filter matches.
+ */
+const mqtt_route *mqtt_route_match(const char *topic, uint16_t len);
+
+/* Number of routes, which are numbered from 0 for mqtt_route_get() */
+uint8_t mqtt_route_count(void);
+const mqtt_route *mqtt_route_get(uint8_t idx);
+
+#endif
@@ -4,6 +4,21 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * QoS 1/2 publishes that may await acknowledgement at once, see
+ * MQTTPublishAsync(). 0 waits for the acknowledgement of every publish before
+ * sending the next one. The Paho library is built with this header as well, so
+ * both agree on the layout of MQTTClient.
+ */
+#define MAX_INFLIGHT_MESSAGES	4
+
+/*
+ * Read the payload of incoming publishes straight into the receive buffer of
+ * their destination, see MQTTSetPayloadLoan(). The read buffer of the client
+ * then only needs room for the headers.
+ */
+#define MQTT_PAYLOAD_LOAN	1
+
 typedef struct Timer {
 	uint64_t end_time;
 } Timer;
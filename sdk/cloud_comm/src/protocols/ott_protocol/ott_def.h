@@ -22,6 +22,29 @@
 #define OTT_UUID_SZ             16 /* unique device id size in bytes */
 #define OTT_DEV_SC_SZ		32 /* device secret size in bytes */
 
+/*
+ * Largest message sent by the device. A status message (command byte, length
+ * and data) is the biggest one, the auth message is much smaller.
+ */
+#define OTT_MAX_FRAME_SZ	PROTO_MAX_MSG_SZ
+
+/*
+ * Define this to keep the authenticated connection to the cloud open between
+ * service cycles instead of closing it at the end of every cycle. Meant for
+ * devices that are not constrained by power. The connection is closed once the
+ * application has not sent anything for OTT_IDLE_TIMEOUT_MS and is kept alive
+ * in the meantime by an empty message after OTT_KEEPALIVE_MS of silence.
+ */
+/*#define OTT_PERSISTENT_SESSION*/
+#define OTT_IDLE_TIMEOUT_MS	((uint32_t)300000)
+#define OTT_KEEPALIVE_MS	((uint32_t)60000)
+
+#ifdef OTT_PERSISTENT_SESSION
+#define PERSISTENT_SESSION	true
+#else
+#define PERSISTENT_SESSION	false
+#endif
+
 #define MAX_HOST_LEN		50
 #define MAX_PORT_LEN		5
 
@@ -92,6 +115,10 @@ static struct {
 	bool pend_bit;			/* Cloud has a pending message */
 	bool pend_ack;			/* Set if the device needs to ACK prev msg */
 	bool nack_sent;			/* Set if a NACK was sent from the device */
+	uint64_t last_io_ts;		/* Last time anything was exchanged */
+	uint64_t last_msg_ts;		/* Last time the application sent a
+					 * message or the session started
+					 */
 	char host[MAX_HOST_LEN + 1];	/* Store the host name */
 	char port[MAX_PORT_LEN + 1];	/* Store the host port */
 	proto_service_id send_svc_id;	/* Service id of last sent message */
@@ -104,10 +131,10 @@ static struct {
 } session;
 
 /*
- * Define this to profile the maximum heap used by mbedTLS. This is done by
- * providing a custom implementation of calloc(). Everytime the connection is
- * closed through ott_close_connection(), the maximum amount of heap used until
- * that point of time is printed to the debug UART.
+ * Define this to profile the memory used by mbedTLS. Everytime the connection
+ * is closed through ott_close_connection(), the peak footprint of the TLS arena
+ * followed by the peak usage during the handshake, steady and close phases is
+ * printed to the debug UART. Requires TLS_MEM_ARENA_SZ (see tls_mem.h).
  */
 /*#define OTT_HEAP_PROFILE*/
 
@@ -7,6 +7,9 @@
 #include "service_ids.h"
 #include "ott_protocol.h"
 #include "ott_def.h"
+#include "tls_cred.h"
+#include "tls_mem.h"
+#include "cc_metrics_def.h"
 
 #include "mbedtls/net.h"
 #include "mbedtls/ssl.h"
@@ -48,60 +51,12 @@ static void my_debug(void *ctx, int level,
 }
 #endif
 
-#ifdef CALC_TLS_OVRHD_BYTES
-extern bool ovrhd_profile_flag;
-extern uint32_t num_bytes_recvd;
-extern uint32_t num_bytes_sent;
-#define START_CALC_OVRHD_BYTES()	ovrhd_profile_flag = true
-#define STOP_CALC_OVRHD_BYTES()		ovrhd_profile_flag = false
-#define PRINT_OVRHD_SENT()		dbg_printf("OVS:%"PRIu32"\n", num_bytes_sent);
-#define PRINT_OVRHD_RECVD()		dbg_printf("OVR:%"PRIu32"\n", num_bytes_recvd);
-#else
-#define START_CALC_OVRHD_BYTES()
-#define STOP_CALC_OVRHD_BYTES()
-#define PRINT_OVRHD_SENT()
-#define PRINT_OVRHD_RECVD()
-#endif	/* CALC_TLS_OVRHD_BYTES */
-
-#ifdef PROTO_HEAP_PROFILE
-#include <stdlib.h>
-#include <inttypes.h>
-#include "mbedtls/platform.h"
-static uintptr_t max_alloc = 0;
-extern int _end;			/* Defined in linker script */
-static uintptr_t heap_start = (uintptr_t)&_end;
-extern caddr_t _sbrk(int);		/* Implemented in libnosys */
-
-static void *ott_calloc(size_t num, size_t size)
-{
-	void *p = calloc(num, size);
-	if (p) {
-		/* Get current top of the heap */
-		uintptr_t s = (uintptr_t)_sbrk(0);
-		s -= heap_start;
-		max_alloc = ((max_alloc >= s) ? max_alloc : s);
-	}
-	return p;
-}
-#endif
-
 #ifdef PROTO_TIME_PROFILE
 static uint64_t proto_begin;
 #endif
 
 static uint32_t current_polling_interval = INIT_POLLING_MS;
 
-/*
- * Assumption: Underlying transport protocol is stream oriented. So parts of
- * the message can be sent through separate write calls.
- */
-#define WRITE_AND_RETURN_ON_ERROR(buf, len, ret) \
-	do { \
-		ret = write_tls((buf), (len)); \
-		if (ret == PROTO_ERROR || ret == PROTO_TIMEOUT) \
-		return ret; \
-	} while(0)
-
 /* mbedTLS specific variables */
 static mbedtls_net_context server_fd;
 static mbedtls_entropy_context entropy;
@@ -110,8 +65,24 @@ static mbedtls_ssl_context ssl;
 static mbedtls_ssl_config conf;
 static mbedtls_x509_crt cacert;
 
+/*
+ * TLS session (session ID and / or session ticket along with the master secret)
+ * negotiated during the last full handshake. It outlives the connection so that
+ * the next connection can resume it through an abbreviated handshake, skipping
+ * the certificate exchange and key agreement.
+ */
+static mbedtls_ssl_session saved_session;
+static bool saved_session_valid;
+
+static void invalidate_tls_session(void)
+{
+	mbedtls_ssl_session_free(&saved_session);
+	saved_session_valid = false;
+}
+
 static inline void cleanup_mbedtls(void)
 {
+	invalidate_tls_session();
 	/* Free network interface resources. */
 	mbedtls_net_free(&server_fd);
 	mbedtls_x509_crt_free(&cacert);
@@ -125,6 +96,7 @@ static inline void cleanup_mbedtls(void)
 void ott_protocol_deinit(void)
 {
 	/* "server_fd" and "ssl" are freed by ott_close_connection() */
+	invalidate_tls_session();
 	mbedtls_x509_crt_free(&cacert);
 	mbedtls_ssl_config_free(&conf);
 	mbedtls_ctr_drbg_free(&ctr_drbg);
@@ -167,15 +139,17 @@ proto_result ott_protocol_init(void)
 	mbedtls_debug_set_threshold(1);
 #endif
 
-#ifdef PROTO_HEAP_PROFILE
-	mbedtls_sys_set_calloc_free(ott_calloc, free);
-#endif
+	if (!tls_mem_init())
+		return PROTO_ERROR;
+
 	/* Initialize TLS structures */
 	mbedtls_net_init(&server_fd);
 	mbedtls_ssl_init(&ssl);
 	mbedtls_ssl_config_init(&conf);
 	mbedtls_x509_crt_init(&cacert);
 	mbedtls_ctr_drbg_init(&ctr_drbg);
+	mbedtls_ssl_session_init(&saved_session);
+	saved_session_valid = false;
 
 	/* Seed the RNG */
 	mbedtls_entropy_init(&entropy);
@@ -197,6 +171,10 @@ proto_result ott_protocol_init(void)
 
 	mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
 	mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+	mbedtls_ssl_conf_session_tickets(&conf,
+			MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
 #ifdef MBEDTLS_DEBUG_C
 	mbedtls_ssl_conf_dbg(&conf, my_debug, stdout);
 #endif
@@ -227,16 +205,21 @@ proto_result ott_set_remote_auth(const uint8_t *serv_cert, uint32_t cert_len)
 	if ((serv_cert == NULL) || (cert_len == 0))
 		return PROTO_INV_PARAM;
 
-	/* Load the CA root certificate */
-	int ret = mbedtls_x509_crt_parse_der(&cacert,
-	                                 (const unsigned char *)serv_cert,
-					 cert_len);
-	if (ret < 0) {
+	/* Load the CA root certificate, unless it is the one already loaded */
+	tls_cred_result ret = tls_cred_load_crt(&cacert, serv_cert, cert_len);
+	if (ret == TLS_CRED_ERROR) {
 		cleanup_mbedtls();
 		return PROTO_ERROR;
 	}
 
-	mbedtls_ssl_conf_ca_chain(&conf, &cacert, NULL);
+	if (ret == TLS_CRED_PARSED) {
+		mbedtls_ssl_conf_ca_chain(&conf, &cacert, NULL);
+		/*
+		 * A session verified against the old trust anchor must not be
+		 * resumed
+		 */
+		invalidate_tls_session();
+	}
 	auth.serv_auth_valid = true;
 	return PROTO_OK;
 }
@@ -258,6 +241,11 @@ proto_result ott_set_destination(const char *dest)
 	if (plen > MAX_PORT_LEN || plen == 0)
 		return PROTO_INV_PARAM;
 
+	/* The cached TLS session belongs to the previous server */
+	if (strncmp(session.host, dest, hlen) != 0 ||
+			session.host[hlen] != '\0')
+		invalidate_tls_session();
+
 	strncpy(session.host, dest, hlen);
 	session.host[hlen] = '\0';
 	strncpy(session.port, delimiter+1, sizeof(session.port));
@@ -280,13 +268,20 @@ static proto_result ott_close_connection(void)
 {
 	PROTO_TIME_PROFILE_BEGIN();
 	/* Close the connection and notify the peer. */
+	tls_mem_set_phase(TLS_MEM_CLOSE);
 	int s = mbedtls_ssl_close_notify(&ssl);
 	mbedtls_ssl_free(&ssl);
 	mbedtls_net_free(&server_fd);
+	tls_mem_conn_reset();
 	PROTO_TIME_PROFILE_END("CC");
 
 #ifdef OTT_HEAP_PROFILE
-	dbg_printf("[HP:%"PRIuPTR"]\n", max_alloc);
+	tls_mem_stats st;
+	tls_mem_get_stats(&st);
+	dbg_printf("[HP:%u,%u,%u,%u]\n", (unsigned)st.peak_footprint,
+			(unsigned)st.peak[TLS_MEM_HANDSHAKE],
+			(unsigned)st.peak[TLS_MEM_STEADY],
+			(unsigned)st.peak[TLS_MEM_CLOSE]);
 #endif
 
 	if (s == 0)
@@ -341,9 +336,58 @@ static proto_result write_tls(const uint8_t *buf, uint16_t len)
 		if (ret > 0)
 			nbytes += ret;
 	} while (nbytes < len);
+	session.last_io_ts = sys_get_tick_ms();
 	return PROTO_OK;
 }
 
+/*
+ * Every field of an outgoing message is first assembled into this buffer so
+ * that the whole message is handed to the TLS layer through a single write.
+ * Each write becomes a TLS record of its own with a header, MAC and padding, so
+ * writing the fields one by one costs several times the size of a small status
+ * message.
+ */
+static struct {
+	uint8_t buf[OTT_MAX_FRAME_SZ];
+	uint16_t len;
+	bool overflow;			/* A field did not fit in the buffer */
+} frame;
+
+static void frame_begin(void)
+{
+	frame.len = 0;
+	frame.overflow = false;
+}
+
+static void frame_put(const void *data, uint16_t len)
+{
+	if (frame.overflow || len > sizeof(frame.buf) - frame.len) {
+		frame.overflow = true;
+		return;
+	}
+	memcpy(frame.buf + frame.len, data, len);
+	frame.len += len;
+}
+
+static void frame_put_byte(uint8_t byte)
+{
+	frame_put(&byte, 1);
+}
+
+/* Length fields are sent in little endian format */
+static void frame_put_len(uint16_t len)
+{
+	uint8_t bytes[PROTO_LEN_SZ] = {len & 0xFF, (len >> 8) & 0xFF};
+	frame_put(bytes, sizeof(bytes));
+}
+
+static proto_result frame_send(void)
+{
+	if (frame.overflow)
+		return PROTO_INV_PARAM;
+	return write_tls(frame.buf, frame.len);
+}
+
 static proto_result ott_send_ctrl_msg(c_flags_t c_flags)
 {
 	PROTO_TIME_PROFILE_BEGIN();
@@ -351,11 +395,12 @@ static proto_result ott_send_ctrl_msg(c_flags_t c_flags)
 	if (!flags_are_valid(c_flags))
 		return PROTO_INV_PARAM;
 
-	proto_result ret;
-	unsigned char byte = (uint8_t)(c_flags | MT_NONE);
-
 	/* Send the command byte */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)&byte, 1, ret);
+	frame_begin();
+	frame_put_byte((uint8_t)(c_flags | MT_NONE));
+	proto_result ret = frame_send();
+	if (ret != PROTO_OK)
+		return ret;
 
 	PROTO_TIME_PROFILE_END("SC");
 	return PROTO_OK;
@@ -539,6 +584,7 @@ static proto_result ott_retrieve_msg(msg_t *msg, uint16_t sz, uint32_t *rbytes)
 	}
 
 	if (ret > 0) {
+		session.last_io_ts = sys_get_tick_ms();
 		recvd += ret;
 		if (msg_is_complete(msg, recvd)) {
 			*rbytes = recvd;
@@ -604,26 +650,55 @@ static bool recv_resp_within_timeout(uint32_t timeout, bool invoke_send_cb)
 	return no_nack;
 }
 
+/* Remember the session negotiated by the handshake that just completed */
+static void save_tls_session(void)
+{
+	/* The copy outlives the connection */
+	tls_mem_phase prev = tls_mem_set_phase(TLS_MEM_IDLE);
+	invalidate_tls_session();
+	if (mbedtls_ssl_get_session(&ssl, &saved_session) == 0)
+		saved_session_valid = true;
+	else
+		/*
+		 * On a failed copy the destination may still point at buffers
+		 * owned by the live session, so only forget them instead of
+		 * freeing.
+		 */
+		mbedtls_ssl_session_init(&saved_session);
+	tls_mem_set_phase(prev);
+}
+
+/* Release what a connection that failed to come up has allocated so far */
+static void abort_connection(void)
+{
+	mbedtls_ssl_free(&ssl);
+	mbedtls_net_free(&server_fd);
+	tls_mem_conn_reset();
+}
+
 static proto_result ott_initiate_connection(const char *host, const char *port)
 {
-	START_CALC_OVRHD_BYTES();
 	PROTO_TIME_PROFILE_BEGIN();
 	if (host == NULL || port == NULL)
 		return PROTO_INV_PARAM;
 
+	uint32_t hs_wire = CC_METRIC_GET(wire_bytes_sent) +
+		CC_METRIC_GET(wire_bytes_rcvd);
+
 	int ret;
+	tls_mem_set_phase(TLS_MEM_HANDSHAKE);
 	/* Connect to the cloud server over TCP */
 	ret = mbedtls_net_connect(&server_fd, host, port,
 				  MBEDTLS_NET_PROTO_TCP);
 	if (ret < 0) {
-		mbedtls_net_free(&server_fd);
+		abort_connection();
 		return PROTO_ERROR;
 	}
 
 	/* Set up the SSL context */
 	ret = mbedtls_ssl_setup(&ssl, &conf);
 	if (ret != 0) {
-		mbedtls_net_free(&server_fd);
+		abort_connection();
 		return PROTO_ERROR;
 	}
 
@@ -636,8 +711,18 @@ static proto_result ott_initiate_connection(const char *host, const char *port)
 	 */
 	dbg_printf("\tSetting required server identity\n");
 	ret = mbedtls_ssl_set_hostname(&ssl, host);
-	if (ret != 0)
+	if (ret != 0) {
+		abort_connection();
 		return PROTO_ERROR;
+	}
+
+	/*
+	 * Offer the session from the previous connection for resumption. If the
+	 * server no longer recognizes it, a full handshake takes place.
+	 */
+	if (saved_session_valid &&
+			mbedtls_ssl_set_session(&ssl, &saved_session) != 0)
+		invalidate_tls_session();
 
 	/* Perform TLS handshake */
 	ret = mbedtls_ssl_handshake(&ssl);
@@ -645,24 +730,23 @@ static proto_result ott_initiate_connection(const char *host, const char *port)
 	while (ret != 0) {
 		if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
 				ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-			mbedtls_ssl_session_reset(&ssl);
-			mbedtls_ssl_free(&ssl);
-			mbedtls_net_free(&server_fd);
+			invalidate_tls_session();
+			abort_connection();
 			return PROTO_ERROR;
 		}
 		if (sys_get_tick_ms() - start > TIMEOUT_MS) {
-			mbedtls_ssl_session_reset(&ssl);
-			mbedtls_ssl_free(&ssl);
-			mbedtls_net_free(&server_fd);
+			abort_connection();
 			return PROTO_TIMEOUT;
 		}
 		ret = mbedtls_ssl_handshake(&ssl);
 	}
+	save_tls_session();
+	tls_mem_set_phase(TLS_MEM_STEADY);
+	CC_METRIC_INC(tls_handshakes);
+	CC_METRIC_ADD(tls_hs_bytes, CC_METRIC_GET(wire_bytes_sent) +
+			CC_METRIC_GET(wire_bytes_rcvd) - hs_wire);
 
 	PROTO_TIME_PROFILE_END("IC");
-	STOP_CALC_OVRHD_BYTES();
-	PRINT_OVRHD_SENT();
-	PRINT_OVRHD_RECVD();
 	return PROTO_OK;
 }
 
@@ -688,26 +772,17 @@ static proto_result ott_send_auth_to_cloud(c_flags_t c_flags)
 	if (!flags_are_valid(c_flags) || OTT_FLAG_IS_SET(c_flags, CF_QUIT))
 		return PROTO_ERROR;
 
-	uint8_t bytes[2] = {VERSION_BYTE, 0};
-	proto_result ret;
-
+	frame_begin();
 	/* The version byte is sent before the very first message. */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)bytes, 1, ret);
+	frame_put_byte(VERSION_BYTE);
+	frame_put_byte((uint8_t)(c_flags | MT_AUTH));
+	frame_put(dev_id, OTT_UUID_SZ);
+	frame_put_len(dev_sec_sz);
+	frame_put(dev_sec, dev_sec_sz);
 
-	/* Send the command byte */
-	bytes[0] = (uint8_t)(c_flags | MT_AUTH);
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)bytes, 1, ret);
-
-	/* Send the device ID */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)dev_id, OTT_UUID_SZ, ret);
-
-	/* Send the device secret size in little endian format */
-	bytes[0] = (uint8_t)(dev_sec_sz & 0xFF);
-	bytes[1] = (uint8_t)((dev_sec_sz >> 8) & 0xFF);
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)bytes, sizeof(uint16_t), ret);
-
-	/* Send the device secret */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)dev_sec, dev_sec_sz, ret);
+	proto_result ret = frame_send();
+	if (ret != PROTO_OK)
+		return ret;
 
 	PROTO_TIME_PROFILE_END("SA");
 	return PROTO_OK;
@@ -721,28 +796,40 @@ static bool establish_session(bool polling)
 		return false;
 
 retry_connection:
-	if (ott_initiate_connection(session.host, session.port) != PROTO_OK)
+	if (ott_initiate_connection(session.host, session.port) != PROTO_OK) {
+		CC_METRIC_INC(connect_failures);
 		return false;
+	}
 	session.conn_done = true;
+	session.last_msg_ts = sys_get_tick_ms();
 	/* Send the authentication message to the cloud. If this is a call to
 	 * simply poll the cloud for possible messages, do not set the PENDING
-	 * flag.
+	 * flag, unless the connection is meant to outlive this poll.
 	 */
-	c_flags_t c_flags = polling ? CF_NONE : CF_PENDING;
+	c_flags_t c_flags = (polling && !PERSISTENT_SESSION) ?
+		CF_NONE : CF_PENDING;
 	if (ott_send_auth_to_cloud(c_flags) != PROTO_OK) {
+		CC_METRIC_INC(connect_failures);
+		invalidate_tls_session();
 		ott_initiate_quit(false);
 		return false;
 	}
 
 	/* This call should not invoke the send callback */
 	if (!recv_resp_within_timeout(RECV_TIMEOUT_MS, false)) {
+		/* Start over with a full handshake after an auth failure */
+		CC_METRIC_INC(connect_failures);
+		invalidate_tls_session();
 		ott_initiate_quit(true);
 		return false;
 	}
 
+	CC_METRIC_INC(connects);
+
 	/* If we NACKed an incoming message, the session was ended. Retry. */
 	if (session.nack_sent) {
 		session.nack_sent = false;
+		CC_METRIC_INC(reconnects);
 		goto retry_connection;
 	}
 
@@ -785,20 +872,14 @@ static proto_result ott_send_status_to_cloud(c_flags_t c_flags,
 			(status_sz > PROTO_DATA_SZ) || (status == NULL))
 		return PROTO_INV_PARAM;
 
-	proto_result ret;
-	uint8_t bytes[2];
+	frame_begin();
+	frame_put_byte((uint8_t)(c_flags | MT_STATUS));
+	frame_put_len(status_sz);
+	frame_put(status, status_sz);
 
-	/* Send the command byte */
-	bytes[0] = (uint8_t)(c_flags | MT_STATUS);
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)bytes, 1, ret);
-
-	/* Send the status length field in little endian format */
-	bytes[0] = (uint8_t)(status_sz & 0xFF);
-	bytes[1] = (uint8_t)((status_sz >> 8) & 0xFF);
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)bytes, sizeof(uint16_t), ret);
-
-	/* Send the actual status data */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)status, status_sz, ret);
+	proto_result ret = frame_send();
+	if (ret != PROTO_OK)
+		return ret;
 
 	PROTO_TIME_PROFILE_END("SS");
 	return PROTO_OK;
@@ -841,6 +922,7 @@ proto_result ott_send_msg_to_cloud(const void *buf, uint32_t sz,
 	 * If a session hasn't been established, initiate a connection. This
 	 * leads to the device being authenticated.
 	 */
+	bool reused = PERSISTENT_SESSION && session.auth_done;
 	if (!session.auth_done)
 		if (!establish_session(false))
 			return PROTO_ERROR;
@@ -854,10 +936,24 @@ proto_result ott_send_msg_to_cloud(const void *buf, uint32_t sz,
 		CF_PENDING;
 
 	proto_result res = ott_send_status_to_cloud(c_flags, sz, buf);
+	if (res != PROTO_OK && reused) {
+		/*
+		 * A connection kept open from a previous cycle may have been
+		 * dropped by the network in the meantime. Reconnect once.
+		 */
+		ott_close_connection();
+		ott_reset_state();
+		CC_METRIC_INC(reconnects);
+		if (!establish_session(false))
+			return PROTO_ERROR;
+		CC_METRIC_INC(retries);
+		res = ott_send_status_to_cloud(CF_PENDING, sz, buf);
+	}
 	if (res != PROTO_OK) {
 		ott_initiate_quit(false);
 		return res;
 	}
+	session.last_msg_ts = sys_get_tick_ms();
 	session.send_buf = buf;
 	session.send_sz = sz;
 	session.send_cb = cb;
@@ -902,11 +998,12 @@ static proto_result ott_send_restarted(c_flags_t c_flags)
 	if (!flags_are_valid(c_flags))
 		return PROTO_INV_PARAM;
 
-	proto_result ret;
-	unsigned char byte = (uint8_t)(c_flags | MT_RESTARTED);
-
 	/* Send the command byte */
-	WRITE_AND_RETURN_ON_ERROR((unsigned char *)&byte, 1, ret);
+	frame_begin();
+	frame_put_byte((uint8_t)(c_flags | MT_RESTARTED));
+	proto_result ret = frame_send();
+	if (ret != PROTO_OK)
+		return ret;
 
 	PROTO_TIME_PROFILE_END("SR");
 	return PROTO_OK;
@@ -971,6 +1068,25 @@ void ott_set_polling_interval(uint32_t interval_ms)
 	}
 }
 
+/*
+ * Exchange an empty message with the cloud over a connection kept open between
+ * service cycles. This keeps the connection from being dropped as idle by the
+ * network and doubles as a poll, as the response may carry a pending message.
+ * Return "false" if the connection is no longer usable.
+ */
+static bool keep_session_alive(void)
+{
+	c_flags_t c_flags = session.pend_ack ? (CF_PENDING | CF_ACK) :
+		CF_PENDING;
+	if (ott_send_ctrl_msg(c_flags) != PROTO_OK)
+		return false;
+	if (!recv_resp_within_timeout(RECV_TIMEOUT_MS, false))
+		return false;
+	if (session.nack_sent)
+		session.nack_sent = false;
+	return true;
+}
+
 /*
  * Receive any pending messages from the cloud or ACK any previous message. If
  * the message was to be NACKed, it would have been already done through the
@@ -978,15 +1094,34 @@ void ott_set_polling_interval(uint32_t interval_ms)
  */
 void ott_maintenance(bool poll_due)
 {
+	if (PERSISTENT_SESSION && session.auth_done) {
+		uint64_t now = sys_get_tick_ms();
+		if (now - session.last_msg_ts >= OTT_IDLE_TIMEOUT_MS) {
+			ott_initiate_quit(false);
+		} else if (poll_due ||
+				now - session.last_io_ts >= OTT_KEEPALIVE_MS) {
+			if (!keep_session_alive()) {
+				/* Reconnect below if a poll is due */
+				ott_close_connection();
+				ott_reset_state();
+			}
+		}
+	}
+
 	if (session.auth_done || poll_due) {
 		if (!session.auth_done)
 			if (!establish_session(true))
 				return;
 		while (session.pend_bit || session.pend_ack) {
 			c_flags_t c_flags = session.pend_ack ? CF_ACK : CF_NONE;
-			c_flags |= ((!session.pend_bit) ? CF_QUIT : CF_NONE);
+			if (PERSISTENT_SESSION)
+				c_flags |= CF_PENDING;
+			else
+				c_flags |= ((!session.pend_bit) ?
+						CF_QUIT : CF_NONE);
 			ott_send_ctrl_msg(c_flags);
-			if (!session.pend_bit) { /* If last message in session */
+			/* If last message in session */
+			if (!PERSISTENT_SESSION && !session.pend_bit) {
 				ott_close_connection();
 				ott_reset_state();
 				return;
@@ -1002,3 +1137,19 @@ void ott_maintenance(bool poll_due)
 		}
 	}
 }
+
+uint32_t ott_end_cycle(uint32_t next_call_ms)
+{
+	if (!PERSISTENT_SESSION || !session.auth_done) {
+		ott_initiate_quit(false);
+		return next_call_ms;
+	}
+
+	/* Make sure maintenance runs in time for the next keepalive */
+	uint64_t silent = sys_get_tick_ms() - session.last_io_ts;
+	uint32_t due = (silent >= OTT_KEEPALIVE_MS) ? 1 :
+		(uint32_t)(OTT_KEEPALIVE_MS - silent);
+	if (next_call_ms == 0 || due < next_call_ms)
+		return due;
+	return next_call_ms;
+}
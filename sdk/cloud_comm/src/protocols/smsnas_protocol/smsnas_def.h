@@ -9,13 +9,12 @@
 #include "protocol_def.h"
 #include "at_sms.h"
 
-/* Macro indicates maximum concatenated sms receive stream protocol handles
+/* Macro indicates maximum concatenated sms receive stream protocol handles.
+ * Each of them reassembles its concatenated sms in a buffer of its own of
+ * MAX_CONC_SMS_NUM * CONCT_SMS_SZ bytes
  */
-
-/*#define SMSNAS_MAX_RCV_PATH	2*/
-
 #ifndef SMSNAS_MAX_RCV_PATH
-#define SMSNAS_MAX_RCV_PATH	        1
+#define SMSNAS_MAX_RCV_PATH	        2
 #endif
 
 /* Defines retries in case of send failure */
@@ -43,7 +42,12 @@
 /* Upper limit for the total messages in the concatenated sms */
 #define MAX_CONC_SMS_NUM		4
 
-/* Time out waiting for the next segment of the concatenated sms in milliseconds
+#if MAX_CONC_SMS_NUM > 8
+#error "Received segments are tracked in a uint8_t bitmap"
+#endif
+
+/* Time out waiting for the next segment of the concatenated sms in milliseconds,
+ * kept separately by every receive path from the last segment it received
  */
 #define CONC_NEXT_SEG_TIMEOUT_MS	2000
 /* Defines for the concatenated sms ends */
@@ -66,6 +70,9 @@
 #define PRINTF_FUNC(...)
 #endif
 
+/* Defines to enable dumping every received message byte by byte */
+/*#define DEBUG_RCV_DUMP*/
+
 /* Defines flag for the ack/nack pending */
 typedef enum {
 	ACK_PENDING,
@@ -84,29 +91,34 @@ typedef struct __attribute__((packed)) {
 	uint8_t payload[];
 } smsnas_msg_t;
 
+/* Receive path reassembling one concatenated sms. Segments may arrive in any
+ * order and be shorter than CONCT_SMS_SZ, segment n is placed in the slot at
+ * (n - 1) * CONCT_SMS_SZ in the buffer. The slots of the completed message are
+ * copied back to back to the user supplied buffer.
+ */
 typedef struct {
 	/* true if concatenated message is in progress */
 	bool conct_in_progress;
-	/* service id received from protocol message */
+	/* service id received from protocol message, valid once the first
+	 * segment arrived
+	 */
 	proto_service_id service_id;
 	/* message reference number in case of concatenated sms from
 	 * tp-user header
 	 */
-	int cref_num;
-	/* Current sequence number it is processing from concatenated sms */
-	uint8_t cur_seq;
-	/* Expected next sequence number within receive timeout */
-	uint8_t expected_seq;
-	/* Future Time interval within which next sequence from the concatenated
-	 * sms should be received
+	uint8_t cref_num;
+	/* Total number of segments of the concatenated sms */
+	uint8_t num_seg;
+	/* Bit n - 1 is set once segment n was received */
+	uint8_t seg_map;
+	/* Size of every segment, valid once it was received */
+	uint8_t seg_len[MAX_CONC_SMS_NUM];
+	/* Time by which the next segment has to be received, or the
+	 * concatenated sms is discarded
 	 */
 	uint64_t next_seq_timeout;
-	/* buffer to store receiving data */
-	uint8_t *buf;
-	/* write index of the buf */
-	proto_pl_sz wr_idx;
-	/* size of the receiving buffer */
-	proto_pl_sz rcv_sz;
+	/* Buffer the segments are placed in */
+	uint8_t buf[MAX_CONC_SMS_NUM * CONCT_SMS_SZ];
 } smsnas_rcv_path;
 
 static struct {
@@ -123,9 +135,8 @@ static struct {
 	uint8_t send_msg[MAX_SMS_PL_SZ];
 	/* True when user has called to schedule any future incoming messages */
 	bool rcv_valid;
-	/* Used to hold user supplied incoming data buffer especially when
-	 * SMSNAS_MAX_RCV_PATH > 1 for which case this layer uses its internal
-	 * buffer to hold data before transferring to rcv_buf
+	/* User supplied incoming data buffer, the modem layer decodes single
+	 * sms's directly into it
 	 */
 	void *rcv_buf;
 	/* Size of the user supplied incoming buffer */
@@ -135,7 +146,8 @@ static struct {
 	/* Keeps track of the polling interval for the next segment of the
 	 * concatenated sms, this variable gets passed to user to call in for
 	 * future time to check back if protocol layer has received next segment
-	 * if not, then call receive time out
+	 * if not, then discard it. It is the earliest timeout of all the
+	 * receive paths.
 	 */
 	uint64_t next_seg_rcv_timeout;
 	/* variable to keep track of the pending ack/nack */
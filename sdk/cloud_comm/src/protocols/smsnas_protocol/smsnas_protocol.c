@@ -28,23 +28,37 @@
 static uint32_t proto_begin;
 #endif
 
-/* Define intermediate buffer to store incoming messages */
-static uint8_t smsnas_rcv_buf[PROTO_MAX_MSG_SZ * SMSNAS_MAX_RCV_PATH];
+#ifdef DEBUG_RCV_DUMP
+static void dump_rcvd_msg(const uint8_t *buf, proto_pl_sz sz)
+{
+	dbg_printf("Received Update Message of bytes: %u\n", sz);
+	for (proto_pl_sz i = 0; i < sz; i++)
+		dbg_printf("\t\t\t\t[Byte %u]: 0x%x, ", i, buf[i]);
+}
+#else
+#define dump_rcvd_msg(buf, sz)
+#endif
+
+static void reset_rcv_path(smsnas_rcv_path *rp)
+{
+	rp->conct_in_progress = false;
+	rp->service_id = 0;
+	rp->cref_num = 0;
+	rp->num_seg = 0;
+	rp->seg_map = 0;
+	memset(rp->seg_len, 0, sizeof(rp->seg_len));
+	rp->next_seq_timeout = 0;
+}
 
-static void reset_rcv_path(uint8_t rcv_path)
+static bool in_user_buf(const uint8_t *p)
 {
-	session.rcv_msg[rcv_path].rcv_sz = PROTO_MAX_MSG_SZ;
-	session.rcv_msg[rcv_path].wr_idx = rcv_path * PROTO_MAX_MSG_SZ;
-	session.rcv_msg[rcv_path].cur_seq = 0;
-	session.rcv_msg[rcv_path].cref_num = -1;
-	session.rcv_msg[rcv_path].conct_in_progress = false;
-	session.rcv_msg[rcv_path].expected_seq = 0;
+	const uint8_t *user = session.rcv_buf;
+	return user && p >= user && p < user + session.rcv_sz;
 }
 
 /* Initializes receive paths and resets internal protocol state */
 proto_result smsnas_protocol_init(void)
 {
-	uint8_t i = 0;
 	if (!at_init())
 		RETURN_ERROR("modem init failed", PROTO_ERROR);
 	/* This will not be set until arrival of the first segement of the
@@ -55,11 +69,8 @@ proto_result smsnas_protocol_init(void)
 	memset(session.host, 0, MAX_HOST_LEN);
 	session.host_valid = false;
 
-	for (i = 0; i < ARRAY_SIZE(session.rcv_msg); i++) {
-		session.rcv_msg[i].buf = (smsnas_rcv_buf +
-							(i * PROTO_MAX_MSG_SZ));
-		reset_rcv_path(i);
-	}
+	for (uint8_t i = 0; i < ARRAY_SIZE(session.rcv_msg); i++)
+		reset_rcv_path(&session.rcv_msg[i]);
 
 	session.msg_ref_num = 0;
 	session.rcv_cb = NULL;
@@ -100,28 +111,6 @@ void smsnas_send_nack(void)
 	session.ack_nack_pend = NACK_PENDING;
 }
 
-static bool is_conct_in_progress(void)
-{
-	bool found = false;
-	uint8_t i;
-	for (i = 0; i < ARRAY_SIZE(session.rcv_msg); i++) {
-		if (session.rcv_msg[i].conct_in_progress) {
-			found = true;
-			break;
-		}
-	}
-	return found;
-}
-
-static void rcv_path_cleanup(int rcv_path)
-{
-	if (!is_conct_in_progress())
-		session.next_seg_rcv_timeout = 0;
-	if (rcv_path == -1)
-		return;
-	reset_rcv_path(rcv_path);
-}
-
 static bool check_mem_overflow(proto_pl_sz rcv_len, proto_pl_sz pl_sz,
 				proto_service_id s_id)
 {
@@ -134,80 +123,114 @@ static bool check_mem_overflow(proto_pl_sz rcv_len, proto_pl_sz pl_sz,
 	return false;
 }
 
-static bool check_validity(const at_msg_t *msg_ptr, uint8_t rcv_path,
-			bool first_seg)
+/* Sanity checks of the header of a segment of a concatenated sms that do not
+ * depend on the segments received before it
+ */
+static bool check_seg_header(const at_msg_t *msg_ptr)
 {
 	/* check if total number of segements are greater then MAX_CONC_SMS_NUM
 	 */
 	if (msg_ptr->num_seg > MAX_CONC_SMS_NUM)
 		return false;
+	if (msg_ptr->seq_no == 0 || msg_ptr->seq_no > msg_ptr->num_seg)
+		return false;
+	/* Every segment has to fit its slot of the receive path buffer */
+	if (msg_ptr->len == 0 || msg_ptr->len > CONCT_SMS_SZ)
+		return false;
+	return true;
+}
 
-	if (first_seg) {
-		if (msg_ptr->seq_no != 1)
-			return false;
-		smsnas_msg_t *smsnas_msg = (smsnas_msg_t *)msg_ptr->buf;
-		if (smsnas_msg->version != SMSNAS_VERSION)
+/* Sanity checks of a received segment of a concatenated sms that do not depend
+ * on the segments received before it
+ */
+static bool check_validity(const at_msg_t *msg_ptr)
+{
+	if (!check_seg_header(msg_ptr))
+		return false;
+	if (msg_ptr->seq_no == 1) {
+		const smsnas_msg_t *smsnas_msg =
+			(const smsnas_msg_t *)msg_ptr->buf;
+		if (msg_ptr->len < PROTO_OVERHEAD_SZ ||
+				smsnas_msg->version != SMSNAS_VERSION)
 			return false;
-		return true;
 	}
-
-	/* check for out of order segment */
-	/* FIXME: action to perform for duplicate message, currently it will
-	 * nack and discard whole concatenated message for any out of sequence
-	 * sms
-	 */
-	if (msg_ptr->seq_no != (session.rcv_msg[rcv_path].cur_seq + 1))
-		return false;
 	return true;
 }
 
-static void update_ack_rcv_path(const at_msg_t *msg_ptr, uint8_t rcv_path)
+/* Receive path reassembling the concatenated sms with the given reference */
+static smsnas_rcv_path *find_rcv_path(uint8_t ref_no)
 {
-	session.rcv_msg[rcv_path].cur_seq = msg_ptr->seq_no;
-	session.rcv_msg[rcv_path].wr_idx += msg_ptr->len;
-	session.rcv_msg[rcv_path].next_seq_timeout = sys_get_tick_ms() +
-							CONC_NEXT_SEG_TIMEOUT_MS;
-	smsnas_send_ack();
+	for (uint8_t i = 0; i < ARRAY_SIZE(session.rcv_msg); i++) {
+		smsnas_rcv_path *rp = &session.rcv_msg[i];
+		if (rp->conct_in_progress && rp->cref_num == ref_no)
+			return rp;
+	}
+	return NULL;
 }
 
-/* Select receive path for the given msg if it is new msg check for
- * its sanity before allocating receive path
+static smsnas_rcv_path *free_rcv_path(void)
+{
+	for (uint8_t i = 0; i < ARRAY_SIZE(session.rcv_msg); i++)
+		if (!session.rcv_msg[i].conct_in_progress)
+			return &session.rcv_msg[i];
+	return NULL;
+}
+
+/* Select the receive path reassembling the concatenated sms the given segment
+ * belongs to, or a free one if it is the first segment received of it
  */
-static int retrieve_rcv_path(const at_msg_t *msg, bool *new,
-				proto_service_id *s_id)
+static smsnas_rcv_path *retrieve_rcv_path(const at_msg_t *msg)
 {
-	uint8_t i;
-	int new_rcvp = -1;
-	for (i = 0; i < ARRAY_SIZE(session.rcv_msg); i++) {
-		if (session.rcv_msg[i].conct_in_progress) {
-			/* middle of receiving concatenated sms */
-			if (session.rcv_msg[i].cref_num == msg->ref_no) {
-				*new = false;
-				return i;
-			}
-		} else
-			new_rcvp = i;
+	smsnas_rcv_path *rp = find_rcv_path(msg->ref_no);
+	if (rp) {
+		if (rp->num_seg == msg->num_seg)
+			return rp;
+		/* Reference number was reused for another message before
+		 * this one completed, drop what is left of the old one
+		 */
+		reset_rcv_path(rp);
+	} else {
+		rp = free_rcv_path();
+		if (!rp)
+			return NULL;
+	}
+	rp->conct_in_progress = true;
+	rp->cref_num = msg->ref_no;
+	rp->num_seg = msg->num_seg;
+	return rp;
+}
 
+/* Called by the modem layer with the header of a segment being received,
+ * returns where its data belongs: the user supplied buffer for a single sms,
+ * the buffer of its receive path for a segment of a concatenated sms. Segments
+ * the receive callback is going to reject, or that would overwrite data
+ * already received, stay in the modem layer's buffer.
+ */
+static uint8_t *smsnas_rcv_dest(const at_msg_t *msg_ptr)
+{
+	if (!session.rcv_valid)
+		return NULL;
+
+	if (msg_ptr->num_seg <= 1)
+		return (msg_ptr->len <= session.rcv_sz) ? session.rcv_buf : NULL;
+
+	if (!check_seg_header(msg_ptr))
+		return NULL;
+	smsnas_rcv_path *rp = find_rcv_path(msg_ptr->ref_no);
+	if (rp) {
+		if (rp->num_seg != msg_ptr->num_seg ||
+				(rp->seg_map & (1 << (msg_ptr->seq_no - 1))))
+			return NULL;
+	} else {
+		rp = free_rcv_path();
+		if (!rp)
+			return NULL;
 	}
-	if (new_rcvp == -1)
-		return -1;
-	/* Means new_rcvp receive path is free to use
-	 */
-	*new = true;
-	/* check validity of the new message before allocating receive path */
-	if (!check_validity(msg, new_rcvp, true))
-		return -1;
-
-	smsnas_msg_t *temp_msg = (smsnas_msg_t *)msg->buf;
-	*s_id = temp_msg->service_id;
-	return new_rcvp;
+	return rp->buf + (msg_ptr->seq_no - 1) * CONCT_SMS_SZ;
 }
 
 static void smsnas_rcv_cb(const at_msg_t *msg_ptr)
 {
-	int rcv_path  = -1;
-	proto_pl_sz rcvd = 0;
-	proto_service_id s_id = 0;
 	/* Must be some random message that upper level is not expecting,
 	 * ignore it and send nack
 	 */
@@ -217,66 +240,72 @@ static void smsnas_rcv_cb(const at_msg_t *msg_ptr)
 	}
 
 	if (msg_ptr->num_seg > 1) {
-		bool new = false;
-		rcv_path = retrieve_rcv_path(msg_ptr, &new, &s_id);
-		/* only possible when allocating new receive path */
-		if (rcv_path == -1) {
+		if (!check_validity(msg_ptr)) {
 			printf("%s: %d: Message is not valid\n",
 				__func__, __LINE__);
 			goto error;
 		}
-		smsnas_rcv_path *rp = &session.rcv_msg[rcv_path];
-		rcvd = rp->wr_idx + msg_ptr->len;
-		/* two step memory overflow check, one for intermediate buffer
-		 * and other for user supplied buffer
+		smsnas_rcv_path *rp = retrieve_rcv_path(msg_ptr);
+		if (!rp) {
+			printf("%s: %d: No free receive path\n",
+				__func__, __LINE__);
+			goto error;
+		}
+		uint8_t seg_bit = 1 << (msg_ptr->seq_no - 1);
+		rp->next_seq_timeout = sys_get_tick_ms() +
+						CONC_NEXT_SEG_TIMEOUT_MS;
+		/* Duplicate of a segment already received, the server did not
+		 * see its ack
 		 */
-		if (check_mem_overflow(rcvd, session.rcv_sz, s_id)) {
+		if (rp->seg_map & seg_bit) {
+			smsnas_send_ack();
+			return;
+		}
+
+		if (msg_ptr->seq_no == 1)
+			rp->service_id = ((smsnas_msg_t *)msg_ptr->buf)->service_id;
+		/* The data normally was decoded in place already */
+		uint8_t *dest = rp->buf + (msg_ptr->seq_no - 1) * CONCT_SMS_SZ;
+		if (msg_ptr->buf != dest)
+			memcpy(dest, msg_ptr->buf, msg_ptr->len);
+		rp->seg_map |= seg_bit;
+		rp->seg_len[msg_ptr->seq_no - 1] = msg_ptr->len;
+
+		/* check for the last missing segment */
+		if (rp->seg_map == (1 << rp->num_seg) - 1) {
+			proto_pl_sz rcvd = 0;
+			for (uint8_t i = 0; i < rp->num_seg; i++)
+				rcvd += rp->seg_len[i];
+			proto_service_id s_id = rp->service_id;
+			session.rcv_valid = false;
 			/* let upper level nack this sms first and then
 			 * reschedule receive buffer
 			 */
-			session.rcv_valid = false;
-			goto done;
-		} else if (rcvd > rp->rcv_sz) {
-			printf("%s:%d: Unlikely Intermediate buffer overflow\n",
-				__func__, __LINE__);
-
-			/* FIXME: Current behaviour is to nack this message
-			 * and return resetting receive path
+			if (check_mem_overflow(rcvd, session.rcv_sz, s_id)) {
+				reset_rcv_path(rp);
+				return;
+			}
+			/* Invoke upper level callback and let upper
+			 * level ack/nack this message, also it is upper
+			 * level's responsibility to schedule receive
+			 * buffer hence rcv_valid is false here to catch
+			 * that scenario where app/services misbehave
 			 */
-			goto error;
-		}
-		if (new) {
-			rp->service_id = s_id;
-			rp->cref_num = msg_ptr->ref_no;
-			memcpy(rp->buf, msg_ptr->buf, msg_ptr->len);
-			rp->conct_in_progress = true;
-		} else {
-			if (!check_validity(msg_ptr, rcv_path, false))
-				goto error;
-			memcpy(rp->buf + rp->wr_idx, msg_ptr->buf, msg_ptr->len);
-			/* check for last segment */
-			if (msg_ptr->seq_no == msg_ptr->num_seg) {
-				session.rcv_valid = false;
-				/* Invoke upper level callback and let upper
-				 * level ack/nack this message, also it is upper
-				 * level's responsibility to schedule receive
-				 * buffer hence rcv_valid is false here to catch
-				 * that scenario where app/services misbehave
-				 */
-
-				memcpy(session.rcv_buf, rp->buf, rcvd);
-				dbg_printf("Received Update Message of bytes: %u\n", rcvd);
-				for (uint16_t i = 0; i < rcvd; i++)
-					dbg_printf("\t\t\t\t[Byte %u]: 0x%x, ", i, rp->buf[i]);
-				INVOKE_RECV_CALLBACK(session.rcv_buf, rcvd,
-					PROTO_RCVD_MSG, rp->service_id);
-				goto done;
+			uint8_t *user = session.rcv_buf;
+			for (uint8_t i = 0; i < rp->num_seg; i++) {
+				memcpy(user, rp->buf + i * CONCT_SMS_SZ,
+						rp->seg_len[i]);
+				user += rp->seg_len[i];
 			}
+			reset_rcv_path(rp);
+			dump_rcvd_msg(session.rcv_buf, rcvd);
+			INVOKE_RECV_CALLBACK(session.rcv_buf, rcvd,
+				PROTO_RCVD_MSG, s_id);
+			return;
 		}
-		update_ack_rcv_path(msg_ptr, rcv_path);
+		smsnas_send_ack();
 		return;
 	} else {
-		rcv_path = -1;
 		smsnas_msg_t *smsnas_msg = (smsnas_msg_t *)msg_ptr->buf;
 		if (smsnas_msg->version != SMSNAS_VERSION)
 			goto error;
@@ -284,19 +313,20 @@ static void smsnas_rcv_cb(const at_msg_t *msg_ptr)
 		session.rcv_valid = false;
 		if (check_mem_overflow(msg_ptr->len, session.rcv_sz,
 			smsnas_msg->service_id)) {
-			goto done;
+			return;
 		}
-		memcpy(session.rcv_buf, msg_ptr->buf, msg_ptr->len);
+		if (msg_ptr->buf != session.rcv_buf)
+			memcpy(session.rcv_buf, msg_ptr->buf, msg_ptr->len);
 		/* let upper level decide to ack/nack this message */
 		INVOKE_RECV_CALLBACK(session.rcv_buf, msg_ptr->len,
 					PROTO_RCVD_MSG, smsnas_msg->service_id);
-		goto done;
-
+		return;
 	}
 error:
+	/* Do not leave a rejected segment in the user supplied buffer */
+	if (in_user_buf(msg_ptr->buf))
+		memset(msg_ptr->buf, 0, msg_ptr->len);
 	smsnas_send_nack();
-done:
-	rcv_path_cleanup(rcv_path);
 }
 
 proto_result smsnas_set_recv_buffer_cb(void *rcv_buf, proto_pl_sz sz,
@@ -314,6 +344,7 @@ proto_result smsnas_set_recv_buffer_cb(void *rcv_buf, proto_pl_sz sz,
 	session.rcv_valid = true;
 	session.rcv_cb = rcv_cb;
 	at_sms_set_rcv_cb(smsnas_rcv_cb);
+	at_sms_set_rcv_buf_cb(smsnas_rcv_dest);
 	return PROTO_OK;
 }
 
@@ -336,84 +367,58 @@ static void handle_pend_ack_nack(void)
 	}
 }
 
-/* Checks if any pending ack or nack of previously received message
- * If poll_due is true, it was in the middle of receiving concatenated message
- * and checks if it received next segment during polling time, if not then
- * invoke callback indicating receiving timeout to upper level, also adjust
- * remaining timeouts for other receiving paths
+/* Checks if any pending ack or nack of previously received message and
+ * discards the concatenated messages whose next segment did not arrive in
+ * time. The polling interval becomes the time left until the earliest of the
+ * remaining timeouts.
  */
 void smsnas_maintenance(bool poll_due, uint64_t cur_timestamp)
 {
-
+	(void)poll_due;
 	handle_pend_ack_nack();
 
-	/* There is nothing to maintain if receive paths are not expecting
-	 * concatenated messages
-	 */
-	if (!is_conct_in_progress())
-		return;
-
 	uint8_t i;
-	uint32_t ns_time = 0;
-	uint64_t *cur_int = &session.next_seg_rcv_timeout;
-	bool init_poll = false;
-
+	uint64_t next = 0;
 	for (i = 0; i < ARRAY_SIZE(session.rcv_msg); i++) {
-		if (session.rcv_msg[i].conct_in_progress) {
-			if (cur_timestamp >=
-				session.rcv_msg[i].next_seq_timeout) {
-				if (session.rcv_msg[i].cur_seq <
-					session.rcv_msg[i].expected_seq) {
-					/* Discard whole concatenated sms */
-					session.rcv_msg[i].conct_in_progress =
-									false;
-					rcv_path_cleanup(i);
-				}
-			} else {
-				ns_time = session.rcv_msg[i].next_seq_timeout;
-				if (session.rcv_msg[i].expected_seq !=
-					(session.rcv_msg[i].cur_seq + 1))
-					session.rcv_msg[i].expected_seq =
-						session.rcv_msg[i].cur_seq + 1;
-				if (poll_due)
-					ns_time -= cur_timestamp;
-				session.rcv_msg[i].next_seq_timeout = ns_time;
-				if (!init_poll) {
-					*cur_int = ns_time;
-					init_poll = true;
-				}
-				/* find the minimum */
-				if (*cur_int >= ns_time)
-					*cur_int = ns_time;
-			}
+		smsnas_rcv_path *rp = &session.rcv_msg[i];
+		if (!rp->conct_in_progress)
+			continue;
+		if (cur_timestamp >= rp->next_seq_timeout) {
+			/* Discard whole concatenated sms */
+			printf("%s:%d: Concatenated sms %u timed out\n",
+				__func__, __LINE__, rp->cref_num);
+			reset_rcv_path(rp);
+			continue;
 		}
+		uint64_t left = rp->next_seq_timeout - cur_timestamp;
+		if (next == 0 || left < next)
+			next = left;
 	}
+	session.next_seg_rcv_timeout = next;
 }
 
 /* FIXME: handle scenario where message is received when in middle of sending sms
  */
-static proto_result write_to_modem(const uint8_t *msg, proto_pl_sz len,
-			uint8_t ref_num, uint8_t total_num, uint8_t seq_num)
+/* Sends the segments of a message, retrying each failed one on its own */
+static proto_result write_to_modem(at_msg_t *segs, uint8_t num_segs)
 {
-	uint8_t retry = 0;
-
-	at_msg_t sm_msg;
-	sm_msg.buf = (uint8_t *)msg;
-	sm_msg.len = len;
-	sm_msg.ref_no = ref_num;
-	sm_msg.num_seg = total_num;
-	sm_msg.seq_no = seq_num;
-	sm_msg.addr = session.host;
-	bool ret = at_sms_send(&sm_msg);
-	while ((!ret) && (retry < MAX_RETRIES)) {
-		ret = at_sms_send(&sm_msg);
-		retry++;
-	}
-	if (retry > MAX_RETRIES)
+	for (uint8_t i = 0; i < num_segs; i++)
+		segs[i].addr = session.host;
+	if (!at_sms_send_multi(segs, num_segs, MAX_RETRIES))
 		RETURN_ERROR("Retries exausted", PROTO_TIMEOUT);
 	return PROTO_OK;
 }
 
+static void set_segment(at_msg_t *seg, const uint8_t *msg, proto_pl_sz len,
+			uint8_t ref_num, uint8_t total_num, uint8_t seq_num)
+{
+	seg->buf = (uint8_t *)msg;
+	seg->len = len;
+	seg->ref_no = ref_num;
+	seg->num_seg = total_num;
+	seg->seq_no = seq_num;
+}
+
 /* takes a payload and builds SMSNAS protocol message */
 static void build_smsnas_msg(const void *payload, proto_pl_sz total_sz,
 				proto_pl_sz cp_sz, proto_service_id s_id)
@@ -484,12 +489,13 @@ proto_result smsnas_send_msg_to_cloud(const void *buf, proto_pl_sz sz,
 	uint8_t msg_ref_num = session.msg_ref_num;
 	uint8_t total_msgs = 1;
 	uint8_t cur_seq_num = 0;
+	at_msg_t segs[MAX_CONC_SMS_NUM];
 	/* check if it needs to be concatenated message */
 	if (sz <= SMS_SZ_WITHT_TUHD_WITH_PHD) {
 		build_smsnas_msg(buf, sz, sz, service_id);
-		proto_result res = write_to_modem(session.send_msg,
-					sz + PROTO_OVERHEAD_SZ, msg_ref_num,
-					total_msgs, cur_seq_num);
+		set_segment(&segs[0], session.send_msg, sz + PROTO_OVERHEAD_SZ,
+				msg_ref_num, total_msgs, cur_seq_num);
+		proto_result res = write_to_modem(segs, 1);
 		if (res != PROTO_OK) {
 			invoke_send_callback(buf, sz, service_id, cb, res);
 			RETURN_ERROR("Send failed", PROTO_ERROR);
@@ -498,7 +504,7 @@ proto_result smsnas_send_msg_to_cloud(const void *buf, proto_pl_sz sz,
 	}
 	cur_seq_num = 1;
 	total_msgs = calculate_total_msgs(sz + PROTO_OVERHEAD_SZ);
-	if (total_msgs > 4)
+	if (total_msgs > MAX_CONC_SMS_NUM)
 		RETURN_ERROR("Send size exceeds", PROTO_ERROR);
 	uint8_t *temp_buf = NULL;
 	proto_pl_sz rem_sz = sz;
@@ -512,12 +518,8 @@ proto_result smsnas_send_msg_to_cloud(const void *buf, proto_pl_sz sz,
 			rem_sz = rem_sz - SMS_SZ_WITH_TUDH_WITH_PHD;
 			send_sz = SMS_SZ_WITH_TUDH_WITH_PHD + PROTO_OVERHEAD_SZ;
 		}
-		proto_result ret = write_to_modem(temp_buf, send_sz,
-					msg_ref_num, total_msgs, cur_seq_num);
-		if (ret != PROTO_OK) {
-			invoke_send_callback(buf, sz, service_id, cb, ret);
-			RETURN_ERROR("Concatenated send failed", PROTO_ERROR);
-		}
+		set_segment(&segs[cur_seq_num - 1], temp_buf, send_sz,
+				msg_ref_num, total_msgs, cur_seq_num);
 		/* Adjust user pointer buffer here for first segment to account
 		 * for the protocol overhead size
 		 */
@@ -536,6 +538,12 @@ proto_result smsnas_send_msg_to_cloud(const void *buf, proto_pl_sz sz,
 			send_sz = SMS_SZ_WITH_TUHD_WITHT_PHD;
 		}
 	}
+	/* All segments go out back to back, see at_sms_send_multi() */
+	proto_result ret = write_to_modem(segs, total_msgs);
+	if (ret != PROTO_OK) {
+		invoke_send_callback(buf, sz, service_id, cb, ret);
+		RETURN_ERROR("Concatenated send failed", PROTO_ERROR);
+	}
 	session.msg_ref_num = (msg_ref_num + 1) % MAX_SMS_REF_NUMBER;
 	return PROTO_OK;
 }
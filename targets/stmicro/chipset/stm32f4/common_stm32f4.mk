@@ -60,6 +60,7 @@ CHIPSET_SRC += stm32f4xx_hal_gpio.c
 CHIPSET_SRC += stm32f4xx_hal_rcc.c
 CHIPSET_SRC += stm32f4xx_hal_rcc_ex.c
 CHIPSET_SRC += stm32f4xx_hal_uart.c
+CHIPSET_SRC += stm32f4xx_hal_dma.c
 CHIPSET_SRC += stm32f4xx_hal_i2c.c
 CHIPSET_SRC += stm32f4xx_hal_pwr.c
 CHIPSET_SRC += stm32f4xx_hal_pwr_ex.c
@@ -21,7 +21,7 @@ export ARCHFLAGS
 
 CHIPSET_INC =
 
-CHIPSET_LDFLAGS = -lrt
+CHIPSET_LDFLAGS = -lrt -pthread
 export CHIPSET_LDFLAGS
 export CHIPSET_CFLAGS
 
@@ -25,7 +25,7 @@ export ARCHFLAGS
 
 CHIPSET_INC =
 
-CHIPSET_LDFLAGS = -lrt
+CHIPSET_LDFLAGS = -lrt -pthread
 CHIPSET_CFLAGS = --sysroot=/ts_sdk_bldenv/toolchain/arm-linux-gnueabihf/libc
 export CHIPSET_LDFLAGS
 export CHIPSET_CFLAGS
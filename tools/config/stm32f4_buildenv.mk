@@ -25,10 +25,10 @@ export CC OBJDUMP OBJCOPY SIZE
 ARCHFLAGS = -mthumb -mcpu=cortex-m4 -mfloat-abi=hard -mfpu=fpv4-sp-d16
 ifeq ($(CHIPSET_MCU),stm32f415rgt)
 	MDEF = -DSTM32F415xx
-	LDSCRIPT = -T $(STMSDK_HEADER_ROOT)/STM32F415RGTx_FLASH.ld
+	LDSCRIPT = -T $(PLATFORM_HAL_ROOT)/sw/stm32f4/stm32f415rgt/STM32F415RGTx_FLASH.ld
 else ifeq ($(CHIPSET_MCU), stm32f429zit)
 	MDEF = -DSTM32F429xx
-	LDSCRIPT = -T $(STMSDK_HEADER_ROOT)/STM32F429ZITx_FLASH.ld
+	LDSCRIPT = -T $(PLATFORM_HAL_ROOT)/sw/stm32f4/stm32f429zit/STM32F429ZITx_FLASH.ld
 else
 	$(error "$(CHIPSET_MCU) chipset is not supported")
 
@@ -33,7 +33,7 @@ LDFLAGS += -u _printf_float
 
 ifeq ($(CHIPSET_MCU),stm32l476rgt)
 	MDEF = -DSTM32L476xx
-	LDSCRIPT = -T $(STMSDK_HEADER_ROOT)/STM32L476RGTx_FLASH.ld
+	LDSCRIPT = -T $(PLATFORM_HAL_ROOT)/sw/stm32l4/stm32l476rgt/STM32L476RGTx_FLASH.ld
 else
 	$(error "$(CHIPSET_MCU) chipset is not supported")
 
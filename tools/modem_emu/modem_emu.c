@@ -0,0 +1,1448 @@
+/* Copyright(C) 2017 Verizon. All rights reserved. */
+
+/*
+ * Modem emulator for host side testing of the AT stack.
+ *
+ * Creates a pseudo-terminal and answers the AT dialect used by the TOBY-L201
+ * and Sequans Monarch drivers on the slave side. TCP sockets opened through
+ * the AT commands are backed by real host sockets, or echoed back when run in
+ * loopback mode. Traffic on the emulated UART can be paced to a baud rate so
+ * that throughput figures are representative of real hardware.
+ *
+ * Usage: modem_emu [options]
+ *   -m <toby201|sqmonarch>  Dialect to emulate (default toby201)
+ *   -b <baud>               Pace the UART to this rate, 0 disables (default 0)
+ *   -d <ms>                 Delay before answering a command (default 0)
+ *   -l <path>               Create a symlink to the pty slave at this path
+ *   -s <script>             Extra responses, URCs and events (see Readme)
+ *   -u <mno>                Value reported for AT+UMNOCONF? (default 3,23)
+ *   -L                      Loopback: echo socket data instead of connecting
+ *   -v                      Log commands and events to stderr
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define MAX_LINE		1024
+#define MAX_RULES		64
+#define MAX_EVENTS		64
+#define OUTQ_SZ			(64 * 1024)
+#define SOCK_CHUNK		2048
+#define MAX_SOCKS		8	/* Socket ids 0 - 7 */
+#define SOCK_RXQ_SZ		(16 * 1024)
+#define USORD_MAX		1024	/* Largest +USORD read */
+#define USOWR_BIN_MAX		1024	/* Largest binary +USOWR write */
+#define SQNS_SEND_MAX		1500	/* Largest +SQNSSENDEXT write */
+#define SQNS_RECV_MAX		1500	/* Largest +SQNSRECV read */
+#define PACE_BURST		64	/* Bytes, roughly a UART FIFO */
+#define BOOT_DELAY_MS		100
+#define PDP_ACT_DELAY_MS	50
+#define NS_PER_MS		1000000ULL
+#define NS_PER_SEC		1000000000ULL
+#define CTRL_Z			0x1A
+
+#define OK			"\r\nOK\r\n"
+#define ERROR			"\r\nERROR\r\n"
+#define CME_ERROR		"\r\n+CME ERROR: 100\r\n"
+
+enum dialect {
+	TOBY201,
+	SQMONARCH
+};
+
+enum mode {
+	MODE_CMD,		/* Accumulating AT command lines */
+	MODE_PDU,		/* Accumulating an SMS PDU up to Ctrl-Z */
+	MODE_SEND,		/* Accumulating +SQNSSENDEXT / +USOWR data */
+	MODE_DATA		/* Direct link / online mode */
+};
+
+enum event_type {
+	EV_URC,			/* Emit text on the UART */
+	EV_CLOSE,		/* Peer closes the socket */
+	EV_BOOT			/* Modem finished (re)booting */
+};
+
+struct rule {
+	char prefix[64];
+	char rsp[256];
+	size_t rsp_len;
+};
+
+struct event {
+	enum event_type type;
+	uint64_t at_ns;		/* Absolute time, 0 when the slot is free */
+	char text[256];
+	size_t len;
+};
+
+/* Script events armed relative to power-on or to a socket connecting */
+struct script_event {
+	enum event_type type;
+	bool on_connect;
+	uint32_t delay_ms;
+	char text[256];
+	size_t len;
+};
+
+/* Socket backed by a host socket or looped back */
+struct sock {
+	bool open;		/* Created / dialled through AT commands */
+	bool connected;
+	int fd;
+	/* Command mode: data from the peer waiting to be read by the host */
+	uint8_t rxq[SOCK_RXQ_SZ];
+	size_t rx_len;
+};
+
+/* Token bucket used to pace one direction of the UART */
+struct pacer {
+	double tokens;
+	uint64_t last_ns;
+};
+
+static struct {
+	enum dialect dialect;
+	uint32_t baud;
+	uint32_t rsp_delay_ms;
+	bool loopback;
+	bool verbose;
+	const char *mno;
+
+	int master;
+	bool powered;		/* A process has the slave side open */
+	enum mode mode;
+	bool echo;
+	uint32_t guard_ms;	/* Escape sequence guard time */
+
+	char line[MAX_LINE];
+	size_t line_len;
+
+	struct sock socks[MAX_SOCKS];
+	int data_sock;		/* Socket attached to data mode, -1 if none */
+	bool hex_mode;		/* AT+UDCONF=1,1 or Monarch recvDataMode 1 */
+	bool hex_send;		/* Monarch sendDataMode 1 */
+
+	/* +SQNSSENDEXT or binary +USOWR data being received */
+	int send_sock;
+	size_t send_left;
+	uint8_t send_buf[2 * SQNS_SEND_MAX];
+	size_t send_len;
+
+	/* Escape sequence detection in data mode */
+	uint8_t esc_cnt;
+	uint64_t esc_ts;
+	uint64_t last_rx_ns;
+
+	uint8_t outq[OUTQ_SZ];
+	size_t out_head;
+	size_t out_len;
+
+	struct pacer tx_pace;
+	struct pacer rx_pace;
+
+	struct rule rules[MAX_RULES];
+	unsigned int num_rules;
+	struct script_event script[MAX_EVENTS];
+	unsigned int num_script;
+	struct event events[MAX_EVENTS];
+
+	unsigned int sms_mr;	/* SMS message reference */
+} emu = {
+	.dialect = TOBY201,
+	.mno = "3,23",
+	.data_sock = -1,
+	.guard_ms = 1000
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void log_v(const char *fmt, ...)
+{
+	if (!emu.verbose)
+		return;
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "modem_emu: ");
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+}
+
+/* Queue bytes to be written to the UART */
+static void out_bytes(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	if (len > OUTQ_SZ - emu.out_len) {
+		log_v("output queue overflow, dropping %zu bytes", len);
+		len = OUTQ_SZ - emu.out_len;
+	}
+	for (size_t i = 0; i < len; i++)
+		emu.outq[(emu.out_head + emu.out_len + i) % OUTQ_SZ] = p[i];
+	emu.out_len += len;
+}
+
+static void out_str(const char *s)
+{
+	out_bytes(s, strlen(s));
+}
+
+static void out_fmt(const char *fmt, ...)
+{
+	char buf[MAX_LINE];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		out_bytes(buf, (size_t)n < sizeof(buf) ? (size_t)n :
+				sizeof(buf) - 1);
+}
+
+static void schedule(enum event_type type, uint32_t delay_ms,
+		const char *text, size_t len)
+{
+	for (unsigned int i = 0; i < MAX_EVENTS; i++) {
+		struct event *e = &emu.events[i];
+		if (e->at_ns != 0)
+			continue;
+		e->type = type;
+		e->at_ns = now_ns() + delay_ms * NS_PER_MS;
+		e->len = len < sizeof(e->text) ? len : sizeof(e->text);
+		if (text)
+			memcpy(e->text, text, e->len);
+		return;
+	}
+	log_v("event table full");
+}
+
+static void cancel_events(enum event_type type)
+{
+	for (unsigned int i = 0; i < MAX_EVENTS; i++)
+		if (emu.events[i].type == type)
+			emu.events[i].at_ns = 0;
+}
+
+static void arm_script(bool on_connect)
+{
+	for (unsigned int i = 0; i < emu.num_script; i++) {
+		struct script_event *s = &emu.script[i];
+		if (s->on_connect == on_connect)
+			schedule(s->type, s->delay_ms, s->text, s->len);
+	}
+}
+
+/*
+ * Socket handling
+ */
+
+static struct sock *sock_get(int id)
+{
+	return (id >= 0 && id < MAX_SOCKS) ? &emu.socks[id] : NULL;
+}
+
+static void sock_close(int id)
+{
+	struct sock *sk = &emu.socks[id];
+	if (sk->fd >= 0)
+		close(sk->fd);
+	sk->fd = -1;
+	sk->open = false;
+	sk->connected = false;
+	sk->rx_len = 0;
+	if (emu.data_sock == id) {
+		emu.data_sock = -1;
+		emu.esc_cnt = 0;
+	}
+}
+
+static void sock_close_all(void)
+{
+	for (int i = 0; i < MAX_SOCKS; i++)
+		sock_close(i);
+	cancel_events(EV_CLOSE);
+}
+
+static bool sock_connect(int id, const char *host, const char *port)
+{
+	struct sock *sk = &emu.socks[id];
+	if (emu.loopback) {
+		sk->connected = true;
+		arm_script(true);
+		log_v("loopback connect %d to %s:%s", id, host, port);
+		return true;
+	}
+
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0) {
+		log_v("could not resolve %s:%s", host, port);
+		return false;
+	}
+	int fd = -1;
+	for (struct addrinfo *a = res; a; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		log_v("could not connect to %s:%s", host, port);
+		return false;
+	}
+	sk->fd = fd;
+	sk->connected = true;
+	arm_script(true);
+	log_v("socket %d connected to %s:%s", id, host, port);
+	return true;
+}
+
+/* Queue data from the peer until the host reads it in command mode */
+static void sock_deliver(int id, const uint8_t *data, size_t len)
+{
+	struct sock *sk = &emu.socks[id];
+	if (len > SOCK_RXQ_SZ - sk->rx_len) {
+		log_v("socket %d receive queue overflow", id);
+		len = SOCK_RXQ_SZ - sk->rx_len;
+	}
+	memcpy(sk->rxq + sk->rx_len, data, len);
+	sk->rx_len += len;
+	if (len == 0)
+		return;
+	if (emu.dialect == TOBY201)
+		out_fmt("\r\n+UUSORD: %d,%zu\r\n", id, sk->rx_len);
+	else
+		out_fmt("\r\n+SQNSRING: %d,%zu\r\n", id, sk->rx_len);
+}
+
+/* Data written by the host goes to the peer */
+static void sock_send(int id, const uint8_t *data, size_t len)
+{
+	struct sock *sk = sock_get(id);
+	if (!sk || !sk->connected || len == 0)
+		return;
+	if (emu.loopback) {
+		if (emu.mode == MODE_DATA && emu.data_sock == id)
+			out_bytes(data, len);
+		else
+			sock_deliver(id, data, len);
+		return;
+	}
+	while (len > 0) {
+		ssize_t n = send(sk->fd, data, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_v("socket send failed: %s", strerror(errno));
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+/* The peer closed the connection, notify the host in the dialect's way */
+static void peer_closed(int id)
+{
+	log_v("peer closed socket %d", id);
+	bool in_data = (emu.mode == MODE_DATA && emu.data_sock == id);
+	sock_close(id);
+	if (in_data)
+		emu.mode = MODE_CMD;
+	if (emu.dialect == TOBY201) {
+		if (in_data)
+			out_str("\r\nDISCONNECT\r\n" OK);
+		out_fmt("\r\n+UUSOCL: %d\r\n", id);
+	} else {
+		if (in_data)
+			out_str("\r\nNO CARRIER\r\n");
+		else
+			out_fmt("\r\n+SQNSH: %d\r\n", id);
+	}
+}
+
+static void enter_data_mode(int id)
+{
+	emu.data_sock = id;
+	emu.mode = MODE_DATA;
+	emu.esc_cnt = 0;
+	emu.last_rx_ns = now_ns();
+	out_str("\r\nCONNECT\r\n");
+}
+
+static void leave_data_mode(void)
+{
+	log_v("escape sequence detected");
+	emu.mode = MODE_CMD;
+	emu.esc_cnt = 0;
+	if (emu.dialect == TOBY201)
+		out_str("\r\nDISCONNECT\r\n" OK);
+	else
+		out_str(OK);
+}
+
+/*
+ * Command handlers. 'args' points just past the matched prefix of the
+ * lowercased command line.
+ */
+
+typedef void (*cmd_handler)(const char *args);
+
+struct command {
+	const char *prefix;
+	bool exact;		/* Whole line must match the prefix */
+	cmd_handler handler;	/* Used when non-NULL */
+	const char *rsp;	/* Otherwise this canned response is sent */
+};
+
+static void power_on(void);
+
+static void h_echo_off(const char *args)
+{
+	emu.echo = false;
+	out_str(OK);
+}
+
+static void h_echo_on(const char *args)
+{
+	emu.echo = true;
+	out_str(OK);
+}
+
+static void h_toby_reset(const char *args)
+{
+	out_str(OK);
+	sock_close_all();
+	emu.echo = true;
+	emu.hex_mode = false;
+}
+
+static void h_s12(const char *args)
+{
+	/* Guard time is given in fiftieths of a second */
+	emu.guard_ms = strtoul(args, NULL, 10) * 20;
+	out_str(OK);
+}
+
+static void h_mno_query(const char *args)
+{
+	out_fmt("\r\n+UMNOCONF: %s\r\n" OK, emu.mno);
+}
+
+static void h_mno_set(const char *args)
+{
+	static char mno[32];
+	snprintf(mno, sizeof(mno), "%s", args);
+	emu.mno = mno;
+	out_str(OK);
+}
+
+static void h_upsda(const char *args)
+{
+	out_str(OK);
+	const char urc[] = "\r\n+UUPSDA: 0,\"10.0.0.2\"\r\n";
+	schedule(EV_URC, PDP_ACT_DELAY_MS, urc, sizeof(urc) - 1);
+}
+
+static void h_usocr(const char *args)
+{
+	for (int id = 0; id < MAX_SOCKS; id++) {
+		if (emu.socks[id].open)
+			continue;
+		emu.socks[id].open = true;
+		out_fmt("\r\n+USOCR: %d\r\n" OK, id);
+		return;
+	}
+	out_str(CME_ERROR);
+}
+
+static void h_udconf(const char *args)
+{
+	if (strncmp(args, "1,", 2) == 0)
+		emu.hex_mode = (atoi(args + 2) == 1);
+	out_str(OK);
+}
+
+static int hex_val(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Split "a,b,c" in place, stripping quotes; returns the number of fields */
+static int split_args(char *s, char *fields[], int max)
+{
+	int n = 0;
+	while (n < max) {
+		while (*s == ' ')
+			s++;
+		if (*s == '"') {
+			s++;
+			fields[n++] = s;
+			char *q = strchr(s, '"');
+			if (!q)
+				break;
+			*q = '\0';
+			s = q + 1;
+			char *c = strchr(s, ',');
+			if (!c)
+				break;
+			s = c + 1;
+		} else {
+			fields[n++] = s;
+			char *c = strchr(s, ',');
+			if (!c)
+				break;
+			*c = '\0';
+			s = c + 1;
+		}
+	}
+	return n;
+}
+
+/* Send and drop the first 'len' bytes of the receive queue */
+static void out_rxq(struct sock *sk, size_t len)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	for (size_t i = 0; i < len; i++) {
+		if (emu.hex_mode) {
+			char hex[2] = {
+				digits[sk->rxq[i] >> 4], digits[sk->rxq[i] & 0xF]
+			};
+			out_bytes(hex, 2);
+		} else {
+			out_bytes(&sk->rxq[i], 1);
+		}
+	}
+	sk->rx_len -= len;
+	memmove(sk->rxq, sk->rxq + len, sk->rx_len);
+}
+
+static void h_usoco(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[3];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	if (split_args(buf, f, 3) == 3)
+		sk = sock_get(atoi(f[0]));
+	if (!sk || !sk->open || sk->connected) {
+		out_str(CME_ERROR);
+		return;
+	}
+	out_str(sock_connect(atoi(f[0]), f[1], f[2]) ? OK : CME_ERROR);
+}
+
+static void h_usodl(const char *args)
+{
+	struct sock *sk = sock_get(atoi(args));
+	if (!sk || !sk->connected) {
+		out_str(CME_ERROR);
+		return;
+	}
+	enter_data_mode(atoi(args));
+}
+
+static void h_usocl(const char *args)
+{
+	struct sock *sk = sock_get(atoi(args));
+	if (!sk || !sk->open) {
+		out_str(CME_ERROR);
+		return;
+	}
+	sock_close(atoi(args));
+	out_str(OK);
+}
+
+/*
+ * AT+USOWR=<id>,<len>,"<data>", data is hex encoded in hex mode. Without the
+ * data, the binary data follows the '@' prompt.
+ */
+static void h_usowr(const char *args)
+{
+	static char buf[MAX_LINE * 4];
+	static uint8_t data[MAX_LINE * 2];
+	char *f[3];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	int nf = split_args(buf, f, 3);
+	if (nf >= 2)
+		sk = sock_get(atoi(f[0]));
+	if (!sk || !sk->connected) {
+		out_str(CME_ERROR);
+		return;
+	}
+	int id = atoi(f[0]);
+	size_t len = strtoul(f[1], NULL, 10);
+	if (nf == 2) {
+		if (len == 0 || len > USOWR_BIN_MAX) {
+			out_str(CME_ERROR);
+			return;
+		}
+		emu.send_sock = id;
+		emu.send_left = len;
+		emu.send_len = 0;
+		emu.mode = MODE_SEND;
+		out_str("\r\n@");
+		return;
+	}
+	size_t n = 0;
+	if (emu.hex_mode) {
+		for (const char *p = f[2]; p[0] && p[1] && n < sizeof(data);
+				p += 2) {
+			int hi = hex_val(p[0]), lo = hex_val(p[1]);
+			if (hi < 0 || lo < 0)
+				break;
+			data[n++] = (hi << 4) | lo;
+		}
+	} else {
+		n = strlen(f[2]);
+		if (n > sizeof(data))
+			n = sizeof(data);
+		memcpy(data, f[2], n);
+	}
+	if (n != len) {
+		out_str(CME_ERROR);
+		return;
+	}
+	/* Answer first, URCs triggered by loopback data follow the command */
+	out_fmt("\r\n+USOWR: %d,%zu\r\n" OK, id, n);
+	sock_send(id, data, n);
+}
+
+/* AT+USORD=<id>,<len>, a length of 0 queries the number of unread bytes */
+static void h_usord(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[2];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	if (split_args(buf, f, 2) == 2)
+		sk = sock_get(atoi(f[0]));
+	if (!sk || !sk->open) {
+		out_str(CME_ERROR);
+		return;
+	}
+	int id = atoi(f[0]);
+	size_t len = strtoul(f[1], NULL, 10);
+	if (len == 0) {
+		out_fmt("\r\n+USORD: %d,%zu\r\n" OK, id, sk->rx_len);
+		return;
+	}
+	if (len > USORD_MAX)
+		len = USORD_MAX;
+	if (len > sk->rx_len)
+		len = sk->rx_len;
+	out_fmt("\r\n+USORD: %d,%zu,\"", id, len);
+	out_rxq(sk, len);
+	out_str("\"\r\n" OK);
+}
+
+static void h_cgpaddr(const char *args)
+{
+	out_fmt("\r\n+CGPADDR: %s,\"10.0.0.2\"\r\n" OK, args);
+}
+
+static void h_cmgs(const char *args)
+{
+	emu.mode = MODE_PDU;
+	out_str("\r\n> ");
+}
+
+static void h_sqn_reset(const char *args)
+{
+	out_str(OK "\r\n+SYSSHDN\r\n");
+	sock_close_all();
+	cancel_events(EV_BOOT);
+	schedule(EV_BOOT, BOOT_DELAY_MS, NULL, 0);
+}
+
+static void h_sqn_cfun(const char *args)
+{
+	out_str(OK);
+	const char urc[] = "\r\n+IMSSTATE: SIMSTORE,READY\r\n";
+	schedule(EV_URC, BOOT_DELAY_MS, urc, sizeof(urc) - 1);
+}
+
+/*
+ * AT+SQNSCFGEXT=<id>,<srMode>,<recvDataMode>,<keepalive>,<listenAutoRsp>,
+ * <sendDataMode>; the data modes apply to all sockets
+ */
+static void h_sqnscfgext(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[6];
+	snprintf(buf, sizeof(buf), "%s", args);
+	if (split_args(buf, f, 6) == 6) {
+		emu.hex_mode = (atoi(f[2]) == 1);
+		emu.hex_send = (atoi(f[5]) == 1);
+	}
+	out_str(OK);
+}
+
+/* AT+SQNSD=<id>,<prot>,<port>,"<host>",<closure>,<lport>,<connMode> */
+static void h_sqnsd(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[7];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	int n = split_args(buf, f, 7);
+	if (n >= 4)
+		sk = sock_get(atoi(f[0]));
+	if (!sk || sk->open) {
+		out_str(ERROR);
+		return;
+	}
+	int id = atoi(f[0]);
+	sk->open = true;
+	if (!sock_connect(id, f[3], f[2])) {
+		sock_close(id);
+		out_str(ERROR);
+		return;
+	}
+	if (n == 7 && atoi(f[6]) == 1)
+		out_str(OK);		/* Command mode */
+	else
+		enter_data_mode(id);
+}
+
+static void h_sqnso(const char *args)
+{
+	struct sock *sk = sock_get(atoi(args));
+	if (!sk || !sk->connected) {
+		out_str(ERROR);
+		return;
+	}
+	enter_data_mode(atoi(args));
+	/* Data that arrived while suspended */
+	bool hex = emu.hex_mode;
+	emu.hex_mode = false;
+	out_rxq(sk, sk->rx_len);
+	emu.hex_mode = hex;
+}
+
+/* AT+SQNSRECV=<id>,<maxBytes> */
+static void h_sqnsrecv(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[2];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	if (split_args(buf, f, 2) == 2)
+		sk = sock_get(atoi(f[0]));
+	size_t len = sk ? strtoul(f[1], NULL, 10) : 0;
+	if (!sk || !sk->open || len == 0 || len > SQNS_RECV_MAX) {
+		out_str(CME_ERROR);
+		return;
+	}
+	if (len > sk->rx_len)
+		len = sk->rx_len;
+	out_fmt("\r\n+SQNSRECV: %d,%zu\r\n", atoi(f[0]), len);
+	out_rxq(sk, len);
+	out_str("\r\n" OK);
+}
+
+/* AT+SQNSSENDEXT=<id>,<bytes>, the data follows the prompt */
+static void h_sqnssendext(const char *args)
+{
+	char buf[MAX_LINE];
+	char *f[2];
+	snprintf(buf, sizeof(buf), "%s", args);
+	struct sock *sk = NULL;
+	if (split_args(buf, f, 2) == 2)
+		sk = sock_get(atoi(f[0]));
+	size_t len = sk ? strtoul(f[1], NULL, 10) : 0;
+	if (!sk || !sk->connected || len == 0 || len > SQNS_SEND_MAX) {
+		out_str(CME_ERROR);
+		return;
+	}
+	emu.send_sock = atoi(f[0]);
+	emu.send_left = emu.hex_send ? 2 * len : len;
+	emu.send_len = 0;
+	emu.mode = MODE_SEND;
+	out_str("\r\n> ");
+}
+
+/* Collect exactly the announced amount of data, then pass it on */
+static void process_send(uint8_t ch)
+{
+	emu.send_buf[emu.send_len++] = ch;
+	if (--emu.send_left > 0)
+		return;
+	emu.mode = MODE_CMD;
+	size_t n = emu.send_len;
+	if (emu.dialect == TOBY201) {
+		out_fmt("\r\n+USOWR: %d,%zu\r\n" OK, emu.send_sock, n);
+		sock_send(emu.send_sock, emu.send_buf, n);
+		return;
+	}
+	if (emu.hex_send) {
+		n = 0;
+		for (size_t i = 0; i + 1 < emu.send_len; i += 2) {
+			int hi = hex_val(emu.send_buf[i]);
+			int lo = hex_val(emu.send_buf[i + 1]);
+			if (hi < 0 || lo < 0) {
+				out_str(CME_ERROR);
+				return;
+			}
+			emu.send_buf[n++] = (hi << 4) | lo;
+		}
+	}
+	/* Answer first, URCs triggered by loopback data follow the command */
+	out_str(OK);
+	sock_send(emu.send_sock, emu.send_buf, n);
+}
+
+static void h_sqnsh(const char *args)
+{
+	if (sock_get(atoi(args)))
+		sock_close(atoi(args));
+	out_str(OK);
+}
+
+static const struct command toby_cmds[] = {
+	{ "at", true, NULL, OK },
+	{ "ate0", true, h_echo_off, NULL },
+	{ "ate1", true, h_echo_on, NULL },
+	{ "at+cmee=", false, NULL, OK },
+	{ "at+cfun=16", true, h_toby_reset, NULL },
+	{ "at+cpin?", true, NULL, "\r\n+CPIN: READY\r\n" OK },
+	{ "at+cereg?", true, NULL, "\r\n+CEREG: 1,1\r\n" OK },
+	{ "at+cereg=", false, NULL, OK },
+	{ "at+ureg?", true, NULL, "\r\n+UREG: 1,7\r\n" OK },
+	{ "at+ureg=", false, NULL, OK },
+	{ "at+creg?", true, NULL, "\r\n+CREG: 1,6\r\n" OK },
+	{ "at+creg=", false, NULL, OK },
+	{ "ats12=", false, h_s12, NULL },
+	{ "at+umnoconf?", true, h_mno_query, NULL },
+	{ "at+umnoconf=", false, h_mno_set, NULL },
+	{ "at+cgdcont=", false, NULL, OK },
+	{ "at+cgact=", false, NULL, OK },
+	{ "at+upsd=", false, NULL, OK },
+	{ "at+upsda=", false, h_upsda, NULL },
+	{ "at+usocr=", false, h_usocr, NULL },
+	{ "at+usoco=", false, h_usoco, NULL },
+	{ "at+udconf=", false, h_udconf, NULL },
+	{ "at+usodl=", false, h_usodl, NULL },
+	{ "at+usocl=", false, h_usocl, NULL },
+	{ "at+usowr=", false, h_usowr, NULL },
+	{ "at+usord=", false, h_usord, NULL },
+	{ "at+cgsn", true, NULL, "\r\n356000000000001\r\n" OK },
+	{ "at+csq", true, NULL, "\r\n+CSQ: 20,99\r\n" OK },
+	{ "at+cgpaddr=", false, h_cgpaddr, NULL },
+	{ "at+ccid", true, NULL, "\r\n+CCID: \"89148000000000000001\"\r\n" OK },
+	{ "at+cclk?", true, NULL, "\r\n+CCLK: \"17/06/01,12:00:00-28\"\r\n" OK },
+	{ "at+cgmm", true, NULL, "\r\nTOBY-L201\r\n" OK },
+	{ "at+cgmi", true, NULL, "\r\nu-blox\r\n" OK },
+	{ "at+cimi", true, NULL, "\r\n311480000000001\r\n" OK },
+	{ "at+cgmr", true, NULL, "\r\n15.90\r\n" OK },
+	{ "at+cmgf=", false, NULL, OK },
+	{ "at+csms=", false, NULL, "\r\n+CSMS: 1,1,1\r\n" OK },
+	{ "at+cnmi=", false, NULL, OK },
+	{ "at+cnma=", false, NULL, OK },
+	{ "at+cmgd=", false, NULL, OK },
+	{ "at+cmgs=", false, h_cmgs, NULL },
+	{ "at+cmms=", false, NULL, OK },
+	{ NULL, false, NULL, NULL }
+};
+
+static const struct command sqn_cmds[] = {
+	{ "at", true, NULL, OK },
+	{ "ate0", true, h_echo_off, NULL },
+	{ "ate1", true, h_echo_on, NULL },
+	{ "at+cmee=", false, NULL, OK },
+	{ "at^reset", true, h_sqn_reset, NULL },
+	{ "at+cfun=1", true, h_sqn_cfun, NULL },
+	{ "at+cpin?", true, NULL, "\r\n+CPIN: READY\r\n" OK },
+	{ "at+cereg?", true, NULL, "\r\n+CEREG: 1,1\r\n" OK },
+	{ "at+cereg=", false, NULL, OK },
+	{ "at+sqnomaautostart?", true, NULL,
+		"\r\n+SQNOMAAUTOSTART: 0\r\n" OK },
+	{ "at+sqnomaautostart=", false, NULL, OK },
+	{ "at+cgact=", false, NULL, OK },
+	{ "at+sqnscfg=", false, NULL, OK },
+	{ "at+sqnscfgext=", false, h_sqnscfgext, NULL },
+	{ "at+sqnsd=", false, h_sqnsd, NULL },
+	{ "at+sqnsrecv=", false, h_sqnsrecv, NULL },
+	{ "at+sqnssendext=", false, h_sqnssendext, NULL },
+	{ "at+sqnso=", false, h_sqnso, NULL },
+	{ "at+sqnsh=", false, h_sqnsh, NULL },
+	{ "at+cgsn", true, NULL, "\r\n354000000000001\r\n" OK },
+	{ "at+csq", true, NULL, "\r\n+CSQ: 20,99\r\n" OK },
+	{ "at+cgpaddr=", false, h_cgpaddr, NULL },
+	{ "at+sqnccid", true, NULL,
+		"\r\n+SQNCCID: \"89148000000000000001\",\"\"\r\n" OK },
+	{ "at+cclk?", true, NULL, "\r\n+CCLK: \"17/06/01,12:00:00-28\"\r\n" OK },
+	{ "at+cgmm", true, NULL, "\r\nVZM20Q\r\n" OK },
+	{ "at+cgmi", true, NULL, "\r\nSEQUANS Communications\r\n" OK },
+	{ "at+cimi", true, NULL, "\r\n311480000000001\r\n" OK },
+	{ "at+cgmr", true, NULL, "\r\nUE5.0.0.0c\r\n" OK },
+	{ NULL, false, NULL, NULL }
+};
+
+static void process_line(void)
+{
+	char cmd[MAX_LINE];
+	size_t n = emu.line_len;
+	for (size_t i = 0; i < n; i++)
+		cmd[i] = tolower((unsigned char)emu.line[i]);
+	cmd[n] = '\0';
+	emu.line_len = 0;
+	if (n == 0)
+		return;
+	log_v("cmd: %s", cmd);
+
+	if (emu.rsp_delay_ms)
+		usleep(emu.rsp_delay_ms * 1000);
+
+	for (unsigned int i = 0; i < emu.num_rules; i++) {
+		struct rule *r = &emu.rules[i];
+		if (strncmp(cmd, r->prefix, strlen(r->prefix)) == 0) {
+			out_bytes(r->rsp, r->rsp_len);
+			return;
+		}
+	}
+
+	const struct command *c = (emu.dialect == TOBY201) ?
+		toby_cmds : sqn_cmds;
+	for (; c->prefix; c++) {
+		size_t plen = strlen(c->prefix);
+		if (strncmp(cmd, c->prefix, plen) != 0)
+			continue;
+		if (c->exact && cmd[plen] != '\0')
+			continue;
+		if (c->handler)
+			c->handler(cmd + plen);
+		else
+			out_str(c->rsp);
+		return;
+	}
+	log_v("unknown command");
+	out_str(ERROR);
+}
+
+static void process_pdu(uint8_t ch)
+{
+	if (ch == CTRL_Z) {
+		log_v("sms pdu: %.*s", (int)emu.line_len, emu.line);
+		emu.line_len = 0;
+		emu.mode = MODE_CMD;
+		out_fmt("\r\n+CMGS: %u\r\n" OK, emu.sms_mr++ & 0xFF);
+	} else if (ch == 0x1B) {	/* ESC aborts the message */
+		emu.line_len = 0;
+		emu.mode = MODE_CMD;
+		out_str(OK);
+	} else if (emu.line_len < MAX_LINE - 1) {
+		emu.line[emu.line_len++] = ch;
+	}
+}
+
+static void flush_esc(void)
+{
+	static const uint8_t plus[3] = { '+', '+', '+' };
+	sock_send(emu.data_sock, plus, emu.esc_cnt);
+	emu.esc_cnt = 0;
+}
+
+/*
+ * Bytes received in data mode are forwarded to the peer, except for an escape
+ * sequence ("+++") framed by guard times of silence on either side.
+ */
+static void process_data(const uint8_t *data, size_t len, uint64_t ts)
+{
+	size_t start = 0;
+	for (size_t i = 0; i < len; i++) {
+		bool quiet_before = (ts - emu.last_rx_ns) >=
+			emu.guard_ms * NS_PER_MS;
+		if (data[i] == '+' && emu.esc_cnt < 3 &&
+				(emu.esc_cnt > 0 || (i == 0 && quiet_before))) {
+			sock_send(emu.data_sock, data + start, i - start);
+			start = i + 1;
+			emu.esc_cnt++;
+			emu.esc_ts = ts;
+			continue;
+		}
+		if (emu.esc_cnt > 0) {
+			flush_esc();
+		}
+	}
+	sock_send(emu.data_sock, data + start, len - start);
+	emu.last_rx_ns = ts;
+}
+
+static void process_uart(const uint8_t *data, size_t len)
+{
+	uint64_t ts = now_ns();
+	for (size_t i = 0; i < len; i++) {
+		switch (emu.mode) {
+		case MODE_DATA:
+			process_data(data + i, len - i, ts);
+			return;
+		case MODE_PDU:
+			process_pdu(data[i]);
+			break;
+		case MODE_SEND:
+			process_send(data[i]);
+			break;
+		case MODE_CMD:
+			if (emu.echo)
+				out_bytes(&data[i], 1);
+			if (data[i] == '\r')
+				process_line();
+			else if (data[i] == '+' && emu.line_len == 0 &&
+					emu.dialect == TOBY201)
+				/* Stray escape characters after leaving dl mode */
+				break;
+			else if (data[i] != '\n' && emu.line_len < MAX_LINE - 1)
+				emu.line[emu.line_len++] = data[i];
+			break;
+		}
+	}
+}
+
+/*
+ * Power management: the emulated modem is powered while some process has the
+ * slave side of the pseudo-terminal open.
+ */
+
+static void power_on(void)
+{
+	log_v("power on");
+	emu.powered = true;
+	emu.mode = MODE_CMD;
+	emu.echo = (emu.dialect == TOBY201);
+	emu.line_len = 0;
+	emu.out_len = 0;
+	emu.guard_ms = (emu.dialect == TOBY201) ? 1000 : 5;
+	emu.hex_mode = false;
+	emu.hex_send = false;
+	memset(emu.events, 0, sizeof(emu.events));
+	sock_close_all();
+	if (emu.dialect == SQMONARCH)
+		schedule(EV_BOOT, BOOT_DELAY_MS, NULL, 0);
+	arm_script(false);
+}
+
+static void power_off(void)
+{
+	log_v("power off");
+	emu.powered = false;
+	sock_close_all();
+	memset(emu.events, 0, sizeof(emu.events));
+	emu.out_len = 0;
+}
+
+static void run_event(struct event *e)
+{
+	switch (e->type) {
+	case EV_URC:
+		out_bytes(e->text, e->len);
+		break;
+	case EV_CLOSE:
+		/* The socket in data mode, otherwise the lowest connected one */
+		if (emu.data_sock >= 0) {
+			peer_closed(emu.data_sock);
+			break;
+		}
+		for (int i = 0; i < MAX_SOCKS; i++)
+			if (emu.socks[i].connected) {
+				peer_closed(i);
+				break;
+			}
+		break;
+	case EV_BOOT:
+		out_str("\r\n+SYSSTART\r\n"
+			"\r\n+IMSSTATE: SIMSTORE,WAIT_SIM\r\n");
+		break;
+	}
+}
+
+/* Returns the number of bytes the pacer lets through right now */
+static size_t pace_allow(struct pacer *p, uint64_t ts)
+{
+	if (emu.baud == 0)
+		return SIZE_MAX;
+	double rate = emu.baud / 10.0 / NS_PER_SEC;	/* bytes per ns */
+	p->tokens += (ts - p->last_ns) * rate;
+	if (p->tokens > PACE_BURST)
+		p->tokens = PACE_BURST;
+	p->last_ns = ts;
+	return (size_t)p->tokens;
+}
+
+static void pace_consume(struct pacer *p, size_t n)
+{
+	if (emu.baud != 0)
+		p->tokens -= n;
+}
+
+/* Nanoseconds until the pacer lets 'n' bytes through */
+static uint64_t pace_wait(const struct pacer *p, size_t n)
+{
+	if (emu.baud == 0 || p->tokens >= n)
+		return 0;
+	return (uint64_t)((n - p->tokens) * 10.0 * NS_PER_SEC / emu.baud) + 1;
+}
+
+static void drain_output(uint64_t ts)
+{
+	size_t allow = pace_allow(&emu.tx_pace, ts);
+	while (emu.out_len > 0 && allow > 0) {
+		size_t n = emu.out_len;
+		if (n > OUTQ_SZ - emu.out_head)
+			n = OUTQ_SZ - emu.out_head;
+		if (n > allow)
+			n = allow;
+		ssize_t w = write(emu.master, emu.outq + emu.out_head, n);
+		if (w <= 0)
+			break;
+		emu.out_head = (emu.out_head + w) % OUTQ_SZ;
+		emu.out_len -= w;
+		allow -= w;
+		pace_consume(&emu.tx_pace, w);
+	}
+	if (emu.out_len == 0)
+		emu.out_head = 0;
+}
+
+/*
+ * Script parsing
+ */
+
+/* Parse a double quoted string with C escapes; returns its length or -1 */
+static int parse_quoted(const char *s, char *out, size_t max)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	if (*s++ != '"')
+		return -1;
+	size_t n = 0;
+	while (*s && *s != '"' && n < max) {
+		char c = *s++;
+		if (c == '\\') {
+			c = *s++;
+			switch (c) {
+			case 'r': c = '\r'; break;
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'z': c = CTRL_Z; break;
+			case 'x':
+				c = (char)strtoul(s, (char **)&s, 16);
+				break;
+			default: break;
+			}
+		}
+		out[n++] = c;
+	}
+	return (*s == '"') ? (int)n : -1;
+}
+
+static bool load_script(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	char line[MAX_LINE];
+	unsigned int lineno = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		char kw[16], arg[64];
+		int off = 0;
+		if (line[0] == '#' || sscanf(line, "%15s%n", kw, &off) != 1)
+			continue;
+		bool ok = false;
+		if (strcmp(kw, "cmd") == 0 && emu.num_rules < MAX_RULES) {
+			struct rule *r = &emu.rules[emu.num_rules];
+			int off2 = 0;
+			if (sscanf(line + off, "%63s%n", arg, &off2) == 1) {
+				for (char *p = arg; *p; p++)
+					*p = tolower((unsigned char)*p);
+				snprintf(r->prefix, sizeof(r->prefix), "%s", arg);
+				int len = parse_quoted(line + off + off2, r->rsp,
+						sizeof(r->rsp));
+				if (len >= 0) {
+					r->rsp_len = len;
+					emu.num_rules++;
+					ok = true;
+				}
+			}
+		} else if ((strcmp(kw, "urc") == 0 || strcmp(kw, "close") == 0)
+				&& emu.num_script < MAX_EVENTS) {
+			struct script_event *s = &emu.script[emu.num_script];
+			int off2 = 0;
+			char when[16];
+			unsigned int ms;
+			if (sscanf(line + off, "%15s %u%n", when, &ms,
+						&off2) == 2 &&
+					(strcmp(when, "boot") == 0 ||
+					 strcmp(when, "connect") == 0)) {
+				s->on_connect = (strcmp(when, "connect") == 0);
+				s->delay_ms = ms;
+				s->type = (kw[0] == 'u') ? EV_URC : EV_CLOSE;
+				s->len = 0;
+				ok = true;
+				if (s->type == EV_URC) {
+					int len = parse_quoted(line + off + off2,
+							s->text, sizeof(s->text));
+					ok = (len >= 0);
+					s->len = len;
+				}
+				if (ok)
+					emu.num_script++;
+			}
+		}
+		if (!ok) {
+			fprintf(stderr, "%s:%u: invalid line\n", path, lineno);
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/*
+ * Main loop
+ */
+
+static int open_pty(const char *link)
+{
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+		perror("pty");
+		return -1;
+	}
+	const char *slave = ptsname(fd);
+	/* Put the slave in raw mode until the host configures it */
+	int s = open(slave, O_RDWR | O_NOCTTY);
+	if (s >= 0) {
+		struct termios tio;
+		if (tcgetattr(s, &tio) == 0) {
+			cfmakeraw(&tio);
+			tcsetattr(s, TCSANOW, &tio);
+		}
+		close(s);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (link) {
+		unlink(link);
+		if (symlink(slave, link) != 0) {
+			perror(link);
+			return -1;
+		}
+	}
+	printf("%s\n", slave);
+	fflush(stdout);
+	return fd;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m toby201|sqmonarch] [-b baud] [-d ms] "
+			"[-l link] [-s script] [-u mno] [-L] [-v]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *link = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:b:d:l:s:u:Lv")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (strcmp(optarg, "toby201") == 0)
+				emu.dialect = TOBY201;
+			else if (strcmp(optarg, "sqmonarch") == 0)
+				emu.dialect = SQMONARCH;
+			else
+				usage(argv[0]);
+			break;
+		case 'b':
+			emu.baud = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			emu.rsp_delay_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			link = optarg;
+			break;
+		case 's':
+			if (!load_script(optarg))
+				return 1;
+			break;
+		case 'u':
+			emu.mno = optarg;
+			break;
+		case 'L':
+			emu.loopback = true;
+			break;
+		case 'v':
+			emu.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	emu.master = open_pty(link);
+	if (emu.master < 0)
+		return 1;
+
+	for (int i = 0; i < MAX_SOCKS; i++)
+		emu.socks[i].fd = -1;
+
+	uint8_t buf[SOCK_CHUNK];
+	for (;;) {
+		uint64_t ts = now_ns();
+		uint64_t timeout = 50 * NS_PER_MS;
+
+		/* The slave side being closed shows up as a hangup */
+		struct pollfd pfd[1 + MAX_SOCKS] = {
+			{ .fd = emu.master, .events = POLLIN }
+		};
+
+		if (emu.powered) {
+			for (unsigned int i = 0; i < MAX_EVENTS; i++) {
+				struct event *e = &emu.events[i];
+				if (e->at_ns == 0)
+					continue;
+				if (e->at_ns <= ts) {
+					e->at_ns = 0;
+					run_event(e);
+				} else if (e->at_ns - ts < timeout) {
+					timeout = e->at_ns - ts;
+				}
+			}
+			/* Escape sequence complete once the trailing guard expires */
+			if (emu.mode == MODE_DATA && emu.esc_cnt > 0) {
+				uint64_t guard = emu.guard_ms * NS_PER_MS;
+				uint64_t end = emu.esc_ts + guard;
+				if (ts >= end) {
+					if (emu.esc_cnt == 3)
+						leave_data_mode();
+					else
+						flush_esc();
+				} else if (end - ts < timeout) {
+					timeout = end - ts;
+				}
+			}
+			drain_output(ts);
+			if (emu.out_len > 0) {
+				pfd[0].events |= POLLOUT;
+				uint64_t w = pace_wait(&emu.tx_pace, 1);
+				if (w && w < timeout)
+					timeout = w;
+			}
+			pace_allow(&emu.rx_pace, ts);
+			uint64_t w = pace_wait(&emu.rx_pace, 1);
+			if (w) {
+				/* Leave bytes in the pty until the line is free */
+				pfd[0].events &= ~POLLIN;
+				if (w < timeout)
+					timeout = w;
+			}
+		}
+		/*
+		 * Only read the peer while the data can be taken: by the UART
+		 * for the socket in data mode, or by the receive queue of a
+		 * socket read through +USORD or +SQNSRECV.
+		 */
+		for (int i = 0; i < MAX_SOCKS; i++) {
+			struct sock *sk = &emu.socks[i];
+			bool in_data = (emu.mode == MODE_DATA &&
+					emu.data_sock == i);
+			bool readable = in_data ?
+				emu.out_len <= OUTQ_SZ / 2 :
+				(emu.mode == MODE_CMD && sk->rx_len < SOCK_RXQ_SZ);
+			pfd[1 + i].fd = readable ? sk->fd : -1;
+			pfd[1 + i].events = POLLIN;
+		}
+
+		struct timespec tmo = {
+			.tv_sec = timeout / NS_PER_SEC,
+			.tv_nsec = timeout % NS_PER_SEC
+		};
+		int r = ppoll(pfd, 1 + MAX_SOCKS, &tmo, NULL);
+		if (r < 0 && errno != EINTR) {
+			perror("poll");
+			return 1;
+		}
+		ts = now_ns();
+
+		if (pfd[0].revents & POLLHUP) {
+			if (emu.powered)
+				power_off();
+			/* Nothing to do until the host opens the port again */
+			usleep(10000);
+			continue;
+		}
+		if (!emu.powered) {
+			power_on();
+			emu.tx_pace.last_ns = emu.rx_pace.last_ns = ts;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			size_t allow = pace_allow(&emu.rx_pace, ts);
+			size_t want = allow < sizeof(buf) ? allow : sizeof(buf);
+			ssize_t n = read(emu.master, buf, want);
+			if (n > 0) {
+				pace_consume(&emu.rx_pace, n);
+				process_uart(buf, n);
+			}
+		}
+		for (int i = 0; i < MAX_SOCKS; i++) {
+			struct sock *sk = &emu.socks[i];
+			if (pfd[1 + i].fd < 0 ||
+					!(pfd[1 + i].revents & (POLLIN | POLLHUP)))
+				continue;
+			bool in_data = (emu.mode == MODE_DATA &&
+					emu.data_sock == i);
+			size_t want = sizeof(buf);
+			if (!in_data && want > SOCK_RXQ_SZ - sk->rx_len)
+				want = SOCK_RXQ_SZ - sk->rx_len;
+			ssize_t n = recv(sk->fd, buf, want, 0);
+			if (n > 0 && in_data)
+				out_bytes(buf, n);
+			else if (n > 0)
+				sock_deliver(i, buf, n);
+			else if (n == 0 || errno != EINTR)
+				peer_closed(i);
+		}
+	}
+	return 0;
+}